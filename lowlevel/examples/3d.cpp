@@ -3,12 +3,50 @@
 Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
 
 This example shows how to basic 3D positioning of sounds.
+
+Positions go through a SpatialUpdater (see spatial_update.h), which works out
+velocities from the time that really passed between frames and only calls
+set3DAttributes for things that moved. Press the stall button to sleep for
+200ms and see that the listener's doppler velocity doesn't jump.
+
+The crowd button scatters CROWD_EMITTERS more copies of the two sounds around
+the listener. A VoiceManager (see voice_manager.h) gives the CROWD_VOICES
+most audible of them real channels and keeps the rest virtual.
+
+The crowd stands among CROWD_BUILDINGS boxes and there is a wall in front of
+sound 2. An OcclusionEngine (see occlusion_engine.h) traces the emitters
+against them, and the results go to Channel::set3DOcclusion, through the
+VoiceManager for the crowd. An OcclusionCache (see occlusion_cache.h) in
+front of it only traces emitters when they or the listener move a cell, at
+most OCCLUSION_MAXTRACES a frame, and glides the values so they don't step.
+
+Sound 1 is ducked under sound 2 by a SidechainDucker (see sidechain_ducker.h)
+on its channel, with sound 2's channel as the sidechain, in place of turning
+its volume down by hand.
 ==============================================================================*/
 #include "fmod.hpp"
 #include "common.h"
+#include "spatial_update.h"
+#include "voice_manager.h"
+#include "occlusion_engine.h"
+#include "occlusion_cache.h"
+#include "sidechain_ducker.h"
+#include <stdlib.h>
 
 const int   INTERFACE_UPDATETIME = 50;      // 50ms update for interface
 const float DISTANCEFACTOR = 1.0f;          // Units per meter.  I.e feet would = 3.28.  centimeters would = 100.
+const float MOVEMENT_EPSILON = 0.01f * DISTANCEFACTOR;  // Movement smaller than this isn't sent to FMOD.
+const int   CROWD_EMITTERS = 10000;
+const int   CROWD_VOICES = 64;                          // Leaves room in the 100 channels for the ones fading out.
+const float CROWD_RADIUS = 200.0f * DISTANCEFACTOR;
+const float CROWD_FADEMS = 20.0f;
+const int   CROWD_BUILDINGS = 64;
+const int   OCCLUSION_TRIANGLES = CROWD_BUILDINGS * 12 + 2;
+const float OCCLUSION_CELLSIZE = 1.0f * DISTANCEFACTOR;    // Movement within a cell reuses the last result.
+const int   OCCLUSION_REFRESHFRAMES = 40;                   // Everything is traced again at least every 2 seconds.
+const int   OCCLUSION_MAXTRACES = 2000;
+const float OCCLUSION_SMOOTHING = 0.1f;                     // Seconds.
+const float DUCKER_BENCHMARK_SECONDS = 10.0f;               // Of audio, to time the ducker over.
 
 int FMOD_Main()
 {
@@ -18,6 +56,19 @@ int FMOD_Main()
     FMOD_RESULT      result;
     bool             listenerflag = true;
     FMOD_VECTOR      listenerpos  = { 0.0f, 0.0f, -1.0f * DISTANCEFACTOR };
+    SpatialUpdater   spatial;
+    VoiceManager     voices;
+    OcclusionEngine  occlusion;
+    OcclusionCache   occlusioncache;
+    SidechainDucker  ducker;
+    FMOD::DSP       *duckerdsp;
+    float            duckercost;
+    int              samplerate;
+    FMOD_VECTOR     *sources;                   // Sound 1, sound 2, then the crowd.
+    float           *occlusions;
+    int             *crowdemitters;             // VoiceManager's ids for the crowd, -1 if it was full.
+    int              emitter1, emitter2;
+    bool             crowd = false;
     unsigned int     version;
     void            *extradriverdata = 0;
 
@@ -46,6 +97,83 @@ int FMOD_Main()
     result = system->set3DSettings(1.0, DISTANCEFACTOR, 1.0f);
     ERRCHECK(result);
 
+    result = spatial.init(system, CROWD_EMITTERS + 2, MOVEMENT_EPSILON, SPATIAL_CLOCK_MONOTONIC);
+    ERRCHECK(result);
+    result = voices.init(system, &spatial, CROWD_EMITTERS, CROWD_VOICES, CROWD_FADEMS);
+    ERRCHECK(result);
+
+    /*
+        Build the level. A wall just in front of sound 2, and boxes for the crowd to stand among, kept away from
+        the line the listener moves along.
+    */
+    result = occlusion.init(OCCLUSION_TRIANGLES, 0);
+    ERRCHECK(result);
+    {
+        FMOD_VECTOR wall[4] =
+        {
+            { 10.0f * DISTANCEFACTOR, -2.0f * DISTANCEFACTOR, -0.5f * DISTANCEFACTOR },
+            { 20.0f * DISTANCEFACTOR, -2.0f * DISTANCEFACTOR, -0.5f * DISTANCEFACTOR },
+            { 20.0f * DISTANCEFACTOR,  2.0f * DISTANCEFACTOR, -0.5f * DISTANCEFACTOR },
+            { 10.0f * DISTANCEFACTOR,  2.0f * DISTANCEFACTOR, -0.5f * DISTANCEFACTOR }
+        };
+        result = occlusion.addPolygon(0.7f, 0.3f, true, 4, wall);
+        ERRCHECK(result);
+
+        for (int i = 0; i < CROWD_BUILDINGS; i++)
+        {
+            static const int faces[6][4] = { { 0, 1, 3, 2 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 3, 7, 5 } };
+            float x = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * CROWD_RADIUS;
+            float z = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * CROWD_RADIUS;
+            float size = (5.0f + (float)rand() / RAND_MAX * 15.0f) * DISTANCEFACTOR;
+            FMOD_VECTOR corners[8];
+
+            if (z > -size - 5.0f * DISTANCEFACTOR && z < 5.0f * DISTANCEFACTOR)
+            {
+                z += (z < 0.0f) ? -size - 5.0f * DISTANCEFACTOR : 5.0f * DISTANCEFACTOR;
+            }
+            for (int c = 0; c < 8; c++)
+            {
+                corners[c].x = x + ((c & 1) ? size : 0.0f);
+                corners[c].y = (c & 2) ? size : -1.0f * DISTANCEFACTOR;
+                corners[c].z = z + ((c & 4) ? size : 0.0f);
+            }
+            for (int f = 0; f < 6; f++)
+            {
+                FMOD_VECTOR face[4] = { corners[faces[f][0]], corners[faces[f][1]], corners[faces[f][2]], corners[faces[f][3]] };
+                result = occlusion.addPolygon(0.6f, 0.3f, true, 4, face);
+                ERRCHECK(result);
+            }
+        }
+    }
+    result = occlusion.build();
+    ERRCHECK(result);
+    result = occlusioncache.init(&occlusion, CROWD_EMITTERS + 2, OCCLUSION_CELLSIZE, OCCLUSION_REFRESHFRAMES, OCCLUSION_MAXTRACES, OCCLUSION_SMOOTHING);
+    ERRCHECK(result);
+
+    sources = (FMOD_VECTOR *)malloc((CROWD_EMITTERS + 2) * sizeof(FMOD_VECTOR));
+    occlusions = (float *)malloc((CROWD_EMITTERS + 2) * 2 * sizeof(float));
+    crowdemitters = (int *)malloc(CROWD_EMITTERS * sizeof(int));
+    if (!sources || !occlusions || !crowdemitters)
+    {
+        Common_Fatal("Out of memory");
+    }
+
+    /*
+        The ducker, timed up front at the mix rate.
+    */
+    result = system->getSoftwareFormat(&samplerate, 0, 0);
+    ERRCHECK(result);
+    result = ducker.init(samplerate);
+    ERRCHECK(result);
+    {
+        FMOD_DSP_DESCRIPTION desc;
+
+        ducker.describe(&desc);
+        result = system->createDSP(&desc, &duckerdsp);
+        ERRCHECK(result);
+    }
+    duckercost = SidechainDucker::benchmark(samplerate, 2, DUCKER_BENCHMARK_SECONDS);
+
     /*
         Load some sounds
     */
@@ -71,11 +199,11 @@ int FMOD_Main()
     */
     {
         FMOD_VECTOR pos = { -10.0f * DISTANCEFACTOR, 0.0f, 0.0f };
-        FMOD_VECTOR vel = {  0.0f, 0.0f, 0.0f };
 
         result = system->playSound(sound1, 0, true, &channel1);
         ERRCHECK(result);
-        result = channel1->set3DAttributes(&pos, &vel);
+        emitter1 = spatial.addEmitter(channel1, &pos);
+        result = spatial.flush();                   // Place it before it's heard.
         ERRCHECK(result);
         result = channel1->setPaused(false);
         ERRCHECK(result);
@@ -83,16 +211,36 @@ int FMOD_Main()
 
     {
         FMOD_VECTOR pos = { 15.0f * DISTANCEFACTOR, 0.0f, 0.0f };
-        FMOD_VECTOR vel = { 0.0f, 0.0f, 0.0f };
 
         result = system->playSound(sound2, 0, true, &channel2);
         ERRCHECK(result);
-        result = channel2->set3DAttributes(&pos, &vel);
+        emitter2 = spatial.addEmitter(channel2, &pos);
+        result = spatial.flush();
         ERRCHECK(result);
         result = channel2->setPaused(false);
         ERRCHECK(result);
     }
 
+    /*
+        Duck sound 1 under sound 2. The sidechain connection runs sound 2's channel for the ducker to listen
+        to, without mixing it in.
+    */
+    {
+        FMOD::DSP *vocal;
+        FMOD_DSP_PARAMETER_SIDECHAIN sidechain;
+
+        result = channel1->addDSP(0, duckerdsp, 0);
+        ERRCHECK(result);
+        result = channel2->getDSP(FMOD_CHANNELCONTROL_DSP_HEAD, &vocal);
+        ERRCHECK(result);
+        result = duckerdsp->addInput(vocal, 0, FMOD_DSPCONNECTION_TYPE_SIDECHAIN);
+        ERRCHECK(result);
+
+        sidechain.sidechainenable = true;
+        result = duckerdsp->setParameterData(SIDECHAIN_DUCKER_PARAM_SIDECHAIN, &sidechain, sizeof(sidechain));
+        ERRCHECK(result);
+    }
+
     /*
         Main loop
     */
@@ -125,6 +273,43 @@ int FMOD_Main()
             listenerflag = !listenerflag;
         }
 
+        if (Common_BtnPress(BTN_UP))
+        {
+            crowd = !crowd;
+            for (int i = 0; i < CROWD_EMITTERS; i++)
+            {
+                if (!crowd)
+                {
+                    if (crowdemitters[i] >= 0)
+                    {
+                        voices.removeEmitter(crowdemitters[i]);
+                    }
+                    continue;
+                }
+
+                FMOD_VECTOR pos;
+                pos.x = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * CROWD_RADIUS;
+                pos.y = 0.0f;
+                pos.z = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * CROWD_RADIUS;
+
+                crowdemitters[i] = voices.addEmitter((i & 1) ? sound2 : sound1, &pos, 0.5f, 128);
+                sources[i + 2] = pos;
+                occlusioncache.invalidate(i + 2);
+            }
+        }
+
+        if (Common_BtnPress(BTN_DOWN))
+        {
+            bool bypass;
+            duckerdsp->getBypass(&bypass);
+            duckerdsp->setBypass(!bypass);
+        }
+
+        if (Common_BtnPress(BTN_ACTION4))
+        {
+            Common_Sleep(200);  // A stalled frame, the listener moves as far as ever but over four times the time.
+        }
+
         if (!listenerflag)
         {
             if (Common_BtnDown(BTN_LEFT))
@@ -151,10 +336,8 @@ int FMOD_Main()
         // ==========================================================================================
         {
             static float t = 0;
-            static FMOD_VECTOR lastpos = { 0.0f, 0.0f, 0.0f };
             FMOD_VECTOR forward        = { 0.0f, 0.0f, 1.0f };
             FMOD_VECTOR up             = { 0.0f, 1.0f, 0.0f };
-            FMOD_VECTOR vel;
 
             if (listenerflag)
             {
@@ -162,15 +345,45 @@ int FMOD_Main()
             }
 
             // ********* NOTE ******* READ NEXT COMMENT!!!!!
-            // vel = how far we moved last FRAME (m/f), then time compensate it to SECONDS (m/s).
-            vel.x = (listenerpos.x - lastpos.x) * (1000 / INTERFACE_UPDATETIME);
-            vel.y = (listenerpos.y - lastpos.y) * (1000 / INTERFACE_UPDATETIME);
-            vel.z = (listenerpos.z - lastpos.z) * (1000 / INTERFACE_UPDATETIME);
+            // Velocity is how far we moved since the last flush over the time that actually passed (m/s), so a
+            // slow frame doesn't give the wrong doppler. Don't assume the frame took INTERFACE_UPDATETIME.
+            result = spatial.setListener(&listenerpos, &forward, &up);
+            ERRCHECK(result);
+
+            // The emitters here don't move, setting them again costs nothing as they're under the epsilon.
+            FMOD_VECTOR pos1 = { -10.0f * DISTANCEFACTOR, 0.0f, 0.0f };
+            FMOD_VECTOR pos2 = {  15.0f * DISTANCEFACTOR, 0.0f, 0.0f };
+            spatial.setPosition(emitter1, &pos1);
+            spatial.setPosition(emitter2, &pos2);
+
+            // Occlusion for everything in one go, before the voice manager scores the crowd with it.
+            sources[0] = pos1;
+            sources[1] = pos2;
+            {
+                int count = crowd ? CROWD_EMITTERS + 2 : 2;
+                float *direct = occlusions;
+                float *reverb = occlusions + count;
+
+                result = occlusioncache.update(&listenerpos, sources, count, direct, reverb);
+                ERRCHECK(result);
 
-            // store pos for next time
-            lastpos = listenerpos;
+                channel1->set3DOcclusion(direct[0], reverb[0]);
+                channel2->set3DOcclusion(direct[1], reverb[1]);
+                for (int i = 2; i < count; i++)
+                {
+                    if (crowdemitters[i - 2] >= 0)
+                    {
+                        voices.setOcclusion(crowdemitters[i - 2], direct[i]);
+                    }
+                }
+            }
 
-            result = system->set3DListenerAttributes(0, &listenerpos, &vel, &forward, &up);
+            // Pick the crowd's real voices, then place everything in one go.
+            voices.setListener(&listenerpos);
+            result = voices.update();
+            ERRCHECK(result);
+
+            result = spatial.flush();
             ERRCHECK(result);
 
             t += (30 * (1.0f / (float)INTERFACE_UPDATETIME));    // t is just a time value .. it increments in 30m/s steps in this example
@@ -193,9 +406,35 @@ int FMOD_Main()
         Common_Draw("Press %s to play a sound (16bit Stereo 2D)", Common_BtnStr(BTN_ACTION3));
         Common_Draw("Press %s or %s to move listener in still mode", Common_BtnStr(BTN_LEFT), Common_BtnStr(BTN_RIGHT));
         Common_Draw("Press %s to toggle listener auto movement", Common_BtnStr(BTN_MORE));
+        Common_Draw("Press %s to stall for 200ms", Common_BtnStr(BTN_ACTION4));
+        Common_Draw("Press %s to toggle a crowd of %d emitters", Common_BtnStr(BTN_UP), CROWD_EMITTERS);
+        Common_Draw("Press %s to toggle ducking sound 1 under sound 2", Common_BtnStr(BTN_DOWN));
         Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
         Common_Draw("");
         Common_Draw(s);
+        {
+            SpatialUpdateStats stats;
+            spatial.getStats(&stats);
+            Common_Draw("");
+            Common_Draw("Frame %3d ms, %d of %d emitters sent, listener %s", (int)(stats.elapsed * 1000.0f), stats.sent, stats.emitters, stats.listenersent ? "sent" : "unchanged");
+
+            VoiceManagerStats voicestats;
+            voices.getStats(&voicestats);
+            Common_Draw("Crowd %d emitters, %d audible, %d real, +%d -%d this frame", voicestats.playing, voicestats.audible, voicestats.real, voicestats.promotions, voicestats.demotions);
+
+            OcclusionStats occlusionstats;
+            OcclusionCacheStats cachestats;
+            occlusion.getStats(&occlusionstats);
+            occlusioncache.getStats(&cachestats);
+            Common_Draw("Occlusion %d traced against %d triangles in %.2f ms on %d threads, sound 2 %d%% occluded", cachestats.traced, occlusionstats.triangles, occlusionstats.elapsed * 1000.0f, occlusionstats.threads, (int)(occlusions[1] * 100.0f));
+            Common_Draw("Occlusion cache %d%% hits of %d, %d deferred, %.2f ms saved", (int)(cachestats.hitrate * 100.0f), cachestats.queries, cachestats.deferred, cachestats.saved * 1000.0f);
+
+            SidechainDuckerStats duckerstats;
+            bool bypass;
+            ducker.getStats(&duckerstats);
+            duckerdsp->getBypass(&bypass);
+            Common_Draw("Ducker %s, sound 1 down %4.1f dB, %4.1f dB at most, %.3f%% of a core at %d Hz stereo", bypass ? "off" : "on", duckerstats.reduction, duckerstats.maxreduction, duckercost, samplerate);
+        }
 
         Common_Sleep(INTERFACE_UPDATETIME - 1);
     } while (!Common_BtnPress(BTN_QUIT));
@@ -203,6 +442,22 @@ int FMOD_Main()
     /*
         Shut down
     */
+    result = channel1->removeDSP(duckerdsp);
+    ERRCHECK(result);
+    result = duckerdsp->disconnectAll(true, false);      // The sidechain from sound 2.
+    ERRCHECK(result);
+    result = duckerdsp->release();
+    ERRCHECK(result);
+    ducker.release();
+
+    voices.release();
+    spatial.release();
+    occlusioncache.release();
+    occlusion.release();
+    free(sources);
+    free(occlusions);
+    free(crowdemitters);
+
     result = sound1->release();
     ERRCHECK(result);
     result = sound2->release();
@@ -0,0 +1,96 @@
+/*==============================================================================
+Asset Store
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "asset_store.h"
+#include <string.h>
+#include <sys/mman.h>
+
+FMOD_RESULT AssetStore_CreateSound(FMOD::System *system, const char *path, FMOD_MODE mode, const FMOD_CREATESOUNDEXINFO *exinfo, FMOD::Sound **sound)
+{
+    FMOD_CREATESOUNDEXINFO info;
+    FMOD_RESULT result;
+
+    MappedFile *file = MappedFile_Acquire(path);
+    if (!file)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+    if (!file->length)
+    {
+        MappedFile_Release(file);
+        return FMOD_ERR_FILE_EOF;
+    }
+
+    if (exinfo)
+    {
+        info = *exinfo;
+    }
+    else
+    {
+        memset(&info, 0, sizeof(FMOD_CREATESOUNDEXINFO));
+        info.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);
+    }
+    info.length = file->length;
+
+    /*
+        Streams and compressed samples read the data as they play, fault the whole file in ahead of them.
+    */
+    MappedFile_Advise(file, 0, file->length, MADV_WILLNEED);
+
+    /*
+        FMOD_OPENMEMORY_POINT wants PCM padded by 16 writable bytes each side, which a read only mapping of the file
+        doesn't have, so only compressed samples, which are decoded straight out of the memory as they play, point
+        into the mapping. Everything else gets copied out of it.
+    */
+    mode &= ~(FMOD_OPENMEMORY | FMOD_OPENMEMORY_POINT);
+    if (mode & FMOD_CREATECOMPRESSEDSAMPLE)
+    {
+        mode &= ~FMOD_HARDWARE;
+        mode |= FMOD_OPENMEMORY_POINT | FMOD_SOFTWARE;
+    }
+    else
+    {
+        mode |= FMOD_OPENMEMORY;
+    }
+
+    result = system->createSound((const char *)file->data, mode, &info, sound);
+    if (result != FMOD_OK)
+    {
+        MappedFile_Release(file);
+        return result;
+    }
+
+    result = (*sound)->setUserData(file);
+    if (result != FMOD_OK)
+    {
+        (*sound)->release();
+        MappedFile_Release(file);
+        *sound = 0;
+    }
+
+    return result;
+}
+
+FMOD_RESULT AssetStore_ReleaseSound(FMOD::Sound *sound)
+{
+    MappedFile *file = 0;
+    FMOD_RESULT result;
+
+    result = sound->getUserData((void **)&file);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    /*
+        FMOD is still reading the mapping until release returns, only drop it after that.
+    */
+    result = sound->release();
+    if (file)
+    {
+        MappedFile_Release(file);
+    }
+
+    return result;
+}
@@ -0,0 +1,47 @@
+/*==============================================================================
+Asset Store
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Creates sounds and loads banks straight out of mmapped files. Loading a file
+into a heap buffer and passing it with FMOD_OPENMEMORY costs a full read plus a
+second copy inside FMOD. Here each file is mapped once (see mapped_file.h) and
+handed to FMOD from there, which saves the heap buffer and the read.
+
+Banks use FMOD_STUDIO_LOAD_MEMORY_POINT, and so do sounds created with
+FMOD_CREATECOMPRESSEDSAMPLE, which are forced to FMOD_SOFTWARE. FMOD uses the
+mapped pages in place and they are only read as they're touched. Any other
+sound uses FMOD_OPENMEMORY and FMOD takes its own copy, because pointing at PCM
+needs writable padding around the data that a mapped file doesn't have.
+
+The mapping is shared by every sound and bank made from the same path and
+stays alive until the last of them is released. Sounds keep their mapping in
+their user data, so release them with AssetStore_ReleaseSound rather than
+Sound::release, and don't call Sound::setUserData on them.
+
+The Studio functions are implemented in studio/examples/asset_store_studio.cpp
+so that low level only programs don't need the Studio headers.
+==============================================================================*/
+#ifndef _ASSET_STORE_H
+#define _ASSET_STORE_H
+
+#include "fmod.hpp"
+#include "mapped_file.h"
+
+namespace FMOD
+{
+    namespace Studio
+    {
+        class System;
+        class Bank;
+    }
+}
+
+/* Low level sounds, exinfo may be 0 */
+FMOD_RESULT AssetStore_CreateSound(FMOD::System *system, const char *path, FMOD_MODE mode, const FMOD_CREATESOUNDEXINFO *exinfo, FMOD::Sound **sound);
+FMOD_RESULT AssetStore_ReleaseSound(FMOD::Sound *sound);
+
+/* Studio banks, the returned MappedFile must be passed back to AssetStore_UnloadBank */
+FMOD_RESULT AssetStore_LoadBank(FMOD::Studio::System *system, const char *path, FMOD::Studio::Bank *bank, MappedFile **file);
+FMOD_RESULT AssetStore_UnloadBank(FMOD::Studio::Bank *bank, MappedFile *file);
+
+#endif
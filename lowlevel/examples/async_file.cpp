@@ -0,0 +1,404 @@
+/*==============================================================================
+Async File System
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "async_file.h"
+#include "monotonic_clock.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct AsyncFileHandle
+{
+    int             fd;
+    unsigned int    length;
+    unsigned int    position;       /* Only used by the synchronous read/seek callbacks. */
+    int             inflight;       /* Reads currently being serviced by an I/O thread. */
+};
+
+struct AsyncFileRequest
+{
+    FMOD_ASYNCREADINFO *info;
+    unsigned long long  deadline;
+    unsigned int        sequence;   /* Keeps requests with equal deadlines in arrival order. */
+};
+
+static pthread_mutex_t  gAsyncLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   gAsyncWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   gAsyncIdle = PTHREAD_COND_INITIALIZER;
+static pthread_t        gAsyncThreads[ASYNC_FILE_MAX_THREADS];
+static int              gAsyncNumThreads = 0;
+static bool             gAsyncQuit = false;
+static AsyncFileRequest gAsyncQueue[ASYNC_FILE_MAX_PENDING];   /* Binary min heap on deadline. */
+static int              gAsyncNumPending = 0;
+static unsigned int     gAsyncSequence = 0;
+static AsyncFileStats   gAsyncStats;
+
+/*
+    Microseconds, deadlines are kept as integers so the heap compares exactly.
+*/
+static unsigned long long AsyncFile_Now()
+{
+    return (unsigned long long)(MonotonicClock_Now() * 1e6);
+}
+
+static bool AsyncFile_Before(const AsyncFileRequest &a, const AsyncFileRequest &b)
+{
+    if (a.deadline != b.deadline)
+    {
+        return a.deadline < b.deadline;
+    }
+    return (int)(a.sequence - b.sequence) < 0;
+}
+
+static void AsyncFile_SiftDown(int index)
+{
+    for (;;)
+    {
+        int smallest = index;
+        int left = index * 2 + 1;
+        int right = left + 1;
+
+        if (left < gAsyncNumPending && AsyncFile_Before(gAsyncQueue[left], gAsyncQueue[smallest]))
+        {
+            smallest = left;
+        }
+        if (right < gAsyncNumPending && AsyncFile_Before(gAsyncQueue[right], gAsyncQueue[smallest]))
+        {
+            smallest = right;
+        }
+        if (smallest == index)
+        {
+            return;
+        }
+
+        AsyncFileRequest tmp = gAsyncQueue[index];
+        gAsyncQueue[index] = gAsyncQueue[smallest];
+        gAsyncQueue[smallest] = tmp;
+        index = smallest;
+    }
+}
+
+static void AsyncFile_Push(const AsyncFileRequest &request)
+{
+    int index = gAsyncNumPending++;
+
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+        if (!AsyncFile_Before(request, gAsyncQueue[parent]))
+        {
+            break;
+        }
+        gAsyncQueue[index] = gAsyncQueue[parent];
+        index = parent;
+    }
+    gAsyncQueue[index] = request;
+}
+
+static AsyncFileRequest AsyncFile_Pop()
+{
+    AsyncFileRequest top = gAsyncQueue[0];
+
+    gAsyncQueue[0] = gAsyncQueue[--gAsyncNumPending];
+    AsyncFile_SiftDown(0);
+
+    return top;
+}
+
+static FMOD_RESULT AsyncFile_ReadAt(AsyncFileHandle *h, void *buffer, unsigned int offset, unsigned int sizebytes, unsigned int *bytesread)
+{
+    unsigned int total = 0;
+
+    while (total < sizebytes && offset + total < h->length)
+    {
+        ssize_t n = pread(h->fd, (char *)buffer + total, sizebytes - total, (off_t)offset + total);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            *bytesread = total;
+            return FMOD_ERR_FILE_BAD;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        total += (unsigned int)n;
+    }
+
+    *bytesread = total;
+    return (total < sizebytes) ? FMOD_ERR_FILE_EOF : FMOD_OK;
+}
+
+static unsigned int AsyncFile_Service(FMOD_ASYNCREADINFO *info)
+{
+    unsigned int bytesread;
+    FMOD_RESULT result = AsyncFile_ReadAt((AsyncFileHandle *)info->handle, info->buffer, info->offset, info->sizebytes, &bytesread);
+
+    /*
+        FMOD picks the data up the moment result changes, so everything else has to be visible first.
+    */
+    info->bytesread = bytesread;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    info->result = result;
+
+    return bytesread;
+}
+
+static void *AsyncFile_ThreadMain(void *arg)
+{
+    pthread_mutex_lock(&gAsyncLock);
+    for (;;)
+    {
+        while (!gAsyncNumPending && !gAsyncQuit)
+        {
+            pthread_cond_wait(&gAsyncWake, &gAsyncLock);
+        }
+        if (!gAsyncNumPending)
+        {
+            break;
+        }
+
+        AsyncFileRequest request = AsyncFile_Pop();
+        AsyncFileHandle *h = (AsyncFileHandle *)request.info->handle;
+        h->inflight++;
+        pthread_mutex_unlock(&gAsyncLock);
+
+        /*
+            'info' belongs to FMOD again once it has a result, don't touch it after this.
+        */
+        unsigned int bytesread = AsyncFile_Service(request.info);
+        unsigned long long finished = AsyncFile_Now();
+
+        pthread_mutex_lock(&gAsyncLock);
+        gAsyncStats.reads++;
+        gAsyncStats.bytes += bytesread;
+        if (finished > request.deadline)
+        {
+            gAsyncStats.missed++;
+        }
+        if (--h->inflight == 0)
+        {
+            pthread_cond_broadcast(&gAsyncIdle);
+        }
+    }
+    pthread_mutex_unlock(&gAsyncLock);
+
+    return 0;
+}
+
+FMOD_RESULT F_CALLBACK AsyncFile_Open(const char *name, int unicode, unsigned int *filesize, void **handle, void *userdata)
+{
+    if (unicode)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;  /* Wide paths aren't supported on POSIX. */
+    }
+
+    int fd = open(name, O_RDONLY);
+    if (fd < 0)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size > 0xFFFFFFFFLL)
+    {
+        close(fd);
+        return FMOD_ERR_FILE_BAD;
+    }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    AsyncFileHandle *h = (AsyncFileHandle *)calloc(1, sizeof(AsyncFileHandle));
+    if (!h)
+    {
+        close(fd);
+        return FMOD_ERR_MEMORY;
+    }
+
+    h->fd = fd;
+    h->length = (unsigned int)info.st_size;
+
+    *filesize = h->length;
+    *handle = h;
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK AsyncFile_Close(void *handle, void *userdata)
+{
+    AsyncFileHandle *h = (AsyncFileHandle *)handle;
+
+    /*
+        FMOD can close as soon as its last read has a result, which is before the I/O thread has finished with
+        the handle. Wait for that the same way a cancel does.
+    */
+    pthread_mutex_lock(&gAsyncLock);
+    while (h->inflight)
+    {
+        pthread_cond_wait(&gAsyncIdle, &gAsyncLock);
+    }
+    pthread_mutex_unlock(&gAsyncLock);
+
+    close(h->fd);
+    free(h);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK AsyncFile_Read(void *handle, void *buffer, unsigned int sizebytes, unsigned int *bytesread, void *userdata)
+{
+    AsyncFileHandle *h = (AsyncFileHandle *)handle;
+
+    FMOD_RESULT result = AsyncFile_ReadAt(h, buffer, h->position, sizebytes, bytesread);
+    h->position += *bytesread;
+
+    return result;
+}
+
+FMOD_RESULT F_CALLBACK AsyncFile_Seek(void *handle, unsigned int pos, void *userdata)
+{
+    AsyncFileHandle *h = (AsyncFileHandle *)handle;
+
+    h->position = pos;
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK AsyncFile_AsyncRead(FMOD_ASYNCREADINFO *info, void *userdata)
+{
+    AsyncFileRequest request;
+    int priority = info->priority;
+
+    if (priority < 0)
+    {
+        priority = 0;
+    }
+    if (priority > 100)
+    {
+        priority = 100;
+    }
+
+    request.info = info;
+    request.deadline = AsyncFile_Now() + (unsigned long long)(100 - priority) * ASYNC_FILE_DEADLINE_STEP;
+
+    pthread_mutex_lock(&gAsyncLock);
+
+    if (!gAsyncNumThreads || gAsyncNumPending == ASYNC_FILE_MAX_PENDING)
+    {
+        /*
+            No room to queue it, serve it here rather than fail the read.
+        */
+        gAsyncStats.inlinereads++;
+        pthread_mutex_unlock(&gAsyncLock);
+
+        AsyncFile_Service(info);
+        return FMOD_OK;
+    }
+
+    request.sequence = gAsyncSequence++;
+    AsyncFile_Push(request);
+    if ((unsigned int)gAsyncNumPending > gAsyncStats.maxpending)
+    {
+        gAsyncStats.maxpending = gAsyncNumPending;
+    }
+
+    pthread_cond_signal(&gAsyncWake);
+    pthread_mutex_unlock(&gAsyncLock);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK AsyncFile_AsyncCancel(void *handle, void *userdata)
+{
+    AsyncFileHandle *h = (AsyncFileHandle *)handle;
+
+    pthread_mutex_lock(&gAsyncLock);
+
+    /*
+        Dropped requests are never given a result, FMOD is abandoning them anyway.
+    */
+    int kept = 0;
+    for (int i = 0; i < gAsyncNumPending; i++)
+    {
+        if (gAsyncQueue[i].info->handle == handle)
+        {
+            gAsyncStats.cancelled++;
+        }
+        else
+        {
+            gAsyncQueue[kept++] = gAsyncQueue[i];
+        }
+    }
+    gAsyncNumPending = kept;
+    for (int i = kept / 2 - 1; i >= 0; i--)
+    {
+        AsyncFile_SiftDown(i);
+    }
+
+    /*
+        A read that's already on an I/O thread can't be stopped, wait for it so FMOD can free the buffer.
+    */
+    while (h->inflight)
+    {
+        pthread_cond_wait(&gAsyncIdle, &gAsyncLock);
+    }
+
+    pthread_mutex_unlock(&gAsyncLock);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT AsyncFile_InstallFileSystem(FMOD::System *system, int numthreads)
+{
+    if (numthreads <= 0 || numthreads > ASYNC_FILE_MAX_THREADS)
+    {
+        numthreads = ASYNC_FILE_MAX_THREADS;
+    }
+
+    pthread_mutex_lock(&gAsyncLock);
+    gAsyncQuit = false;
+    pthread_mutex_unlock(&gAsyncLock);
+
+    while (gAsyncNumThreads < numthreads)
+    {
+        if (pthread_create(&gAsyncThreads[gAsyncNumThreads], 0, AsyncFile_ThreadMain, 0) != 0)
+        {
+            break;
+        }
+        gAsyncNumThreads++;
+    }
+
+    /*
+        Keep FMOD's default block alignment, its file buffer is what the async reads fill.
+    */
+    return system->setFileSystem(AsyncFile_Open, AsyncFile_Close, AsyncFile_Read, AsyncFile_Seek, AsyncFile_AsyncRead, AsyncFile_AsyncCancel, 2048);
+}
+
+void AsyncFile_Shutdown()
+{
+    pthread_mutex_lock(&gAsyncLock);
+    gAsyncQuit = true;
+    pthread_cond_broadcast(&gAsyncWake);
+    pthread_mutex_unlock(&gAsyncLock);
+
+    for (int i = 0; i < gAsyncNumThreads; i++)
+    {
+        pthread_join(gAsyncThreads[i], 0);
+    }
+    gAsyncNumThreads = 0;
+}
+
+void AsyncFile_GetStats(AsyncFileStats *stats)
+{
+    pthread_mutex_lock(&gAsyncLock);
+    *stats = gAsyncStats;
+    pthread_mutex_unlock(&gAsyncLock);
+}
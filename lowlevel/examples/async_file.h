@@ -0,0 +1,51 @@
+/*==============================================================================
+Async File System
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+FMOD file system callbacks that hand reads to a small pool of I/O threads
+through FMOD_FILE_ASYNCREAD_CALLBACK, so a slow disk read for one stream no
+longer holds up every other stream waiting on FMOD's stream thread.
+
+Requests are served earliest deadline first. The deadline is the time the
+request arrived plus a slack that shrinks as FMOD's priority rises, priority 100
+('must read now or stuttering may occur') has no slack at all. Low priority
+reads still age towards the front, so they can't starve.
+
+FMOD_FILE_ASYNCCANCEL_CALLBACK drops every queued read for the handle and
+waits for any read already in progress to finish before returning.
+
+Install with AsyncFile_InstallFileSystem before System::init, and call
+AsyncFile_Shutdown after the system has been released.
+==============================================================================*/
+#ifndef _ASYNC_FILE_H
+#define _ASYNC_FILE_H
+
+#include "fmod.hpp"
+
+#define ASYNC_FILE_MAX_THREADS      8
+#define ASYNC_FILE_MAX_PENDING      256     /* Queued reads, past this reads are done inline. */
+#define ASYNC_FILE_DEADLINE_STEP    2000    /* Microseconds of slack per priority step below 100. */
+
+struct AsyncFileStats
+{
+    unsigned int        reads;              /* Reads completed on the I/O threads. */
+    unsigned int        inlinereads;        /* Reads done on the caller's thread because the queue was full. */
+    unsigned int        cancelled;          /* Queued reads dropped by a cancel. */
+    unsigned int        missed;             /* Reads that completed after their deadline. */
+    unsigned int        maxpending;         /* Deepest the queue has been. */
+    unsigned long long  bytes;
+};
+
+/* FMOD file system callbacks */
+FMOD_RESULT F_CALLBACK AsyncFile_Open       (const char *name, int unicode, unsigned int *filesize, void **handle, void *userdata);
+FMOD_RESULT F_CALLBACK AsyncFile_Close      (void *handle, void *userdata);
+FMOD_RESULT F_CALLBACK AsyncFile_Read       (void *handle, void *buffer, unsigned int sizebytes, unsigned int *bytesread, void *userdata);
+FMOD_RESULT F_CALLBACK AsyncFile_Seek       (void *handle, unsigned int pos, void *userdata);
+FMOD_RESULT F_CALLBACK AsyncFile_AsyncRead  (FMOD_ASYNCREADINFO *info, void *userdata);
+FMOD_RESULT F_CALLBACK AsyncFile_AsyncCancel(void *handle, void *userdata);
+
+FMOD_RESULT AsyncFile_InstallFileSystem(FMOD::System *system, int numthreads);  /* 0 = ASYNC_FILE_MAX_THREADS */
+void        AsyncFile_Shutdown();
+void        AsyncFile_GetStats(AsyncFileStats *stats);
+
+#endif
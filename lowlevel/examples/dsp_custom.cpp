@@ -5,9 +5,69 @@ Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
 This example shows how to add a user created DSP callback to process audio 
 data. The read callback is executed at runtime, and can be added anywhere in
 the DSP network.
+
+A second user DSP, the SpectrumAnalyzer, sits on the master group and shows
+the output in octave bands. Its read callback only copies the audio into a
+ring, the FFT runs on a thread of its own and the result is read back with
+DSP::getParameterData. The cost of the FFT at each size it supports is
+measured before the sound starts.
+
+Both DSPs are created through a DSPProfiler (see dsp_profiler.h), which times
+every call to their read callbacks. The most expensive ones can be shown in
+place of the spectrum, and when the example quits the timings are written to
+dsp_profile.json, a Chrome trace, with a summary in dsp_profile.txt.
+
+A MixerWatchdog (see mixer_watchdog.h) on the master group checks each mixer
+block against its deadline and appends a report to mixer_watchdog.txt every
+few seconds. The filter can be made slow enough to miss it.
 ==============================================================================*/
 #include "fmod.hpp"
 #include "common.h"
+#include "spectrum_analyzer.h"
+#include "dsp_profiler.h"
+#include "mixer_watchdog.h"
+#include <math.h>
+
+#define SPECTRUM_SIZE           2048
+#define SPECTRUM_BAR_WIDTH      30
+#define SPECTRUM_FLOOR_DB       -60.0f
+#define FFT_BENCHMARK_MIN       256
+#define FFT_BENCHMARK_MAX       8192
+#define FFT_BENCHMARK_SAMPLES   (1 << 22)
+#define PROFILER_TIMINGS        (1 << 18)   /* About 20 minutes of both DSPs at 48kHz. */
+#define PROFILER_INTERVAL       0.1f
+#define PROFILER_TOP            8
+#define WATCHDOG_INTERVAL       5.0f
+#define SLOW_FILTER_PASSES      20000       /* Enough to take longer than a block on most machines. */
+
+static bool gSlowFilter = false;
+
+static const float  OCTAVE_CENTRE[] = { 31.5f, 63.0f, 125.0f, 250.0f, 500.0f, 1000.0f, 2000.0f, 4000.0f, 8000.0f, 16000.0f };
+static const char  *OCTAVE_STRING[] = { "31", "63", "125", "250", "500", "1k", "2k", "4k", "8k", "16k" };
+static const int    NUM_OCTAVES     = sizeof(OCTAVE_CENTRE) / sizeof(OCTAVE_CENTRE[0]);
+
+/*
+    Level of one octave band in dB, summing the power of the bins inside it. The Hann window spreads a tone
+    over 1.5 bins worth of power, take that back out so a full scale sine reads 0 dB.
+*/
+static float octaveLevel(const SpectrumData *data, float centre)
+{
+    float binwidth = (float)data->samplerate / data->size;
+    int first = (int)ceilf(centre * 0.70710678f / binwidth);
+    int last = (int)floorf(centre * 1.41421356f / binwidth);
+    float power = 0.0f;
+
+    if (last > data->numbins - 1)
+    {
+        last = data->numbins - 1;
+    }
+    for (int k = first; k <= last; k++)
+    {
+        power += data->spectrum[k] * data->spectrum[k];
+    }
+
+    return (power > 0.0f) ? 10.0f * log10f(power / 1.5f) : SPECTRUM_FLOOR_DB;
+}
 
 FMOD_RESULT F_CALLBACK myDSPCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels) 
 {
@@ -26,6 +86,23 @@ FMOD_RESULT F_CALLBACK myDSPCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer,
     result = thisdsp->getUserData((void **)&userdata);
     ERRCHECK(result);
 
+    if (__atomic_load_n(&gSlowFilter, __ATOMIC_RELAXED))
+    {
+        /*
+            Do the same work over and over, to give the mixer watchdog something to find. Volatile so it
+            isn't optimized down to once.
+        */
+        volatile float *slowbuffer = outbuffer;
+
+        for (int pass = 0; pass < SLOW_FILTER_PASSES; pass++)
+        {
+            for (unsigned int i = 0; i < length * inchannels; i++)
+            {
+                slowbuffer[i] = inbuffer[i] * 0.2f;
+            }
+        }
+    }
+
     /*
         This loop assumes inchannels = outchannels, which it will be if the DSP is created with '0' 
         as the number of channels in FMOD_DSP_DESCRIPTION.  
@@ -58,10 +135,18 @@ int FMOD_Main()
     FMOD::Sound        *sound;
     FMOD::Channel      *channel;
     FMOD::DSP          *mydsp;
+    FMOD::DSP          *analyzerdsp;
     FMOD::ChannelGroup *mastergroup;
     FMOD_RESULT         result;
     unsigned int        version;
+    int                 samplerate;
     void               *extradriverdata = 0;
+    SpectrumAnalyzer    analyzer;
+    float               fftcost[6];         /* FFT_BENCHMARK_MIN to FFT_BENCHMARK_MAX. */
+    int                 numfftcosts = 0;
+    DSPProfiler         profiler;
+    MixerWatchdog       watchdog;
+    bool                showprofile = false;
 
     Common_Init(&extradriverdata);
 
@@ -82,6 +167,20 @@ int FMOD_Main()
     result = system->init(32, FMOD_INIT_NORMAL, extradriverdata);
     ERRCHECK(result);
 
+    result = system->getSoftwareFormat(&samplerate, 0, 0);
+    ERRCHECK(result);
+
+    result = profiler.init(system, PROFILER_TIMINGS, PROFILER_INTERVAL);
+    ERRCHECK(result);
+
+    /*
+        Time the FFT at each size on about the same number of samples, before anything else is running.
+    */
+    for (int size = FFT_BENCHMARK_MIN; size <= FFT_BENCHMARK_MAX; size *= 2)
+    {
+        fftcost[numfftcosts++] = SpectrumAnalyzer::benchmark(size, FFT_BENCHMARK_SAMPLES / size);
+    }
+
     result = system->createSound(Common_MediaPath("drumloop.wav"), FMOD_SOFTWARE | FMOD_LOOP_NORMAL, 0, &sound);
     ERRCHECK(result);
 
@@ -102,10 +201,33 @@ int FMOD_Main()
         dspdesc.read = myDSPCallback; 
         dspdesc.userdata = (void *)0x12345678; 
 
-        result = system->createDSP(&dspdesc, &mydsp); 
+        FMOD_DSP_DESCRIPTION timeddesc;
+        result = profiler.wrap(&dspdesc, &timeddesc);
+        ERRCHECK(result);
+
+        result = system->createDSP(&timeddesc, &mydsp); 
         ERRCHECK(result); 
     } 
 
+    /*
+        Create the analyzer, the description comes from the analyzer itself.
+    */
+    {
+        FMOD_DSP_DESCRIPTION dspdesc;
+        FMOD_DSP_DESCRIPTION timeddesc;
+
+        result = analyzer.init(SPECTRUM_SIZE, 0, samplerate);
+        ERRCHECK(result);
+
+        analyzer.describe(&dspdesc);
+
+        result = profiler.wrap(&dspdesc, &timeddesc);
+        ERRCHECK(result);
+
+        result = system->createDSP(&timeddesc, &analyzerdsp);
+        ERRCHECK(result);
+    }
+
     /*
         Attach the DSP, inactive by default.
     */
@@ -118,6 +240,18 @@ int FMOD_Main()
     result = mastergroup->addDSP(0, mydsp, 0);
     ERRCHECK(result);
 
+    /*
+        At the head of the master group, so it sees the output after the filter.
+    */
+    result = mastergroup->addDSP(0, analyzerdsp, 0);
+    ERRCHECK(result);
+
+    /*
+        Last, so its head DSP is the head of the master group.
+    */
+    result = watchdog.init(system, mastergroup, "mixer_watchdog.txt", WATCHDOG_INTERVAL);
+    ERRCHECK(result);
+
     /*
         Main loop.
     */
@@ -138,18 +272,91 @@ int FMOD_Main()
             ERRCHECK(result);
         }
 
+        if (Common_BtnPress(BTN_ACTION2))
+        {
+            showprofile = !showprofile;
+        }
+
+        if (Common_BtnPress(BTN_ACTION3))
+        {
+            __atomic_store_n(&gSlowFilter, !gSlowFilter, __ATOMIC_RELAXED);
+        }
+
         result = system->update();
         ERRCHECK(result);
 
+        profiler.update();
+        watchdog.update();
+
         Common_Draw("==================================================");
         Common_Draw("Custom DSP Example.");
         Common_Draw("Copyright (c) Firelight Technologies 2004-2014.");
         Common_Draw("==================================================");
         Common_Draw("");
         Common_Draw("Press %s to toggle filter bypass", Common_BtnStr(BTN_ACTION1));
+        Common_Draw("Press %s to show the %s", Common_BtnStr(BTN_ACTION2), showprofile ? "spectrum" : "DSP profile");
+        Common_Draw("Press %s to make the filter %s", Common_BtnStr(BTN_ACTION3), gSlowFilter ? "fast" : "slow");
         Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
         Common_Draw("");
-        Common_Draw("Filter is %s", bypass ? "inactive" : "active");
+        Common_Draw("Filter is %s%s", bypass ? "inactive" : "active", gSlowFilter ? " and slow" : "");
+        {
+            MixerWatchdogCounters counters;
+
+            watchdog.getCounters(&counters);
+            Common_Draw("Mixer %.0f us of %.0f us per block, worst %.0f us, %u misses", counters.average, counters.deadline, counters.worst, counters.misses);
+        }
+        Common_Draw("");
+
+        if (showprofile)
+        {
+            DSPProfilerEntry    entries[PROFILER_TOP];
+            DSPProfilerStats    stats;
+            int                 count = profiler.getTop(entries, PROFILER_TOP);
+
+            profiler.getStats(&stats);
+
+            Common_Draw("%-20s %8s %8s %8s", "DSP", "avg us", "worst us", "% rt");
+            for (int i = 0; i < count; i++)
+            {
+                Common_Draw("%-20.20s %8.1f %8.1f %8.2f", entries[i].name, entries[i].average, entries[i].worst, entries[i].realtime);
+            }
+            Common_Draw("");
+            Common_Draw("%u timings, %u dropped", stats.timings, stats.dropped);
+        }
+        else
+        {
+            SpectrumData           *data;
+            SpectrumAnalyzerStats   stats;
+            unsigned int            length;
+            int                     peakbin = 1;
+
+            result = analyzerdsp->getParameterData(SPECTRUM_ANALYZER_PARAM_SPECTRUM, (void **)&data, &length, 0, 0);
+            ERRCHECK(result);
+
+            analyzer.getStats(&stats);
+
+            for (int i = 0; i < NUM_OCTAVES; i++)
+            {
+                char bar[SPECTRUM_BAR_WIDTH + 1];
+                float db = octaveLevel(data, OCTAVE_CENTRE[i]);
+                int width = (int)((db - SPECTRUM_FLOOR_DB) * SPECTRUM_BAR_WIDTH / -SPECTRUM_FLOOR_DB);
+
+                width = (width < 0) ? 0 : (width > SPECTRUM_BAR_WIDTH) ? SPECTRUM_BAR_WIDTH : width;
+                memset(bar, '#', width);
+                bar[width] = 0;
+
+                Common_Draw("%4s |%-30s| %4.0f dB", OCTAVE_STRING[i], bar, db);
+            }
+
+            for (int k = 2; k < data->numbins; k++)
+            {
+                peakbin = (data->spectrum[k] > data->spectrum[peakbin]) ? k : peakbin;
+            }
+
+            Common_Draw("Peak %5.0f Hz, rms %5.1f dB", (float)peakbin * data->samplerate / data->size, (data->rms > 0.0f) ? 20.0f * log10f(data->rms) : SPECTRUM_FLOOR_DB);
+            Common_Draw("%u frames, %u dropped, %.1f us per FFT", stats.frames, stats.dropped, stats.cost);
+            Common_Draw("FFT us %d-%d: %.1f %.1f %.1f %.1f %.1f %.1f", FFT_BENCHMARK_MIN, FFT_BENCHMARK_MAX, fftcost[0], fftcost[1], fftcost[2], fftcost[3], fftcost[4], fftcost[5]);
+        }
 
         Common_Sleep(50);
     } while (!Common_BtnPress(BTN_QUIT));
@@ -165,6 +372,22 @@ int FMOD_Main()
     result = mydsp->release();
     ERRCHECK(result);
 
+    result = mastergroup->removeDSP(analyzerdsp);
+    ERRCHECK(result);
+    result = analyzerdsp->release();
+    ERRCHECK(result);
+
+    result = watchdog.release();
+    ERRCHECK(result);
+
+    analyzer.release();
+
+    result = profiler.writeTrace("dsp_profile.json");
+    ERRCHECK(result);
+    result = profiler.writeSummary("dsp_profile.txt", PROFILER_TOP);
+    ERRCHECK(result);
+    profiler.release();
+
     result = system->close();
     ERRCHECK(result);
     result = system->release();
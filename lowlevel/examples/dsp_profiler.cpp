@@ -0,0 +1,528 @@
+/*==============================================================================
+DSP Profiler
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "dsp_profiler.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#endif
+
+struct DSPProfilerCallbacks
+{
+    FMOD_DSP_READ_CALLBACK      read;
+    FMOD_DSP_PROCESS_CALLBACK   process;
+};
+
+/*
+    One pair of timed callbacks per slot, each knowing its slot number.
+*/
+template <int SLOT> struct DSPProfilerSlot
+{
+    static FMOD_RESULT F_CALLBACK read(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+    {
+        return DSPProfiler::timeRead(SLOT, dsp_state, inbuffer, outbuffer, length, inchannels, outchannels);
+    }
+
+    static FMOD_RESULT F_CALLBACK process(FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, bool inputsidle, FMOD_DSP_PROCESS_OPERATION op)
+    {
+        return DSPProfiler::timeProcess(SLOT, dsp_state, length, inbufferarray, outbufferarray, inputsidle, op);
+    }
+};
+
+#define DSP_PROFILER_SLOT(_n) { DSPProfilerSlot<_n>::read, DSPProfilerSlot<_n>::process }
+
+static const DSPProfilerCallbacks gDSPProfilerTimed[DSP_PROFILER_MAX_SLOTS] =
+{
+    DSP_PROFILER_SLOT(0),  DSP_PROFILER_SLOT(1),  DSP_PROFILER_SLOT(2),  DSP_PROFILER_SLOT(3),
+    DSP_PROFILER_SLOT(4),  DSP_PROFILER_SLOT(5),  DSP_PROFILER_SLOT(6),  DSP_PROFILER_SLOT(7),
+    DSP_PROFILER_SLOT(8),  DSP_PROFILER_SLOT(9),  DSP_PROFILER_SLOT(10), DSP_PROFILER_SLOT(11),
+    DSP_PROFILER_SLOT(12), DSP_PROFILER_SLOT(13), DSP_PROFILER_SLOT(14), DSP_PROFILER_SLOT(15),
+};
+
+static DSPProfilerCallbacks gDSPProfilerWrapped[DSP_PROFILER_MAX_SLOTS];    /* The real ones. */
+static DSPProfiler         *gDSPProfiler = 0;
+
+static unsigned long long DSPProfiler_Ticks()
+{
+#if defined(__APPLE__)
+    return mach_absolute_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+DSPProfiler::DSPProfiler()
+{
+    m_system = 0;
+    m_samplerate = 0;
+    m_tick = 0.0;
+    m_origin = 0;
+    m_interval = 0.0f;
+    m_lastsample = 0.0;
+    m_havekey = false;
+    m_threads = 0;
+    m_numthreads = 0;
+    m_lost = 0;
+    m_log = 0;
+    m_maxtimings = 0;
+    m_numtimings = 0;
+    m_samples = 0;
+    m_numsamples = 0;
+    memset(m_entries, 0, sizeof(m_entries));
+    m_numentries = 0;
+    memset(m_names, 0, sizeof(m_names));
+    m_numslots = 0;
+    m_timings = 0;
+    m_unlogged = 0;
+    m_untracked = 0;
+}
+
+FMOD_RESULT DSPProfiler::init(FMOD::System *system, int maxtimings, float interval)
+{
+    FMOD_RESULT result;
+
+    if (!system || maxtimings < 0 || interval <= 0.0f)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    if (gDSPProfiler)
+    {
+        return FMOD_ERR_ALREADYLOCKED;      /* One profiler at a time. */
+    }
+
+    result = system->getSoftwareFormat(&m_samplerate, 0, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    if (pthread_key_create(&m_key, 0) != 0)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    m_havekey = true;
+
+    m_threads = (DSPProfilerThread *)calloc(DSP_PROFILER_MAX_THREADS, sizeof(DSPProfilerThread));
+    m_log = (DSPProfilerTiming *)malloc((maxtimings ? maxtimings : 1) * sizeof(DSPProfilerTiming));
+    m_samples = (DSPProfilerSample *)malloc(DSP_PROFILER_MAX_SAMPLES * sizeof(DSPProfilerSample));
+    if (!m_threads || !m_log || !m_samples)
+    {
+        release();
+        return FMOD_ERR_MEMORY;
+    }
+
+#if defined(__APPLE__)
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    m_tick = (double)timebase.numer / timebase.denom * 1e-9;
+#else
+    m_tick = 1e-9;
+#endif
+
+    m_system = system;
+    m_maxtimings = maxtimings;
+    m_interval = interval;
+    m_origin = DSPProfiler_Ticks();
+    m_lastsample = -interval;
+
+    gDSPProfiler = this;
+    return FMOD_OK;
+}
+
+void DSPProfiler::release()
+{
+    if (gDSPProfiler == this)
+    {
+        gDSPProfiler = 0;
+    }
+    if (m_havekey)
+    {
+        pthread_key_delete(m_key);
+        m_havekey = false;
+    }
+
+    free(m_threads);
+    free(m_log);
+    free(m_samples);
+    m_threads = 0;
+    m_log = 0;
+    m_samples = 0;
+    m_system = 0;
+}
+
+FMOD_RESULT DSPProfiler::wrap(const FMOD_DSP_DESCRIPTION *desc, FMOD_DSP_DESCRIPTION *out)
+{
+    if (!m_system || !desc || !out)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    if (m_numslots == DSP_PROFILER_MAX_SLOTS)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    int slot = m_numslots++;
+
+    gDSPProfilerWrapped[slot].read = desc->read;
+    gDSPProfilerWrapped[slot].process = desc->process;
+
+    /*
+        The name ends up in the trace as is, keep it to characters that need no escaping.
+    */
+    for (int i = 0; i < 31 && desc->name[i]; i++)
+    {
+        unsigned char c = (unsigned char)desc->name[i];
+        m_names[slot][i] = (c < 0x20 || c == '"' || c == '\\') ? '_' : (char)c;
+    }
+    if (!m_names[slot][0])
+    {
+        sprintf(m_names[slot], "DSP %d", slot);
+    }
+
+    *out = *desc;
+    out->read = desc->read ? gDSPProfilerTimed[slot].read : 0;
+    out->process = desc->process ? gDSPProfilerTimed[slot].process : 0;
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT DSPProfiler::timeRead(int slot, FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+{
+    unsigned long long start = DSPProfiler_Ticks();
+
+    FMOD_RESULT result = gDSPProfilerWrapped[slot].read(dsp_state, inbuffer, outbuffer, length, inchannels, outchannels);
+
+    gDSPProfiler->record(slot, dsp_state->instance, start, DSPProfiler_Ticks(), length);
+    return result;
+}
+
+FMOD_RESULT DSPProfiler::timeProcess(int slot, FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, bool inputsidle, FMOD_DSP_PROCESS_OPERATION op)
+{
+    /*
+        Queries only ask about the output format, only the calls doing the work are worth timing.
+    */
+    if (op != FMOD_DSP_PROCESS_PERFORM)
+    {
+        return gDSPProfilerWrapped[slot].process(dsp_state, length, inbufferarray, outbufferarray, inputsidle, op);
+    }
+
+    unsigned long long start = DSPProfiler_Ticks();
+
+    FMOD_RESULT result = gDSPProfilerWrapped[slot].process(dsp_state, length, inbufferarray, outbufferarray, inputsidle, op);
+
+    gDSPProfiler->record(slot, dsp_state->instance, start, DSPProfiler_Ticks(), length);
+    return result;
+}
+
+void DSPProfiler::record(int slot, FMOD_DSP *instance, unsigned long long start, unsigned long long end, unsigned int length)
+{
+    /*
+        A thread takes a ring the first time it gets here and keeps its number, plus one, in the key.
+    */
+    intptr_t index = (intptr_t)pthread_getspecific(m_key) - 1;
+    if (index < 0)
+    {
+        index = __atomic_fetch_add(&m_numthreads, 1, __ATOMIC_ACQ_REL);
+        pthread_setspecific(m_key, (void *)(index + 1));
+    }
+    if (index >= DSP_PROFILER_MAX_THREADS)
+    {
+        __atomic_fetch_add(&m_lost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    DSPProfilerThread *thread = &m_threads[index];
+    unsigned int write = thread->write;
+
+    if (write - __atomic_load_n(&thread->read, __ATOMIC_ACQUIRE) >= DSP_PROFILER_RING)
+    {
+        __atomic_store_n(&thread->dropped, thread->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    DSPProfilerTiming *timing = &thread->ring[write & (DSP_PROFILER_RING - 1)];
+    timing->start = start;
+    timing->end = end;
+    timing->instance = instance;
+    timing->length = length;
+    timing->slot = slot;
+    timing->thread = (int)index;
+
+    __atomic_store_n(&thread->write, write + 1, __ATOMIC_RELEASE);
+}
+
+double DSPProfiler::seconds(unsigned long long ticks) const
+{
+    return (double)(ticks - m_origin) * m_tick;
+}
+
+void DSPProfiler::total(const DSPProfilerTiming *timing)
+{
+    DSPProfilerEntry *entry = 0;
+
+    for (int i = 0; i < m_numentries && !entry; i++)
+    {
+        if (m_entries[i].instance == timing->instance)
+        {
+            entry = &m_entries[i];
+        }
+    }
+    if (!entry)
+    {
+        if (m_numentries == DSP_PROFILER_MAX_INSTANCES)
+        {
+            m_untracked++;
+            return;
+        }
+
+        entry = &m_entries[m_numentries++];
+        memcpy(entry->name, m_names[timing->slot], sizeof(entry->name));
+        entry->instance = timing->instance;
+    }
+
+    float elapsed = (float)((timing->end - timing->start) * m_tick * 1e6);
+
+    entry->calls++;
+    entry->samples += timing->length;
+    entry->total += elapsed;
+    if (elapsed > entry->worst)
+    {
+        entry->worst = elapsed;
+        entry->worstblock = timing->length ? elapsed * m_samplerate * 1e-4f / timing->length : 0.0f;
+    }
+}
+
+void DSPProfiler::sample(double now)
+{
+    DSPProfilerSample *sample;
+    float geometry;
+
+    if (m_numsamples == DSP_PROFILER_MAX_SAMPLES)
+    {
+        return;
+    }
+
+    sample = &m_samples[m_numsamples];
+    sample->time = now;
+
+    if (m_system->getCPUUsage(&sample->dsp, &sample->stream, &geometry, &sample->update, &sample->total) != FMOD_OK ||
+        m_system->getChannelsPlaying(&sample->channels) != FMOD_OK)
+    {
+        return;
+    }
+
+    m_numsamples++;
+}
+
+void DSPProfiler::update()
+{
+    if (!m_system)
+    {
+        return;
+    }
+
+    int numthreads = __atomic_load_n(&m_numthreads, __ATOMIC_ACQUIRE);
+    if (numthreads > DSP_PROFILER_MAX_THREADS)
+    {
+        numthreads = DSP_PROFILER_MAX_THREADS;
+    }
+
+    for (int t = 0; t < numthreads; t++)
+    {
+        DSPProfilerThread *thread = &m_threads[t];
+        unsigned int write = __atomic_load_n(&thread->write, __ATOMIC_ACQUIRE);
+        unsigned int read = thread->read;
+
+        for (; read != write; read++)
+        {
+            const DSPProfilerTiming *timing = &thread->ring[read & (DSP_PROFILER_RING - 1)];
+
+            total(timing);
+            if (m_numtimings < m_maxtimings)
+            {
+                m_log[m_numtimings++] = *timing;
+            }
+            else
+            {
+                m_unlogged++;
+            }
+            m_timings++;
+        }
+
+        __atomic_store_n(&thread->read, read, __ATOMIC_RELEASE);
+    }
+
+    double now = seconds(DSPProfiler_Ticks());
+    if (now - m_lastsample >= m_interval)
+    {
+        sample(now);
+        m_lastsample = now;
+    }
+}
+
+int DSPProfiler::getTop(DSPProfilerEntry *entries, int max) const
+{
+    bool taken[DSP_PROFILER_MAX_INSTANCES];
+    int count = 0;
+
+    memset(taken, 0, sizeof(taken));
+
+    for (; count < max && count < m_numentries; count++)
+    {
+        int best = -1;
+
+        for (int i = 0; i < m_numentries; i++)
+        {
+            if (!taken[i] && (best < 0 || m_entries[i].total > m_entries[best].total))
+            {
+                best = i;
+            }
+        }
+
+        taken[best] = true;
+        entries[count] = m_entries[best];
+        entries[count].average = (float)(entries[count].total / entries[count].calls);
+        entries[count].realtime = entries[count].samples ? (float)(entries[count].total * m_samplerate * 1e-4 / entries[count].samples) : 0.0f;
+    }
+
+    return count;
+}
+
+void DSPProfiler::getStats(DSPProfilerStats *stats) const
+{
+    int numthreads = __atomic_load_n(&m_numthreads, __ATOMIC_ACQUIRE);
+
+    stats->timings = m_timings;
+    stats->dropped = __atomic_load_n(&m_lost, __ATOMIC_RELAXED);
+    stats->unlogged = m_unlogged;
+    stats->untracked = m_untracked;
+    stats->threads = numthreads;
+    stats->instances = m_numentries;
+
+    for (int t = 0; t < numthreads && t < DSP_PROFILER_MAX_THREADS; t++)
+    {
+        stats->dropped += __atomic_load_n(&m_threads[t].dropped, __ATOMIC_RELAXED);
+    }
+}
+
+FMOD_RESULT DSPProfiler::writeTrace(const char *path) const
+{
+    int numthreads = __atomic_load_n(&m_numthreads, __ATOMIC_ACQUIRE);
+    const char *separator = "";
+
+    if (!m_system || !path)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+
+    /*
+        Chrome's trace event format, times in microseconds. Each thread that called a wrapped DSP gets a row of
+        complete events, the CPU usage samples become counters.
+    */
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (int t = 0; t < numthreads && t < DSP_PROFILER_MAX_THREADS; t++)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"DSP thread %d\"}}", separator, t + 1, t);
+        separator = ",\n";
+    }
+
+    for (int i = 0; i < m_numtimings; i++)
+    {
+        const DSPProfilerTiming *timing = &m_log[i];
+
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"dsp\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"instance\":\"%p\",\"samples\":%u}}",
+                separator, m_names[timing->slot], timing->thread + 1,
+                seconds(timing->start) * 1e6, (timing->end - timing->start) * m_tick * 1e6,
+                (void *)timing->instance, timing->length);
+        separator = ",\n";
+    }
+
+    for (int i = 0; i < m_numsamples; i++)
+    {
+        const DSPProfilerSample *sample = &m_samples[i];
+
+        fprintf(file, "%s{\"name\":\"CPU usage\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"dsp\":%.2f,\"stream\":%.2f,\"update\":%.2f,\"total\":%.2f}}",
+                separator, sample->time * 1e6, sample->dsp, sample->stream, sample->update, sample->total);
+        separator = ",\n";
+        fprintf(file, "%s{\"name\":\"Channels playing\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"channels\":%d}}",
+                separator, sample->time * 1e6, sample->channels);
+    }
+
+    fprintf(file, "\n]}\n");
+
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed)
+    {
+        return FMOD_ERR_FILE_BAD;
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT DSPProfiler::writeSummary(const char *path, int count) const
+{
+    DSPProfilerEntry entries[DSP_PROFILER_MAX_INSTANCES];
+    DSPProfilerStats stats;
+    float dsp = 0.0f, total = 0.0f, peak = 0.0f;
+
+    if (!m_system || !path || count < 1)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+
+    count = getTop(entries, count);
+    getStats(&stats);
+
+    for (int i = 0; i < m_numsamples; i++)
+    {
+        dsp += m_samples[i].dsp;
+        total += m_samples[i].total;
+        peak = (m_samples[i].dsp > peak) ? m_samples[i].dsp : peak;
+    }
+    if (m_numsamples)
+    {
+        dsp /= m_numsamples;
+        total /= m_numsamples;
+    }
+
+    fprintf(file, "DSP CPU %.1f%% average, %.1f%% peak, total CPU %.1f%% average, over %d samples\n", dsp, peak, total, m_numsamples);
+    fprintf(file, "%u timings on %d threads, %u dropped, %u not logged, %u from untracked instances\n\n", stats.timings, stats.threads, stats.dropped, stats.unlogged, stats.untracked);
+    fprintf(file, "%-4s %-31s %-18s %10s %12s %10s %10s %8s %8s\n", "rank", "name", "instance", "calls", "total us", "avg us", "worst us", "% rt", "% block");
+
+    for (int i = 0; i < count; i++)
+    {
+        const DSPProfilerEntry *entry = &entries[i];
+
+        fprintf(file, "%-4d %-31s %-18p %10u %12.0f %10.2f %10.2f %8.2f %8.2f\n",
+                i + 1, entry->name, (void *)entry->instance, entry->calls, entry->total,
+                entry->average, entry->worst, entry->realtime, entry->worstblock);
+    }
+
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed)
+    {
+        return FMOD_ERR_FILE_BAD;
+    }
+
+    return FMOD_OK;
+}
@@ -0,0 +1,160 @@
+/*==============================================================================
+DSP Profiler
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Times every call FMOD makes into the read or process callback of user
+created DSPs, per instance, to find which one is taking the mixer's time.
+System::getCPUUsage only gives totals.
+
+wrap copies an FMOD_DSP_DESCRIPTION and swaps its read and process callbacks
+for ones that read the clock either side of the real callback. Nothing else
+in the description changes, so userdata and plugindata still work. A timing
+goes into a ring that belongs to the thread that made the call, so the mixer
+never takes a lock or waits for anything. If the ring is full the timing is
+dropped and counted.
+
+update, called once a frame from the main thread, empties the rings into a
+total for each DSP instance and a log of every call. It also samples
+System::getCPUUsage and System::getChannelsPlaying every so often. The log
+and the samples can be written out as a Chrome trace, to load into
+chrome://tracing, and the totals as a summary of the most expensive
+instances.
+
+The wrapped callbacks are plain functions with nowhere to keep a pointer to
+their profiler, so there's only one profiler at a time, and at most
+DSP_PROFILER_MAX_SLOTS descriptions can be wrapped.
+==============================================================================*/
+#ifndef _DSP_PROFILER_H
+#define _DSP_PROFILER_H
+
+#include "fmod.hpp"
+#include <pthread.h>
+
+#define DSP_PROFILER_MAX_SLOTS      16      /* Descriptions wrapped. */
+#define DSP_PROFILER_MAX_INSTANCES  64      /* DSPs totalled, calls from any more are only logged. */
+#define DSP_PROFILER_MAX_THREADS    8       /* Threads that can call into a wrapped DSP. */
+#define DSP_PROFILER_RING           4096    /* Timings per thread between updates, a power of two. */
+#define DSP_PROFILER_MAX_SAMPLES    4096    /* getCPUUsage samples kept for the trace. */
+
+struct DSPProfilerTiming
+{
+    unsigned long long  start;          /* Ticks. */
+    unsigned long long  end;
+    FMOD_DSP           *instance;
+    unsigned int        length;         /* Samples. */
+    int                 slot;
+    int                 thread;
+};
+
+struct DSPProfilerThread
+{
+    DSPProfilerTiming   ring[DSP_PROFILER_RING];
+    unsigned int        write;          /* Free running, only written by the thread. */
+    unsigned int        read;           /* Free running, only written by update. */
+    unsigned int        dropped;
+};
+
+struct DSPProfilerSample
+{
+    double              time;           /* Seconds since init. */
+    float               dsp;            /* Percent, as System::getCPUUsage. */
+    float               stream;
+    float               update;
+    float               total;
+    int                 channels;
+};
+
+/*
+    Totals for one DSP instance. Percent of real time is the time spent in the callback over the duration of
+    the audio it was asked for, so 100 would take the whole mixer by itself.
+*/
+struct DSPProfilerEntry
+{
+    char                name[32];       /* From the description. */
+    FMOD_DSP           *instance;
+    unsigned int        calls;
+    unsigned long long  samples;
+    double              total;          /* Microseconds. */
+    float               average;        /* Microseconds per call. */
+    float               worst;
+    float               realtime;       /* Percent, over every call. */
+    float               worstblock;     /* Percent, of the worst call's own block. */
+};
+
+struct DSPProfilerStats
+{
+    unsigned int        timings;        /* Taken out of the rings. */
+    unsigned int        dropped;        /* Rings were full, or too many threads. */
+    unsigned int        unlogged;       /* The log was full. */
+    unsigned int        untracked;      /* More instances than DSP_PROFILER_MAX_INSTANCES. */
+    int                 threads;
+    int                 instances;
+};
+
+class DSPProfiler
+{
+public:
+    DSPProfiler();
+
+    /*
+        'maxtimings' is the size of the log for the trace, 'interval' the seconds between CPU usage samples.
+    */
+    FMOD_RESULT init(FMOD::System *system, int maxtimings, float interval);
+    void        release();              /* Only once every wrapped DSP is released. */
+
+    /*
+        Fills in 'out' as a copy of 'desc' with timed callbacks, for System::createDSP.
+    */
+    FMOD_RESULT wrap(const FMOD_DSP_DESCRIPTION *desc, FMOD_DSP_DESCRIPTION *out);
+
+    void        update();
+
+    /*
+        The 'max' most expensive instances by total time, returns how many were filled in.
+    */
+    int         getTop(DSPProfilerEntry *entries, int max) const;
+    void        getStats(DSPProfilerStats *stats) const;
+
+    FMOD_RESULT writeTrace(const char *path) const;
+    FMOD_RESULT writeSummary(const char *path, int count) const;
+
+    static FMOD_RESULT timeRead(int slot, FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels);
+    static FMOD_RESULT timeProcess(int slot, FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, bool inputsidle, FMOD_DSP_PROCESS_OPERATION op);
+
+private:
+    void        record(int slot, FMOD_DSP *instance, unsigned long long start, unsigned long long end, unsigned int length);
+    void        total(const DSPProfilerTiming *timing);
+    void        sample(double now);
+    double      seconds(unsigned long long ticks) const;
+
+    FMOD::System       *m_system;
+    int                 m_samplerate;
+    double              m_tick;             /* Seconds per tick. */
+    unsigned long long  m_origin;           /* Ticks at init. */
+    float               m_interval;
+    double              m_lastsample;
+
+    pthread_key_t       m_key;
+    bool                m_havekey;
+    DSPProfilerThread  *m_threads;          /* DSP_PROFILER_MAX_THREADS of them. */
+    int                 m_numthreads;       /* Claimed, can pass the maximum. */
+    unsigned int        m_lost;             /* Timings from threads past the maximum. */
+
+    DSPProfilerTiming  *m_log;
+    int                 m_maxtimings;
+    int                 m_numtimings;
+
+    DSPProfilerSample  *m_samples;          /* DSP_PROFILER_MAX_SAMPLES of them. */
+    int                 m_numsamples;
+
+    DSPProfilerEntry    m_entries[DSP_PROFILER_MAX_INSTANCES];
+    int                 m_numentries;
+    char                m_names[DSP_PROFILER_MAX_SLOTS][32];
+    int                 m_numslots;
+
+    unsigned int        m_timings;
+    unsigned int        m_unlogged;
+    unsigned int        m_untracked;
+};
+
+#endif
@@ -0,0 +1,519 @@
+/*==============================================================================
+Effect Graph
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "effect_graph.h"
+#include <stdlib.h>
+#include <string.h>
+
+EffectGraph::EffectGraph()
+{
+    m_system = 0;
+    memset(m_pools, 0, sizeof(m_pools));
+    m_attached = 0;
+    m_detached = 0;
+    m_hits = 0;
+    m_misses = 0;
+    m_released = 0;
+}
+
+FMOD_RESULT EffectGraph::init(FMOD::System *system)
+{
+    if (!system)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    m_system = system;
+    return FMOD_OK;
+}
+
+FMOD_RESULT EffectGraph::release()
+{
+    FMOD_RESULT result = FMOD_OK;
+
+    for (int type = 0; type < EFFECT_GRAPH_NUM_TYPES; type++)
+    {
+        EffectGraphPool *pool = &m_pools[type];
+
+        for (int i = 0; i < pool->numfree; i++)
+        {
+            FMOD_RESULT r = pool->free[i]->release();
+            if (r != FMOD_OK && result == FMOD_OK)
+            {
+                result = r;
+            }
+        }
+
+        free(pool->free);
+    }
+
+    memset(m_pools, 0, sizeof(m_pools));
+    m_system = 0;
+    return result;
+}
+
+FMOD_RESULT EffectGraph::validate(const EffectChainDesc *desc)
+{
+    if (!desc || desc->numnodes < 0 || desc->numnodes > EFFECT_GRAPH_MAX_NODES)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    for (int i = 0; i < desc->numnodes; i++)
+    {
+        const EffectNodeDesc *node = &desc->nodes[i];
+
+        if (node->type <= FMOD_DSP_TYPE_UNKNOWN || node->type >= EFFECT_GRAPH_NUM_TYPES)
+        {
+            return FMOD_ERR_INVALID_PARAM;
+        }
+        if (node->numparams < 0 || node->numparams > EFFECT_GRAPH_MAX_PARAMS)
+        {
+            return FMOD_ERR_INVALID_PARAM;
+        }
+        if (node->source != EFFECT_GRAPH_SERIES && node->source != EFFECT_GRAPH_INPUT)
+        {
+            /*
+                A send can only be fed by a series node that comes before it.
+            */
+            if (node->source < 0 || node->source >= i || desc->nodes[node->source].source != EFFECT_GRAPH_SERIES)
+            {
+                return FMOD_ERR_INVALID_PARAM;
+            }
+        }
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT EffectGraph::create(FMOD_DSP_TYPE type, FMOD::DSP **dsp)
+{
+    EffectGraphPool *pool = &m_pools[type];
+    FMOD_RESULT result;
+
+    result = m_system->createDSPByType(type, dsp);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    /*
+        DSP::reset clears a unit's state but not its parameters, so note the defaults the first time to put
+        back whatever a chain changes.
+    */
+    if (pool->numdefaults == 0)
+    {
+        int numparams = 0;
+
+        result = (*dsp)->getNumParameters(&numparams);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+        if (numparams > EFFECT_GRAPH_MAX_DEFAULTS)
+        {
+            numparams = EFFECT_GRAPH_MAX_DEFAULTS;
+        }
+
+        for (int i = 0; i < numparams; i++)
+        {
+            FMOD_DSP_PARAMETER_DESC *info = 0;
+
+            result = (*dsp)->getParameterInfo(i, &info);
+            if (result != FMOD_OK)
+            {
+                return result;
+            }
+
+            pool->isfloat[i] = (info->type == FMOD_DSP_PARAMETER_TYPE_FLOAT);
+            pool->defaults[i] = pool->isfloat[i] ? info->floatdesc.defaultval : 0.0f;
+        }
+
+        pool->numdefaults = numparams;
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT EffectGraph::reserve(FMOD_DSP_TYPE type, int count)
+{
+    if (!m_system || type <= FMOD_DSP_TYPE_UNKNOWN || type >= EFFECT_GRAPH_NUM_TYPES || count < 0)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    if (count == 0)
+    {
+        return FMOD_OK;
+    }
+
+    EffectGraphPool *pool = &m_pools[type];
+
+    FMOD::DSP **grown = (FMOD::DSP **)realloc(pool->free, (pool->capacity + count) * sizeof(FMOD::DSP *));
+    if (!grown)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    pool->free = grown;
+    pool->capacity += count;
+
+    for (int i = 0; i < count; i++)
+    {
+        FMOD::DSP *dsp = 0;
+
+        FMOD_RESULT result = create(type, &dsp);
+        if (result != FMOD_OK)
+        {
+            if (dsp)
+            {
+                dsp->release();
+            }
+            return result;
+        }
+
+        pool->free[pool->numfree++] = dsp;
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT EffectGraph::reserve(const EffectChainDesc *desc, int instances)
+{
+    int counts[EFFECT_GRAPH_NUM_TYPES];
+    bool hassends = false;
+    FMOD_RESULT result;
+
+    result = validate(desc);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < desc->numnodes; i++)
+    {
+        counts[desc->nodes[i].type]++;
+        if (desc->nodes[i].source != EFFECT_GRAPH_SERIES)
+        {
+            hassends = true;
+        }
+    }
+    if (hassends)
+    {
+        counts[FMOD_DSP_TYPE_MIXER]++;
+    }
+
+    for (int type = 0; type < EFFECT_GRAPH_NUM_TYPES; type++)
+    {
+        if (counts[type])
+        {
+            result = reserve((FMOD_DSP_TYPE)type, counts[type] * instances);
+            if (result != FMOD_OK)
+            {
+                return result;
+            }
+        }
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT EffectGraph::acquire(FMOD_DSP_TYPE type, FMOD::DSP **dsp)
+{
+    EffectGraphPool *pool = &m_pools[type];
+
+    if (pool->numfree > 0)
+    {
+        *dsp = pool->free[--pool->numfree];
+        m_hits++;
+        return FMOD_OK;
+    }
+
+    /*
+        Nothing reserved is left, create one the slow way.
+    */
+    FMOD_RESULT result = create(type, dsp);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_misses++;
+    return FMOD_OK;
+}
+
+FMOD_RESULT EffectGraph::recycle(FMOD_DSP_TYPE type, FMOD::DSP *dsp, const EffectNodeDesc *node)
+{
+    EffectGraphPool *pool = &m_pools[type];
+    FMOD_RESULT result;
+
+    if (pool->numfree == pool->capacity)
+    {
+        m_released++;
+        return dsp->release();
+    }
+
+    result = dsp->reset();
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    if (node)
+    {
+        for (int i = 0; i < node->numparams; i++)
+        {
+            int index = node->params[i].index;
+
+            if (index >= 0 && index < pool->numdefaults && pool->isfloat[index])
+            {
+                result = dsp->setParameterFloat(index, pool->defaults[index]);
+                if (result != FMOD_OK)
+                {
+                    return result;
+                }
+            }
+        }
+    }
+
+    pool->free[pool->numfree++] = dsp;
+    return FMOD_OK;
+}
+
+FMOD_RESULT EffectGraph::unwire(EffectChain *chain)
+{
+    const EffectChainDesc *desc = chain->desc;
+    FMOD_RESULT result = FMOD_OK;
+    FMOD_RESULT r;
+
+    /*
+        Sends first, so every series node is back to one input and one output when it's removed and
+        removeDSP joins its neighbours back up.
+    */
+    for (int i = 0; i < desc->numnodes; i++)
+    {
+        if (chain->dsps[i] && desc->nodes[i].source != EFFECT_GRAPH_SERIES)
+        {
+            r = chain->dsps[i]->disconnectAll(true, true);
+            if (r != FMOD_OK && result == FMOD_OK)
+            {
+                result = r;
+            }
+        }
+    }
+
+    if (chain->mixer)
+    {
+        r = chain->target->removeDSP(chain->mixer);
+        if (r != FMOD_OK && result == FMOD_OK)
+        {
+            result = r;
+        }
+    }
+
+    for (int i = desc->numnodes - 1; i >= 0; i--)
+    {
+        if (chain->dsps[i] && desc->nodes[i].source == EFFECT_GRAPH_SERIES)
+        {
+            r = chain->target->removeDSP(chain->dsps[i]);
+            if (r != FMOD_OK && result == FMOD_OK)
+            {
+                result = r;
+            }
+        }
+    }
+
+    return result;
+}
+
+FMOD_RESULT EffectGraph::detach(EffectChain *chain)
+{
+    const EffectChainDesc *desc;
+    FMOD_RESULT result;
+    FMOD_RESULT r;
+
+    if (!chain || !chain->target)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    desc = chain->desc;
+
+    result = unwire(chain);
+
+    for (int i = 0; i < desc->numnodes; i++)
+    {
+        if (chain->dsps[i])
+        {
+            r = recycle(desc->nodes[i].type, chain->dsps[i], &desc->nodes[i]);
+            if (r != FMOD_OK && result == FMOD_OK)
+            {
+                result = r;
+            }
+        }
+    }
+    if (chain->mixer)
+    {
+        r = recycle(FMOD_DSP_TYPE_MIXER, chain->mixer, 0);
+        if (r != FMOD_OK && result == FMOD_OK)
+        {
+            result = r;
+        }
+    }
+
+    memset(chain, 0, sizeof(EffectChain));
+    m_detached++;
+    return result;
+}
+
+FMOD_RESULT EffectGraph::attach(FMOD::ChannelControl *target, const EffectChainDesc *desc, EffectChain *chain)
+{
+    FMOD::DSP *first = 0;           /* Whose input is the chain's input. */
+    bool hassends = false;
+    FMOD_RESULT result;
+
+    if (!m_system || !target || !chain)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    result = validate(desc);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    memset(chain, 0, sizeof(EffectChain));
+    chain->target = target;
+    chain->desc = desc;
+
+    for (int i = 0; i < desc->numnodes && result == FMOD_OK; i++)
+    {
+        const EffectNodeDesc *node = &desc->nodes[i];
+
+        result = acquire(node->type, &chain->dsps[i]);
+        for (int p = 0; p < node->numparams && result == FMOD_OK; p++)
+        {
+            result = chain->dsps[i]->setParameterFloat(node->params[p].index, node->params[p].value);
+        }
+        if (node->source != EFFECT_GRAPH_SERIES)
+        {
+            hassends = true;
+        }
+    }
+
+    /*
+        Each series node goes in as the new head, so the last one is nearest the output and the signal
+        goes through them in the order they're listed.
+    */
+    for (int i = 0; i < desc->numnodes && result == FMOD_OK; i++)
+    {
+        if (desc->nodes[i].source == EFFECT_GRAPH_SERIES)
+        {
+            result = target->addDSP(0, chain->dsps[i], 0);
+            if (!first)
+            {
+                first = chain->dsps[i];
+            }
+        }
+    }
+
+    if (hassends && result == FMOD_OK)
+    {
+        FMOD::DSP *input = 0;
+
+        result = acquire(FMOD_DSP_TYPE_MIXER, &chain->mixer);
+        if (result == FMOD_OK)
+        {
+            result = target->addDSP(0, chain->mixer, 0);
+        }
+        if (!first)
+        {
+            first = chain->mixer;
+        }
+        if (result == FMOD_OK)
+        {
+            result = first->getInput(0, &input, 0);
+        }
+
+        /*
+                           [SEND]
+                          /      \
+            [MIXER]<----[...]<----[FIRST]<----[input]
+        */
+        for (int i = 0; i < desc->numnodes && result == FMOD_OK; i++)
+        {
+            const EffectNodeDesc *node = &desc->nodes[i];
+            FMOD::DSPConnection *connection = 0;
+
+            if (node->source == EFFECT_GRAPH_SERIES)
+            {
+                continue;
+            }
+
+            result = chain->dsps[i]->addInput(node->source == EFFECT_GRAPH_INPUT ? input : chain->dsps[node->source]);
+            if (result == FMOD_OK)
+            {
+                result = chain->mixer->addInput(chain->dsps[i], &connection);
+            }
+            if (result == FMOD_OK)
+            {
+                result = connection->setMix(node->level);
+            }
+        }
+    }
+
+    if (result != FMOD_OK)
+    {
+        /*
+            Take back out whatever got in, the first error is the one worth reporting.
+        */
+        detach(chain);
+        m_detached--;
+        return result;
+    }
+
+    m_attached++;
+    return FMOD_OK;
+}
+
+FMOD_RESULT EffectGraph::reconfigure(EffectChain *chain, const EffectChainDesc *desc)
+{
+    FMOD::ChannelControl *target;
+    FMOD_RESULT result;
+
+    if (!chain || !chain->target)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    result = validate(desc);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    target = chain->target;
+
+    result = detach(chain);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    return attach(target, desc, chain);
+}
+
+void EffectGraph::getStats(EffectGraphStats *stats) const
+{
+    stats->attached = m_attached;
+    stats->detached = m_detached;
+    stats->hits = m_hits;
+    stats->misses = m_misses;
+    stats->released = m_released;
+    stats->free = 0;
+    stats->reserved = 0;
+
+    for (int type = 0; type < EFFECT_GRAPH_NUM_TYPES; type++)
+    {
+        stats->free += m_pools[type].numfree;
+        stats->reserved += m_pools[type].capacity;
+    }
+}
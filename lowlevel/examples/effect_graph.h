@@ -0,0 +1,139 @@
+/*==============================================================================
+Effect Graph
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Builds effect chains on channels and channel groups from a description, out
+of DSP units created ahead of time. Creating a DSP allocates, so adding and
+removing effects per event instance with System::createDSPByType and
+DSP::release allocates on every change. Here each type has a pool filled by
+reserve, attach takes units from the pools and wires them in, and detach
+unwires them, calls DSP::reset to clear delay lines and filter state, puts
+back any parameters the chain changed and returns them to their pools.
+
+A chain is a list of nodes. Series nodes go into the target's DSP chain with
+ChannelControl::addDSP, in signal order. Send nodes run in parallel: each is
+fed by the chain's input or by an earlier series node, and is mixed back in
+at the end of the chain through a mixer unit that is added after the last
+series node, the same wiring dsp_effect_per_speaker does by hand.
+
+If a pool is empty when attach needs a unit, that's a miss and one is
+created on the spot. When it's detached it's kept if the pool has room for
+it and released otherwise, so reserve enough for the chains alive at once.
+
+Everything here must be called from the same thread as System::update.
+==============================================================================*/
+#ifndef _EFFECT_GRAPH_H
+#define _EFFECT_GRAPH_H
+
+#include "fmod.hpp"
+
+#define EFFECT_GRAPH_MAX_NODES      8
+#define EFFECT_GRAPH_MAX_PARAMS     4       /* Set on each node by attach. */
+#define EFFECT_GRAPH_MAX_DEFAULTS   16      /* Parameters of each type that detach can put back. */
+#define EFFECT_GRAPH_NUM_TYPES      (FMOD_DSP_TYPE_ENVELOPEFOLLOWER + 1)
+
+#define EFFECT_GRAPH_SERIES         -2      /* EffectNodeDesc::source for a node in line. */
+#define EFFECT_GRAPH_INPUT          -1      /* EffectNodeDesc::source for a send fed by the chain's input. */
+
+struct EffectParam
+{
+    int                 index;
+    float               value;
+};
+
+struct EffectNodeDesc
+{
+    FMOD_DSP_TYPE       type;
+    int                 source;             /* EFFECT_GRAPH_SERIES, EFFECT_GRAPH_INPUT or the index of an earlier series node. */
+    float               level;              /* Sends only, where they join the chain. */
+    int                 numparams;
+    EffectParam         params[EFFECT_GRAPH_MAX_PARAMS];
+};
+
+struct EffectChainDesc
+{
+    const char         *name;
+    int                 numnodes;
+    EffectNodeDesc      nodes[EFFECT_GRAPH_MAX_NODES];
+};
+
+/*
+    A chain as attached. Owned by the caller, the descriptions must outlive it.
+*/
+struct EffectChain
+{
+    FMOD::ChannelControl   *target;         /* 0 = not attached. */
+    const EffectChainDesc  *desc;
+    FMOD::DSP              *dsps[EFFECT_GRAPH_MAX_NODES];
+    FMOD::DSP              *mixer;          /* Where the sends join, 0 if there are none. */
+};
+
+struct EffectGraphStats
+{
+    unsigned int    attached;       /* Chains. */
+    unsigned int    detached;
+    unsigned int    hits;           /* Units taken from a pool. */
+    unsigned int    misses;         /* Units created because their pool was empty. */
+    unsigned int    released;       /* Units released because their pool was full. */
+    int             free;           /* Units in the pools right now. */
+    int             reserved;
+};
+
+struct EffectGraphPool
+{
+    FMOD::DSP     **free;
+    int             numfree;
+    int             capacity;
+    int             numdefaults;    /* 0 until a unit of this type has been created. */
+    float           defaults[EFFECT_GRAPH_MAX_DEFAULTS];
+    bool            isfloat[EFFECT_GRAPH_MAX_DEFAULTS];
+};
+
+class EffectGraph
+{
+public:
+    EffectGraph();
+
+    FMOD_RESULT init(FMOD::System *system);
+    FMOD_RESULT release();                  /* Detach every chain first. */
+
+    /*
+        Creates 'count' more units of a type. The only calls here that allocate, other than on a miss.
+    */
+    FMOD_RESULT reserve(FMOD_DSP_TYPE type, int count);
+
+    /*
+        Enough units of every type 'desc' uses for 'instances' of it attached at once, on top of what's
+        reserved already.
+    */
+    FMOD_RESULT reserve(const EffectChainDesc *desc, int instances);
+
+    FMOD_RESULT attach(FMOD::ChannelControl *target, const EffectChainDesc *desc, EffectChain *chain);
+    FMOD_RESULT detach(EffectChain *chain);
+
+    /*
+        Swaps an attached chain for another on the same target.
+    */
+    FMOD_RESULT reconfigure(EffectChain *chain, const EffectChainDesc *desc);
+
+    void        getStats(EffectGraphStats *stats) const;
+
+    static FMOD_RESULT validate(const EffectChainDesc *desc);
+
+private:
+    FMOD_RESULT acquire(FMOD_DSP_TYPE type, FMOD::DSP **dsp);
+    FMOD_RESULT recycle(FMOD_DSP_TYPE type, FMOD::DSP *dsp, const EffectNodeDesc *node);
+    FMOD_RESULT create(FMOD_DSP_TYPE type, FMOD::DSP **dsp);
+    FMOD_RESULT unwire(EffectChain *chain);
+
+    FMOD::System       *m_system;
+    EffectGraphPool     m_pools[EFFECT_GRAPH_NUM_TYPES];
+
+    unsigned int        m_attached;
+    unsigned int        m_detached;
+    unsigned int        m_hits;
+    unsigned int        m_misses;
+    unsigned int        m_released;
+};
+
+#endif
@@ -8,26 +8,163 @@ would be filtered in the same way. To filter per channel, and not have other
 channels affected, simply apply the same functions to the FMOD::Channel instead
 of the FMOD::ChannelGroup.
 
-Note in this example you don't have to add and remove units each time, you could
-simply add them all at the start then use DSP::setActive to toggle them on and
-off.
+The effects come from an EffectGraph (see effect_graph.h) rather than being
+created and released as they're needed. Each toggle rebuilds the chain from a
+description, and the units are taken from pools filled at startup, so
+changing the chain doesn't allocate.
+
+There is also a benchmark that plays the sound on a number of channels and
+swaps the chain on each of them over and over while they're mixing, once with
+the pools filled and once with them empty, which is the same as creating and
+releasing units every time.
 ==============================================================================*/
 #include "fmod.hpp"
 #include "common.h"
+#include "effect_graph.h"
+#include "monotonic_clock.h"
+#include <string.h>
+
+#define NUM_EFFECTS         4
+#define BENCHMARK_VOICES    16
+#define BENCHMARK_ROUNDS    32      /* Chain changes per voice. */
+
+/*
+    What each toggle adds, in the order they go into the chain.
+*/
+static const EffectNodeDesc EFFECT_NODES[NUM_EFFECTS] =
+{
+    { FMOD_DSP_TYPE_LOWPASS,  EFFECT_GRAPH_SERIES, 1.0f, 0, { { 0, 0.0f } } },
+    { FMOD_DSP_TYPE_HIGHPASS, EFFECT_GRAPH_SERIES, 1.0f, 0, { { 0, 0.0f } } },
+    { FMOD_DSP_TYPE_ECHO,     EFFECT_GRAPH_SERIES, 1.0f, 1, { { FMOD_DSP_ECHO_DELAY, 50.0f } } },
+    { FMOD_DSP_TYPE_FLANGE,   EFFECT_GRAPH_SERIES, 1.0f, 0, { { 0, 0.0f } } },
+};
+
+/*
+    The chains the benchmark switches between, the sorts of things an event might put on itself.
+*/
+static const EffectChainDesc BENCHMARK_CHAINS[] =
+{
+    { "dry", 0, { { FMOD_DSP_TYPE_UNKNOWN, 0, 0.0f, 0, { { 0, 0.0f } } } } },
+    { "radio", 3,
+        {
+            { FMOD_DSP_TYPE_HIGHPASS,   EFFECT_GRAPH_SERIES, 1.0f, 1, { { FMOD_DSP_HIGHPASS_CUTOFF, 800.0f } } },
+            { FMOD_DSP_TYPE_DISTORTION, EFFECT_GRAPH_SERIES, 1.0f, 1, { { FMOD_DSP_DISTORTION_LEVEL, 0.3f } } },
+            { FMOD_DSP_TYPE_LOWPASS,    EFFECT_GRAPH_SERIES, 1.0f, 1, { { FMOD_DSP_LOWPASS_CUTOFF, 3000.0f } } },
+        }
+    },
+    { "muffled", 2,
+        {
+            { FMOD_DSP_TYPE_LOWPASS,    EFFECT_GRAPH_SERIES, 1.0f, 1, { { FMOD_DSP_LOWPASS_CUTOFF, 1000.0f } } },
+            { FMOD_DSP_TYPE_CHORUS,     EFFECT_GRAPH_INPUT,  0.5f, 1, { { FMOD_DSP_CHORUS_DEPTH, 60.0f } } },
+        }
+    },
+    { "hall", 3,
+        {
+            { FMOD_DSP_TYPE_LOWPASS,    EFFECT_GRAPH_SERIES, 1.0f, 1, { { FMOD_DSP_LOWPASS_CUTOFF, 8000.0f } } },
+            { FMOD_DSP_TYPE_ECHO,       0,                   0.4f, 2, { { FMOD_DSP_ECHO_DELAY, 120.0f }, { FMOD_DSP_ECHO_DRYLEVEL, -80.0f } } },
+            { FMOD_DSP_TYPE_FLANGE,     EFFECT_GRAPH_INPUT,  0.2f, 0, { { 0, 0.0f } } },
+        }
+    },
+};
+
+#define NUM_BENCHMARK_CHAINS (int)(sizeof(BENCHMARK_CHAINS) / sizeof(BENCHMARK_CHAINS[0]))
+
+struct BenchmarkResult
+{
+    float           average;        /* Microseconds per chain change. */
+    float           worst;
+    unsigned int    misses;
+};
+
+/*
+    Swaps the chain on every voice each round, with System::update between rounds so the mixer keeps going.
+*/
+static void Effects_Benchmark(FMOD::System *system, EffectGraph *graph, FMOD::Channel **voices, BenchmarkResult *out)
+{
+    EffectChain chains[BENCHMARK_VOICES];
+    EffectGraphStats before, after;
+    double total = 0.0;
+    double worst = 0.0;
+    FMOD_RESULT result;
+
+    graph->getStats(&before);
+
+    for (int i = 0; i < BENCHMARK_VOICES; i++)
+    {
+        result = graph->attach(voices[i], &BENCHMARK_CHAINS[0], &chains[i]);
+        ERRCHECK(result);
+    }
+
+    for (int round = 1; round <= BENCHMARK_ROUNDS; round++)
+    {
+        for (int i = 0; i < BENCHMARK_VOICES; i++)
+        {
+            double start = MonotonicClock_Now();
+
+            result = graph->reconfigure(&chains[i], &BENCHMARK_CHAINS[(round + i) % NUM_BENCHMARK_CHAINS]);
+            ERRCHECK(result);
+
+            double elapsed = MonotonicClock_Now() - start;
+            total += elapsed;
+            if (elapsed > worst)
+            {
+                worst = elapsed;
+            }
+        }
+
+        result = system->update();
+        ERRCHECK(result);
+    }
+
+    for (int i = 0; i < BENCHMARK_VOICES; i++)
+    {
+        result = graph->detach(&chains[i]);
+        ERRCHECK(result);
+    }
+
+    graph->getStats(&after);
+
+    out->average = (float)(total * 1e6 / (BENCHMARK_ROUNDS * BENCHMARK_VOICES));
+    out->worst = (float)(worst * 1e6);
+    out->misses = after.misses - before.misses;
+}
+
+/*
+    Writes the chain for the toggles into 'desc'.
+*/
+static void Effects_Describe(const bool *enabled, EffectChainDesc *desc)
+{
+    desc->name = "toggles";
+    desc->numnodes = 0;
+
+    for (int i = 0; i < NUM_EFFECTS; i++)
+    {
+        if (enabled[i])
+        {
+            desc->nodes[desc->numnodes++] = EFFECT_NODES[i];
+        }
+    }
+}
 
 int FMOD_Main()
 {
     FMOD::System       *system        = 0;
     FMOD::Sound        *sound         = 0;
     FMOD::Channel      *channel       = 0;
-    FMOD::ChannelGroup *mastergroup   = 0; 
-    FMOD::DSP          *dsplowpass    = 0;
-    FMOD::DSP          *dsphighpass   = 0;
-    FMOD::DSP          *dspecho       = 0;
-    FMOD::DSP          *dspflange     = 0;
+    FMOD::ChannelGroup *mastergroup   = 0;
     FMOD_RESULT         result;
     unsigned int        version;
     void               *extradriverdata = 0;
+    EffectGraph         graph;
+    EffectGraph         unpooled;
+    EffectChain         chain;
+    EffectChainDesc     descs[2];       /* The chain keeps pointing at its description, so switch between two. */
+    int                 current         = 0;
+    bool                enabled[NUM_EFFECTS] = { false, false, false, false };
+    float               lastchange      = 0.0f;
+    bool                benchmarked     = false;
+    BenchmarkResult     pooledresult;
+    BenchmarkResult     unpooledresult;
 
     Common_Init(&extradriverdata);
 
@@ -51,22 +188,35 @@ int FMOD_Main()
     result = system->getMasterChannelGroup(&mastergroup);
     ERRCHECK(result);
 
-    result = system->createSound(Common_MediaPath("drumloop.wav"), FMOD_SOFTWARE, 0, &sound);
+    result = system->createSound(Common_MediaPath("drumloop.wav"), FMOD_SOFTWARE | FMOD_LOOP_NORMAL, 0, &sound);
     ERRCHECK(result);
 
     result = system->playSound(sound, 0, false, &channel);
     ERRCHECK(result);
 
     /*
-        Create some effects to play with
+        Create the effects to play with up front. One of each for the master group, and enough for every
+        benchmark voice to be on any of the benchmark chains, which is more than it needs. The second graph
+        gets nothing, so every unit it hands out is created and released on the spot.
     */
-    result = system->createDSPByType(FMOD_DSP_TYPE_LOWPASS, &dsplowpass);
-    ERRCHECK(result);
-    result = system->createDSPByType(FMOD_DSP_TYPE_HIGHPASS, &dsphighpass);
+    result = graph.init(system);
     ERRCHECK(result);
-    result = system->createDSPByType(FMOD_DSP_TYPE_ECHO, &dspecho);
+    result = unpooled.init(system);
     ERRCHECK(result);
-    result = system->createDSPByType(FMOD_DSP_TYPE_FLANGE, &dspflange);
+
+    for (int i = 0; i < NUM_EFFECTS; i++)
+    {
+        result = graph.reserve(EFFECT_NODES[i].type, 1);
+        ERRCHECK(result);
+    }
+    for (int i = 0; i < NUM_BENCHMARK_CHAINS; i++)
+    {
+        result = graph.reserve(&BENCHMARK_CHAINS[i], BENCHMARK_VOICES);
+        ERRCHECK(result);
+    }
+
+    Effects_Describe(enabled, &descs[current]);
+    result = graph.attach(mastergroup, &descs[current], &chain);
     ERRCHECK(result);
 
     /*
@@ -74,6 +224,8 @@ int FMOD_Main()
     */
     do
     {
+        bool changed = false;
+
         Common_Update();
 
         if (Common_BtnPress(BTN_MORE))
@@ -89,81 +241,49 @@ int FMOD_Main()
             ERRCHECK(result);
         }
 
-        if (Common_BtnPress(BTN_ACTION1))
+        for (int i = 0; i < NUM_EFFECTS; i++)
         {
-            bool active;
-
-            result = dsplowpass->getActive(&active);
-            ERRCHECK(result);
-
-            if (active)
+            if (Common_BtnPress((Common_Button)(BTN_ACTION1 + i)))
             {
-                result = mastergroup->removeDSP(dsplowpass);
-                ERRCHECK(result);
-            }
-            else
-            {
-                result = mastergroup->addDSP(0, dsplowpass, 0);
-                ERRCHECK(result);
+                enabled[i] = !enabled[i];
+                changed = true;
             }
         }
 
-        if (Common_BtnPress(BTN_ACTION2))
+        if (changed)
         {
-            bool active;
+            current = 1 - current;
+            Effects_Describe(enabled, &descs[current]);
+
+            double start = MonotonicClock_Now();
 
-            result = dsphighpass->getActive(&active);
+            result = graph.reconfigure(&chain, &descs[current]);
             ERRCHECK(result);
 
-            if (active)
-            {
-                result = mastergroup->removeDSP(dsphighpass);
-                ERRCHECK(result);
-            }
-            else
-            {
-                result = mastergroup->addDSP(0, dsphighpass, 0);
-                ERRCHECK(result);
-            }
+            lastchange = (float)((MonotonicClock_Now() - start) * 1e6);
         }
 
-        if (Common_BtnPress(BTN_ACTION3))
+        if (Common_BtnPress(BTN_UP))
         {
-            bool active;
-
-            result = dspecho->getActive(&active);
-            ERRCHECK(result);
+            FMOD::Channel *voices[BENCHMARK_VOICES];
 
-            if (active)
+            for (int i = 0; i < BENCHMARK_VOICES; i++)
             {
-                result = mastergroup->removeDSP(dspecho);
+                result = system->playSound(sound, 0, true, &voices[i]);
                 ERRCHECK(result);
-            }
-            else
-            {
-                result = mastergroup->addDSP(0, dspecho, 0);
+                result = voices[i]->setVolume(1.0f / BENCHMARK_VOICES);
                 ERRCHECK(result);
-
-                result = dspecho->setParameterFloat(FMOD_DSP_ECHO_DELAY, 50.0f);
+                result = voices[i]->setPaused(false);
                 ERRCHECK(result);
             }
-        }
 
-        if (Common_BtnPress(BTN_ACTION4))
-        {
-            bool active;
+            Effects_Benchmark(system, &graph, voices, &pooledresult);
+            Effects_Benchmark(system, &unpooled, voices, &unpooledresult);
+            benchmarked = true;
 
-            result = dspflange->getActive(&active);
-            ERRCHECK(result);
-
-            if (active)
-            {
-                result = mastergroup->removeDSP(dspflange);
-                ERRCHECK(result);
-            }
-            else
+            for (int i = 0; i < BENCHMARK_VOICES; i++)
             {
-                result = mastergroup->addDSP(0, dspflange, 0);
+                result = voices[i]->stop();
                 ERRCHECK(result);
             }
         }
@@ -173,15 +293,9 @@ int FMOD_Main()
 
         {
             bool paused = 0;
-            bool dsplowpass_active;
-            bool dsphighpass_active;
-            bool dspecho_active;
-            bool dspflange_active;
+            EffectGraphStats stats;
 
-            dsplowpass   ->getActive(&dsplowpass_active);
-            dsphighpass  ->getActive(&dsphighpass_active);
-            dspecho      ->getActive(&dspecho_active);
-            dspflange    ->getActive(&dspflange_active);
+            graph.getStats(&stats);
 
             if (channel)
             {
@@ -202,14 +316,22 @@ int FMOD_Main()
             Common_Draw("Press %s to toggle dsphighpass effect", Common_BtnStr(BTN_ACTION2));
             Common_Draw("Press %s to toggle dspecho effect", Common_BtnStr(BTN_ACTION3));
             Common_Draw("Press %s to toggle dspflange effect", Common_BtnStr(BTN_ACTION4));
+            Common_Draw("Press %s to benchmark changing chains on %d channels", Common_BtnStr(BTN_UP), BENCHMARK_VOICES);
             Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
             Common_Draw("");
-            Common_Draw("%s : lowpass[%c] highpass[%c] echo[%c] flange[%c]", 
+            Common_Draw("%s : lowpass[%c] highpass[%c] echo[%c] flange[%c]",
                     paused              ? "Paused " : "Playing",
-                    dsplowpass_active   ? 'x' : ' ',
-                    dsphighpass_active  ? 'x' : ' ',
-                    dspecho_active      ? 'x' : ' ',
-                    dspflange_active    ? 'x' : ' ');
+                    enabled[0]          ? 'x' : ' ',
+                    enabled[1]          ? 'x' : ' ',
+                    enabled[2]          ? 'x' : ' ',
+                    enabled[3]          ? 'x' : ' ');
+            Common_Draw("Last change %.1f us, units %d of %d free, %u misses", lastchange, stats.free, stats.reserved, stats.misses);
+            if (benchmarked)
+            {
+                Common_Draw("");
+                Common_Draw("Pooled   : %6.1f us average, %6.1f us worst, %u misses", pooledresult.average, pooledresult.worst, pooledresult.misses);
+                Common_Draw("Unpooled : %6.1f us average, %6.1f us worst, %u misses", unpooledresult.average, unpooledresult.worst, unpooledresult.misses);
+            }
         }
 
         Common_Sleep(50);
@@ -218,6 +340,12 @@ int FMOD_Main()
     /*
         Shut down
     */
+    result = graph.detach(&chain);
+    ERRCHECK(result);
+    result = graph.release();
+    ERRCHECK(result);
+    result = unpooled.release();
+    ERRCHECK(result);
     result = sound->release();
     ERRCHECK(result);
     result = system->close();
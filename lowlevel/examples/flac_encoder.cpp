@@ -0,0 +1,1148 @@
+/*==============================================================================
+FLAC Encoder
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "flac_encoder.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    FLAC_FRAME_FREE,
+    FLAC_FRAME_QUEUED,
+    FLAC_FRAME_DONE
+};
+
+enum
+{
+    FLAC_SUBFRAME_CONSTANT,
+    FLAC_SUBFRAME_VERBATIM,
+    FLAC_SUBFRAME_FIXED,
+    FLAC_SUBFRAME_LPC
+};
+
+enum
+{
+    FLAC_CHANNELS_INDEPENDENT,
+    FLAC_CHANNELS_LEFT_SIDE,
+    FLAC_CHANNELS_SIDE_RIGHT,
+    FLAC_CHANNELS_MID_SIDE
+};
+
+#define FLAC_MAX_PARTITION_ORDER    8
+#define FLAC_MAX_FIXED_ORDER        4
+#define FLAC_RICE_PARAMETER_BITS    5
+
+struct FlacEncoderFrame
+{
+    FlacEncoder    *encoder;
+    WorkerJob       job;
+    int             state;
+    unsigned int    number;
+    unsigned int    blocksize;
+    int            *samples[FLAC_ENCODER_MAX_CHANNELS];
+    int            *mid;
+    int            *side;
+    int            *residual;
+    double         *windowed;       /* LPC analysis scratch. */
+    unsigned char  *output;
+    unsigned int    outputbytes;
+};
+
+struct FlacSubframePlan
+{
+    int             type;
+    int             order;
+    int             precision;
+    int             shift;
+    int             coefs[FLAC_ENCODER_MAX_LPC_ORDER];
+    int             partitionorder;
+    unsigned int    bits;
+};
+
+/*
+    CRC tables, built once from FlacEncoder::open before any worker touches them. Several encoders can be opened at
+    once from different threads, so only the first one in builds them.
+*/
+static unsigned char  gFlacCRC8[256];
+static unsigned short gFlacCRC16[256];
+static pthread_once_t gFlacCRCOnce = PTHREAD_ONCE_INIT;
+
+static void flacBuildCRC()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        unsigned int crc8 = i;
+        unsigned int crc16 = i << 8;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc8 = (crc8 & 0x80) ? ((crc8 << 1) ^ 0x07) : (crc8 << 1);
+            crc16 = (crc16 & 0x8000) ? ((crc16 << 1) ^ 0x8005) : (crc16 << 1);
+        }
+        gFlacCRC8[i] = (unsigned char)crc8;
+        gFlacCRC16[i] = (unsigned short)crc16;
+    }
+}
+
+static void flacInitCRC()
+{
+    pthread_once(&gFlacCRCOnce, flacBuildCRC);
+}
+
+static unsigned char flacCRC8(const unsigned char *data, unsigned int length)
+{
+    unsigned char crc = 0;
+    while (length--)
+    {
+        crc = gFlacCRC8[crc ^ *data++];
+    }
+    return crc;
+}
+
+static unsigned short flacCRC16(const unsigned char *data, unsigned int length)
+{
+    unsigned short crc = 0;
+    while (length--)
+    {
+        crc = (unsigned short)((crc << 8) ^ gFlacCRC16[(crc >> 8) ^ *data++]);
+    }
+    return crc;
+}
+
+/*
+    MSB first bit writer.  The caller guarantees the buffer is big enough, see FLAC_FRAME_BYTES.
+*/
+class FlacBitWriter
+{
+public:
+    FlacBitWriter(unsigned char *data) : m_data(data), m_bytes(0), m_accum(0), m_bits(0) { }
+
+    void writeBits(unsigned int value, int bits)
+    {
+        if (bits == 0)
+        {
+            return;
+        }
+        m_accum = (m_accum << bits) | (value & (0xFFFFFFFFu >> (32 - bits)));
+        m_bits += bits;
+        while (m_bits >= 8)
+        {
+            m_bits -= 8;
+            m_data[m_bytes++] = (unsigned char)(m_accum >> m_bits);
+        }
+    }
+
+    void writeZeros(unsigned int count)
+    {
+        while (count > 24)
+        {
+            writeBits(0, 24);
+            count -= 24;
+        }
+        writeBits(0, count);
+    }
+
+    void alignToByte()
+    {
+        if (m_bits)
+        {
+            writeBits(0, 8 - m_bits);
+        }
+    }
+
+    unsigned int   bytes() const { return m_bytes; }
+    unsigned char *data() const { return m_data; }
+
+private:
+    unsigned char      *m_data;
+    unsigned int        m_bytes;
+    unsigned long long  m_accum;
+    int                 m_bits;
+};
+
+#define FLAC_FRAME_BYTES(_blocksize, _channels) ((_blocksize) * (_channels) * 4 + (_channels) * 64 + 64)
+
+static inline unsigned int flacZigZag(int value)
+{
+    return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+/*
+    Residual generators.  The first 'order' entries of residual are left untouched.
+*/
+static void flacFixedResidual(const int *x, unsigned int n, int order, int *residual)
+{
+    unsigned int i;
+
+    switch (order)
+    {
+        case 0:
+            for (i = 0; i < n; i++) residual[i] = x[i];
+            break;
+        case 1:
+            for (i = 1; i < n; i++) residual[i] = x[i] - x[i-1];
+            break;
+        case 2:
+            for (i = 2; i < n; i++) residual[i] = x[i] - 2 * x[i-1] + x[i-2];
+            break;
+        case 3:
+            for (i = 3; i < n; i++) residual[i] = x[i] - 3 * x[i-1] + 3 * x[i-2] - x[i-3];
+            break;
+        case 4:
+            for (i = 4; i < n; i++) residual[i] = x[i] - 4 * x[i-1] + 6 * x[i-2] - 4 * x[i-3] + x[i-4];
+            break;
+    }
+}
+
+static void flacLPCResidual(const int *x, unsigned int n, const int *coefs, int order, int shift, int *residual)
+{
+    for (unsigned int i = order; i < n; i++)
+    {
+        long long sum = 0;
+        for (int j = 0; j < order; j++)
+        {
+            sum += (long long)coefs[j] * x[i - 1 - j];
+        }
+        residual[i] = x[i] - (int)(sum >> shift);
+    }
+}
+
+/*
+    Rice coding.  Parameters are chosen from the sum of zigzagged residuals in each partition.
+*/
+static int flacRiceParameter(unsigned long long sum, unsigned int count)
+{
+    int k = 0;
+    while (k < 30 && ((unsigned long long)count << (k + 1)) < sum)
+    {
+        k++;
+    }
+    return k;
+}
+
+static unsigned int flacPartitionCount(unsigned int blocksize, int partitionorder, int partition, int predictororder)
+{
+    unsigned int count = blocksize >> partitionorder;
+    return (partition == 0) ? count - predictororder : count;
+}
+
+/*
+    Pick a partition order from estimated costs, then return the exact size of the residual in bits.
+*/
+static unsigned int flacPlanResidual(const int *residual, unsigned int blocksize, int predictororder, int *partitionorder)
+{
+    unsigned long long sums[1 << FLAC_MAX_PARTITION_ORDER];
+    int maxorder = 0;
+
+    while (maxorder < FLAC_MAX_PARTITION_ORDER &&
+           ((blocksize >> (maxorder + 1)) << (maxorder + 1)) == blocksize &&
+           (int)(blocksize >> (maxorder + 1)) > predictororder)
+    {
+        maxorder++;
+    }
+
+    /*
+        Sums at the finest partition order, coarser orders are built by merging neighbours.
+    */
+    {
+        int partitions = 1 << maxorder;
+        unsigned int size = blocksize >> maxorder;
+        unsigned int i = predictororder;
+
+        for (int p = 0; p < partitions; p++)
+        {
+            unsigned long long sum = 0;
+            unsigned int end = (p + 1) * size;
+            for (; i < end; i++)
+            {
+                sum += flacZigZag(residual[i]);
+            }
+            sums[p] = sum;
+        }
+    }
+
+    unsigned long long bestbits = ~0ULL;
+    int bestorder = 0;
+
+    for (int order = maxorder; order >= 0; order--)
+    {
+        int partitions = 1 << order;
+        unsigned long long bits = 0;
+
+        for (int p = 0; p < partitions; p++)
+        {
+            unsigned int count = flacPartitionCount(blocksize, order, p, predictororder);
+            int k = flacRiceParameter(sums[p], count);
+            bits += FLAC_RICE_PARAMETER_BITS + (unsigned long long)count * (k + 1) + (sums[p] >> k);
+        }
+
+        if (bits < bestbits)
+        {
+            bestbits = bits;
+            bestorder = order;
+        }
+
+        if (order)
+        {
+            for (int p = 0; p < partitions / 2; p++)
+            {
+                sums[p] = sums[2 * p] + sums[2 * p + 1];
+            }
+        }
+    }
+
+    /*
+        Exact cost for the chosen layout, so a subframe never ends up bigger than verbatim.
+    */
+    {
+        unsigned long long bits = 2 + 4;
+        int partitions = 1 << bestorder;
+        unsigned int size = blocksize >> bestorder;
+        unsigned int i = predictororder;
+
+        for (int p = 0; p < partitions; p++)
+        {
+            unsigned long long sum = 0;
+            unsigned int end = (p + 1) * size;
+            for (unsigned int j = i; j < end; j++)
+            {
+                sum += flacZigZag(residual[j]);
+            }
+
+            unsigned int count = flacPartitionCount(blocksize, bestorder, p, predictororder);
+            int k = flacRiceParameter(sum, count);
+            bits += FLAC_RICE_PARAMETER_BITS + (unsigned long long)count * (k + 1);
+            for (; i < end; i++)
+            {
+                bits += flacZigZag(residual[i]) >> k;
+            }
+        }
+
+        *partitionorder = bestorder;
+        return (bits > 0xFFFFFFFFULL) ? 0xFFFFFFFFu : (unsigned int)bits;
+    }
+}
+
+static void flacWriteResidual(FlacBitWriter *bw, const int *residual, unsigned int blocksize, int predictororder, int partitionorder)
+{
+    int partitions = 1 << partitionorder;
+    unsigned int size = blocksize >> partitionorder;
+    int params[1 << FLAC_MAX_PARTITION_ORDER];
+    bool wide = false;
+    unsigned int i = predictororder;
+
+    for (int p = 0; p < partitions; p++)
+    {
+        unsigned long long sum = 0;
+        unsigned int end = (p + 1) * size;
+        for (; i < end; i++)
+        {
+            sum += flacZigZag(residual[i]);
+        }
+        params[p] = flacRiceParameter(sum, flacPartitionCount(blocksize, partitionorder, p, predictororder));
+        wide |= (params[p] > 14);
+    }
+
+    bw->writeBits(wide ? 1 : 0, 2);
+    bw->writeBits(partitionorder, 4);
+
+    i = predictororder;
+    for (int p = 0; p < partitions; p++)
+    {
+        int k = params[p];
+        unsigned int end = (p + 1) * size;
+
+        bw->writeBits(k, wide ? 5 : 4);
+        for (; i < end; i++)
+        {
+            unsigned int u = flacZigZag(residual[i]);
+            bw->writeZeros(u >> k);
+            bw->writeBits(1, 1);
+            bw->writeBits(u, k);
+        }
+    }
+}
+
+/*
+    LPC analysis.  Welch windowed autocorrelation followed by Levinson-Durbin.  windowed is scratch space of n entries.
+*/
+static int flacComputeLPC(const int *x, unsigned int n, int maxorder, double *windowed, double lpc[FLAC_ENCODER_MAX_LPC_ORDER][FLAC_ENCODER_MAX_LPC_ORDER])
+{
+    double autoc[FLAC_ENCODER_MAX_LPC_ORDER + 1];
+    double half = (n - 1) / 2.0;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        double w = (i - half) / (half + 1.0);
+        windowed[i] = x[i] * (1.0 - w * w);
+    }
+
+    for (int lag = 0; lag <= maxorder; lag++)
+    {
+        double sum = 0;
+        for (unsigned int i = lag; i < n; i++)
+        {
+            sum += windowed[i] * windowed[i - lag];
+        }
+        autoc[lag] = sum;
+    }
+
+    if (autoc[0] == 0.0)
+    {
+        return 0;
+    }
+
+    double error = autoc[0];
+    double current[FLAC_ENCODER_MAX_LPC_ORDER];
+
+    for (int order = 0; order < maxorder; order++)
+    {
+        double r = -autoc[order + 1];
+        for (int j = 0; j < order; j++)
+        {
+            r -= current[j] * autoc[order - j];
+        }
+        r /= error;
+
+        current[order] = r;
+        for (int j = 0; j < order / 2; j++)
+        {
+            double tmp = current[j];
+            current[j] += r * current[order - 1 - j];
+            current[order - 1 - j] += r * tmp;
+        }
+        if (order & 1)
+        {
+            current[order / 2] += current[order / 2] * r;
+        }
+
+        error *= (1.0 - r * r);
+
+        for (int j = 0; j <= order; j++)
+        {
+            lpc[order][j] = -current[j];
+        }
+
+        if (error <= 0.0)
+        {
+            return order + 1;
+        }
+    }
+
+    return maxorder;
+}
+
+static bool flacQuantizeLPC(const double *lpc, int order, int precision, int *coefs, int *shift)
+{
+    double cmax = 0.0;
+    for (int i = 0; i < order; i++)
+    {
+        double a = fabs(lpc[i]);
+        if (a > cmax)
+        {
+            cmax = a;
+        }
+    }
+    if (cmax <= 0.0)
+    {
+        return false;
+    }
+
+    int log2cmax;
+    frexp(cmax, &log2cmax);
+    log2cmax--;
+
+    int s = (precision - 1) - log2cmax - 1;
+    if (s > 15)
+    {
+        s = 15;
+    }
+    if (s < 0)
+    {
+        return false;
+    }
+
+    int qmax = (1 << (precision - 1)) - 1;
+    int qmin = -(1 << (precision - 1));
+    double error = 0.0;
+
+    for (int i = 0; i < order; i++)
+    {
+        error += lpc[i] * (1 << s);
+        int q = (int)floor(error + 0.5);
+        if (q > qmax) q = qmax;
+        if (q < qmin) q = qmin;
+        error -= q;
+        coefs[i] = q;
+    }
+
+    *shift = s;
+    return true;
+}
+
+/*
+    Find the cheapest encoding for one channel.  residual and windowed are scratch space of blocksize entries.
+*/
+static void flacPlanSubframe(const int *x, unsigned int n, int bits, int *residual, double *windowed, FlacSubframePlan *plan)
+{
+    plan->type = FLAC_SUBFRAME_VERBATIM;
+    plan->order = 0;
+    plan->bits = 8 + n * bits;
+
+    {
+        bool constant = true;
+        for (unsigned int i = 1; i < n && constant; i++)
+        {
+            constant = (x[i] == x[0]);
+        }
+        if (constant)
+        {
+            plan->type = FLAC_SUBFRAME_CONSTANT;
+            plan->bits = 8 + bits;
+            return;
+        }
+    }
+
+    for (int order = 0; order <= FLAC_MAX_FIXED_ORDER && order < (int)n; order++)
+    {
+        int partitionorder;
+        flacFixedResidual(x, n, order, residual);
+        unsigned int cost = 8 + order * bits + flacPlanResidual(residual, n, order, &partitionorder);
+        if (cost < plan->bits)
+        {
+            plan->type = FLAC_SUBFRAME_FIXED;
+            plan->order = order;
+            plan->partitionorder = partitionorder;
+            plan->bits = cost;
+        }
+    }
+
+    if (n > FLAC_ENCODER_MAX_LPC_ORDER * 2)
+    {
+        double lpc[FLAC_ENCODER_MAX_LPC_ORDER][FLAC_ENCODER_MAX_LPC_ORDER];
+        int maxorder = flacComputeLPC(x, n, FLAC_ENCODER_MAX_LPC_ORDER, windowed, lpc);
+        int precision = (bits <= 17) ? 12 : 15;
+
+        for (int order = 1; order <= maxorder; order++)
+        {
+            int coefs[FLAC_ENCODER_MAX_LPC_ORDER];
+            int shift;
+            int partitionorder;
+
+            if (!flacQuantizeLPC(lpc[order - 1], order, precision, coefs, &shift))
+            {
+                continue;
+            }
+
+            flacLPCResidual(x, n, coefs, order, shift, residual);
+            unsigned int cost = 8 + order * bits + 4 + 5 + order * precision + flacPlanResidual(residual, n, order, &partitionorder);
+            if (cost < plan->bits)
+            {
+                plan->type = FLAC_SUBFRAME_LPC;
+                plan->order = order;
+                plan->precision = precision;
+                plan->shift = shift;
+                plan->partitionorder = partitionorder;
+                plan->bits = cost;
+                memcpy(plan->coefs, coefs, sizeof(coefs));
+            }
+        }
+    }
+}
+
+static void flacWriteSubframe(FlacBitWriter *bw, const int *x, unsigned int n, int bits, int *residual, const FlacSubframePlan *plan)
+{
+    switch (plan->type)
+    {
+        case FLAC_SUBFRAME_CONSTANT:
+        {
+            bw->writeBits(0x00, 8);
+            bw->writeBits(x[0], bits);
+            break;
+        }
+        case FLAC_SUBFRAME_VERBATIM:
+        {
+            bw->writeBits(0x01 << 1, 8);
+            for (unsigned int i = 0; i < n; i++)
+            {
+                bw->writeBits(x[i], bits);
+            }
+            break;
+        }
+        case FLAC_SUBFRAME_FIXED:
+        {
+            bw->writeBits((0x08 | plan->order) << 1, 8);
+            for (int i = 0; i < plan->order; i++)
+            {
+                bw->writeBits(x[i], bits);
+            }
+            flacFixedResidual(x, n, plan->order, residual);
+            flacWriteResidual(bw, residual, n, plan->order, plan->partitionorder);
+            break;
+        }
+        case FLAC_SUBFRAME_LPC:
+        {
+            bw->writeBits((0x20 | (plan->order - 1)) << 1, 8);
+            for (int i = 0; i < plan->order; i++)
+            {
+                bw->writeBits(x[i], bits);
+            }
+            bw->writeBits(plan->precision - 1, 4);
+            bw->writeBits(plan->shift, 5);
+            for (int i = 0; i < plan->order; i++)
+            {
+                bw->writeBits(plan->coefs[i], plan->precision);
+            }
+            flacLPCResidual(x, n, plan->coefs, plan->order, plan->shift, residual);
+            flacWriteResidual(bw, residual, n, plan->order, plan->partitionorder);
+            break;
+        }
+    }
+}
+
+static void flacWriteUTF8(FlacBitWriter *bw, unsigned int value)
+{
+    if (value < 0x80)
+    {
+        bw->writeBits(value, 8);
+        return;
+    }
+
+    int extra = (value < 0x800) ? 1 : (value < 0x10000) ? 2 : (value < 0x200000) ? 3 : (value < 0x4000000) ? 4 : 5;
+    unsigned int lead = (0xFF00u >> (extra + 1)) & 0xFF;
+
+    bw->writeBits(lead | (value >> (6 * extra)), 8);
+    for (int i = extra - 1; i >= 0; i--)
+    {
+        bw->writeBits(0x80 | ((value >> (6 * i)) & 0x3F), 8);
+    }
+}
+
+static void flacEncodeFrame(FlacEncoderFrame *frame, int channels, int bits)
+{
+    FlacBitWriter bw(frame->output);
+    unsigned int n = frame->blocksize;
+    FlacSubframePlan plans[FLAC_ENCODER_MAX_CHANNELS];
+    const int *sources[FLAC_ENCODER_MAX_CHANNELS];
+    int sourcebits[FLAC_ENCODER_MAX_CHANNELS];
+    int assignment = FLAC_CHANNELS_INDEPENDENT;
+
+    for (int ch = 0; ch < channels; ch++)
+    {
+        flacPlanSubframe(frame->samples[ch], n, bits, frame->residual, frame->windowed, &plans[ch]);
+        sources[ch] = frame->samples[ch];
+        sourcebits[ch] = bits;
+    }
+
+    if (channels == 2)
+    {
+        const int *left = frame->samples[0];
+        const int *right = frame->samples[1];
+        FlacSubframePlan midplan, sideplan;
+
+        for (unsigned int i = 0; i < n; i++)
+        {
+            frame->mid[i] = (left[i] + right[i]) >> 1;
+            frame->side[i] = left[i] - right[i];
+        }
+
+        flacPlanSubframe(frame->mid, n, bits, frame->residual, frame->windowed, &midplan);
+        flacPlanSubframe(frame->side, n, bits + 1, frame->residual, frame->windowed, &sideplan);
+
+        unsigned int independent = plans[0].bits + plans[1].bits;
+        unsigned int leftside    = plans[0].bits + sideplan.bits;
+        unsigned int sideright   = sideplan.bits + plans[1].bits;
+        unsigned int midside     = midplan.bits + sideplan.bits;
+        unsigned int best        = independent;
+
+        if (leftside < best)
+        {
+            best = leftside;
+            assignment = FLAC_CHANNELS_LEFT_SIDE;
+        }
+        if (sideright < best)
+        {
+            best = sideright;
+            assignment = FLAC_CHANNELS_SIDE_RIGHT;
+        }
+        if (midside < best)
+        {
+            best = midside;
+            assignment = FLAC_CHANNELS_MID_SIDE;
+        }
+
+        switch (assignment)
+        {
+            case FLAC_CHANNELS_LEFT_SIDE:
+                plans[1] = sideplan;
+                sources[1] = frame->side;
+                sourcebits[1] = bits + 1;
+                break;
+            case FLAC_CHANNELS_SIDE_RIGHT:
+                plans[0] = sideplan;
+                sources[0] = frame->side;
+                sourcebits[0] = bits + 1;
+                break;
+            case FLAC_CHANNELS_MID_SIDE:
+                plans[0] = midplan;
+                plans[1] = sideplan;
+                sources[0] = frame->mid;
+                sources[1] = frame->side;
+                sourcebits[1] = bits + 1;
+                break;
+        }
+    }
+
+    /*
+        Frame header.  Sample rate comes from STREAMINFO, block size is stored as a 16 bit value.
+    */
+    bw.writeBits(0xFFF8, 16);
+    bw.writeBits(0x7, 4);
+    bw.writeBits(0x0, 4);
+    bw.writeBits((assignment == FLAC_CHANNELS_INDEPENDENT) ? (channels - 1) : (0x7 + assignment), 4);
+    bw.writeBits((bits == 24) ? 0x6 : 0x4, 3);
+    bw.writeBits(0, 1);
+    flacWriteUTF8(&bw, frame->number);
+    bw.writeBits(n - 1, 16);
+    bw.writeBits(flacCRC8(bw.data(), bw.bytes()), 8);
+
+    for (int ch = 0; ch < channels; ch++)
+    {
+        flacWriteSubframe(&bw, sources[ch], n, sourcebits[ch], frame->residual, &plans[ch]);
+    }
+
+    bw.alignToByte();
+    bw.writeBits(flacCRC16(bw.data(), bw.bytes()), 16);
+
+    frame->outputbytes = bw.bytes();
+}
+
+FlacEncoder::FlacEncoder()
+{
+    m_file = 0;
+    m_pool = 0;
+    m_frames = 0;
+    m_num_frames = 0;
+}
+
+FMOD_RESULT FlacEncoder::open(const char *filename, int channels, int samplerate, int bitspersample, WorkerPool *pool)
+{
+    if (channels < 1 || channels > FLAC_ENCODER_MAX_CHANNELS || (bitspersample != 16 && bitspersample != 24) ||
+        samplerate <= 0 || samplerate > 655350 || !pool)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    flacInitCRC();
+
+    m_channels = channels;
+    m_samplerate = samplerate;
+    m_bits = bitspersample;
+    m_pool = pool;
+    m_submitted = 0;
+    m_written = 0;
+    m_fill = 0;
+    m_current = 0;
+    m_flushing = false;
+    m_error = false;
+    m_total_samples = 0;
+    m_stream_bytes = 0;
+    m_dropped = 0;
+    m_min_framesize = 0xFFFFFF;
+    m_max_framesize = 0;
+    m_num_seekpoints = 0;
+    m_seek_interval = (unsigned long long)samplerate * FLAC_ENCODER_SEEK_INTERVAL;
+    m_next_seek = 0;
+
+    /*
+        Two frames per worker keeps every core busy while the previous frames are written out.
+    */
+    m_num_frames = pool->numThreads() * 2 + 2;
+    m_frames = (FlacEncoderFrame *)calloc(m_num_frames, sizeof(FlacEncoderFrame));
+    if (!m_frames)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    unsigned int samplebytes = FLAC_ENCODER_BLOCKSIZE * sizeof(int);
+    unsigned int windowbytes = FLAC_ENCODER_BLOCKSIZE * sizeof(double);
+    unsigned int framebytes = samplebytes * (channels + 3) + windowbytes + FLAC_FRAME_BYTES(FLAC_ENCODER_BLOCKSIZE, channels);
+
+    for (int i = 0; i < m_num_frames; i++)
+    {
+        FlacEncoderFrame *frame = &m_frames[i];
+        unsigned char *mem = (unsigned char *)malloc(framebytes);
+        if (!mem)
+        {
+            close();
+            return FMOD_ERR_MEMORY;
+        }
+
+        frame->encoder = this;
+        frame->job.func = encodeJob;
+        frame->job.arg = frame;
+        frame->state = FLAC_FRAME_FREE;
+        for (int ch = 0; ch < channels; ch++)
+        {
+            frame->samples[ch] = (int *)(mem + samplebytes * ch);
+        }
+        frame->mid = (int *)(mem + samplebytes * channels);
+        frame->side = (int *)(mem + samplebytes * (channels + 1));
+        frame->residual = (int *)(mem + samplebytes * (channels + 2));
+        frame->windowed = (double *)(mem + samplebytes * (channels + 3));
+        frame->output = mem + samplebytes * (channels + 3) + windowbytes;
+    }
+
+    m_file = fopen(filename, "wb");
+    if (!m_file)
+    {
+        close();
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+
+    pthread_mutex_init(&m_lock, 0);
+    pthread_cond_init(&m_frame_free, 0);
+    pool->attach(&m_inbox);
+
+    return writeHeader();
+}
+
+FMOD_RESULT FlacEncoder::writeHeader()
+{
+    unsigned char header[4 + 4 + 34 + 4 + FLAC_ENCODER_SEEKPOINTS * 18];
+    FlacBitWriter bw(header);
+
+    bw.writeBits('f', 8);
+    bw.writeBits('L', 8);
+    bw.writeBits('a', 8);
+    bw.writeBits('C', 8);
+
+    /*
+        STREAMINFO.  The MD5 signature is left as zero which means 'unknown'.
+    */
+    bw.writeBits(0x00, 8);
+    bw.writeBits(34, 24);
+    bw.writeBits(FLAC_ENCODER_BLOCKSIZE, 16);
+    bw.writeBits(FLAC_ENCODER_BLOCKSIZE, 16);
+    bw.writeBits(m_max_framesize ? m_min_framesize : 0, 24);
+    bw.writeBits(m_max_framesize, 24);
+    bw.writeBits(m_samplerate, 20);
+    bw.writeBits(m_channels - 1, 3);
+    bw.writeBits(m_bits - 1, 5);
+    bw.writeBits((unsigned int)(m_total_samples >> 32) & 0xF, 4);
+    bw.writeBits((unsigned int)m_total_samples, 32);
+    for (int i = 0; i < 4; i++)
+    {
+        bw.writeBits(0, 32);
+    }
+
+    /*
+        SEEKTABLE.  Unused entries are placeholder points, which must come last.
+    */
+    bw.writeBits(0x80 | 0x03, 8);
+    bw.writeBits(FLAC_ENCODER_SEEKPOINTS * 18, 24);
+    for (int i = 0; i < FLAC_ENCODER_SEEKPOINTS; i++)
+    {
+        if (i < m_num_seekpoints)
+        {
+            const FlacSeekPoint *point = &m_seekpoints[i];
+            bw.writeBits((unsigned int)(point->sample >> 32), 32);
+            bw.writeBits((unsigned int)point->sample, 32);
+            bw.writeBits((unsigned int)(point->offset >> 32), 32);
+            bw.writeBits((unsigned int)point->offset, 32);
+            bw.writeBits(point->samples, 16);
+        }
+        else
+        {
+            bw.writeBits(0xFFFFFFFF, 32);
+            bw.writeBits(0xFFFFFFFF, 32);
+            bw.writeBits(0, 32);
+            bw.writeBits(0, 32);
+            bw.writeBits(0, 16);
+        }
+    }
+
+    if (fwrite(header, 1, bw.bytes(), m_file) != bw.bytes())
+    {
+        return FMOD_ERR_FILE_BAD;
+    }
+
+    return FMOD_OK;
+}
+
+/*
+    0 if every frame is still in flight, ie the disk or the encoder can't keep up. A frame's state is the only thing
+    shared with the workers: they don't touch a FREE frame, and this thread doesn't touch one that isn't.
+*/
+FlacEncoderFrame *FlacEncoder::acquireFrame()
+{
+    FlacEncoderFrame *frame = &m_frames[m_submitted % m_num_frames];
+
+    if (__atomic_load_n(&frame->state, __ATOMIC_ACQUIRE) != FLAC_FRAME_FREE)
+    {
+        return 0;
+    }
+
+    frame->number = m_submitted;
+    return frame;
+}
+
+void FlacEncoder::submitFrame()
+{
+    m_current->blocksize = m_fill;
+    __atomic_store_n(&m_current->state, FLAC_FRAME_QUEUED, __ATOMIC_RELEASE);
+
+    /*
+        The inbox has more slots than there are frames, so there is always room.
+    */
+    m_pool->submit(&m_inbox, &m_current->job);
+
+    m_submitted++;
+    m_current = 0;
+    m_fill = 0;
+}
+
+FMOD_RESULT FlacEncoder::write(const float *buffer, unsigned int length, int inchannels)
+{
+    if (!m_file)
+    {
+        return FMOD_ERR_UNINITIALIZED;
+    }
+    if (__atomic_load_n(&m_error, __ATOMIC_RELAXED))
+    {
+        return FMOD_ERR_FILE_BAD;
+    }
+
+    float scale = (float)(1 << (m_bits - 1));
+    int maxvalue = (1 << (m_bits - 1)) - 1;
+    int minvalue = -(1 << (m_bits - 1));
+
+    while (length)
+    {
+        if (!m_current)
+        {
+            m_current = acquireFrame();
+            if (!m_current)
+            {
+                __atomic_store_n(&m_dropped, m_dropped + length, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+
+        unsigned int count = FLAC_ENCODER_BLOCKSIZE - m_fill;
+        if (count > length)
+        {
+            count = length;
+        }
+
+        for (int ch = 0; ch < m_channels; ch++)
+        {
+            int *dest = m_current->samples[ch] + m_fill;
+
+            if (ch >= inchannels)
+            {
+                memset(dest, 0, count * sizeof(int));
+                continue;
+            }
+
+            const float *src = buffer + ch;
+            for (unsigned int i = 0; i < count; i++)
+            {
+                int value = (int)floorf(*src * scale + 0.5f);
+                if (value > maxvalue) value = maxvalue;
+                if (value < minvalue) value = minvalue;
+                dest[i] = value;
+                src += inchannels;
+            }
+        }
+
+        buffer += count * inchannels;
+        length -= count;
+        m_fill += count;
+
+        if (m_fill == FLAC_ENCODER_BLOCKSIZE)
+        {
+            submitFrame();
+        }
+    }
+
+    return FMOD_OK;
+}
+
+void FlacEncoder::encodeJob(void *arg)
+{
+    FlacEncoderFrame *frame = (FlacEncoderFrame *)arg;
+    FlacEncoder *encoder = frame->encoder;
+
+    flacEncodeFrame(frame, encoder->m_channels, encoder->m_bits);
+    encoder->frameDone(frame);
+}
+
+void FlacEncoder::frameDone(FlacEncoderFrame *frame)
+{
+    pthread_mutex_lock(&m_lock);
+    __atomic_store_n(&frame->state, FLAC_FRAME_DONE, __ATOMIC_RELAXED);
+
+    /*
+        Whichever worker gets here first writes out every finished frame that is next in line,
+        the others just leave their frame marked done for it to pick up.
+    */
+    if (!m_flushing)
+    {
+        m_flushing = true;
+        for (;;)
+        {
+            FlacEncoderFrame *next = &m_frames[m_written % m_num_frames];
+            if (__atomic_load_n(&next->state, __ATOMIC_RELAXED) != FLAC_FRAME_DONE || next->number != m_written)
+            {
+                break;
+            }
+
+            pthread_mutex_unlock(&m_lock);
+            writeFrame(next);
+            pthread_mutex_lock(&m_lock);
+
+            __atomic_store_n(&next->state, FLAC_FRAME_FREE, __ATOMIC_RELEASE);
+            m_written++;
+            pthread_cond_broadcast(&m_frame_free);
+        }
+        m_flushing = false;
+    }
+
+    pthread_mutex_unlock(&m_lock);
+}
+
+void FlacEncoder::writeFrame(FlacEncoderFrame *frame)
+{
+    addSeekPoint(m_total_samples, frame->blocksize);
+
+    if (fwrite(frame->output, 1, frame->outputbytes, m_file) != frame->outputbytes)
+    {
+        __atomic_store_n(&m_error, true, __ATOMIC_RELAXED);
+    }
+
+    if (frame->outputbytes < m_min_framesize)
+    {
+        m_min_framesize = frame->outputbytes;
+    }
+    if (frame->outputbytes > m_max_framesize)
+    {
+        m_max_framesize = frame->outputbytes;
+    }
+
+    m_stream_bytes += frame->outputbytes;
+    m_total_samples += frame->blocksize;
+}
+
+void FlacEncoder::addSeekPoint(unsigned long long sample, unsigned int samples)
+{
+    if (sample < m_next_seek)
+    {
+        return;
+    }
+
+    if (m_num_seekpoints == FLAC_ENCODER_SEEKPOINTS)
+    {
+        /*
+            Table is full, keep every second point and double the interval.
+        */
+        for (int i = 0; i < FLAC_ENCODER_SEEKPOINTS / 2; i++)
+        {
+            m_seekpoints[i] = m_seekpoints[i * 2];
+        }
+        m_num_seekpoints = FLAC_ENCODER_SEEKPOINTS / 2;
+        m_seek_interval *= 2;
+
+        if (sample < m_seekpoints[m_num_seekpoints - 1].sample + m_seek_interval)
+        {
+            m_next_seek = m_seekpoints[m_num_seekpoints - 1].sample + m_seek_interval;
+            return;
+        }
+    }
+
+    FlacSeekPoint *point = &m_seekpoints[m_num_seekpoints++];
+    point->sample = sample;
+    point->offset = m_stream_bytes;
+    point->samples = samples;
+
+    m_next_seek = (sample / m_seek_interval + 1) * m_seek_interval;
+}
+
+void FlacEncoder::waitForFrame()
+{
+    if (!m_file)
+    {
+        return;
+    }
+
+    /*
+        The frame being filled may run out part way through, so it's the one after that has to be free.
+    */
+    FlacEncoderFrame *frame = &m_frames[(m_submitted + (m_current ? 1 : 0)) % m_num_frames];
+
+    pthread_mutex_lock(&m_lock);
+    while (__atomic_load_n(&frame->state, __ATOMIC_RELAXED) != FLAC_FRAME_FREE)
+    {
+        pthread_cond_wait(&m_frame_free, &m_lock);
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+FMOD_RESULT FlacEncoder::close()
+{
+    FMOD_RESULT result = FMOD_OK;
+
+    if (m_file)
+    {
+        if (m_current && m_fill)
+        {
+            submitFrame();
+        }
+
+        pthread_mutex_lock(&m_lock);
+        while (m_written != m_submitted)
+        {
+            pthread_cond_wait(&m_frame_free, &m_lock);
+        }
+        pthread_mutex_unlock(&m_lock);
+
+        /*
+            Every frame is on disk, go back and fill in the sizes, length and seek table.
+        */
+        if (fseek(m_file, 0, SEEK_SET) == 0)
+        {
+            result = writeHeader();
+        }
+        else
+        {
+            result = FMOD_ERR_FILE_COULDNOTSEEK;
+        }
+
+        if (m_error)
+        {
+            result = FMOD_ERR_FILE_BAD;
+        }
+
+        fclose(m_file);
+        m_file = 0;
+
+        m_pool->detach(&m_inbox);
+        pthread_cond_destroy(&m_frame_free);
+        pthread_mutex_destroy(&m_lock);
+    }
+
+    if (m_frames)
+    {
+        for (int i = 0; i < m_num_frames; i++)
+        {
+            /*
+                Each frame's buffers live in one block that starts at the first channel.
+            */
+            free(m_frames[i].samples[0]);
+        }
+        free(m_frames);
+        m_frames = 0;
+    }
+
+    return result;
+}
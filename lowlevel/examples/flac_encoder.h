@@ -0,0 +1,103 @@
+/*==============================================================================
+FLAC Encoder
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Streaming FLAC encoder for captured mixer output. Interleaved float blocks
+passed to FlacEncoder::write are cut into fixed size frames, the frames are
+encoded in parallel on a WorkerPool and written to disk strictly in order.
+
+Each frame is encoded with whichever of constant, verbatim, fixed or LPC
+prediction is smallest, with stereo decorrelation picked per frame. A seek
+table is reserved when the file is opened and filled in by FlacEncoder::close.
+If the table fills up, the interval between seek points is doubled.
+
+write never waits or takes a lock, it is called from the mixer. It fills
+frames from a ring whose slots are handed between it and the workers by
+their state alone, and passes full ones to the pool through a WorkerInbox.
+If every frame is still being encoded or written, the block is dropped and
+counted in samplesDropped. Callers that aren't real time, such as a non real
+time render, can call waitForFrame before each block so nothing is dropped.
+==============================================================================*/
+#ifndef _FLAC_ENCODER_H
+#define _FLAC_ENCODER_H
+
+#include "fmod.h"
+#include "worker_pool.h"
+#include <stdio.h>
+#include <pthread.h>
+
+#define FLAC_ENCODER_BLOCKSIZE          4096    /* Samples per channel in each frame. */
+#define FLAC_ENCODER_MAX_CHANNELS       8
+#define FLAC_ENCODER_MAX_LPC_ORDER      8
+#define FLAC_ENCODER_SEEKPOINTS         256     /* Seek points reserved in the header. */
+#define FLAC_ENCODER_SEEK_INTERVAL      10      /* Initial seconds between seek points. */
+
+struct FlacEncoderFrame;
+
+struct FlacSeekPoint
+{
+    unsigned long long sample;      /* First sample in the target frame. */
+    unsigned long long offset;      /* Byte offset of the target frame from the first frame header. */
+    unsigned int       samples;     /* Samples in the target frame. */
+};
+
+class FlacEncoder
+{
+public:
+    FlacEncoder();
+
+    FMOD_RESULT         open(const char *filename, int channels, int samplerate, int bitspersample, WorkerPool *pool);
+    FMOD_RESULT         write(const float *buffer, unsigned int length, int inchannels);
+    FMOD_RESULT         close();
+
+    /*
+        Blocks until a frame's worth of samples can be written without any being dropped. Not from the mixer.
+    */
+    void                waitForFrame();
+
+    bool                isOpen() const { return m_file != 0; }
+    unsigned long long  samplesWritten() const { return m_total_samples; }
+    unsigned long long  bytesWritten() const { return m_stream_bytes; }
+    unsigned long long  samplesDropped() const { return __atomic_load_n(&m_dropped, __ATOMIC_RELAXED); }
+
+private:
+    static void         encodeJob(void *arg);
+
+    FMOD_RESULT         writeHeader();
+    FlacEncoderFrame   *acquireFrame();
+    void                submitFrame();
+    void                frameDone(FlacEncoderFrame *frame);
+    void                writeFrame(FlacEncoderFrame *frame);
+    void                addSeekPoint(unsigned long long sample, unsigned int samples);
+
+    FILE               *m_file;
+    WorkerPool         *m_pool;
+    WorkerInbox         m_inbox;
+    int                 m_channels;
+    int                 m_samplerate;
+    int                 m_bits;
+
+    FlacEncoderFrame   *m_frames;
+    int                 m_num_frames;
+    unsigned int        m_submitted;        /* Frames handed to the pool. */
+    unsigned int        m_written;          /* Frames written to disk, always in order. */
+    unsigned int        m_fill;             /* Samples in the frame currently being filled. */
+    FlacEncoderFrame   *m_current;
+    bool                m_flushing;
+    bool                m_error;
+    pthread_mutex_t     m_lock;
+    pthread_cond_t      m_frame_free;
+
+    unsigned long long  m_total_samples;
+    unsigned long long  m_stream_bytes;
+    unsigned long long  m_dropped;          /* Samples per channel write had no frame for. */
+    unsigned int        m_min_framesize;
+    unsigned int        m_max_framesize;
+
+    FlacSeekPoint       m_seekpoints[FLAC_ENCODER_SEEKPOINTS];
+    int                 m_num_seekpoints;
+    unsigned long long  m_seek_interval;
+    unsigned long long  m_next_seek;
+};
+
+#endif
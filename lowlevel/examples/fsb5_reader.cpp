@@ -0,0 +1,420 @@
+/*==============================================================================
+FSB5 Reader
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "fsb5_reader.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FSB5_HEADER_SIZE            60      /* Version 1, version 0 has an extra word. */
+#define FSB5_HEADER_SIZE_V0         64
+
+#define FSB5_CHUNK_CHANNELS         1
+#define FSB5_CHUNK_FREQUENCY        2
+#define FSB5_CHUNK_LOOP             3
+
+static const int FSB5_FREQUENCY[16] = { 4000, 8000, 11000, 11025, 16000, 22050, 24000, 32000, 44100, 48000, 96000, 0, 0, 0, 0, 0 };
+static const int FSB5_CHANNELS[4] = { 1, 2, 6, 8 };
+
+static inline unsigned int Fsb5_Read32(const unsigned char *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int)data[3] << 24);
+}
+
+/*
+    Sample header, a 64 bit little endian word:
+        bit  0      more chunks follow
+        bits 1-4    frequency index
+        bits 5-6    channel count index
+        bits 7-33   data offset / 32
+        bits 34-63  length in samples
+*/
+struct Fsb5SampleHeader
+{
+    bool            chunks;
+    int             frequency;
+    int             channels;
+    unsigned int    dataoffset;
+    unsigned int    lengthpcm;
+};
+
+static void Fsb5_ParseSampleHeader(const unsigned char *data, Fsb5SampleHeader *header)
+{
+    unsigned int low = Fsb5_Read32(data);
+    unsigned int high = Fsb5_Read32(data + 4);
+
+    header->chunks = (low & 1) != 0;
+    header->frequency = FSB5_FREQUENCY[(low >> 1) & 0xF];
+    header->channels = FSB5_CHANNELS[(low >> 5) & 0x3];
+    header->dataoffset = (((high & 0x3) << 25) | ((low >> 7) & 0x1FFFFFF)) << 5;
+    header->lengthpcm = high >> 2;
+}
+
+Fsb5Reader::Fsb5Reader()
+{
+    m_read = 0;
+    m_seek = 0;
+    m_handle = 0;
+    m_userdata = 0;
+    m_offset = 0;
+    m_numsubsounds = 0;
+    m_format = FMOD_SOUND_FORMAT_NONE;
+    m_headersstart = 0;
+    m_namesstart = 0;
+    m_namessize = 0;
+    m_datastart = 0;
+    m_datasize = 0;
+    m_checkpoints = 0;
+    m_numcheckpoints = 0;
+    m_maxcheckpoints = 0;
+}
+
+FMOD_RESULT Fsb5Reader::open(FMOD_FILE_READ_CALLBACK read, FMOD_FILE_SEEK_CALLBACK seek, void *handle, void *userdata, unsigned int offset)
+{
+    unsigned char header[FSB5_HEADER_SIZE_V0];
+    FMOD_RESULT result;
+
+    m_read = read;
+    m_seek = seek;
+    m_handle = handle;
+    m_userdata = userdata;
+    m_offset = offset;
+
+    result = readAt(0, header, FSB5_HEADER_SIZE);
+    if (result != FMOD_OK || memcmp(header, "FSB5", 4))
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    unsigned int version = Fsb5_Read32(header + 4);
+    unsigned int mode = Fsb5_Read32(header + 24);
+    if (version > 1 || mode == FMOD_SOUND_FORMAT_NONE || mode >= FMOD_SOUND_FORMAT_MAX)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    m_numsubsounds = (int)Fsb5_Read32(header + 8);
+    m_format = (FMOD_SOUND_FORMAT)mode;
+    m_headersstart = (version == 0) ? FSB5_HEADER_SIZE_V0 : FSB5_HEADER_SIZE;
+    m_namesstart = m_headersstart + Fsb5_Read32(header + 12);
+    m_namessize = Fsb5_Read32(header + 16);
+    m_datastart = m_namesstart + m_namessize;
+    m_datasize = Fsb5_Read32(header + 20);
+
+    if (m_numsubsounds <= 0 || m_namesstart < m_headersstart || m_datastart < m_namesstart || m_datastart + m_datasize < m_datastart)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    /*
+        Subsound 0's header is always straight after the file header, that's the first checkpoint.
+    */
+    m_maxcheckpoints = 16;
+    m_checkpoints = (unsigned int *)malloc(m_maxcheckpoints * sizeof(unsigned int));
+    if (!m_checkpoints)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    m_checkpoints[0] = m_headersstart;
+    m_numcheckpoints = 1;
+
+    return FMOD_OK;
+}
+
+void Fsb5Reader::release()
+{
+    free(m_checkpoints);
+    m_checkpoints = 0;
+    m_numcheckpoints = 0;
+    m_maxcheckpoints = 0;
+}
+
+FMOD_RESULT Fsb5Reader::readAt(unsigned int offset, void *buffer, unsigned int size)
+{
+    unsigned int bytesread = 0;
+    FMOD_RESULT result;
+
+    result = m_seek(m_handle, m_offset + offset, m_userdata);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    result = m_read(m_handle, buffer, size, &bytesread, m_userdata);
+    if (bytesread < size)
+    {
+        return (result == FMOD_OK) ? FMOD_ERR_FILE_EOF : result;
+    }
+    return FMOD_OK;
+}
+
+/*
+    Moves 'offset' from one sample header to the next, over any chunks.
+*/
+FMOD_RESULT Fsb5Reader::skipHeader(unsigned int *offset)
+{
+    unsigned char data[8];
+    FMOD_RESULT result;
+
+    result = readAt(*offset, data, 8);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+    *offset += 8;
+
+    bool more = (data[0] & 1) != 0;
+    while (more)
+    {
+        result = readAt(*offset, data, 4);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+
+        unsigned int chunk = Fsb5_Read32(data);
+        more = (chunk & 1) != 0;
+        *offset += 4 + ((chunk >> 1) & 0xFFFFFF);
+
+        if (*offset > m_namesstart)
+        {
+            return FMOD_ERR_FILE_BAD;
+        }
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT Fsb5Reader::findHeader(int index, unsigned int *offset)
+{
+    FMOD_RESULT result;
+    int checkpoint = index / FSB5_READER_CHECKPOINT_STRIDE;
+
+    /*
+        Walk out to the checkpoint before this subsound if nothing has been that far yet.
+    */
+    while (m_numcheckpoints <= checkpoint)
+    {
+        unsigned int position = m_checkpoints[m_numcheckpoints - 1];
+
+        for (int count = 0; count < FSB5_READER_CHECKPOINT_STRIDE; count++)
+        {
+            result = skipHeader(&position);
+            if (result != FMOD_OK)
+            {
+                return result;
+            }
+        }
+
+        if (m_numcheckpoints == m_maxcheckpoints)
+        {
+            unsigned int *checkpoints = (unsigned int *)realloc(m_checkpoints, m_maxcheckpoints * 2 * sizeof(unsigned int));
+            if (!checkpoints)
+            {
+                return FMOD_ERR_MEMORY;
+            }
+            m_checkpoints = checkpoints;
+            m_maxcheckpoints *= 2;
+        }
+        m_checkpoints[m_numcheckpoints++] = position;
+    }
+
+    *offset = m_checkpoints[checkpoint];
+    for (int count = checkpoint * FSB5_READER_CHECKPOINT_STRIDE; count < index; count++)
+    {
+        result = skipHeader(offset);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT Fsb5Reader::getSubsound(int index, Fsb5Subsound *subsound)
+{
+    Fsb5SampleHeader header;
+    unsigned char data[12];
+    unsigned int offset;
+    FMOD_RESULT result;
+
+    if (index < 0 || index >= m_numsubsounds)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    result = findHeader(index, &offset);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    result = readAt(offset, data, 8);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+    Fsb5_ParseSampleHeader(data, &header);
+    offset += 8;
+
+    subsound->format = m_format;
+    subsound->channels = header.channels;
+    subsound->frequency = header.frequency;
+    subsound->lengthpcm = header.lengthpcm;
+    subsound->loopstart = 0;
+    subsound->loopend = header.lengthpcm ? header.lengthpcm - 1 : 0;
+
+    /*
+        Chunks override what the header word can't express.
+    */
+    bool more = header.chunks;
+    while (more)
+    {
+        result = readAt(offset, data, 4);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+
+        unsigned int chunk = Fsb5_Read32(data);
+        unsigned int size = (chunk >> 1) & 0xFFFFFF;
+        int type = chunk >> 25;
+        more = (chunk & 1) != 0;
+        offset += 4;
+
+        if (offset + size > m_namesstart)
+        {
+            return FMOD_ERR_FILE_BAD;
+        }
+
+        if (type == FSB5_CHUNK_CHANNELS && size >= 1)
+        {
+            result = readAt(offset, data, 1);
+            subsound->channels = data[0];
+        }
+        else if (type == FSB5_CHUNK_FREQUENCY && size >= 4)
+        {
+            result = readAt(offset, data, 4);
+            subsound->frequency = (int)Fsb5_Read32(data);
+        }
+        else if (type == FSB5_CHUNK_LOOP && size >= 8)
+        {
+            result = readAt(offset, data, 8);
+            subsound->loopstart = Fsb5_Read32(data);
+            subsound->loopend = Fsb5_Read32(data + 4);
+        }
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+
+        offset += size;
+    }
+
+    /*
+        Data runs up to where the next subsound's starts.
+    */
+    unsigned int dataend = m_datasize;
+    if (index + 1 < m_numsubsounds)
+    {
+        Fsb5SampleHeader next;
+
+        result = readAt(offset, data, 8);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+        Fsb5_ParseSampleHeader(data, &next);
+        dataend = next.dataoffset;
+    }
+
+    if (header.dataoffset > dataend || dataend > m_datasize || subsound->channels <= 0 || subsound->frequency <= 0)
+    {
+        return FMOD_ERR_FILE_BAD;
+    }
+    subsound->dataoffset = m_datastart + header.dataoffset;
+    subsound->datalength = dataend - header.dataoffset;
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT Fsb5Reader::getName(int index, char *name, int namelength)
+{
+    unsigned char data[4];
+    FMOD_RESULT result;
+
+    if (index < 0 || index >= m_numsubsounds || namelength <= 0)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    name[0] = 0;
+    if (!m_namessize)
+    {
+        return FMOD_OK;
+    }
+
+    result = readAt(m_namesstart + index * 4, data, 4);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    unsigned int offset = Fsb5_Read32(data);
+    if (offset >= m_namessize)
+    {
+        return FMOD_ERR_FILE_BAD;
+    }
+
+    /*
+        The table only gives where names start, read what can be there and cut it at the terminator.
+    */
+    unsigned int size = m_namessize - offset;
+    if (size > (unsigned int)namelength - 1)
+    {
+        size = namelength - 1;
+    }
+
+    result = readAt(m_namesstart + offset, name, size);
+    if (result != FMOD_OK)
+    {
+        name[0] = 0;
+        return result;
+    }
+    name[size] = 0;
+
+    return FMOD_OK;
+}
+
+bool Fsb5Reader::find(const void *data, unsigned int length, unsigned int *offset, unsigned int *size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned int position = 0;
+
+    while (position + FSB5_HEADER_SIZE <= length)
+    {
+        const unsigned char *match = (const unsigned char *)memchr(bytes + position, 'F', length - FSB5_HEADER_SIZE + 1 - position);
+        if (!match)
+        {
+            break;
+        }
+        position = (unsigned int)(match - bytes);
+
+        if (!memcmp(match, "FSB5", 4) && Fsb5_Read32(match + 4) <= 1)
+        {
+            unsigned int headersize = Fsb5_Read32(match + 4) == 0 ? FSB5_HEADER_SIZE_V0 : FSB5_HEADER_SIZE;
+            unsigned long long total = (unsigned long long)headersize + Fsb5_Read32(match + 12) + Fsb5_Read32(match + 16) + Fsb5_Read32(match + 20);
+
+            if (Fsb5_Read32(match + 8) && total <= length - position)
+            {
+                *offset = position;
+                *size = (unsigned int)total;
+                return true;
+            }
+        }
+        position++;
+    }
+
+    return false;
+}
@@ -0,0 +1,86 @@
+/*==============================================================================
+FSB5 Reader
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Reads the subsound table of an FSB5 container, the format banks carry their
+audio in, through a pair of read and seek functions.
+
+Nothing is parsed up front but the fixed header. Sample headers are variable
+length, so finding subsound N means walking the ones before it. The walk
+drops a checkpoint every FSB5_READER_CHECKPOINT_STRIDE headers and later
+lookups start from the nearest one, so a lookup costs at most one stride of
+walking. The checkpoint table only grows as far as the highest subsound asked
+for, and the source is only read around the headers and names that are used.
+Against an mmapped file that means a bank with
+thousands of subsounds opens in constant time and only the pages holding the
+used ones get touched.
+==============================================================================*/
+#ifndef _FSB5_READER_H
+#define _FSB5_READER_H
+
+#include "fmod.hpp"
+
+#define FSB5_READER_CHECKPOINT_STRIDE   64
+#define FSB5_READER_MAX_NAME            256
+
+struct Fsb5Subsound
+{
+    FMOD_SOUND_FORMAT   format;
+    int                 channels;
+    int                 frequency;
+    unsigned int        lengthpcm;
+    unsigned int        loopstart;
+    unsigned int        loopend;        /* Inclusive. */
+    unsigned int        dataoffset;     /* From the start of the container. */
+    unsigned int        datalength;
+};
+
+class Fsb5Reader
+{
+public:
+    Fsb5Reader();
+
+    /*
+        'offset' is where the container starts in the source, for one embedded in a bank. Call release afterwards
+        even if open fails.
+    */
+    FMOD_RESULT         open(FMOD_FILE_READ_CALLBACK read, FMOD_FILE_SEEK_CALLBACK seek, void *handle, void *userdata, unsigned int offset);
+    void                release();
+
+    int                 getNumSubsounds() const     { return m_numsubsounds; }
+    FMOD_SOUND_FORMAT   getFormat() const           { return m_format; }     /* Every subsound shares it. */
+    unsigned int        getSize() const             { return m_datastart + m_datasize; }
+
+    FMOD_RESULT         getSubsound(int index, Fsb5Subsound *subsound);
+    FMOD_RESULT         getName(int index, char *name, int namelength);         /* Empty if the container has no names. */
+
+    /*
+        Scans memory, a mapped bank for example, for an FSB5 header. Returns false if there isn't one.
+    */
+    static bool         find(const void *data, unsigned int length, unsigned int *offset, unsigned int *size);
+
+private:
+    FMOD_RESULT         readAt(unsigned int offset, void *buffer, unsigned int size);
+    FMOD_RESULT         skipHeader(unsigned int *offset);
+    FMOD_RESULT         findHeader(int index, unsigned int *offset);
+
+    FMOD_FILE_READ_CALLBACK m_read;
+    FMOD_FILE_SEEK_CALLBACK m_seek;
+    void               *m_handle;
+    void               *m_userdata;
+    unsigned int        m_offset;
+
+    int                 m_numsubsounds;
+    FMOD_SOUND_FORMAT   m_format;
+    unsigned int        m_headersstart;     /* Offsets from the start of the container. */
+    unsigned int        m_namesstart;
+    unsigned int        m_namessize;
+    unsigned int        m_datastart;
+    unsigned int        m_datasize;
+
+    unsigned int       *m_checkpoints;      /* Header offset of every stride'th subsound found so far. */
+    int                 m_numcheckpoints;
+    int                 m_maxcheckpoints;
+};
+
+#endif
@@ -0,0 +1,300 @@
+/*==============================================================================
+Grain Sequencer
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "grain_sequencer.h"
+#include <string.h>
+
+GrainSequencer::GrainSequencer()
+{
+    m_system = 0;
+    m_group = 0;
+    memset(&m_source, 0, sizeof(m_source));
+    m_lookahead = 0;
+    m_minahead = 0;
+    m_crossfade = 0;
+    m_outputrate = 0;
+    m_bufferlength = 0;
+    memset(m_slots, 0, sizeof(m_slots));
+    m_scheduled = 0;
+    m_next_start = 0;
+    m_next_fadein = 0;
+    m_running = false;
+    m_played = 0;
+    m_late = 0;
+}
+
+FMOD_RESULT GrainSequencer::init(FMOD::System *system, const GrainSource &source, int lookahead, unsigned int minaheadms, unsigned int crossfadems)
+{
+    FMOD_RESULT result;
+
+    if (!source.pick || lookahead < 2 || lookahead > GRAIN_SEQUENCER_MAX_SLOTS)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    m_system = system;
+    m_source = source;
+    m_lookahead = lookahead;
+
+    result = system->getSoftwareFormat(&m_outputrate, 0, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+    result = system->getDSPBufferSize(&m_bufferlength, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_minahead = (unsigned long long)minaheadms * m_outputrate / 1000;
+    m_crossfade = (unsigned long long)crossfadems * m_outputrate / 1000;
+
+    for (int i = 0; i < GRAIN_SEQUENCER_MAX_SLOTS; i++)
+    {
+        m_slots[i].sequencer = this;
+    }
+
+    /*
+        Grains play on their own group, its clock is the one every setDelay and fade point is measured against.
+    */
+    return system->createChannelGroup("Grains", &m_group);
+}
+
+FMOD_RESULT GrainSequencer::start()
+{
+    unsigned long long now;
+
+    FMOD_RESULT result = m_group->getDSPClock(&now, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_running = true;
+    m_next_start = now + 2 * m_bufferlength;
+    m_next_fadein = 0;
+
+    return refill();
+}
+
+FMOD_RESULT GrainSequencer::release()
+{
+    m_running = false;
+
+    for (int i = 0; i < GRAIN_SEQUENCER_MAX_SLOTS; i++)
+    {
+        GrainSequencerSlot *slot = &m_slots[i];
+        if (slot->active)
+        {
+            slot->channel->setCallback(0);
+            slot->channel->stop();
+            finish(slot);
+        }
+    }
+
+    FMOD_RESULT result = FMOD_OK;
+    if (m_group)
+    {
+        result = m_group->release();
+        m_group = 0;
+    }
+    return result;
+}
+
+void GrainSequencer::getStats(GrainSequencerStats *stats)
+{
+    unsigned long long now = 0;
+
+    m_group->getDSPClock(&now, 0);
+
+    stats->scheduled = m_scheduled;
+    stats->played = m_played;
+    stats->late = m_late;
+    stats->ahead = (m_next_start > now) ? m_next_start - now : 0;
+}
+
+FMOD_RESULT GrainSequencer::refill()
+{
+    unsigned long long now;
+
+    if (!m_running)
+    {
+        return FMOD_OK;
+    }
+
+    FMOD_RESULT result = m_group->getDSPClock(&now, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    while (m_scheduled < GRAIN_SEQUENCER_MAX_SLOTS && (m_scheduled < m_lookahead || m_next_start < now + m_minahead))
+    {
+        result = schedule(now);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT GrainSequencer::schedule(unsigned long long now)
+{
+    FMOD_RESULT result;
+    GrainSequencerSlot *slot = 0;
+    FMOD::Sound *sound;
+    FMOD::Channel *channel;
+    unsigned int length;
+    float frequency;
+
+    for (int i = 0; i < GRAIN_SEQUENCER_MAX_SLOTS && !slot; i++)
+    {
+        if (!m_slots[i].active)
+        {
+            slot = &m_slots[i];
+        }
+    }
+
+    /*
+        The window ran dry, the previous grain has already ended. Restart the chain a little in the future.
+    */
+    if (m_next_start < now + m_bufferlength)
+    {
+        m_late++;
+        m_next_start = now + 2 * m_bufferlength;
+        m_next_fadein = 0;
+    }
+
+    result = m_source.pick(m_source.userdata, &sound);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    result = m_system->playSound(sound, m_group, true, &channel);
+    if (result != FMOD_OK)
+    {
+        if (m_source.done)
+        {
+            m_source.done(m_source.userdata, sound);
+        }
+        return result;
+    }
+
+    if (m_source.setup)
+    {
+        result = m_source.setup(m_source.userdata, channel);
+    }
+
+    /*
+        Length in output samples, after setup has had its say on the pitch.
+        Ie a 22050 sample sound at 44khz, played into a 48khz output, lasts 24000 output samples.
+    */
+    length = 0;
+    frequency = 0.0f;
+    if (result == FMOD_OK)
+    {
+        result = sound->getLength(&length, FMOD_TIMEUNIT_PCM);
+    }
+    if (result == FMOD_OK)
+    {
+        result = channel->getFrequency(&frequency);
+    }
+    if (result == FMOD_OK && frequency <= 0.0f)
+    {
+        result = FMOD_ERR_INVALID_PARAM;
+    }
+
+    unsigned long long duration = (result == FMOD_OK) ? (unsigned long long)((double)length * m_outputrate / frequency + 0.5) : 0;
+    unsigned long long overlap = (m_crossfade < duration / 2) ? m_crossfade : duration / 2;
+    unsigned long long start = m_next_start;
+    unsigned long long end = start + duration;
+
+    if (result == FMOD_OK)
+    {
+        result = channel->setDelay(start, 0, false);
+    }
+    if (result == FMOD_OK && m_next_fadein)
+    {
+        result = channel->addFadePoint(start, 0.0f);
+        if (result == FMOD_OK)
+        {
+            result = channel->addFadePoint(start + m_next_fadein, 1.0f);
+        }
+    }
+    if (result == FMOD_OK && overlap)
+    {
+        result = channel->addFadePoint(end - overlap, 1.0f);
+        if (result == FMOD_OK)
+        {
+            result = channel->addFadePoint(end, 0.0f);
+        }
+    }
+
+    /*
+        The channel is still paused and holding a voice, stop it rather than leave it for the pool to run out.
+        No callback is set yet, so hand the sound back here.
+    */
+    if (result != FMOD_OK)
+    {
+        channel->stop();
+        if (m_source.done)
+        {
+            m_source.done(m_source.userdata, sound);
+        }
+        return result;
+    }
+
+    m_next_start = end - overlap;
+    m_next_fadein = overlap;
+
+    slot->channel = channel;
+    slot->sound = sound;
+    slot->active = true;
+    m_scheduled++;
+
+    channel->setUserData(slot);
+    channel->setCallback(channelCallback);
+
+    return channel->setPaused(false);
+}
+
+void GrainSequencer::finish(GrainSequencerSlot *slot)
+{
+    slot->active = false;
+    m_scheduled--;
+    m_played++;
+
+    if (m_source.done)
+    {
+        m_source.done(m_source.userdata, slot->sound);
+    }
+}
+
+FMOD_RESULT F_CALLBACK GrainSequencer::channelCallback(FMOD_CHANNELCONTROL *channelcontrol, FMOD_CHANNELCONTROL_TYPE controltype, FMOD_CHANNELCONTROL_CALLBACK_TYPE callbacktype, void *commanddata1, void *commanddata2)
+{
+    GrainSequencerSlot *slot = 0;
+
+    if (controltype != FMOD_CHANNELCONTROL_CHANNEL || callbacktype != FMOD_CHANNELCONTROL_CALLBACK_END)
+    {
+        return FMOD_OK;
+    }
+
+    FMOD_RESULT result = ((FMOD::Channel *)channelcontrol)->getUserData((void **)&slot);
+    if (result != FMOD_OK || !slot || !slot->active)
+    {
+        return result;
+    }
+
+    GrainSequencer *sequencer = slot->sequencer;
+    sequencer->finish(slot);
+
+    /*
+        Top the window back up straight away rather than waiting for the game loop to notice.
+    */
+    return sequencer->refill();
+}
@@ -0,0 +1,91 @@
+/*==============================================================================
+Grain Sequencer
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Plays an endless chain of sounds back to back, sample accurately, using the
+DSP clock. Each grain is started with Channel::setDelay at the exact output
+sample the previous one ends on. A window of grains is always scheduled ahead
+of the clock, at least 'lookahead' of them and at least 'minahead' ms worth,
+so the chain keeps playing through long stalls between System::update calls.
+
+The window is refilled from FMOD_CHANNELCONTROL_CALLBACK_END as each grain
+finishes, not by polling. All clock math is 64 bit. Grains can overlap by a
+crossfade, done with fade points on both channels.
+
+A GrainSource supplies the grains: 'pick' returns the next sound, the optional
+'setup' can change a channel's pitch or volume before its length is measured,
+and the optional 'done' is told when a sound has finished playing, or when it
+couldn't be scheduled and its channel was stopped.
+==============================================================================*/
+#ifndef _GRAIN_SEQUENCER_H
+#define _GRAIN_SEQUENCER_H
+
+#include "fmod.hpp"
+
+#define GRAIN_SEQUENCER_MAX_SLOTS   64      /* Most grains that can be scheduled at once. */
+
+struct GrainSource
+{
+    FMOD_RESULT   (*pick)(void *userdata, FMOD::Sound **sound);
+    FMOD_RESULT   (*setup)(void *userdata, FMOD::Channel *channel);
+    void          (*done)(void *userdata, FMOD::Sound *sound);
+    void           *userdata;
+};
+
+struct GrainSequencerStats
+{
+    unsigned int        scheduled;      /* Grains waiting or playing right now. */
+    unsigned int        played;         /* Grains that have finished. */
+    unsigned int        late;           /* Times the window ran dry and the chain had to restart, each one is a gap. */
+    unsigned long long  ahead;          /* Output samples scheduled past the current clock. */
+};
+
+class GrainSequencer;
+
+struct GrainSequencerSlot
+{
+    GrainSequencer     *sequencer;
+    FMOD::Channel      *channel;
+    FMOD::Sound        *sound;
+    bool                active;
+};
+
+class GrainSequencer
+{
+public:
+    GrainSequencer();
+
+    FMOD_RESULT         init(FMOD::System *system, const GrainSource &source, int lookahead, unsigned int minaheadms, unsigned int crossfadems);
+    FMOD_RESULT         start();
+    FMOD_RESULT         release();
+
+    FMOD::ChannelGroup *getChannelGroup() const { return m_group; }
+    void                getStats(GrainSequencerStats *stats);
+
+private:
+    static FMOD_RESULT F_CALLBACK channelCallback(FMOD_CHANNELCONTROL *channelcontrol, FMOD_CHANNELCONTROL_TYPE controltype, FMOD_CHANNELCONTROL_CALLBACK_TYPE callbacktype, void *commanddata1, void *commanddata2);
+
+    FMOD_RESULT         refill();
+    FMOD_RESULT         schedule(unsigned long long now);
+    void                finish(GrainSequencerSlot *slot);
+
+    FMOD::System       *m_system;
+    FMOD::ChannelGroup *m_group;
+    GrainSource         m_source;
+    int                 m_lookahead;
+    unsigned long long  m_minahead;         /* Output samples. */
+    unsigned long long  m_crossfade;        /* Output samples. */
+    int                 m_outputrate;
+    unsigned int        m_bufferlength;
+
+    GrainSequencerSlot  m_slots[GRAIN_SEQUENCER_MAX_SLOTS];
+    int                 m_scheduled;
+    unsigned long long  m_next_start;       /* Clock the next grain starts at, on the group's clock. */
+    unsigned long long  m_next_fadein;      /* Overlap with the grain before it. */
+    bool                m_running;
+
+    unsigned int        m_played;
+    unsigned int        m_late;
+};
+
+#endif
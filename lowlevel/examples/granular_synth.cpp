@@ -3,44 +3,60 @@ Granular Synthesis Example
 Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
 
 This example shows how you can play a string of sounds together without gaps,
-using the setDelay command.
+using the setDelay command. The scheduling is done by a GrainSequencer (see
+grain_sequencer.h).
 
 The basic operation is:
-1. Play 2 sounds initially at the same time, the first sound immediately, and
-   the 2nd sound with a delay calculated by the length of the first sound.
-2. Call setDelay to initiate the delayed playback. setDelay is sample accurate
-   and uses -output- samples as the time frame, not source samples. These
-   samples are a fixed amount per second regardless of the source sound format,
-   for example, 48000 samples per second if FMOD is initialized to 48khz output.
+1. Keep a window of sounds queued up ahead of the one that is playing, each
+   one with a start time calculated from the end of the sound before it.
+2. Call setDelay to place each sound on the timeline. setDelay is sample
+   accurate and uses -output- samples as the time frame, not source samples.
+   These samples are a fixed amount per second regardless of the source sound
+   format, for example, 48000 samples per second if FMOD is initialized to
+   48khz output.
 3. Output samples are calculated from source samples with a simple
    source->output sample rate conversion. i.e.
        sound_length *= output_rate
        sound_length /= sound_frequency
-4. When the first sound finishes, the second one should have automatically
-   started. This is a good oppurtunity to queue up the next sound. Repeat
-   step 2.
-5. Make sure the framerate is high enough to queue up a new sound before the
-   other one finishes otherwise you will get gaps.
- 
+   This is done in 64 bit, a few seconds of sound times the output rate
+   doesn't fit in 32 bits.
+4. When a sound finishes its channel's end callback queues up the next one,
+   so the window stays full without having to poll every frame.
+5. The window is at least half a second long, so the sounds keep playing
+   seamlessly even if System::update isn't called for a while. Press the
+   stall button to sleep for 200ms and hear that there are no gaps.
+
 These sounds are not limited by format, channel count or bit depth like the 
-realtimestitching example is, and can also be modified to allow for overlap,
-by reducing the delay from the first sound playing to the second by the overlap
-amount.
+realtimestitching example is, and can also overlap. The sequencer starts each
+sound a crossfade early and fades the two across each other.
  
-#define USE_STREAMS = Use 2 stream instances, create and free them while they
-                      play.
+#define USE_STREAMS = Use stream instances. A StreamPool (see stream_pool.h)
+                      opens a couple of streams per file ahead of time with
+                      FMOD_NONBLOCKING and rewinds finished ones for reuse, so
+                      queueing the next sound never waits on the disk. Their
+                      file reads go through a pool of I/O threads (see
+                      async_file.h) so opening streams doesn't stall the one
+                      that's playing.
 //#define USE_STREAMS = Use 6 static wavs, all loaded into memory.
 ==============================================================================*/
 #include "fmod.hpp"
 #include "common.h"
+#include "async_file.h"
+#include "grain_sequencer.h"
+#include "stream_pool.h"
+#include <string.h>
 
 //#define USE_STREAMS
 
 FMOD::System *gSystem;
 
+#define LOOKAHEAD       4       /* Sounds queued up ahead at all times. */
+#define MINAHEAD_MS     500     /* And at least this much audio. */
+#define CROSSFADE_MS    10
+
 #ifdef USE_STREAMS
-#define NUMSOUNDS 3               /* Use some longer sounds, free and load them on the fly. */
-FMOD::Sound *sound[2] = { 0, 0 }; /* 2 streams active, double buffer them. */
+#define NUMSOUNDS 3               /* Use some longer sounds, opened on the fly by the stream pool. */
+#define SPARESTREAMS 2            /* Streams per file kept ready to go. */
 const char  *soundname[NUMSOUNDS] = { Common_MediaPath("c.ogg"),
                                       Common_MediaPath("d.ogg"),
                                       Common_MediaPath("e.ogg") };
@@ -55,111 +71,64 @@ const char  *soundname[NUMSOUNDS] = { Common_MediaPath("granular/truck_idle_off_
                                       Common_MediaPath("granular/truck_idle_off_06.wav") };
 #endif
 
-FMOD::Channel *queue_next_sound(int outputrate, FMOD::Channel *playingchannel, int newindex, int slot)
+FMOD_RESULT pick_next_sound(void *userdata, FMOD::Sound **newsound)
 {
-    FMOD_RESULT result;
-    FMOD::Channel *newchannel;
-    FMOD::Sound *newsound;
-    
-#ifdef USE_STREAMS  /* Create a new stream */
-    FMOD_CREATESOUNDEXINFO info;
-    Common_Memset(&info, 0, sizeof(FMOD_CREATESOUNDEXINFO));
-    info.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);
-    info.suggestedsoundtype = FMOD_SOUND_TYPE_OGGVORBIS;
-    result = gSystem->createStream(soundname[newindex], FMOD_IGNORETAGS | FMOD_LOWMEM, &info, &sound[slot]);
-    ERRCHECK(result);
-    newsound = sound[slot];
-#else   /* Use an existing sound that was passed into us */
-    (void)slot;
-    newsound = sound[newindex];
+#ifdef USE_STREAMS  /* Take a stream the pool opened ahead of time, it goes back to the pool when it finishes. */
+    return ((StreamPool *)userdata)->acquire(rand()%NUMSOUNDS, newsound);
+#else   /* Use one of the sounds loaded at startup */
+    (void)userdata;
+    *newsound = sound[rand()%NUMSOUNDS];
+    return FMOD_OK;
 #endif
-    
-    result = gSystem->playSound(newsound, 0, true, &newchannel);
-    ERRCHECK(result);
-      
-    if (playingchannel)
-    {    
-        unsigned long long startdelay = 0;
-        unsigned int soundlength = 0;
-        float soundfrequency;
-        FMOD::Sound *playingsound;
-        
-        /*
-            Get the start time of the playing channel.
-        */
-        result = playingchannel->getDelay(&startdelay, 0);
-        ERRCHECK(result);
-        
-        /*
-            Grab the length of the playing sound, and its frequency, so we can caluate where to place the new sound on the time line.
-        */
-        result = playingchannel->getCurrentSound(&playingsound);
-        ERRCHECK(result);
-        result = playingsound->getLength(&soundlength, FMOD_TIMEUNIT_PCM);
-        ERRCHECK(result);
-        result = playingchannel->getFrequency(&soundfrequency);
-        ERRCHECK(result);
-        
-        /* 
-            Now calculate the length of the sound in 'output samples'.  
-            Ie if a 44khz sound is 22050 samples long, and the output rate is 48khz, then we want to delay by 24000 output samples.
-        */
-        soundlength *= outputrate;   
-        soundlength /= (int)soundfrequency;
-        
-        startdelay += soundlength; /* Add output rate adjusted sound length, to the clock value of the sound that is currently playing */
+}
 
-        result = newchannel->setDelay(startdelay, 0); /* Set the delay of the new sound to the end of the old sound */
-        ERRCHECK(result);
-    }
-    else
-    {
-        unsigned int bufferlength;
-        unsigned long long startdelay;
+FMOD_RESULT setup_channel(void * /*userdata*/, FMOD::Channel *newchannel)
+{
+    FMOD_RESULT result;
+    float val, variation;
 
-        result = gSystem->getDSPBufferSize(&bufferlength, 0);
-        ERRCHECK(result);
+    /*
+        Randomize pitch/volume to make it sound more realistic / random.
+    */
+    result = newchannel->getFrequency(&val);
+    ERRCHECK(result);
+    variation = (((float)(rand()%10000) / 5000.0f) - 1.0f); /* -1.0 to +1.0 */
+    val *= (1.0f + (variation * 0.02f));                    /* @22khz, range fluctuates from 21509 to 22491 */
+    result = newchannel->setFrequency(val);
+    ERRCHECK(result);
 
-        result = newchannel->getDSPClock(0, &startdelay);
-        ERRCHECK(result);
+    result = newchannel->getVolume(&val);
+    ERRCHECK(result);
+    variation = ((float)(rand()%10000) / 10000.0f);         /*  0.0 to 1.0 */
+    val *= (1.0f - (variation * 0.2f));                     /*  0.8 to 1.0 */
+    result = newchannel->setVolume(val);
+    ERRCHECK(result);
 
-        startdelay += (2 * bufferlength);
-        result = newchannel->setDelay(startdelay, 0);
-        ERRCHECK(result);
-    }
-    
-    {
-        float val, variation;
-        
-        /*
-            Randomize pitch/volume to make it sound more realistic / random.
-        */
-        result = newchannel->getFrequency(&val);
-        ERRCHECK(result);
-        variation = (((float)(rand()%10000) / 5000.0f) - 1.0f); /* -1.0 to +1.0 */
-        val *= (1.0f + (variation * 0.02f));                    /* @22khz, range fluctuates from 21509 to 22491 */
-        result = newchannel->setFrequency(val);
-        ERRCHECK(result);
+    return FMOD_OK;
+}
 
-        result = newchannel->getVolume(&val);
-        ERRCHECK(result);
-        variation = ((float)(rand()%10000) / 10000.0f);         /*  0.0 to 1.0 */
-        val *= (1.0f - (variation * 0.2f));                     /*  0.8 to 1.0 */
-        result = newchannel->setVolume(val);
-        ERRCHECK(result);
-    }   
-        
-    result = newchannel->setPaused(false);
+void sound_finished(void *userdata, FMOD::Sound *oldsound)
+{
+#ifdef USE_STREAMS
+    FMOD_RESULT result = ((StreamPool *)userdata)->recycle(oldsound);
     ERRCHECK(result);
-       
-    return newchannel;
+#else
+    (void)userdata;
+    (void)oldsound;
+#endif
 }
 
 int FMOD_Main()
 {
-    FMOD::Channel    *channel[2] = { 0,0 };
+    GrainSequencer    sequencer;
+#ifdef USE_STREAMS
+    StreamPool        streampool;
+    GrainSource       source = { pick_next_sound, setup_channel, sound_finished, &streampool };
+#else
+    GrainSource       source = { pick_next_sound, setup_channel, sound_finished, 0 };
+#endif
     FMOD_RESULT       result;
-    int               outputrate, slot = 0;
+    int               outputrate;
     unsigned int      version;
     void             *extradriverdata = 0;
     bool              paused = false;
@@ -177,13 +146,27 @@ int FMOD_Main()
         Common_Fatal("FMOD lib version %08x doesn't match header version %08x", version, FMOD_VERSION);
     }
     
+#ifdef USE_STREAMS
+    result = AsyncFile_InstallFileSystem(gSystem, 0);
+    ERRCHECK(result);
+#endif
+
     result = gSystem->init(100, FMOD_INIT_NORMAL, extradriverdata);
     ERRCHECK(result);
        
     result = gSystem->getSoftwareFormat(&outputrate, 0, 0);
     ERRCHECK(result);   
    
-#if !defined(USE_STREAMS)
+#ifdef USE_STREAMS
+    {
+        FMOD_CREATESOUNDEXINFO info;
+        memset(&info, 0, sizeof(FMOD_CREATESOUNDEXINFO));
+        info.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);
+        info.suggestedsoundtype = FMOD_SOUND_TYPE_OGGVORBIS;
+        result = streampool.init(gSystem, soundname, NUMSOUNDS, SPARESTREAMS, FMOD_IGNORETAGS | FMOD_LOWMEM, &info);
+        ERRCHECK(result);
+    }
+#else
     for (unsigned int count = 0; count < NUMSOUNDS; count++)
     {
         result = gSystem->createSound(soundname[count], FMOD_IGNORETAGS, 0, &sound[count]);
@@ -192,16 +175,16 @@ int FMOD_Main()
 #endif
 
     /*
-        Kick off the first 2 sounds.  First one is immediate, second one will be triggered to start after the first one.
+        Kick off the sequencer. It queues up the first few sounds and keeps going by itself from there.
     */
-    channel[slot] = queue_next_sound(outputrate, channel[1-slot], rand()%NUMSOUNDS, slot);
-    slot = 1-slot;  /* flip */
-    channel[slot] = queue_next_sound(outputrate, channel[1-slot], rand()%NUMSOUNDS, slot);
-    slot = 1-slot;  /* flip */
+    result = sequencer.init(gSystem, source, LOOKAHEAD, MINAHEAD_MS, CROSSFADE_MS);
+    ERRCHECK(result);
+    result = sequencer.start();
+    ERRCHECK(result);
 
     do
     {
-        bool isplaying = false;
+        GrainSequencerStats stats;
 
         Common_Update();
 
@@ -217,35 +200,23 @@ int FMOD_Main()
             ERRCHECK(result);
         }
 
-        result = gSystem->update();
-        ERRCHECK(result);
+        if (Common_BtnPress(BTN_ACTION2))
+        {
+            Common_Sleep(200);  /* Simulate a long frame, the queued sounds cover it. */
+        }
 
         /*
-            Replace the sound that just finished with a new sound, to create endless seamless stitching!
+            Channel end callbacks are fired from here, that is where the sequencer queues up new sounds.
         */
-        result = channel[slot]->isPlaying(&isplaying);
-        if (result != FMOD_ERR_INVALID_HANDLE)
-        {
-            ERRCHECK(result);
-        }
+        result = gSystem->update();
+        ERRCHECK(result);
 
-        if (!isplaying && !paused)
-        {
 #ifdef USE_STREAMS
-            /* 
-                Release the sound that isn't playing any more. 
-            */
-            result = sound[slot]->release();       
-            ERRCHECK(result);
-            sound[slot] = 0;
+        result = streampool.update();
+        ERRCHECK(result);
 #endif
 
-            /*
-                Replace sound that just ended with a new sound, queued up to trigger exactly after the other sound ends.
-            */
-            channel[slot] = queue_next_sound(outputrate, channel[1-slot], rand()%NUMSOUNDS, slot);
-            slot = 1-slot;  /* flip */
-        }
+        sequencer.getStats(&stats);
 
         Common_Draw("==================================================");
         Common_Draw("Granular Synthesis SetDelay Example.");
@@ -255,27 +226,44 @@ int FMOD_Main()
         Common_Draw("Toggle #define USE_STREAM on/off in code to switch between streams and static samples.");
         Common_Draw("");
         Common_Draw("Press %s to pause", Common_BtnStr(BTN_ACTION1));
+        Common_Draw("Press %s to stall for 200ms", Common_BtnStr(BTN_ACTION2));
         Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
         Common_Draw("");
         Common_Draw("Channels are %s", paused ? "paused" : "playing");
+        Common_Draw("Queued %d, played %d, gaps %d, %dms ahead", stats.scheduled, stats.played, stats.late, (int)(stats.ahead * 1000 / outputrate));
+#ifdef USE_STREAMS
+        {
+            StreamPoolStats poolstats;
+            streampool.getStats(&poolstats);
+            Common_Draw("Stream pool: %d hits, %d misses, %d recycled, %d ready, %d opening", poolstats.hits, poolstats.misses, poolstats.recycled, poolstats.ready, poolstats.pending);
+        }
+#endif
 
-        Common_Sleep(10);   /* If you wait too long, ie longer than the length of the shortest sound, you will get gaps. */
+        Common_Sleep(10);
     } while (!Common_BtnPress(BTN_QUIT));
 
     /*
         Shut down
     */
-    for (unsigned int count = 0; count < sizeof(sound) / sizeof(sound[0]); count++)
+    result = sequencer.release();
+    ERRCHECK(result);
+
+#ifdef USE_STREAMS
+    result = streampool.release();
+    ERRCHECK(result);
+#else
+    for (unsigned int count = 0; count < NUMSOUNDS; count++)
     {
-        if (sound[count])
-        {
-            result = sound[count]->release();
-            ERRCHECK(result);
-        }
+        result = sound[count]->release();
+        ERRCHECK(result);
     }
+#endif
     
     result = gSystem->release();
     ERRCHECK(result);
+#ifdef USE_STREAMS
+    AsyncFile_Shutdown();
+#endif
 
     Common_Close();
 
@@ -5,21 +5,92 @@ Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
 This example is simply a variant of the Play Sound example, but it loads the
 data into memory then uses the 'load from memory' feature of 
 System::createSound.
+
+The files are mmapped rather than read into a heap buffer and handed to
+FMOD with FMOD_OPENMEMORY, which copies them straight out of the mapping.
+Sounds created with FMOD_CREATECOMPRESSEDSAMPLE would point into the mapping
+instead. See asset_store.h.
+
+All the sounds are loaded at once by a SoundLoader (see sound_loader.h), which
+spreads them across one thread per core. The fourth button loads a made up
+level of LEVEL_SOUNDS Ogg Vorbis samples, alternately on one thread and on
+every core, and shows how long each took to be ready to play.
 ==============================================================================*/
 #include "fmod.hpp"
 #include "common.h"
+#include "asset_store.h"
+#include "sound_loader.h"
+#include <string.h>
+#include <sys/time.h>
+
+#define LEVEL_SOUNDS    1024
+
+static SoundLoaderEntry gLevel[LEVEL_SOUNDS];
+static char             gLevelPaths[4][256];
+
+static unsigned int Example_Milliseconds()
+{
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return (unsigned int)(now.tv_sec * 1000 + now.tv_usec / 1000);
+}
+
+/*
+    Runs on the main thread from SoundLoader::update, never on a loader thread.
+*/
+static void soundLoaded(SoundLoaderEntry *entry, void * /*userdata*/)
+{
+    ERRCHECK(entry->result);
+    *(FMOD::Sound **)entry->userdata = entry->sound;
+}
+
+static void releaseLevel(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (gLevel[i].sound)
+        {
+            FMOD_RESULT result = AssetStore_ReleaseSound(gLevel[i].sound);
+            ERRCHECK(result);
+            gLevel[i].sound = 0;
+        }
+    }
+}
+
+static void loadLevel(SoundLoader *loader)
+{
+    static const char *files[] = { "c.ogg", "d.ogg", "e.ogg", "stereo.ogg" };
+
+    for (int i = 0; i < 4; i++)
+    {
+        strncpy(gLevelPaths[i], Common_MediaPath(files[i]), sizeof(gLevelPaths[i]) - 1);
+    }
+
+    for (int i = 0; i < LEVEL_SOUNDS; i++)
+    {
+        memset(&gLevel[i], 0, sizeof(SoundLoaderEntry));
+        gLevel[i].type = SOUND_LOADER_SOUND;
+        gLevel[i].path = gLevelPaths[i % 4];
+        gLevel[i].mode = FMOD_SOFTWARE | FMOD_LOOP_OFF;
+    }
+
+    FMOD_RESULT result = loader->load(gLevel, LEVEL_SOUNDS, 0, 0);
+    ERRCHECK(result);
+}
 
 int FMOD_Main()
 {
     FMOD::System     *system;
-    FMOD::Sound      *sound1, *sound2, *sound3;
+    FMOD::Sound      *sound1 = 0, *sound2 = 0, *sound3 = 0;
+    SoundLoader       loader, serialloader;
+    SoundLoader      *levelloader = 0;
+    unsigned int      levelstart = 0;
+    unsigned int      leveltime[2] = { 0, 0 };      /* One thread, every core. */
+    int               levelruns = 0;
     FMOD::Channel    *channel = 0;
     FMOD_RESULT       result;
     unsigned int      version;
     void             *extradriverdata = 0;
-    void             *buff = 0;
-    int               length = 0;
-    FMOD_CREATESOUNDEXINFO exinfo;
     
     Common_Init(&extradriverdata);
 
@@ -40,32 +111,34 @@ int FMOD_Main()
     result = system->init(32, FMOD_INIT_NORMAL, extradriverdata);
     ERRCHECK(result);
     
-    Common_LoadFileMemory(Common_MediaPath("drumloop.wav"), &buff, &length);
-    memset(&exinfo, 0, sizeof(FMOD_CREATESOUNDEXINFO));
-    exinfo.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);
-    exinfo.length = length;
-
-    result = system->createSound((const char *)buff, FMOD_HARDWARE | FMOD_OPENMEMORY | FMOD_LOOP_OFF, &exinfo, &sound1);
+    result = loader.init(system, 0);
     ERRCHECK(result);
-    Common_UnloadFileMemory(buff); // don't need the original memory any more.  Note!  If loading as a stream, the memory must stay active so do not free it!
-
-    Common_LoadFileMemory(Common_MediaPath("jaguar.wav"), &buff, &length);
-    memset(&exinfo, 0, sizeof(FMOD_CREATESOUNDEXINFO));
-    exinfo.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);
-    exinfo.length = length;    
-   
-    result = system->createSound((const char *)buff, FMOD_SOFTWARE | FMOD_OPENMEMORY, &exinfo, &sound2);
+    result = serialloader.init(system, 1);
     ERRCHECK(result);
-    Common_UnloadFileMemory(buff); // don't need the original memory any more.  Note!  If loading as a stream, the memory must stay active so do not free it!
-    
-    Common_LoadFileMemory(Common_MediaPath("swish.wav"), &buff, &length);
-    memset(&exinfo, 0, sizeof(FMOD_CREATESOUNDEXINFO));
-    exinfo.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);
-    exinfo.length = length;    
 
-    result = system->createSound((const char *)buff, FMOD_HARDWARE | FMOD_OPENMEMORY, &exinfo, &sound3);
-    ERRCHECK(result);
-    Common_UnloadFileMemory(buff); // don't need the original memory any more.  Note!  If loading as a stream, the memory must stay active so do not free it!
+    /*
+        The memory stays mapped until each sound is released with AssetStore_ReleaseSound, so streams work too.
+        The loader reads the paths on its own threads, so they're copied out of Common_MediaPath's temporary strings.
+    */
+    {
+        char paths[3][256];
+        SoundLoaderEntry entries[3];
+
+        memset(paths, 0, sizeof(paths));
+        memset(entries, 0, sizeof(entries));
+        strncpy(paths[0], Common_MediaPath("drumloop.wav"), sizeof(paths[0]) - 1);
+        strncpy(paths[1], Common_MediaPath("jaguar.wav"), sizeof(paths[1]) - 1);
+        strncpy(paths[2], Common_MediaPath("swish.wav"), sizeof(paths[2]) - 1);
+
+        entries[0].type = SOUND_LOADER_SOUND; entries[0].path = paths[0]; entries[0].mode = FMOD_HARDWARE | FMOD_LOOP_OFF; entries[0].userdata = &sound1;
+        entries[1].type = SOUND_LOADER_SOUND; entries[1].path = paths[1]; entries[1].mode = FMOD_SOFTWARE;                 entries[1].userdata = &sound2;
+        entries[2].type = SOUND_LOADER_SOUND; entries[2].path = paths[2]; entries[2].mode = FMOD_HARDWARE;                 entries[2].userdata = &sound3;
+
+        result = loader.load(entries, 3, soundLoaded, 0);
+        ERRCHECK(result);
+
+        loader.wait();
+    }
 
     /*
         Main loop
@@ -92,6 +165,33 @@ int FMOD_Main()
             ERRCHECK(result);
         }
 
+        if (Common_BtnPress(BTN_ACTION4) && !levelloader)
+        {
+            releaseLevel(LEVEL_SOUNDS);
+
+            levelloader = (levelruns & 1) ? &loader : &serialloader;
+            levelstart = Example_Milliseconds();
+            loadLevel(levelloader);
+        }
+
+        loader.update();
+        serialloader.update();
+
+        SoundLoaderProgress progress;
+        memset(&progress, 0, sizeof(progress));
+        if (levelloader)
+        {
+            levelloader->getProgress(&progress);
+            if (progress.done == progress.total)
+            {
+                ERRCHECK(progress.failed ? FMOD_ERR_FILE_BAD : FMOD_OK);
+
+                leveltime[levelruns & 1] = Example_Milliseconds() - levelstart;
+                levelruns++;
+                levelloader = 0;
+            }
+        }
+
         result = system->update();
         ERRCHECK(result);
 
@@ -145,10 +245,20 @@ int FMOD_Main()
             Common_Draw("Press %s to play a mono sound (drumloop)", Common_BtnStr(BTN_ACTION1));
             Common_Draw("Press %s to play a mono sound (jaguar)", Common_BtnStr(BTN_ACTION2));
             Common_Draw("Press %s to play a stereo sound (swish)", Common_BtnStr(BTN_ACTION3));
+            Common_Draw("Press %s to load a %d sound level on %s", Common_BtnStr(BTN_ACTION4), LEVEL_SOUNDS, (levelruns & 1) ? "every core" : "one thread");
             Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
             Common_Draw("");
             Common_Draw("Time %02d:%02d:%02d/%02d:%02d:%02d : %s", ms / 1000 / 60, ms / 1000 % 60, ms / 10 % 100, lenms / 1000 / 60, lenms / 1000 % 60, lenms / 10 % 100, paused ? "Paused " : playing ? "Playing" : "Stopped");
             Common_Draw("Channels Playing %2d", channelsplaying);
+            Common_Draw("");
+            if (levelloader)
+            {
+                Common_Draw("Loading level %4d/%4d, %6d KB", progress.done, progress.total, (int)(progress.bytes / 1024));
+            }
+            else
+            {
+                Common_Draw("Level ready in %5d ms on 1 thread, %5d ms on %d threads", leveltime[0], leveltime[1], loader.numThreads());
+            }
         }
 
         Common_Sleep(50);
@@ -157,11 +267,15 @@ int FMOD_Main()
     /*
         Shut down
     */
-    result = sound1->release();
+    loader.release();
+    serialloader.release();
+    releaseLevel(LEVEL_SOUNDS);
+
+    result = AssetStore_ReleaseSound(sound1);
     ERRCHECK(result);
-    result = sound2->release();
+    result = AssetStore_ReleaseSound(sound2);
     ERRCHECK(result);
-    result = sound3->release();
+    result = AssetStore_ReleaseSound(sound3);
     ERRCHECK(result);
     result = system->close();
     ERRCHECK(result);
@@ -0,0 +1,636 @@
+/*==============================================================================
+Loudness Meter
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "loudness_meter.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define LOUDNESS_METER_SURROUND_WEIGHT  1.41f   /* Channels behind the listener, BS.1770 table 3. */
+#define LOUDNESS_METER_MAX_PATH         1024
+
+/*
+    Filter and interpolator state for four channels, one per lane.
+*/
+struct LoudnessMeterGroup
+{
+    float   shelf[2][4];
+    float   highpass[2][4];
+    float   energy[4];                              /* Sum of squares so far this step. */
+    float   truepeak[4];
+    float   samplepeak[4];
+    float   history[2 * LOUDNESS_METER_TAPS][4];    /* Written twice so the taps are always contiguous. */
+    int     position;                               /* Of the newest sample. */
+};
+
+static double LoudnessMeter_LUFS(double power)
+{
+    return -0.691 + 10.0 * log10(power);
+}
+
+static float LoudnessMeter_Decibels(float linear)
+{
+    return (linear > 0.0f) ? 20.0f * log10f(linear) : -HUGE_VALF;
+}
+
+static void LoudnessMeter_WriteNumber(FILE *file, const char *key, double value, bool last)
+{
+    if (value == value && value > -HUGE_VAL && value < HUGE_VAL)
+    {
+        fprintf(file, "    \"%s\": %.2f%s\n", key, value, last ? "" : ",");
+    }
+    else
+    {
+        fprintf(file, "    \"%s\": null%s\n", key, last ? "" : ",");
+    }
+}
+
+static void LoudnessMeter_WriteString(FILE *file, const char *key, const char *value)
+{
+    fprintf(file, "    \"%s\": \"", key);
+    for (const unsigned char *c = (const unsigned char *)value; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(file, "\\%c", *c);
+        }
+        else if (*c < 0x20)
+        {
+            fprintf(file, "\\u%04x", *c);
+        }
+        else
+        {
+            fputc(*c, file);
+        }
+    }
+    fprintf(file, "\",\n");
+}
+
+LoudnessMeter::LoudnessMeter()
+{
+    m_samplerate = 0;
+    m_channels = 0;
+    m_groups = 0;
+    memset(m_weights, 0, sizeof(m_weights));
+    memset(m_shelf, 0, sizeof(m_shelf));
+    memset(m_highpass, 0, sizeof(m_highpass));
+    memset(m_phases, 0, sizeof(m_phases));
+    m_state = 0;
+    m_step_length = 0;
+    m_step_fill = 0;
+    m_num_steps = 0;
+    m_blocks = 0;
+    m_momentary = -HUGE_VALF;
+    m_shortterm = -HUGE_VALF;
+    m_integrated = -HUGE_VALF;
+    m_momentarymax = -HUGE_VALF;
+    m_shorttermmax = -HUGE_VALF;
+    m_truepeak = 0.0f;
+    m_samplepeak = 0.0f;
+    m_samples = 0;
+}
+
+FMOD_RESULT LoudnessMeter::init(int samplerate)
+{
+    if (samplerate < 8000)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    m_state = (LoudnessMeterGroup *)calloc(LOUDNESS_METER_GROUPS, sizeof(LoudnessMeterGroup));
+    if (!m_state)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    m_samplerate = samplerate;
+    m_step_length = (samplerate + 5) / 10;
+
+    /*
+        K-weighting, the BS.1770 high shelf and high pass worked out again for this rate. At 48 kHz these
+        come out as the coefficients in the standard.
+    */
+    {
+        double K = tan(M_PI * 1681.974450955533 / samplerate);
+        double Q = 0.7071752369554196;
+        double Vh = pow(10.0, 3.999843853973347 / 20.0);
+        double Vb = pow(Vh, 0.4996667741545416);
+        double a0 = 1.0 + K / Q + K * K;
+
+        m_shelf[0] = (float)((Vh + Vb * K / Q + K * K) / a0);
+        m_shelf[1] = (float)(2.0 * (K * K - Vh) / a0);
+        m_shelf[2] = (float)((Vh - Vb * K / Q + K * K) / a0);
+        m_shelf[3] = (float)(2.0 * (K * K - 1.0) / a0);
+        m_shelf[4] = (float)((1.0 - K / Q + K * K) / a0);
+
+        K = tan(M_PI * 38.13547087602444 / samplerate);
+        Q = 0.5003270373238773;
+        a0 = 1.0 + K / Q + K * K;
+
+        m_highpass[0] = (float)(2.0 * (K * K - 1.0) / a0);
+        m_highpass[1] = (float)((1.0 - K / Q + K * K) / a0);
+    }
+
+    /*
+        Interpolator, a Blackman windowed sinc cut off at the original Nyquist, split into four phases. Each
+        phase is normalized so DC passes at unity.
+    */
+    {
+        const int length = 4 * LOUDNESS_METER_TAPS;
+        const double centre = (length - 1) * 0.5;
+
+        for (int p = 0; p < 4; p++)
+        {
+            double sum = 0.0;
+            double taps[LOUDNESS_METER_TAPS];
+
+            for (int t = 0; t < LOUDNESS_METER_TAPS; t++)
+            {
+                int n = 4 * t + p;
+                double x = (n - centre) * 0.25 * M_PI;
+                double window = 0.42 - 0.5 * cos(2.0 * M_PI * n / (length - 1)) + 0.08 * cos(4.0 * M_PI * n / (length - 1));
+
+                taps[t] = sin(x) / x * window;
+                sum += taps[t];
+            }
+            for (int t = 0; t < LOUDNESS_METER_TAPS; t++)
+            {
+                m_phases[p][t] = (float)(taps[t] / sum);
+            }
+        }
+    }
+
+    m_channels = 0;
+    reset();
+
+    return FMOD_OK;
+}
+
+void LoudnessMeter::release()
+{
+    free(m_state);
+    m_state = 0;
+}
+
+void LoudnessMeter::reset()
+{
+    if (m_state)
+    {
+        memset(m_state, 0, LOUDNESS_METER_GROUPS * sizeof(LoudnessMeterGroup));
+    }
+    m_step_fill = 0;
+    memset(m_steps, 0, sizeof(m_steps));
+    m_num_steps = 0;
+    memset(m_bin_counts, 0, sizeof(m_bin_counts));
+    memset(m_bin_power, 0, sizeof(m_bin_power));
+    m_blocks = 0;
+
+    float silent = -HUGE_VALF, zero = 0.0f;
+    __atomic_store(&m_momentary, &silent, __ATOMIC_RELAXED);
+    __atomic_store(&m_shortterm, &silent, __ATOMIC_RELAXED);
+    __atomic_store(&m_integrated, &silent, __ATOMIC_RELAXED);
+    __atomic_store(&m_momentarymax, &silent, __ATOMIC_RELAXED);
+    __atomic_store(&m_shorttermmax, &silent, __ATOMIC_RELAXED);
+    __atomic_store(&m_truepeak, &zero, __ATOMIC_RELAXED);
+    __atomic_store(&m_samplepeak, &zero, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_samples, 0ULL, __ATOMIC_RELAXED);
+}
+
+void LoudnessMeter::configure(int channels)
+{
+    /*
+        LFE doesn't count and surrounds count a bit more, by FMOD's speaker order for each channel count.
+    */
+    for (int c = 0; c < LOUDNESS_METER_MAX_CHANNELS; c++)
+    {
+        m_weights[c] = (c < channels) ? 1.0f : 0.0f;
+    }
+    switch (channels)
+    {
+        case 4:
+            m_weights[2] = m_weights[3] = LOUDNESS_METER_SURROUND_WEIGHT;
+            break;
+        case 5:
+            m_weights[3] = m_weights[4] = LOUDNESS_METER_SURROUND_WEIGHT;
+            break;
+        case 6:
+        case 8:
+            m_weights[FMOD_SPEAKER_LOW_FREQUENCY] = 0.0f;
+            for (int c = FMOD_SPEAKER_SURROUND_LEFT; c < channels; c++)
+            {
+                m_weights[c] = LOUDNESS_METER_SURROUND_WEIGHT;
+            }
+            break;
+    }
+
+    __atomic_store_n(&m_channels, channels, __ATOMIC_RELAXED);
+    m_groups = (channels + 3) / 4;
+    reset();
+}
+
+void LoudnessMeter::filter(const float *buffer, unsigned int length)
+{
+    const int channels = m_channels;
+
+#if defined(__SSE2__)
+    /*
+        The high pass tails off into denormals on silence, flush them for the duration.
+    */
+    unsigned int csr = _mm_getcsr();
+    _mm_setcsr(csr | 0x8040);
+
+    const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 b0 = _mm_set1_ps(m_shelf[0]), b1 = _mm_set1_ps(m_shelf[1]), b2 = _mm_set1_ps(m_shelf[2]);
+    const __m128 a1 = _mm_set1_ps(m_shelf[3]), a2 = _mm_set1_ps(m_shelf[4]);
+    const __m128 h1 = _mm_set1_ps(m_highpass[0]), h2 = _mm_set1_ps(m_highpass[1]);
+    const __m128 minus2 = _mm_set1_ps(-2.0f);
+    __m128 phases[4][LOUDNESS_METER_TAPS];
+
+    for (int p = 0; p < 4; p++)
+    {
+        for (int t = 0; t < LOUDNESS_METER_TAPS; t++)
+        {
+            phases[p][t] = _mm_set1_ps(m_phases[p][t]);
+        }
+    }
+
+    for (int g = 0; g < m_groups; g++)
+    {
+        LoudnessMeterGroup *state = &m_state[g];
+        const int lanes = (channels - 4 * g < 4) ? channels - 4 * g : 4;
+        const float *in = buffer + 4 * g;
+        int position = state->position;
+
+        __m128 s1 = _mm_loadu_ps(state->shelf[0]), s2 = _mm_loadu_ps(state->shelf[1]);
+        __m128 t1 = _mm_loadu_ps(state->highpass[0]), t2 = _mm_loadu_ps(state->highpass[1]);
+        __m128 energy = _mm_loadu_ps(state->energy);
+        __m128 truepeak = _mm_loadu_ps(state->truepeak);
+        __m128 samplepeak = _mm_loadu_ps(state->samplepeak);
+
+        for (unsigned int i = 0; i < length; i++, in += channels)
+        {
+            __m128 x;
+            if (lanes == 4)
+            {
+                x = _mm_loadu_ps(in);
+            }
+            else if (lanes == 2)
+            {
+                x = _mm_castpd_ps(_mm_load_sd((const double *)in));
+            }
+            else
+            {
+                float padded[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (int lane = 0; lane < lanes; lane++)
+                {
+                    padded[lane] = in[lane];
+                }
+                x = _mm_loadu_ps(padded);
+            }
+
+            samplepeak = _mm_max_ps(samplepeak, _mm_and_ps(x, absmask));
+
+            position = position ? position - 1 : LOUDNESS_METER_TAPS - 1;
+            _mm_storeu_ps(state->history[position], x);
+            _mm_storeu_ps(state->history[position + LOUDNESS_METER_TAPS], x);
+
+            const float (*taps)[4] = state->history + position;
+            __m128 p0 = _mm_setzero_ps(), p1 = _mm_setzero_ps(), p2 = _mm_setzero_ps(), p3 = _mm_setzero_ps();
+            for (int t = 0; t < LOUDNESS_METER_TAPS; t++)
+            {
+                __m128 tap = _mm_loadu_ps(taps[t]);
+                p0 = _mm_add_ps(p0, _mm_mul_ps(tap, phases[0][t]));
+                p1 = _mm_add_ps(p1, _mm_mul_ps(tap, phases[1][t]));
+                p2 = _mm_add_ps(p2, _mm_mul_ps(tap, phases[2][t]));
+                p3 = _mm_add_ps(p3, _mm_mul_ps(tap, phases[3][t]));
+            }
+            truepeak = _mm_max_ps(truepeak, _mm_max_ps(_mm_max_ps(_mm_and_ps(p0, absmask), _mm_and_ps(p1, absmask)),
+                                                       _mm_max_ps(_mm_and_ps(p2, absmask), _mm_and_ps(p3, absmask))));
+
+            __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), s1);
+            s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), s2);
+            s2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+
+            __m128 z = _mm_add_ps(y, t1);
+            t1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(minus2, y), _mm_mul_ps(h1, z)), t2);
+            t2 = _mm_sub_ps(y, _mm_mul_ps(h2, z));
+
+            energy = _mm_add_ps(energy, _mm_mul_ps(z, z));
+        }
+
+        _mm_storeu_ps(state->shelf[0], s1);
+        _mm_storeu_ps(state->shelf[1], s2);
+        _mm_storeu_ps(state->highpass[0], t1);
+        _mm_storeu_ps(state->highpass[1], t2);
+        _mm_storeu_ps(state->energy, energy);
+        _mm_storeu_ps(state->truepeak, truepeak);
+        _mm_storeu_ps(state->samplepeak, samplepeak);
+        state->position = position;
+    }
+
+    _mm_setcsr(csr);
+#else
+    for (int c = 0; c < channels; c++)
+    {
+        LoudnessMeterGroup *state = &m_state[c >> 2];
+        const int lane = c & 3;
+        int position = state->position;
+
+        for (unsigned int i = 0; i < length; i++)
+        {
+            float x = buffer[i * channels + c];
+
+            state->samplepeak[lane] = (fabsf(x) > state->samplepeak[lane]) ? fabsf(x) : state->samplepeak[lane];
+
+            position = position ? position - 1 : LOUDNESS_METER_TAPS - 1;
+            state->history[position][lane] = x;
+            state->history[position + LOUDNESS_METER_TAPS][lane] = x;
+            for (int p = 0; p < 4; p++)
+            {
+                float sum = 0.0f;
+                for (int t = 0; t < LOUDNESS_METER_TAPS; t++)
+                {
+                    sum += state->history[position + t][lane] * m_phases[p][t];
+                }
+                state->truepeak[lane] = (fabsf(sum) > state->truepeak[lane]) ? fabsf(sum) : state->truepeak[lane];
+            }
+
+            float y = m_shelf[0] * x + state->shelf[0][lane];
+            state->shelf[0][lane] = m_shelf[1] * x - m_shelf[3] * y + state->shelf[1][lane];
+            state->shelf[1][lane] = m_shelf[2] * x - m_shelf[4] * y;
+
+            float z = y + state->highpass[0][lane];
+            state->highpass[0][lane] = -2.0f * y - m_highpass[0] * z + state->highpass[1][lane];
+            state->highpass[1][lane] = y - m_highpass[1] * z;
+
+            state->energy[lane] += z * z;
+        }
+
+        /*
+            Every channel in the group moves the shared position on, so only the last one keeps it.
+        */
+        if (lane == 3 || c == channels - 1)
+        {
+            state->position = position;
+        }
+    }
+#endif
+}
+
+void LoudnessMeter::step()
+{
+    double power = 0.0;
+
+    for (int c = 0; c < m_channels; c++)
+    {
+        float *energy = &m_state[c >> 2].energy[c & 3];
+        power += m_weights[c] * *energy;
+        *energy = 0.0f;
+    }
+    m_steps[m_num_steps % LOUDNESS_METER_SHORTTERM_STEPS] = power / m_step_length;
+    m_num_steps++;
+
+    float momentary = -HUGE_VALF, shortterm = -HUGE_VALF, value;
+
+    if (m_num_steps >= LOUDNESS_METER_MOMENTARY_STEPS)
+    {
+        double sum = 0.0;
+        for (int i = 1; i <= LOUDNESS_METER_MOMENTARY_STEPS; i++)
+        {
+            sum += m_steps[(m_num_steps - i) % LOUDNESS_METER_SHORTTERM_STEPS];
+        }
+        double block = sum / LOUDNESS_METER_MOMENTARY_STEPS;
+        double lufs = LoudnessMeter_LUFS(block);
+
+        /*
+            Every momentary block is also a gating block for the integrated loudness.
+        */
+        if (lufs >= LOUDNESS_METER_GATE)
+        {
+            int bin = (int)((lufs - LOUDNESS_METER_GATE) * 10.0);
+            bin = (bin < LOUDNESS_METER_BINS) ? bin : LOUDNESS_METER_BINS - 1;
+            m_bin_counts[bin]++;
+            m_bin_power[bin] += block;
+            m_blocks++;
+        }
+
+        momentary = (float)lufs;
+        if (momentary > m_momentarymax)
+        {
+            __atomic_store(&m_momentarymax, &momentary, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (m_num_steps >= LOUDNESS_METER_SHORTTERM_STEPS)
+    {
+        double sum = 0.0;
+        for (int i = 0; i < LOUDNESS_METER_SHORTTERM_STEPS; i++)
+        {
+            sum += m_steps[i];
+        }
+
+        shortterm = (float)LoudnessMeter_LUFS(sum / LOUDNESS_METER_SHORTTERM_STEPS);
+        if (shortterm > m_shorttermmax)
+        {
+            __atomic_store(&m_shorttermmax, &shortterm, __ATOMIC_RELAXED);
+        }
+    }
+
+    __atomic_store(&m_momentary, &momentary, __ATOMIC_RELAXED);
+    __atomic_store(&m_shortterm, &shortterm, __ATOMIC_RELAXED);
+
+    /*
+        Integrated, relative gate first, then the blocks above it. A bin counts as above if its centre is.
+    */
+    value = -HUGE_VALF;
+    if (m_blocks)
+    {
+        double sum = 0.0;
+        for (int bin = 0; bin < LOUDNESS_METER_BINS; bin++)
+        {
+            sum += m_bin_power[bin];
+        }
+
+        double relative = LoudnessMeter_LUFS(sum / m_blocks) - 10.0;
+        unsigned int count = 0;
+        sum = 0.0;
+        for (int bin = 0; bin < LOUDNESS_METER_BINS; bin++)
+        {
+            if (LOUDNESS_METER_GATE + (bin + 0.5) * 0.1 > relative)
+            {
+                count += m_bin_counts[bin];
+                sum += m_bin_power[bin];
+            }
+        }
+        if (count)
+        {
+            value = (float)LoudnessMeter_LUFS(sum / count);
+        }
+    }
+    __atomic_store(&m_integrated, &value, __ATOMIC_RELAXED);
+}
+
+void LoudnessMeter::publishPeaks()
+{
+    float truepeak = 0.0f, samplepeak = 0.0f;
+
+    for (int c = 0; c < m_channels; c++)
+    {
+        const LoudnessMeterGroup *state = &m_state[c >> 2];
+        truepeak = (state->truepeak[c & 3] > truepeak) ? state->truepeak[c & 3] : truepeak;
+        samplepeak = (state->samplepeak[c & 3] > samplepeak) ? state->samplepeak[c & 3] : samplepeak;
+    }
+
+    /*
+        The interpolator smooths over some inter-sample overs and can miss a lone sample, so true peak is never
+        less than sample peak.
+    */
+    truepeak = (samplepeak > truepeak) ? samplepeak : truepeak;
+
+    __atomic_store(&m_truepeak, &truepeak, __ATOMIC_RELAXED);
+    __atomic_store(&m_samplepeak, &samplepeak, __ATOMIC_RELAXED);
+}
+
+void LoudnessMeter::process(const float *buffer, unsigned int length, int channels)
+{
+    if (!m_state || channels < 1 || channels > LOUDNESS_METER_MAX_CHANNELS)
+    {
+        return;
+    }
+    if (channels != m_channels)
+    {
+        configure(channels);
+    }
+
+    unsigned long long samples = m_samples + length;
+
+    while (length)
+    {
+        unsigned int count = m_step_length - m_step_fill;
+        count = (length < count) ? length : count;
+
+        filter(buffer, count);
+        buffer += count * channels;
+        length -= count;
+
+        m_step_fill += count;
+        if (m_step_fill == m_step_length)
+        {
+            step();
+            m_step_fill = 0;
+        }
+    }
+
+    publishPeaks();
+    __atomic_store_n(&m_samples, samples, __ATOMIC_RELAXED);
+}
+
+void LoudnessMeter::getResults(LoudnessResults *results) const
+{
+    float truepeak, samplepeak;
+
+    __atomic_load(&m_momentary, &results->momentary, __ATOMIC_RELAXED);
+    __atomic_load(&m_shortterm, &results->shortterm, __ATOMIC_RELAXED);
+    __atomic_load(&m_integrated, &results->integrated, __ATOMIC_RELAXED);
+    __atomic_load(&m_momentarymax, &results->momentarymax, __ATOMIC_RELAXED);
+    __atomic_load(&m_shorttermmax, &results->shorttermmax, __ATOMIC_RELAXED);
+    __atomic_load(&m_truepeak, &truepeak, __ATOMIC_RELAXED);
+    __atomic_load(&m_samplepeak, &samplepeak, __ATOMIC_RELAXED);
+
+    results->truepeak = LoudnessMeter_Decibels(truepeak);
+    results->samplepeak = LoudnessMeter_Decibels(samplepeak);
+    results->channels = __atomic_load_n(&m_channels, __ATOMIC_RELAXED);
+    results->samplerate = m_samplerate;
+    results->seconds = m_samplerate ? (double)__atomic_load_n(&m_samples, __ATOMIC_RELAXED) / m_samplerate : 0.0;
+}
+
+FMOD_RESULT LoudnessMeter::writeSidecar(const char *audiopath, const char *name) const
+{
+    char path[LOUDNESS_METER_MAX_PATH];
+    LoudnessResults results;
+
+    size_t length = strlen(audiopath);
+    if (length + sizeof(".json") > sizeof(path))
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    memcpy(path, audiopath, length + 1);
+    char *extension = strrchr(path, '.');
+    if (!extension || strchr(extension, '/'))
+    {
+        extension = path + length;
+    }
+    strcpy(extension, ".json");
+
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+
+    getResults(&results);
+
+    const char *filename = strrchr(audiopath, '/');
+    filename = filename ? filename + 1 : audiopath;
+
+    fprintf(file, "{\n");
+    if (name)
+    {
+        LoudnessMeter_WriteString(file, "name", name);
+    }
+    LoudnessMeter_WriteString(file, "file", filename);
+    fprintf(file, "    \"samplerate\": %d,\n", results.samplerate);
+    fprintf(file, "    \"channels\": %d,\n", results.channels);
+    fprintf(file, "    \"seconds\": %.3f,\n", results.seconds);
+    LoudnessMeter_WriteNumber(file, "integrated_lufs", results.integrated, false);
+    LoudnessMeter_WriteNumber(file, "momentary_max_lufs", results.momentarymax, false);
+    LoudnessMeter_WriteNumber(file, "shortterm_max_lufs", results.shorttermmax, false);
+    LoudnessMeter_WriteNumber(file, "true_peak_dbtp", results.truepeak, false);
+    LoudnessMeter_WriteNumber(file, "sample_peak_dbfs", results.samplepeak, true);
+    fprintf(file, "}\n");
+
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed)
+    {
+        return FMOD_ERR_FILE_BAD;
+    }
+
+    return FMOD_OK;
+}
+
+void LoudnessMeter::describe(FMOD_DSP_DESCRIPTION *desc)
+{
+    memset(desc, 0, sizeof(FMOD_DSP_DESCRIPTION));
+    strncpy(desc->name, "Loudness Meter", sizeof(desc->name));
+    desc->version = 0x00010000;
+    desc->numinputbuffers = 1;
+    desc->numoutputbuffers = 1;
+    desc->read = readCallback;
+    desc->userdata = this;
+}
+
+FMOD_RESULT F_CALLBACK LoudnessMeter::readCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+{
+    LoudnessMeter *meter;
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&meter);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    memcpy(outbuffer, inbuffer, length * inchannels * sizeof(float));
+    meter->process(inbuffer, length, inchannels);
+
+    return FMOD_OK;
+}
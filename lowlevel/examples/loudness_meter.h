@@ -0,0 +1,130 @@
+/*==============================================================================
+Loudness Meter
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Loudness and true peak as ITU-R BS.1770-4 and EBU R128 define them, measured
+on interleaved float blocks as they are mixed, so a render can be checked
+without reading the file back.
+
+Each channel goes through the two K-weighting biquads, and the mean square
+is summed in 100 ms steps. Momentary loudness covers the last 400 ms and
+short-term the last 3 s. Integrated loudness gates every 400 ms block,
+overlapping by 75%, at -70 LUFS and then 10 LU below the loudness of the
+blocks that passed. Blocks are kept in a histogram of 0.1 LU bins that holds
+their exact power, so a measurement of any length takes fixed memory. Only
+blocks near the relative gate can land on the wrong side of it.
+
+True peak is the highest absolute value of the signal upsampled 4x by a 48
+tap polyphase interpolator, or of the samples themselves if higher.
+
+Up to four channels share an SSE2 register, so both filters and the
+interpolator run on every channel of a stereo or quad mix at once, and on a
+5.1 or 7.1 mix in two passes.
+
+process runs on the mixer thread. getResults can be called from any thread
+and sees the loudness as of the last 100 ms step.
+==============================================================================*/
+#ifndef _LOUDNESS_METER_H
+#define _LOUDNESS_METER_H
+
+#include "fmod.hpp"
+
+#define LOUDNESS_METER_MAX_CHANNELS     8
+#define LOUDNESS_METER_GROUPS           (LOUDNESS_METER_MAX_CHANNELS / 4)
+#define LOUDNESS_METER_TAPS             12      /* Per phase of the 4x true peak interpolator. */
+#define LOUDNESS_METER_SHORTTERM_STEPS  30      /* 100 ms steps in the short-term window. */
+#define LOUDNESS_METER_MOMENTARY_STEPS  4
+#define LOUDNESS_METER_GATE             -70.0f  /* Absolute gate, LUFS. */
+#define LOUDNESS_METER_BINS             1000    /* 0.1 LU each from the gate up, louder blocks share the last. */
+
+/*
+    Loudness in LUFS and peaks in dB relative to full scale. Anything with nothing to measure yet, or below the
+    gate, is -HUGE_VALF.
+*/
+struct LoudnessResults
+{
+    float               momentary;          /* Last 400 ms. */
+    float               shortterm;          /* Last 3 s. */
+    float               integrated;         /* Gated, since the last reset. */
+    float               momentarymax;
+    float               shorttermmax;
+    float               truepeak;           /* dBTP. */
+    float               samplepeak;         /* dBFS. */
+    int                 channels;
+    int                 samplerate;
+    double              seconds;            /* Audio measured. */
+};
+
+struct LoudnessMeterGroup;
+
+class LoudnessMeter
+{
+public:
+    LoudnessMeter();
+
+    FMOD_RESULT init(int samplerate);
+    void        release();
+
+    /*
+        Starts a new measurement. Not thread safe against process.
+    */
+    void        reset();
+
+    /*
+        The channel count is taken from the first block. A block with a different count starts the measurement
+        over, one with more than LOUDNESS_METER_MAX_CHANNELS is ignored.
+    */
+    void        process(const float *buffer, unsigned int length, int channels);
+    void        getResults(LoudnessResults *results) const;
+
+    /*
+        Writes the results as JSON next to 'audiopath', with its extension replaced by .json. 'name' is
+        recorded with them and can be 0.
+    */
+    FMOD_RESULT writeSidecar(const char *audiopath, const char *name) const;
+
+    /*
+        Fills in a description for a pass-through DSP that meters what goes through it, with this as the
+        userdata.
+    */
+    void        describe(FMOD_DSP_DESCRIPTION *desc);
+
+    static FMOD_RESULT F_CALLBACK readCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels);
+
+private:
+    void        configure(int channels);
+    void        filter(const float *buffer, unsigned int length);
+    void        step();                     /* End of a 100 ms step. */
+    void        publishPeaks();
+
+    int                 m_samplerate;
+    int                 m_channels;
+    int                 m_groups;
+    float               m_weights[LOUDNESS_METER_MAX_CHANNELS];
+
+    float               m_shelf[5];         /* b0, b1, b2, a1, a2. */
+    float               m_highpass[2];      /* a1, a2, the numerator is 1, -2, 1. */
+    float               m_phases[4][LOUDNESS_METER_TAPS];
+
+    LoudnessMeterGroup *m_state;            /* LOUDNESS_METER_GROUPS of them. */
+    unsigned int        m_step_length;      /* Samples in a 100 ms step. */
+    unsigned int        m_step_fill;
+
+    double              m_steps[LOUDNESS_METER_SHORTTERM_STEPS];   /* Weighted mean square of each step, a ring. */
+    unsigned int        m_num_steps;        /* Ever, the ring index is this modulo the ring size. */
+    unsigned int        m_bin_counts[LOUDNESS_METER_BINS];
+    double              m_bin_power[LOUDNESS_METER_BINS];
+    unsigned int        m_blocks;           /* Blocks above the absolute gate. */
+
+    /* Published for getResults, only written by process. Peaks are linear. */
+    float               m_momentary;
+    float               m_shortterm;
+    float               m_integrated;
+    float               m_momentarymax;
+    float               m_shorttermmax;
+    float               m_truepeak;
+    float               m_samplepeak;
+    unsigned long long  m_samples;
+};
+
+#endif
@@ -0,0 +1,279 @@
+/*==============================================================================
+Mapped File System
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct MappedFileHandle
+{
+    MappedFile     *file;
+    unsigned int    position;
+    unsigned int    lastreadend;    /* Where the previous read stopped, a read starting here is sequential. */
+    unsigned int    readahead;      /* Current readahead window in bytes. */
+    unsigned int    advisedend;     /* WILLNEED has been issued up to this offset. */
+    unsigned int    sequentialstart;    /* MADV_SEQUENTIAL covers from here to advisedend while sequential. */
+    bool            sequential;
+};
+
+static MappedFile      *gMappedFiles = 0;
+static pthread_mutex_t  gMappedFilesLock = PTHREAD_MUTEX_INITIALIZER;
+
+MappedFile *MappedFile_Acquire(const char *path)
+{
+    pthread_mutex_lock(&gMappedFilesLock);
+
+    for (MappedFile *file = gMappedFiles; file; file = file->next)
+    {
+        if (!strcmp(file->path, path))
+        {
+            file->refcount++;
+            pthread_mutex_unlock(&gMappedFilesLock);
+            return file;
+        }
+    }
+
+    MappedFile *file = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size <= 0xFFFFFFFFLL)
+        {
+            void *data = 0;
+            if (info.st_size > 0)
+            {
+                data = mmap(0, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            }
+
+            if (data != MAP_FAILED)
+            {
+                file = (MappedFile *)calloc(1, sizeof(MappedFile));
+                if (!file || !(file->path = strdup(path)))
+                {
+                    free(file);
+                    munmap(data, (size_t)info.st_size);
+                    close(fd);
+                    pthread_mutex_unlock(&gMappedFilesLock);
+                    return 0;
+                }
+                file->data = data;
+                file->length = (unsigned int)info.st_size;
+                file->refcount = 1;
+                file->advice = MADV_NORMAL;
+                file->next = gMappedFiles;
+                gMappedFiles = file;
+            }
+        }
+
+        /*
+            The mapping keeps its own reference to the file, the descriptor isn't needed any more.
+        */
+        close(fd);
+    }
+
+    pthread_mutex_unlock(&gMappedFilesLock);
+    return file;
+}
+
+void MappedFile_Release(MappedFile *file)
+{
+    pthread_mutex_lock(&gMappedFilesLock);
+
+    if (--file->refcount == 0)
+    {
+        MappedFile **link = &gMappedFiles;
+        while (*link != file)
+        {
+            link = &(*link)->next;
+        }
+        *link = file->next;
+
+        if (file->length)
+        {
+            munmap((void *)file->data, file->length);
+        }
+        free(file->path);
+        free(file);
+    }
+
+    pthread_mutex_unlock(&gMappedFilesLock);
+}
+
+void MappedFile_Advise(const MappedFile *file, unsigned int offset, unsigned int length, int advice)
+{
+    if (offset >= file->length || !length)
+    {
+        return;
+    }
+    if (length > file->length - offset)
+    {
+        length = file->length - offset;
+    }
+
+    /*
+        madvise wants a page aligned start, round the range out to whole pages.
+    */
+    unsigned long pagesize = (unsigned long)sysconf(_SC_PAGESIZE);
+    unsigned long start = (unsigned long)file->data + offset;
+    unsigned long end = start + length;
+
+    start &= ~(pagesize - 1);
+    madvise((void *)start, end - start, advice);
+}
+
+void MappedFile_SetAdvice(MappedFile *file, int advice)
+{
+    file->advice = advice;
+    MappedFile_Advise(file, 0, file->length, advice);
+}
+
+/*
+    Puts the mapping's own advice back over the range a sequential handle advised.
+*/
+static void MappedFile_EndSequential(MappedFileHandle *h)
+{
+    if (h->sequential)
+    {
+        h->sequential = false;
+        if (h->advisedend > h->sequentialstart)
+        {
+            MappedFile_Advise(h->file, h->sequentialstart, h->advisedend - h->sequentialstart, h->file->advice);
+        }
+    }
+}
+
+FMOD_RESULT F_CALLBACK MappedFile_Open(const char *name, int unicode, unsigned int *filesize, void **handle, void *userdata)
+{
+    if (unicode)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;  /* Wide paths aren't supported on POSIX. */
+    }
+
+    MappedFile *file = MappedFile_Acquire(name);
+    if (!file)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+
+    MappedFileHandle *h = (MappedFileHandle *)calloc(1, sizeof(MappedFileHandle));
+    if (!h)
+    {
+        MappedFile_Release(file);
+        return FMOD_ERR_MEMORY;
+    }
+
+    h->file = file;
+    h->readahead = MAPPED_FILE_READAHEAD_MIN;
+
+    /*
+        Every codec starts by parsing a header, fault that in before the first read asks for it.
+    */
+    MappedFile_Advise(file, 0, MAPPED_FILE_READAHEAD_MIN, MADV_WILLNEED);
+    h->advisedend = MAPPED_FILE_READAHEAD_MIN;
+
+    *filesize = file->length;
+    *handle = h;
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK MappedFile_Close(void *handle, void *userdata)
+{
+    MappedFileHandle *h = (MappedFileHandle *)handle;
+
+    MappedFile_EndSequential(h);
+    MappedFile_Release(h->file);
+    free(h);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK MappedFile_Read(void *handle, void *buffer, unsigned int sizebytes, unsigned int *bytesread, void *userdata)
+{
+    MappedFileHandle *h = (MappedFileHandle *)handle;
+    const MappedFile *file = h->file;
+    unsigned int pos = h->position;
+
+    *bytesread = 0;
+    if (pos >= file->length)
+    {
+        return FMOD_ERR_FILE_EOF;
+    }
+
+    unsigned int count = file->length - pos;
+    if (count > sizebytes)
+    {
+        count = sizebytes;
+    }
+
+    if (pos == h->lastreadend)
+    {
+        /*
+            Sequential, grow the readahead window the same way the kernel does for read().
+        */
+        if (!h->sequential && pos)
+        {
+            h->sequential = true;
+            h->sequentialstart = pos;
+        }
+        if (h->readahead < MAPPED_FILE_READAHEAD_MAX)
+        {
+            h->readahead *= 2;
+        }
+    }
+    else
+    {
+        /*
+            Random access.  Shrink the window so a seeking reader doesn't drag in pages it won't use.
+        */
+        MappedFile_EndSequential(h);
+        h->readahead = MAPPED_FILE_READAHEAD_MIN;
+        h->advisedend = pos;
+    }
+
+    {
+        unsigned int end = pos + count;
+        unsigned int target = (file->length - end > h->readahead) ? end + h->readahead : file->length;
+        unsigned int start = (h->advisedend > pos) ? h->advisedend : pos;
+
+        if (target > start)
+        {
+            if (h->sequential)
+            {
+                MappedFile_Advise(file, start, target - start, MADV_SEQUENTIAL);
+            }
+            MappedFile_Advise(file, start, target - start, MADV_WILLNEED);
+            h->advisedend = target;
+        }
+    }
+
+    memcpy(buffer, (const char *)file->data + pos, count);
+
+    h->position = pos + count;
+    h->lastreadend = h->position;
+    *bytesread = count;
+
+    return (count < sizebytes) ? FMOD_ERR_FILE_EOF : FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK MappedFile_Seek(void *handle, unsigned int pos, void *userdata)
+{
+    MappedFileHandle *h = (MappedFileHandle *)handle;
+
+    h->position = pos;
+    return FMOD_OK;
+}
+
+FMOD_RESULT MappedFile_InstallFileSystem(FMOD::System *system)
+{
+    /*
+        A blockalign of 0 stops FMOD buffering on top of us, the mapping already is the buffer.
+    */
+    return system->setFileSystem(MappedFile_Open, MappedFile_Close, MappedFile_Read, MappedFile_Seek, 0, 0, 0);
+}
@@ -0,0 +1,58 @@
+/*==============================================================================
+Mapped File System
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+FMOD file system callbacks that back every file with a read only mmap instead
+of FMOD's buffered file layer. Each path is mapped once per process and shared
+between all handles opening it, and because the mapping is shared the pages
+come straight from the OS page cache, so several processes reading the same
+banks only hold one copy.
+
+Reads are a memcpy out of the mapping. The handle watches its own access
+pattern: sequential readers get a WILLNEED readahead window that doubles up to
+MAPPED_FILE_READAHEAD_MAX, a seek shrinks the window back to
+MAPPED_FILE_READAHEAD_MIN.
+
+The mapping is shared, so advice that changes how the kernel pages it in,
+MADV_SEQUENTIAL or MADV_RANDOM, belongs to the mapping. MappedFile_SetAdvice
+sets that standing advice. A handle reading sequentially only advises
+MADV_SEQUENTIAL over the range it has read ahead, and puts the standing advice
+back over that range when it seeks or closes. Anyone else advising part of a
+mapping should do the same with MappedFile_Advise and file->advice.
+
+Install with MappedFile_InstallFileSystem before System::init, or before
+Studio::System::initialize via the low level system.
+==============================================================================*/
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include "fmod.hpp"
+
+#define MAPPED_FILE_READAHEAD_MIN   (64 * 1024)
+#define MAPPED_FILE_READAHEAD_MAX   (1024 * 1024)
+
+struct MappedFile
+{
+    char           *path;
+    const void     *data;
+    unsigned int    length;
+    int             refcount;
+    int             advice;         /* Standing advice for the whole mapping, MADV_NORMAL until set. */
+    MappedFile     *next;
+};
+
+/* Shared mappings, refcounted per path */
+MappedFile *MappedFile_Acquire(const char *path);
+void        MappedFile_Release(MappedFile *file);
+void        MappedFile_Advise(const MappedFile *file, unsigned int offset, unsigned int length, int advice);
+void        MappedFile_SetAdvice(MappedFile *file, int advice);
+
+/* FMOD file system callbacks */
+FMOD_RESULT F_CALLBACK MappedFile_Open (const char *name, int unicode, unsigned int *filesize, void **handle, void *userdata);
+FMOD_RESULT F_CALLBACK MappedFile_Close(void *handle, void *userdata);
+FMOD_RESULT F_CALLBACK MappedFile_Read (void *handle, void *buffer, unsigned int sizebytes, unsigned int *bytesread, void *userdata);
+FMOD_RESULT F_CALLBACK MappedFile_Seek (void *handle, unsigned int pos, void *userdata);
+
+FMOD_RESULT MappedFile_InstallFileSystem(FMOD::System *system);
+
+#endif
@@ -0,0 +1,498 @@
+/*==============================================================================
+Memory Pool
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "memory_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMORY_POOL_ALIGN       16
+#define MEMORY_POOL_LARGE       MEMORY_POOL_NUM_CLASSES     /* Size class stored in the header of large blocks. */
+
+/*
+    Every allocation is preceded by a header, which keeps the pointer handed to FMOD 16 byte aligned.
+*/
+struct MemoryPoolHeader
+{
+    unsigned int    size;           /* Usable bytes, what the allocation is accounted as. */
+    unsigned int    chunk;          /* Bytes taken from the arena for a large block, header included. */
+    unsigned short  sizeclass;
+    unsigned short  category;
+    unsigned int    pad;
+};
+
+struct MemoryPoolBlock
+{
+    MemoryPoolBlock *next;
+};
+
+struct MemoryPoolCache
+{
+    MemoryPoolBlock *head[MEMORY_POOL_NUM_CLASSES];
+    int              count[MEMORY_POOL_NUM_CLASSES];
+};
+
+struct MemoryPoolCentral
+{
+    pthread_mutex_t  lock;
+    MemoryPoolBlock *head;
+};
+
+struct MemoryPoolChunk
+{
+    unsigned int     size;
+    MemoryPoolChunk *next;
+};
+
+static const unsigned int gClassSize[MEMORY_POOL_NUM_CLASSES] =
+{
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, MEMORY_POOL_MAX_SMALL
+};
+
+static const char *gCategoryName[MEMORY_POOL_NUM_CATEGORIES] =
+{
+    "Normal", "Stream file", "Stream decode", "Sample data", "DSP buffer", "Plugin"
+};
+
+static unsigned char        gClassLookup[MEMORY_POOL_MAX_SMALL / MEMORY_POOL_ALIGN + 1];
+static MemoryPoolCentral    gCentral[MEMORY_POOL_NUM_CLASSES];
+static pthread_key_t        gCacheKey;     /* Each thread's MemoryPoolCache. */
+
+static pthread_mutex_t      gArenaLock = PTHREAD_MUTEX_INITIALIZER;
+static MemoryPoolChunk     *gArenaFree = 0;                 /* Address ordered, so neighbours can be merged. */
+static bool                 gUseArena = false;
+
+static unsigned int         gBudget = 0;
+static MemoryPoolStats      gStats;
+
+static void MemoryPool_Raise(unsigned int *mark, unsigned int value)
+{
+    unsigned int old = __atomic_load_n(mark, __ATOMIC_RELAXED);
+    while (value > old && !__atomic_compare_exchange_n(mark, &old, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static int MemoryPool_Category(FMOD_MEMORY_TYPE type)
+{
+    if (type & FMOD_MEMORY_STREAM_FILE)     return MEMORY_POOL_STREAM_FILE;
+    if (type & FMOD_MEMORY_STREAM_DECODE)   return MEMORY_POOL_STREAM_DECODE;
+    if (type & FMOD_MEMORY_SAMPLEDATA)      return MEMORY_POOL_SAMPLEDATA;
+    if (type & FMOD_MEMORY_DSP_BUFFER)      return MEMORY_POOL_DSP_BUFFER;
+    if (type & FMOD_MEMORY_PLUGIN)          return MEMORY_POOL_PLUGIN;
+    return MEMORY_POOL_NORMAL;
+}
+
+/*
+    Accounting. Charging happens before the memory is found, so the budget can refuse it up front.
+*/
+static bool MemoryPool_Charge(int category, unsigned int size)
+{
+    unsigned int total = __atomic_add_fetch(&gStats.total, size, __ATOMIC_RELAXED);
+
+    if (gBudget && total > gBudget)
+    {
+        __atomic_sub_fetch(&gStats.total, size, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&gStats.failed, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    MemoryPool_Raise(&gStats.totalhighwater, total);
+    MemoryPool_Raise(&gStats.highwater[category], __atomic_add_fetch(&gStats.current[category], size, __ATOMIC_RELAXED));
+    return true;
+}
+
+static void MemoryPool_Refund(int category, unsigned int size)
+{
+    __atomic_sub_fetch(&gStats.total, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&gStats.current[category], size, __ATOMIC_RELAXED);
+}
+
+/*
+    Backing memory, either malloc or first fit out of the arena.
+*/
+static void *MemoryPool_Reserve(unsigned int *size)
+{
+    void *mem = 0;
+
+    if (!gUseArena)
+    {
+        mem = malloc(*size);
+    }
+    else
+    {
+        pthread_mutex_lock(&gArenaLock);
+
+        MemoryPoolChunk **link = &gArenaFree;
+        while (*link && (*link)->size < *size)
+        {
+            link = &(*link)->next;
+        }
+
+        MemoryPoolChunk *chunk = *link;
+        if (chunk)
+        {
+            if (chunk->size - *size >= 4 * MEMORY_POOL_ALIGN)
+            {
+                MemoryPoolChunk *rest = (MemoryPoolChunk *)((char *)chunk + *size);
+                rest->size = chunk->size - *size;
+                rest->next = chunk->next;
+                *link = rest;
+            }
+            else
+            {
+                *size = chunk->size;    /* Too small a remainder to track, hand it all out. */
+                *link = chunk->next;
+            }
+            mem = chunk;
+        }
+
+        pthread_mutex_unlock(&gArenaLock);
+    }
+
+    if (mem)
+    {
+        __atomic_add_fetch(&gStats.reserved, *size, __ATOMIC_RELAXED);
+    }
+    return mem;
+}
+
+static void MemoryPool_Unreserve(void *mem, unsigned int size)
+{
+    __atomic_sub_fetch(&gStats.reserved, size, __ATOMIC_RELAXED);
+
+    if (!gUseArena)
+    {
+        free(mem);
+        return;
+    }
+
+    pthread_mutex_lock(&gArenaLock);
+
+    MemoryPoolChunk *chunk = (MemoryPoolChunk *)mem;
+    MemoryPoolChunk *prev = 0;
+    MemoryPoolChunk *next = gArenaFree;
+    while (next && next < chunk)
+    {
+        prev = next;
+        next = next->next;
+    }
+
+    chunk->size = size;
+    chunk->next = next;
+    if (next && (char *)chunk + chunk->size == (char *)next)
+    {
+        chunk->size += next->size;
+        chunk->next = next->next;
+    }
+
+    if (prev && (char *)prev + prev->size == (char *)chunk)
+    {
+        prev->size += chunk->size;
+        prev->next = chunk->next;
+    }
+    else if (prev)
+    {
+        prev->next = chunk;
+    }
+    else
+    {
+        gArenaFree = chunk;
+    }
+
+    pthread_mutex_unlock(&gArenaLock);
+}
+
+/*
+    Size classes.
+*/
+static bool MemoryPool_Refill(MemoryPoolCache *cache, int sizeclass)
+{
+    MemoryPoolCentral *central = &gCentral[sizeclass];
+    unsigned int blocksize = gClassSize[sizeclass] + sizeof(MemoryPoolHeader);
+
+    pthread_mutex_lock(&central->lock);
+
+    if (!central->head)
+    {
+        /*
+            Spans are never given back, the blocks cycle between the caches and the shared list.
+        */
+        unsigned int spansize = MEMORY_POOL_SPAN_SIZE;
+        char *span = (char *)MemoryPool_Reserve(&spansize);
+        if (!span)
+        {
+            pthread_mutex_unlock(&central->lock);
+            return false;
+        }
+
+        for (unsigned int offset = 0; offset + blocksize <= MEMORY_POOL_SPAN_SIZE; offset += blocksize)
+        {
+            MemoryPoolBlock *block = (MemoryPoolBlock *)(span + offset);
+            block->next = central->head;
+            central->head = block;
+        }
+    }
+
+    for (int i = 0; i < MEMORY_POOL_BATCH && central->head; i++)
+    {
+        MemoryPoolBlock *block = central->head;
+        central->head = block->next;
+        block->next = cache->head[sizeclass];
+        cache->head[sizeclass] = block;
+        cache->count[sizeclass]++;
+    }
+
+    pthread_mutex_unlock(&central->lock);
+    return true;
+}
+
+static void MemoryPool_Spill(MemoryPoolCache *cache, int sizeclass, int count)
+{
+    MemoryPoolCentral *central = &gCentral[sizeclass];
+
+    pthread_mutex_lock(&central->lock);
+    for (int i = 0; i < count && cache->head[sizeclass]; i++)
+    {
+        MemoryPoolBlock *block = cache->head[sizeclass];
+        cache->head[sizeclass] = block->next;
+        cache->count[sizeclass]--;
+        block->next = central->head;
+        central->head = block;
+    }
+    pthread_mutex_unlock(&central->lock);
+}
+
+static void MemoryPool_CacheDestroy(void *arg)
+{
+    MemoryPoolCache *cache = (MemoryPoolCache *)arg;
+
+    for (int i = 0; i < MEMORY_POOL_NUM_CLASSES; i++)
+    {
+        MemoryPool_Spill(cache, i, cache->count[i]);
+    }
+    free(cache);
+}
+
+static MemoryPoolCache *MemoryPool_GetCache()
+{
+    /*
+        The projects target 10.5, where Apple's compiler has no __thread. The key's destructor also hands the
+        blocks back when the thread exits.
+    */
+    MemoryPoolCache *cache = (MemoryPoolCache *)pthread_getspecific(gCacheKey);
+    if (!cache)
+    {
+        cache = (MemoryPoolCache *)calloc(1, sizeof(MemoryPoolCache));
+        if (cache)
+        {
+            pthread_setspecific(gCacheKey, cache);
+        }
+    }
+    return cache;
+}
+
+void * F_CALLBACK MemoryPool_Alloc(unsigned int size, FMOD_MEMORY_TYPE type, const char *sourcestr)
+{
+    int category = MemoryPool_Category(type);
+    MemoryPoolHeader *header;
+
+    if (size <= MEMORY_POOL_MAX_SMALL)
+    {
+        MemoryPoolCache *cache = MemoryPool_GetCache();
+        int sizeclass = gClassLookup[(size + MEMORY_POOL_ALIGN - 1) / MEMORY_POOL_ALIGN];
+
+        if (cache)
+        {
+            if (!MemoryPool_Charge(category, gClassSize[sizeclass]))
+            {
+                return 0;
+            }
+            if (!cache->head[sizeclass] && !MemoryPool_Refill(cache, sizeclass))
+            {
+                MemoryPool_Refund(category, gClassSize[sizeclass]);
+                __atomic_add_fetch(&gStats.failed, 1, __ATOMIC_RELAXED);
+                return 0;
+            }
+
+            MemoryPoolBlock *block = cache->head[sizeclass];
+            cache->head[sizeclass] = block->next;
+            cache->count[sizeclass]--;
+
+            header = (MemoryPoolHeader *)block;
+            header->size = gClassSize[sizeclass];
+            header->chunk = 0;
+            header->sizeclass = (unsigned short)sizeclass;
+            header->category = (unsigned short)category;
+            return header + 1;
+        }
+    }
+
+    /*
+        Large, or no thread cache could be made.
+    */
+    unsigned int usable = (size + MEMORY_POOL_ALIGN - 1) & ~(MEMORY_POOL_ALIGN - 1);
+    unsigned int chunk = usable + sizeof(MemoryPoolHeader);
+
+    if (!MemoryPool_Charge(category, usable))
+    {
+        return 0;
+    }
+
+    header = (MemoryPoolHeader *)MemoryPool_Reserve(&chunk);
+    if (!header)
+    {
+        MemoryPool_Refund(category, usable);
+        __atomic_add_fetch(&gStats.failed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    header->size = usable;
+    header->chunk = chunk;
+    header->sizeclass = MEMORY_POOL_LARGE;
+    header->category = (unsigned short)category;
+    return header + 1;
+}
+
+void F_CALLBACK MemoryPool_Free(void *ptr, FMOD_MEMORY_TYPE type, const char *sourcestr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    MemoryPoolHeader *header = (MemoryPoolHeader *)ptr - 1;
+    int sizeclass = header->sizeclass;
+
+    MemoryPool_Refund(header->category, header->size);
+
+    if (sizeclass == MEMORY_POOL_LARGE)
+    {
+        MemoryPool_Unreserve(header, header->chunk);
+        return;
+    }
+
+    /*
+        Blocks go to the freeing thread's cache, whichever thread allocated them.
+    */
+    MemoryPoolCache *cache = MemoryPool_GetCache();
+    MemoryPoolBlock *block = (MemoryPoolBlock *)header;
+
+    if (!cache)
+    {
+        pthread_mutex_lock(&gCentral[sizeclass].lock);
+        block->next = gCentral[sizeclass].head;
+        gCentral[sizeclass].head = block;
+        pthread_mutex_unlock(&gCentral[sizeclass].lock);
+        return;
+    }
+
+    block->next = cache->head[sizeclass];
+    cache->head[sizeclass] = block;
+    if (++cache->count[sizeclass] > 2 * MEMORY_POOL_BATCH)
+    {
+        MemoryPool_Spill(cache, sizeclass, MEMORY_POOL_BATCH);
+    }
+}
+
+void * F_CALLBACK MemoryPool_Realloc(void *ptr, unsigned int size, FMOD_MEMORY_TYPE type, const char *sourcestr)
+{
+    if (!ptr)
+    {
+        return MemoryPool_Alloc(size, type, sourcestr);
+    }
+
+    MemoryPoolHeader *header = (MemoryPoolHeader *)ptr - 1;
+    int category = MemoryPool_Category(type);
+
+    /*
+        Still fits the same block, nothing to move.
+    */
+    if (header->sizeclass != MEMORY_POOL_LARGE && size <= header->size && category == header->category &&
+        (header->sizeclass == 0 || size > gClassSize[header->sizeclass - 1]))
+    {
+        return ptr;
+    }
+
+    void *mem = MemoryPool_Alloc(size, type, sourcestr);
+    if (mem)
+    {
+        memcpy(mem, ptr, (size < header->size) ? size : header->size);
+        MemoryPool_Free(ptr, type, sourcestr);
+    }
+    return mem;
+}
+
+FMOD_RESULT MemoryPool_Initialize(void *arena, unsigned int arenasize, unsigned int budget)
+{
+    int sizeclass = 0;
+    for (unsigned int i = 0; i < sizeof(gClassLookup); i++)
+    {
+        while (i * MEMORY_POOL_ALIGN > gClassSize[sizeclass])
+        {
+            sizeclass++;
+        }
+        gClassLookup[i] = (unsigned char)sizeclass;
+    }
+
+    for (int i = 0; i < MEMORY_POOL_NUM_CLASSES; i++)
+    {
+        pthread_mutex_init(&gCentral[i].lock, 0);
+        gCentral[i].head = 0;
+    }
+
+    if (pthread_key_create(&gCacheKey, MemoryPool_CacheDestroy) != 0)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    memset(&gStats, 0, sizeof(gStats));
+    gBudget = budget;
+    gUseArena = (arena != 0);
+    gArenaFree = 0;
+
+    if (arena)
+    {
+        if (arenasize < MEMORY_POOL_SPAN_SIZE + MEMORY_POOL_ALIGN)
+        {
+            return FMOD_ERR_INVALID_PARAM;
+        }
+
+        char *start = (char *)(((size_t)arena + MEMORY_POOL_ALIGN - 1) & ~(size_t)(MEMORY_POOL_ALIGN - 1));
+        unsigned int length = (arenasize - (unsigned int)(start - (char *)arena)) & ~(MEMORY_POOL_ALIGN - 1);
+
+        gArenaFree = (MemoryPoolChunk *)start;
+        gArenaFree->size = length;
+        gArenaFree->next = 0;
+    }
+
+    return FMOD::Memory_Initialize(0, 0, MemoryPool_Alloc, MemoryPool_Realloc, MemoryPool_Free, FMOD_MEMORY_ALL);
+}
+
+void MemoryPool_SetBudget(unsigned int budget)
+{
+    gBudget = budget;
+}
+
+void MemoryPool_GetStats(MemoryPoolStats *stats)
+{
+    for (int i = 0; i < MEMORY_POOL_NUM_CATEGORIES; i++)
+    {
+        stats->current[i] = __atomic_load_n(&gStats.current[i], __ATOMIC_RELAXED);
+        stats->highwater[i] = __atomic_load_n(&gStats.highwater[i], __ATOMIC_RELAXED);
+    }
+    stats->total = __atomic_load_n(&gStats.total, __ATOMIC_RELAXED);
+    stats->totalhighwater = __atomic_load_n(&gStats.totalhighwater, __ATOMIC_RELAXED);
+    stats->reserved = __atomic_load_n(&gStats.reserved, __ATOMIC_RELAXED);
+    stats->failed = __atomic_load_n(&gStats.failed, __ATOMIC_RELAXED);
+
+    stats->fmodcurrent = 0;
+    stats->fmodmax = 0;
+    FMOD::Memory_GetStats(&stats->fmodcurrent, &stats->fmodmax, false);
+}
+
+const char *MemoryPool_CategoryName(int category)
+{
+    return (category >= 0 && category < MEMORY_POOL_NUM_CATEGORIES) ? gCategoryName[category] : "";
+}
@@ -0,0 +1,63 @@
+/*==============================================================================
+Memory Pool
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Allocator for FMOD::Memory_Initialize. Small allocations are rounded up to one
+of a fixed set of size classes and served from a per thread cache of free
+blocks, so the mixer thread and the stream thread never fight over a lock for
+the allocations they make every update. Caches refill from, and spill back to,
+a shared free list per size class in batches.
+
+Memory comes from malloc, or from a caller supplied arena if one is passed to
+MemoryPool_Initialize, in which case nothing outside the arena is ever used.
+An optional budget fails any allocation that would take the total in use past
+it, which FMOD reports as FMOD_ERR_MEMORY.
+
+Usage is tracked per FMOD_MEMORY_TYPE with a high-water mark for each.
+MemoryPool_Initialize must be called before the first System is created.
+==============================================================================*/
+#ifndef _MEMORY_POOL_H
+#define _MEMORY_POOL_H
+
+#include "fmod.hpp"
+
+#define MEMORY_POOL_NUM_CLASSES     16
+#define MEMORY_POOL_MAX_SMALL       4096            /* Largest size served from a size class. */
+#define MEMORY_POOL_SPAN_SIZE       (64 * 1024)     /* Bytes carved into blocks when a size class runs dry. */
+#define MEMORY_POOL_BATCH           32              /* Blocks moved between a thread cache and the shared list at once. */
+
+enum MemoryPoolCategory
+{
+    MEMORY_POOL_NORMAL,
+    MEMORY_POOL_STREAM_FILE,
+    MEMORY_POOL_STREAM_DECODE,
+    MEMORY_POOL_SAMPLEDATA,
+    MEMORY_POOL_DSP_BUFFER,
+    MEMORY_POOL_PLUGIN,
+
+    MEMORY_POOL_NUM_CATEGORIES
+};
+
+struct MemoryPoolStats
+{
+    unsigned int    current[MEMORY_POOL_NUM_CATEGORIES];    /* Bytes in use, by FMOD_MEMORY_TYPE. */
+    unsigned int    highwater[MEMORY_POOL_NUM_CATEGORIES];
+    unsigned int    total;                                  /* Bytes in use over all types. */
+    unsigned int    totalhighwater;
+    unsigned int    reserved;                               /* Bytes taken from malloc or the arena, including free blocks. */
+    unsigned int    failed;                                 /* Allocations refused by the budget or a full arena. */
+    int             fmodcurrent;                            /* As reported by FMOD::Memory_GetStats. */
+    int             fmodmax;
+};
+
+FMOD_RESULT MemoryPool_Initialize(void *arena, unsigned int arenasize, unsigned int budget);  /* arena 0 = use malloc, budget 0 = unlimited */
+void        MemoryPool_SetBudget(unsigned int budget);
+void        MemoryPool_GetStats(MemoryPoolStats *stats);
+const char *MemoryPool_CategoryName(int category);
+
+/* FMOD memory callbacks */
+void * F_CALLBACK MemoryPool_Alloc  (unsigned int size, FMOD_MEMORY_TYPE type, const char *sourcestr);
+void * F_CALLBACK MemoryPool_Realloc(void *ptr, unsigned int size, FMOD_MEMORY_TYPE type, const char *sourcestr);
+void   F_CALLBACK MemoryPool_Free   (void *ptr, FMOD_MEMORY_TYPE type, const char *sourcestr);
+
+#endif
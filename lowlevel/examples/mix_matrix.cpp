@@ -0,0 +1,328 @@
+/*==============================================================================
+Mix Matrix
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "mix_matrix.h"
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MIX_MATRIX_NUM_LAYOUTS  (FMOD_SPEAKERMODE_7POINT1 - FMOD_SPEAKERMODE_MONO + 1)
+#define MIX_MATRIX_NO_LFE       -1
+#define MIX_MATRIX_PI           3.14159265358979323846f
+
+struct MixMatrixLayout
+{
+    int     channels;
+    int     lfe;
+    float   angles[MIX_MATRIX_MAX_CHANNELS];    /* Degrees clockwise from straight ahead, in channel order. */
+};
+
+static const MixMatrixLayout gMixMatrix_Layouts[MIX_MATRIX_NUM_LAYOUTS] =
+{
+    { 1, MIX_MATRIX_NO_LFE, { 0 } },                                            /* Mono */
+    { 2, MIX_MATRIX_NO_LFE, { -30, 30 } },                                      /* Stereo */
+    { 4, MIX_MATRIX_NO_LFE, { -45, 45, -135, 135 } },                           /* Quad, FL FR SL SR */
+    { 5, MIX_MATRIX_NO_LFE, { -30, 30, 0, -110, 110 } },                        /* Surround, FL FR C SL SR */
+    { 6, 3,                 { -30, 30, 0, 0, -110, 110 } },                     /* 5.1, FL FR C LFE SL SR */
+    { 8, 3,                 { -30, 30, 0, 0, -90, 90, -150, 150 } }             /* 7.1, FL FR C LFE SL SR BL BR */
+};
+
+/*
+    One extra step on the end, a copy of the first, so interpolating never has to wrap.
+*/
+static float            gMixMatrix_PanLaw[MIX_MATRIX_NUM_LAYOUTS][MIX_MATRIX_PAN_STEPS + 1][MIX_MATRIX_MAX_CHANNELS];
+static pthread_once_t   gMixMatrix_Once = PTHREAD_ONCE_INIT;
+
+static const MixMatrixLayout *MixMatrix_Layout(FMOD_SPEAKERMODE mode)
+{
+    if (mode < FMOD_SPEAKERMODE_MONO || mode > FMOD_SPEAKERMODE_7POINT1)
+    {
+        return 0;
+    }
+    return &gMixMatrix_Layouts[mode - FMOD_SPEAKERMODE_MONO];
+}
+
+static float MixMatrix_Wrap(float degrees)
+{
+    degrees = fmodf(degrees, 360.0f);
+    return degrees < 0.0f ? degrees + 360.0f : degrees;
+}
+
+/*
+    Finds the pair of neighbouring speakers either side of 'azimuth', going round the circle, and splits the sound
+    between them.
+*/
+static void MixMatrix_PanPair(const MixMatrixLayout *layout, float azimuth, float *gains)
+{
+    float position = MixMatrix_Wrap(azimuth);
+    int   from = -1, to = -1;
+    float fromdistance = 360.0f, todistance = 360.0f;
+
+    for (int i = 0; i < layout->channels; i++)
+    {
+        if (i == layout->lfe)
+        {
+            continue;
+        }
+
+        float ahead = MixMatrix_Wrap(layout->angles[i] - position);    /* Clockwise from the sound to the speaker. */
+        float behind = MixMatrix_Wrap(position - layout->angles[i]);   /* And from the speaker to the sound. */
+        if (behind < fromdistance)
+        {
+            fromdistance = behind;
+            from = i;
+        }
+        if (ahead < todistance)
+        {
+            todistance = ahead;
+            to = i;
+        }
+    }
+
+    if (from == to || fromdistance + todistance <= 0.0f)
+    {
+        gains[from] = 1.0f;
+        return;
+    }
+
+    float across = fromdistance / (fromdistance + todistance) * (MIX_MATRIX_PI * 0.5f);
+    gains[from] = cosf(across);
+    gains[to] = sinf(across);
+}
+
+static void MixMatrix_BuildPanLaws()
+{
+    for (int mode = 0; mode < MIX_MATRIX_NUM_LAYOUTS; mode++)
+    {
+        const MixMatrixLayout *layout = &gMixMatrix_Layouts[mode];
+
+        for (int step = 0; step <= MIX_MATRIX_PAN_STEPS; step++)
+        {
+            float *gains = gMixMatrix_PanLaw[mode][step];
+            float azimuth = (float)(step % MIX_MATRIX_PAN_STEPS) * (360.0f / MIX_MATRIX_PAN_STEPS);
+
+            memset(gains, 0, MIX_MATRIX_MAX_CHANNELS * sizeof(float));
+
+            if (layout->channels == 1)
+            {
+                gains[0] = 1.0f;
+            }
+            else if (layout->channels == 2)
+            {
+                /*
+                    Fold behind to in front, then anything wider than the speakers is hard left or right.
+                */
+                azimuth = (azimuth > 180.0f) ? azimuth - 360.0f : azimuth;
+                azimuth = (azimuth > 90.0f) ? 180.0f - azimuth : (azimuth < -90.0f ? -180.0f - azimuth : azimuth);
+                azimuth = (azimuth > 30.0f) ? 30.0f : (azimuth < -30.0f ? -30.0f : azimuth);
+
+                float across = (azimuth + 30.0f) / 60.0f * (MIX_MATRIX_PI * 0.5f);
+                gains[0] = cosf(across);
+                gains[1] = sinf(across);
+            }
+            else
+            {
+                MixMatrix_PanPair(layout, azimuth, gains);
+            }
+        }
+    }
+}
+
+int MixMatrix_Channels(FMOD_SPEAKERMODE mode)
+{
+    const MixMatrixLayout *layout = MixMatrix_Layout(mode);
+    return layout ? layout->channels : 0;
+}
+
+FMOD_SPEAKERMODE MixMatrix_ModeFromChannels(int channels)
+{
+    for (int mode = 0; mode < MIX_MATRIX_NUM_LAYOUTS; mode++)
+    {
+        if (gMixMatrix_Layouts[mode].channels == channels)
+        {
+            return (FMOD_SPEAKERMODE)(FMOD_SPEAKERMODE_MONO + mode);
+        }
+    }
+    return FMOD_SPEAKERMODE_RAW;
+}
+
+FMOD_RESULT MixMatrix_Compile(MixMatrix *matrix, FMOD_SPEAKERMODE inmode, FMOD_SPEAKERMODE outmode, float azimuth)
+{
+    const MixMatrixLayout *in = MixMatrix_Layout(inmode);
+    const MixMatrixLayout *out = MixMatrix_Layout(outmode);
+
+    if (!in || !out)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    pthread_once(&gMixMatrix_Once, MixMatrix_BuildPanLaws);
+
+    matrix->inmode = inmode;
+    matrix->outmode = outmode;
+    matrix->inchannels = in->channels;
+    matrix->outchannels = out->channels;
+    matrix->azimuth = azimuth;
+    memset(matrix->gains, 0, sizeof(matrix->gains));
+
+    const float (*law)[MIX_MATRIX_MAX_CHANNELS] = gMixMatrix_PanLaw[outmode - FMOD_SPEAKERMODE_MONO];
+    float scale = 1.0f;
+    if (out->channels == 1)
+    {
+        scale = 1.0f / sqrtf((float)(in->channels - (in->lfe == MIX_MATRIX_NO_LFE ? 0 : 1)));
+    }
+
+    for (int i = 0; i < in->channels; i++)
+    {
+        if (i == in->lfe)
+        {
+            if (out->lfe != MIX_MATRIX_NO_LFE)
+            {
+                matrix->gains[out->lfe * in->channels + i] = 1.0f;
+            }
+            continue;
+        }
+
+        float position = MixMatrix_Wrap(in->angles[i] + azimuth) * (MIX_MATRIX_PAN_STEPS / 360.0f);
+        int   step = (int)position;
+        step = step >= MIX_MATRIX_PAN_STEPS ? MIX_MATRIX_PAN_STEPS - 1 : step;
+        float frac = position - (float)step;
+
+        for (int o = 0; o < out->channels; o++)
+        {
+            float gain = law[step][o] + (law[step + 1][o] - law[step][o]) * frac;
+            matrix->gains[o * in->channels + i] = gain * scale;
+        }
+    }
+
+    return FMOD_OK;
+}
+
+void MixMatrix_Apply(const MixMatrix *from, const MixMatrix *to, const float *in, float *out, unsigned int length)
+{
+    const int inchannels = to->inchannels;
+    const int outchannels = to->outchannels;
+    float columns[MIX_MATRIX_MAX_CHANNELS][MIX_MATRIX_MAX_CHANNELS];    /* [in][out], padded to 8 outputs. */
+    float deltas[MIX_MATRIX_MAX_CHANNELS][MIX_MATRIX_MAX_CHANNELS];
+    bool  ramp = false;
+
+    if (!length)
+    {
+        return;
+    }
+    if (!from || from->inchannels != inchannels || from->outchannels != outchannels)
+    {
+        from = to;
+    }
+
+    /*
+        The kernel wants the matrix a column at a time, every output an input reaches.
+    */
+    memset(columns, 0, sizeof(columns));
+    memset(deltas, 0, sizeof(deltas));
+    for (int i = 0; i < inchannels; i++)
+    {
+        for (int o = 0; o < outchannels; o++)
+        {
+            float start = from->gains[o * inchannels + i];
+            float end = to->gains[o * inchannels + i];
+
+            columns[i][o] = start;
+            if (start != end)
+            {
+                deltas[i][o] = (end - start) / (float)length;
+                ramp = true;
+            }
+        }
+    }
+
+#if defined(__SSE2__)
+    __m128 c0[MIX_MATRIX_MAX_CHANNELS], c1[MIX_MATRIX_MAX_CHANNELS];
+    __m128 d0[MIX_MATRIX_MAX_CHANNELS], d1[MIX_MATRIX_MAX_CHANNELS];
+    const unsigned int width = (outchannels > 4) ? 8 : 4;
+    const unsigned int total = length * outchannels;
+
+    for (int i = 0; i < inchannels; i++)
+    {
+        c0[i] = _mm_loadu_ps(&columns[i][0]);
+        c1[i] = _mm_loadu_ps(&columns[i][4]);
+        d0[i] = _mm_loadu_ps(&deltas[i][0]);
+        d1[i] = _mm_loadu_ps(&deltas[i][4]);
+    }
+
+    for (unsigned int s = 0; s < length; s++)
+    {
+        const float *x = in + s * inchannels;
+        float *y = out + s * outchannels;
+        __m128 a0 = _mm_setzero_ps();
+        __m128 a1 = _mm_setzero_ps();
+
+        for (int i = 0; i < inchannels; i++)
+        {
+            __m128 v = _mm_set1_ps(x[i]);
+            a0 = _mm_add_ps(a0, _mm_mul_ps(v, c0[i]));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(v, c1[i]));
+        }
+
+        if (ramp)
+        {
+            for (int i = 0; i < inchannels; i++)
+            {
+                c0[i] = _mm_add_ps(c0[i], d0[i]);
+                c1[i] = _mm_add_ps(c1[i], d1[i]);
+            }
+        }
+
+        /*
+            Whole registers are stored, spilling into the next frame's outputs which get written over when it's done.
+            Only the last few frames, where that would run off the end, go through a copy.
+        */
+        if (s * outchannels + width <= total)
+        {
+            _mm_storeu_ps(y, a0);
+            if (width == 8)
+            {
+                _mm_storeu_ps(y + 4, a1);
+            }
+        }
+        else
+        {
+            float frame[MIX_MATRIX_MAX_CHANNELS];
+            _mm_storeu_ps(frame, a0);
+            _mm_storeu_ps(frame + 4, a1);
+            memcpy(y, frame, outchannels * sizeof(float));
+        }
+    }
+#else
+    for (unsigned int s = 0; s < length; s++)
+    {
+        const float *x = in + s * inchannels;
+        float *y = out + s * outchannels;
+
+        for (int o = 0; o < outchannels; o++)
+        {
+            float sum = 0.0f;
+            for (int i = 0; i < inchannels; i++)
+            {
+                sum += x[i] * columns[i][o];
+            }
+            y[o] = sum;
+        }
+
+        if (ramp)
+        {
+            for (int i = 0; i < inchannels; i++)
+            {
+                for (int o = 0; o < outchannels; o++)
+                {
+                    columns[i][o] += deltas[i][o];
+                }
+            }
+        }
+    }
+#endif
+}
@@ -0,0 +1,54 @@
+/*==============================================================================
+Mix Matrix
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Builds and applies the matrices for panning and up or down mixing between
+speaker modes, mono to 7.1, the same layout ChannelControl::setMixMatrix
+takes: one row per output channel, one column per input channel.
+
+Each output speaker mode's constant power pan law is worked out once, the
+first time any matrix is compiled, into a table of speaker gains for every
+MIX_MATRIX_PAN_STEPS of azimuth. A sound between two speakers goes to that
+pair, with cos and sin of how far it is across, so its power stays the same
+as it moves. Compiling a matrix is then a table lookup per input channel: each
+one is placed at its own speaker's angle, turned by the azimuth, and LFE goes
+straight to LFE if there is one. At an azimuth of 0 that is the up or down mix
+between the two modes, and between the same two modes it's the identity.
+
+Stereo has nothing behind the listener, so sounds behind are folded to the
+front. Into mono every input channel gets 1/sqrt(channels), so uncorrelated
+channels keep their power.
+
+MixMatrix_Apply multiplies a block of interleaved samples by a matrix, one
+SSE register holding four output channels, and can move from one matrix to
+another across the block so a change doesn't click.
+==============================================================================*/
+#ifndef _MIX_MATRIX_H
+#define _MIX_MATRIX_H
+
+#include "fmod.hpp"
+
+#define MIX_MATRIX_MAX_CHANNELS     8
+#define MIX_MATRIX_PAN_STEPS        360     /* Pan law entries, one a degree. */
+
+struct MixMatrix
+{
+    FMOD_SPEAKERMODE    inmode;
+    FMOD_SPEAKERMODE    outmode;
+    int                 inchannels;
+    int                 outchannels;
+    float               azimuth;            /* Degrees clockwise from straight ahead. */
+    float               gains[MIX_MATRIX_MAX_CHANNELS * MIX_MATRIX_MAX_CHANNELS];   /* [out * inchannels + in] */
+};
+
+int                 MixMatrix_Channels(FMOD_SPEAKERMODE mode);          /* 0 for a mode with no fixed layout. */
+FMOD_SPEAKERMODE    MixMatrix_ModeFromChannels(int channels);           /* FMOD_SPEAKERMODE_RAW if no layout has that many. */
+
+FMOD_RESULT         MixMatrix_Compile(MixMatrix *matrix, FMOD_SPEAKERMODE inmode, FMOD_SPEAKERMODE outmode, float azimuth);
+
+/*
+    Ramps from 'from' to 'to' over the block, pass 0 or the same matrix for no ramp. 'in' and 'out' can't overlap.
+*/
+void                MixMatrix_Apply(const MixMatrix *from, const MixMatrix *to, const float *in, float *out, unsigned int length);
+
+#endif
@@ -0,0 +1,524 @@
+/*==============================================================================
+Mixer Watchdog
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "mixer_watchdog.h"
+#include "monotonic_clock.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+/*
+    CPU time of the calling thread, in seconds.
+*/
+static double MixerWatchdog_ThreadTime()
+{
+#if defined(__APPLE__)
+    thread_basic_info_data_t info;
+    mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+
+    if (thread_info(pthread_mach_thread_np(pthread_self()), THREAD_BASIC_INFO, (thread_info_t)&info, &count) != KERN_SUCCESS)
+    {
+        return 0.0;
+    }
+    return (double)(info.user_time.seconds + info.system_time.seconds) + (double)(info.user_time.microseconds + info.system_time.microseconds) * 1e-6;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/*
+    Values under 128 get a bucket each, above that each power of two is split into MIXER_WATCHDOG_SUB_BUCKETS.
+*/
+static int MixerWatchdog_Bucket(unsigned int value)
+{
+    if (value < 2 * MIXER_WATCHDOG_SUB_BUCKETS)
+    {
+        return (int)value;
+    }
+
+    int shift = 31 - __builtin_clz(value) - 6;
+    return (shift + 1) * MIXER_WATCHDOG_SUB_BUCKETS + (int)(value >> shift) - MIXER_WATCHDOG_SUB_BUCKETS;
+}
+
+/*
+    The highest value that lands in a bucket.
+*/
+static float MixerWatchdog_BucketValue(int bucket)
+{
+    if (bucket < 2 * MIXER_WATCHDOG_SUB_BUCKETS)
+    {
+        return (float)bucket;
+    }
+
+    int shift = bucket / MIXER_WATCHDOG_SUB_BUCKETS - 1;
+    unsigned int sub = bucket % MIXER_WATCHDOG_SUB_BUCKETS + MIXER_WATCHDOG_SUB_BUCKETS;
+    return (float)(((double)(sub + 1) * (double)(1u << shift)) - 1.0);
+}
+
+static FMOD_RESULT MixerWatchdog_Pass(float *inbuffer, float *outbuffer, unsigned int length, int inchannels)
+{
+    memcpy(outbuffer, inbuffer, length * inchannels * sizeof(float));
+    return FMOD_OK;
+}
+
+MixerWatchdog::MixerWatchdog()
+{
+    m_system = 0;
+    m_group = 0;
+    m_head = 0;
+    m_tail = 0;
+    m_deadline = 0.0f;
+    m_buffered = 0.0f;
+    m_origin = 0.0;
+    m_lasthead = 0.0;
+    m_lastcpu = 0.0;
+    m_tailtime = 0.0;
+    memset(m_histogram, 0, sizeof(m_histogram));
+    m_blocks = 0;
+    m_misses = 0;
+    m_stalls = 0;
+    m_dropped = 0;
+    m_total = 0;
+    m_last = 0.0f;
+    m_worst = 0.0f;
+    m_worstgap = 0.0f;
+    m_chain = 0.0f;
+    memset(m_queue, 0, sizeof(m_queue));
+    m_write = 0;
+    m_read = 0;
+    memset(m_kept, 0, sizeof(m_kept));
+    m_numkept = 0;
+    m_report = 0;
+    m_interval = 0.0f;
+    m_lastreport = 0.0;
+    m_reported = 0;
+}
+
+FMOD_RESULT MixerWatchdog::init(FMOD::System *system, FMOD::ChannelGroup *group, const char *reportpath, float interval)
+{
+    FMOD_DSP_DESCRIPTION desc;
+    unsigned int bufferlength;
+    int numbuffers;
+    int samplerate;
+    int numdsps;
+    FMOD_RESULT result;
+
+    if (!system || !group || (reportpath && interval <= 0.0f))
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    result = system->getDSPBufferSize(&bufferlength, &numbuffers);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+    result = system->getSoftwareFormat(&samplerate, 0, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_system = system;
+    m_group = group;
+    m_deadline = (float)bufferlength * 1e6f / samplerate;
+    m_buffered = m_deadline * numbuffers;
+    m_origin = MonotonicClock_Now();
+    m_lastreport = m_origin;
+    m_interval = interval;
+
+    if (reportpath)
+    {
+        m_report = fopen(reportpath, "a");
+        if (!m_report)
+        {
+            return FMOD_ERR_FILE_NOTFOUND;
+        }
+    }
+
+    memset(&desc, 0, sizeof(desc));
+    desc.version = 0x00010000;
+    desc.numinputbuffers = 1;
+    desc.numoutputbuffers = 1;
+    desc.userdata = this;
+
+    strncpy(desc.name, "Mixer Watchdog Tail", sizeof(desc.name));
+    desc.read = tailCallback;
+    result = system->createDSP(&desc, &m_tail);
+    if (result != FMOD_OK)
+    {
+        release();
+        return result;
+    }
+
+    strncpy(desc.name, "Mixer Watchdog Head", sizeof(desc.name));
+    desc.read = headCallback;
+    result = system->createDSP(&desc, &m_head);
+    if (result != FMOD_OK)
+    {
+        release();
+        return result;
+    }
+
+    /*
+        Tail first, so the head going in doesn't move the end of the chain.
+    */
+    result = group->getNumDSPs(&numdsps);
+    if (result == FMOD_OK)
+    {
+        result = group->addDSP(numdsps, m_tail, 0);
+    }
+    if (result == FMOD_OK)
+    {
+        result = group->addDSP(0, m_head, 0);
+    }
+    if (result != FMOD_OK)
+    {
+        release();
+        return result;
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT MixerWatchdog::release()
+{
+    FMOD_RESULT result = FMOD_OK;
+    FMOD::DSP *dsps[2] = { m_head, m_tail };
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!dsps[i])
+        {
+            continue;
+        }
+
+        /*
+            Not being on the group is fine, init might not have got that far.
+        */
+        m_group->removeDSP(dsps[i]);
+
+        FMOD_RESULT r = dsps[i]->release();
+        if (r != FMOD_OK && result == FMOD_OK)
+        {
+            result = r;
+        }
+    }
+    m_head = 0;
+    m_tail = 0;
+
+    if (m_report)
+    {
+        fclose(m_report);
+        m_report = 0;
+    }
+
+    return result;
+}
+
+FMOD_RESULT F_CALLBACK MixerWatchdog::tailCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+{
+    MixerWatchdog *watchdog;
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&watchdog);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    watchdog->m_tailtime = MonotonicClock_Now();
+
+    return MixerWatchdog_Pass(inbuffer, outbuffer, length, inchannels);
+}
+
+FMOD_RESULT F_CALLBACK MixerWatchdog::headCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+{
+    MixerWatchdog *watchdog;
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&watchdog);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    result = MixerWatchdog_Pass(inbuffer, outbuffer, length, inchannels);
+
+    /*
+        After the copy, so it's counted in this block rather than the next.
+    */
+    watchdog->block(MonotonicClock_Now(), MixerWatchdog_ThreadTime());
+
+    return result;
+}
+
+void MixerWatchdog::block(double now, double cpu)
+{
+    if (m_lasthead > 0.0)
+    {
+        float work = (cpu > m_lastcpu) ? (float)((cpu - m_lastcpu) * 1e6) : 0.0f;
+        float gap = (float)((now - m_lasthead) * 1e6);
+        float chain = (m_tailtime > m_lasthead) ? (float)((now - m_tailtime) * 1e6) : 0.0f;
+        int bucket = MixerWatchdog_Bucket(work > 4.0e9f ? 4000000000u : (unsigned int)work);
+        unsigned int blocks = m_blocks + 1;
+
+        /*
+            Only this thread writes, the atomics are so readers never see half a value.
+        */
+        __atomic_store_n(&m_histogram[bucket], m_histogram[bucket] + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_total, m_total + (unsigned long long)work, __ATOMIC_RELAXED);
+        __atomic_store(&m_last, &work, __ATOMIC_RELAXED);
+        __atomic_store(&m_chain, &chain, __ATOMIC_RELAXED);
+        if (work > m_worst)
+        {
+            __atomic_store(&m_worst, &work, __ATOMIC_RELAXED);
+        }
+        if (gap > m_worstgap)
+        {
+            __atomic_store(&m_worstgap, &gap, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&m_blocks, blocks, __ATOMIC_RELAXED);
+
+        if (work > m_deadline)
+        {
+            __atomic_store_n(&m_misses, m_misses + 1, __ATOMIC_RELAXED);
+            post(MIXER_WATCHDOG_MISS, now, work, gap, chain);
+        }
+        if (gap > m_buffered)
+        {
+            __atomic_store_n(&m_stalls, m_stalls + 1, __ATOMIC_RELAXED);
+            post(MIXER_WATCHDOG_STALL, now, work, gap, chain);
+        }
+    }
+
+    m_lasthead = now;
+    m_lastcpu = cpu;
+}
+
+void MixerWatchdog::post(MixerWatchdogKind kind, double now, float work, float gap, float chain)
+{
+    unsigned int write = m_write;
+
+    if (write - __atomic_load_n(&m_read, __ATOMIC_ACQUIRE) >= MIXER_WATCHDOG_QUEUE)
+    {
+        __atomic_store_n(&m_dropped, m_dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    MixerWatchdogEvent *event = &m_queue[write & (MIXER_WATCHDOG_QUEUE - 1)];
+    event->kind = kind;
+    event->block = m_blocks;
+    event->time = now - m_origin;
+    event->work = work;
+    event->gap = gap;
+    event->chain = chain;
+
+    __atomic_store_n(&m_write, write + 1, __ATOMIC_RELEASE);
+}
+
+void MixerWatchdog::walk(MixerWatchdogMiss *miss, FMOD::DSP *dsp, int depth)
+{
+    MixerWatchdogNode *node;
+    int numinputs = 0;
+
+    if (miss->numnodes == MIXER_WATCHDOG_MAX_NODES || depth > MIXER_WATCHDOG_MAX_DEPTH)
+    {
+        return;
+    }
+
+    node = &miss->nodes[miss->numnodes++];
+    memset(node, 0, sizeof(MixerWatchdogNode));
+    node->depth = depth;
+    dsp->getInfo(node->name, 0, 0, 0, 0);
+    dsp->getType(&node->type);
+    dsp->getActive(&node->active);
+    dsp->getBypass(&node->bypass);
+    dsp->getNumInputs(&numinputs);
+    node->inputs = numinputs;
+
+    for (int i = 0; i < numinputs; i++)
+    {
+        FMOD::DSP *input = 0;
+
+        if (dsp->getInput(i, &input, 0) == FMOD_OK && input)
+        {
+            walk(miss, input, depth + 1);
+        }
+    }
+}
+
+void MixerWatchdog::snapshot(MixerWatchdogMiss *miss)
+{
+    FMOD::DSP *head = 0;
+    float stream, geometry, update;
+
+    miss->cpudsp = 0.0f;
+    miss->cputotal = 0.0f;
+    miss->channels = 0;
+    miss->numnodes = 0;
+
+    m_system->getCPUUsage(&miss->cpudsp, &stream, &geometry, &update, &miss->cputotal);
+    m_system->getChannelsPlaying(&miss->channels);
+
+    if (m_group->getDSP(FMOD_CHANNELCONTROL_DSP_HEAD, &head) == FMOD_OK && head)
+    {
+        walk(miss, head, 0);
+    }
+}
+
+void MixerWatchdog::update()
+{
+    if (!m_system)
+    {
+        return;
+    }
+
+    /*
+        The graph is looked at here rather than when the miss happened, the mixer can't stop to walk it. It's
+        at most a frame later, and graphs don't often change that fast.
+    */
+    unsigned int write = __atomic_load_n(&m_write, __ATOMIC_ACQUIRE);
+    unsigned int read = m_read;
+
+    for (; read != write; read++)
+    {
+        MixerWatchdogMiss *miss = &m_kept[m_numkept % MIXER_WATCHDOG_MAX_MISSES];
+
+        miss->event = m_queue[read & (MIXER_WATCHDOG_QUEUE - 1)];
+        snapshot(miss);
+        m_numkept++;
+    }
+    __atomic_store_n(&m_read, read, __ATOMIC_RELEASE);
+
+    double now = MonotonicClock_Now();
+    if (m_report && now - m_lastreport >= m_interval)
+    {
+        writeReport(m_report);
+        fflush(m_report);
+        m_lastreport = now;
+        m_reported = m_numkept;
+    }
+}
+
+void MixerWatchdog::getCounters(MixerWatchdogCounters *counters) const
+{
+    unsigned long long total = __atomic_load_n(&m_total, __ATOMIC_RELAXED);
+
+    counters->blocks = __atomic_load_n(&m_blocks, __ATOMIC_RELAXED);
+    counters->misses = __atomic_load_n(&m_misses, __ATOMIC_RELAXED);
+    counters->stalls = __atomic_load_n(&m_stalls, __ATOMIC_RELAXED);
+    counters->dropped = __atomic_load_n(&m_dropped, __ATOMIC_RELAXED);
+    counters->deadline = m_deadline;
+    counters->average = counters->blocks ? (float)total / counters->blocks : 0.0f;
+    __atomic_load(&m_last, &counters->last, __ATOMIC_RELAXED);
+    __atomic_load(&m_worst, &counters->worst, __ATOMIC_RELAXED);
+    __atomic_load(&m_worstgap, &counters->worstgap, __ATOMIC_RELAXED);
+    __atomic_load(&m_chain, &counters->chain, __ATOMIC_RELAXED);
+}
+
+float MixerWatchdog::getPercentile(float percent) const
+{
+    unsigned int counts[MIXER_WATCHDOG_BUCKETS];
+    unsigned long long blocks = 0;
+
+    for (int i = 0; i < MIXER_WATCHDOG_BUCKETS; i++)
+    {
+        counts[i] = __atomic_load_n(&m_histogram[i], __ATOMIC_RELAXED);
+        blocks += counts[i];
+    }
+    if (!blocks)
+    {
+        return 0.0f;
+    }
+
+    unsigned long long target = (unsigned long long)(blocks * (double)percent / 100.0 + 0.5);
+    unsigned long long seen = 0;
+
+    target = (target < 1) ? 1 : (target > blocks) ? blocks : target;
+
+    for (int i = 0; i < MIXER_WATCHDOG_BUCKETS; i++)
+    {
+        seen += counts[i];
+        if (seen >= target)
+        {
+            return MixerWatchdog_BucketValue(i);
+        }
+    }
+
+    return MixerWatchdog_BucketValue(MIXER_WATCHDOG_BUCKETS - 1);
+}
+
+int MixerWatchdog::getNumMisses() const
+{
+    return (m_numkept < MIXER_WATCHDOG_MAX_MISSES) ? (int)m_numkept : MIXER_WATCHDOG_MAX_MISSES;
+}
+
+const MixerWatchdogMiss *MixerWatchdog::getMiss(int index) const
+{
+    int count = getNumMisses();
+
+    if (index < 0 || index >= count)
+    {
+        return 0;
+    }
+
+    return &m_kept[(m_numkept - count + index) % MIXER_WATCHDOG_MAX_MISSES];
+}
+
+FMOD_RESULT MixerWatchdog::writeReport(FILE *file) const
+{
+    static const float PERCENTILES[] = { 50.0f, 90.0f, 99.0f, 99.9f, 100.0f };
+    MixerWatchdogCounters counters;
+
+    if (!file)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    getCounters(&counters);
+
+    fprintf(file, "Mixer watchdog at %.1f s: %u blocks, deadline %.0f us, %u misses, %u stalls, %u not recorded\n",
+            MonotonicClock_Now() - m_origin, counters.blocks, counters.deadline, counters.misses, counters.stalls, counters.dropped);
+    fprintf(file, "    work average %.0f us, worst %.0f us, longest gap %.0f us, last block %.0f us in the group's DSPs\n",
+            counters.average, counters.worst, counters.worstgap, counters.chain);
+    fprintf(file, "    percentile ");
+    for (int i = 0; i < (int)(sizeof(PERCENTILES) / sizeof(PERCENTILES[0])); i++)
+    {
+        float value = getPercentile(PERCENTILES[i]);
+        fprintf(file, " p%g %.0f us (%.0f%%)", PERCENTILES[i], value, counters.deadline > 0.0f ? value * 100.0f / counters.deadline : 0.0f);
+    }
+    fprintf(file, "\n");
+
+    /*
+        Only misses since the last report, each with the graph as it was.
+    */
+    int count = getNumMisses();
+    for (int i = 0; i < count; i++)
+    {
+        const MixerWatchdogMiss *miss = getMiss(i);
+
+        if (m_numkept - count + i < m_reported)
+        {
+            continue;
+        }
+
+        fprintf(file, "    %s at %.3f s, block %u: work %.0f us, gap %.0f us, group DSPs %.0f us, DSP CPU %.1f%%, total CPU %.1f%%, %d channels\n",
+                miss->event.kind == MIXER_WATCHDOG_MISS ? "Miss" : "Stall", miss->event.time, miss->event.block,
+                miss->event.work, miss->event.gap, miss->event.chain, miss->cpudsp, miss->cputotal, miss->channels);
+
+        for (int n = 0; n < miss->numnodes; n++)
+        {
+            const MixerWatchdogNode *node = &miss->nodes[n];
+
+            fprintf(file, "        %*s%s (type %d, %d inputs)%s%s\n", node->depth * 2, "", node->name, (int)node->type, node->inputs,
+                    node->active ? "" : " inactive", node->bypass ? " bypassed" : "");
+        }
+    }
+
+    return ferror(file) ? FMOD_ERR_FILE_BAD : FMOD_OK;
+}
@@ -0,0 +1,168 @@
+/*==============================================================================
+Mixer Watchdog
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Watches the mixer for blocks that took longer to make than they last, which
+is heard as a glitch once the output runs out of buffered audio.
+
+Two pass-through DSPs go on a channel group, normally the master one. The
+one at the tail runs once everything feeding the group has been mixed, and
+the one at the head as the last thing in the block. FMOD pulls a DSP's
+inputs before calling it, so no DSP on the master group runs at the start of
+a block. Instead the head reads the mixer thread's CPU time, and the CPU time
+between one head call and the next is the work that went into the block,
+whichever DSPs did it, leaving out any time the thread slept waiting for the
+output. Head minus tail is the time spent in the group's own effects.
+
+The work per block goes into a histogram of 64 linear steps per power of
+two, so any value is kept to within about 1.5%, against a deadline of one
+block at the mix rate. A block over the deadline is a miss. A gap between
+blocks longer than all of the output's buffers is a stall, the output must
+have run dry. Both are passed to update on the main thread, which records
+what the DSP graph under the group looked like. update also appends a
+report to a file at a set interval.
+
+getCounters can be called from any thread at any time. It reads a handful
+of counters the mixer thread keeps and takes no locks.
+==============================================================================*/
+#ifndef _MIXER_WATCHDOG_H
+#define _MIXER_WATCHDOG_H
+
+#include "fmod.hpp"
+#include <stdio.h>
+
+#define MIXER_WATCHDOG_SUB_BUCKETS  64                                  /* Per power of two. */
+#define MIXER_WATCHDOG_BUCKETS      ((32 - 6) * MIXER_WATCHDOG_SUB_BUCKETS + MIXER_WATCHDOG_SUB_BUCKETS)   /* Microseconds, to about an hour. */
+#define MIXER_WATCHDOG_QUEUE        64      /* Misses waiting for update, a power of two. */
+#define MIXER_WATCHDOG_MAX_MISSES   16      /* Kept with their graph, the oldest make way. */
+#define MIXER_WATCHDOG_MAX_NODES    32      /* DSPs recorded per miss. */
+#define MIXER_WATCHDOG_MAX_DEPTH    8
+
+enum MixerWatchdogKind
+{
+    MIXER_WATCHDOG_MISS,            /* Took longer than the block lasts. */
+    MIXER_WATCHDOG_STALL            /* No block for longer than the output buffers last. */
+};
+
+struct MixerWatchdogCounters
+{
+    unsigned int    blocks;
+    unsigned int    misses;
+    unsigned int    stalls;
+    unsigned int    dropped;        /* Misses that found the queue to update full. */
+    float           deadline;       /* Microseconds per block. */
+    float           last;           /* Microseconds of work for the last block. */
+    float           average;
+    float           worst;
+    float           worstgap;       /* Longest between blocks. */
+    float           chain;          /* Last block, in the group's own DSPs. */
+};
+
+struct MixerWatchdogNode
+{
+    char            name[32];
+    FMOD_DSP_TYPE   type;
+    int             depth;          /* 0 = the group's head. */
+    int             inputs;
+    bool            active;
+    bool            bypass;
+};
+
+struct MixerWatchdogEvent
+{
+    MixerWatchdogKind   kind;
+    unsigned int        block;
+    double              time;       /* Seconds since init. */
+    float               work;       /* Microseconds. */
+    float               gap;
+    float               chain;
+};
+
+/*
+    An event as update saw it, with what else was going on.
+*/
+struct MixerWatchdogMiss
+{
+    MixerWatchdogEvent  event;
+    float               cpudsp;     /* Percent, as System::getCPUUsage. */
+    float               cputotal;
+    int                 channels;
+    int                 numnodes;
+    MixerWatchdogNode   nodes[MIXER_WATCHDOG_MAX_NODES];
+};
+
+class MixerWatchdog
+{
+public:
+    MixerWatchdog();
+
+    /*
+        Puts the DSPs on 'group'. 'reportpath' 0 = no periodic report, otherwise one is appended every
+        'interval' seconds.
+    */
+    FMOD_RESULT init(FMOD::System *system, FMOD::ChannelGroup *group, const char *reportpath, float interval);
+    FMOD_RESULT release();
+
+    void        update();
+    void        getCounters(MixerWatchdogCounters *counters) const;
+
+    /*
+        Microseconds of work that 'percent' of blocks came in under. update's thread only.
+    */
+    float       getPercentile(float percent) const;
+
+    /*
+        The misses kept, 0 is the oldest. update's thread only.
+    */
+    int         getNumMisses() const;
+    const MixerWatchdogMiss *getMiss(int index) const;
+    FMOD_RESULT writeReport(FILE *file) const;
+
+    static FMOD_RESULT F_CALLBACK tailCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels);
+    static FMOD_RESULT F_CALLBACK headCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels);
+
+private:
+    void        block(double now, double cpu);     /* Mixer thread. */
+    void        post(MixerWatchdogKind kind, double now, float work, float gap, float chain);
+    void        snapshot(MixerWatchdogMiss *miss);
+    void        walk(MixerWatchdogMiss *miss, FMOD::DSP *dsp, int depth);
+
+    FMOD::System       *m_system;
+    FMOD::ChannelGroup *m_group;
+    FMOD::DSP          *m_head;
+    FMOD::DSP          *m_tail;
+    float               m_deadline;         /* Microseconds. */
+    float               m_buffered;         /* Microseconds of audio the output holds. */
+    double              m_origin;
+
+    /* Mixer thread only. */
+    double              m_lasthead;         /* 0 = no block yet. */
+    double              m_lastcpu;
+    double              m_tailtime;
+
+    /* Written by the mixer thread, read anywhere. */
+    unsigned int        m_histogram[MIXER_WATCHDOG_BUCKETS];
+    unsigned int        m_blocks;
+    unsigned int        m_misses;
+    unsigned int        m_stalls;
+    unsigned int        m_dropped;
+    unsigned long long  m_total;            /* Microseconds of work, all blocks. */
+    float               m_last;
+    float               m_worst;
+    float               m_worstgap;
+    float               m_chain;
+
+    MixerWatchdogEvent  m_queue[MIXER_WATCHDOG_QUEUE];
+    unsigned int        m_write;            /* Free running, only written by the mixer thread. */
+    unsigned int        m_read;             /* Free running, only written by update. */
+
+    MixerWatchdogMiss   m_kept[MIXER_WATCHDOG_MAX_MISSES];     /* A ring. */
+    unsigned int        m_numkept;          /* Ever. */
+
+    FILE               *m_report;
+    float               m_interval;
+    double              m_lastreport;
+    unsigned int        m_reported;         /* Misses already in a report. */
+};
+
+#endif
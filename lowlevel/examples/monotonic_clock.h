@@ -0,0 +1,32 @@
+/*==============================================================================
+Monotonic Clock
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Seconds from an arbitrary start that never go backwards, for timing work and
+measuring intervals. Cheap enough to call from the mixer thread.
+==============================================================================*/
+#ifndef _MONOTONIC_CLOCK_H
+#define _MONOTONIC_CLOCK_H
+
+#include <time.h>
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#endif
+
+inline double MonotonicClock_Now()
+{
+#if defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+    if (!timebase.denom)
+    {
+        mach_timebase_info(&timebase);
+    }
+    return (double)(mach_absolute_time() * timebase.numer / timebase.denom) * 1e-9;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+#endif
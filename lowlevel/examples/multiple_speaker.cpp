@@ -5,10 +5,22 @@ Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
 This example shows how to play sounds in multiple speakers, and also how to even
 assign sound subchannels, such as those in a stereo sound to different
 individual speakers.
+
+The last two selections pan a sound around the listener with the panner DSP
+(plugins/fmod_panner.cpp), which mixes it to the output speaker mode with a
+matrix it only compiles when the direction changes (see mix_matrix.h). The
+time it takes per sample frame is shown underneath.
 ==============================================================================*/
 #include "fmod.hpp"
 #include "common.h"
 
+extern "C" FMOD_DSP_DESCRIPTION* F_STDCALL FMODGetDSPDescription();
+
+#define PANNER_PARAM_AZIMUTH        0
+#define PANNER_PARAM_SPEAKERMODE    1
+#define PANNER_PARAM_COST           2
+#define PANNER_DEGREES_PER_UPDATE   6.0f
+
 const char *SPEAKERMODE_STRING[] = { "default", "raw", "mono", "stereo", "quad", "surround", "5.1", "7.1" };
 const char *SELECTION_STRING[] = { "Mono from front left speaker",
                                    "Mono from front right speaker",
@@ -19,7 +31,9 @@ const char *SELECTION_STRING[] = { "Mono from front left speaker",
                                    "Mono from rear right speaker",
                                    "Stereo from front speakers",
                                    "Stereo from front speakers (channel swapped)",
-                                   "Stereo (right only) from center speaker" };
+                                   "Stereo (right only) from center speaker",
+                                   "Mono panned around by the panner DSP",
+                                   "Stereo panned around by the panner DSP" };
 const unsigned int SELECTION_COUNT = sizeof(SELECTION_STRING) / sizeof(char *);
 
 bool isSelectionAvailable(FMOD_SPEAKERMODE mode, unsigned int selection)
@@ -45,6 +59,9 @@ int FMOD_Main()
     FMOD::System     *system;
     FMOD::Sound      *sound1, *sound2;
     FMOD::Channel    *channel = 0;
+    FMOD::DSP        *panner;
+    FMOD::Channel    *pannedchannel = 0;
+    float             azimuth = 0.0f;
     FMOD_RESULT       result;
     unsigned int      version;
     int               selection = 0;
@@ -79,6 +96,18 @@ int FMOD_Main()
     result = system->createSound(Common_MediaPath("stereo.ogg"), FMOD_SOFTWARE | FMOD_2D | FMOD_LOOP_OFF,  0, &sound2);
     ERRCHECK(result);
 
+    /*
+        The panner outputs the system's speaker mode, whatever it is given.
+    */
+    result = system->createDSP(FMODGetDSPDescription(), &panner);
+    ERRCHECK(result);
+
+    if (speakermode >= FMOD_SPEAKERMODE_MONO && speakermode <= FMOD_SPEAKERMODE_7POINT1)
+    {
+        result = panner->setParameterInt(PANNER_PARAM_SPEAKERMODE, speakermode);
+        ERRCHECK(result);
+    }
+
     /*
         Main loop.
     */
@@ -206,11 +235,43 @@ int FMOD_Main()
                 result = channel->setMixMatrix(matrix, 3, 2);
                 ERRCHECK(result);
 
+                result = channel->setPaused(false);
+                ERRCHECK(result);
+            }
+            else if (selection == 10 || selection == 11) /* Panned by the panner DSP */
+            {
+                result = system->playSound(selection == 10 ? sound1 : sound2, 0, true, &channel);
+                ERRCHECK(result);
+
+                /*
+                    A DSP can only be on one channel, take it off the last one it was on first.
+                */
+                if (pannedchannel)
+                {
+                    result = pannedchannel->removeDSP(panner);
+                    if ((result != FMOD_OK) && (result != FMOD_ERR_INVALID_HANDLE) && (result != FMOD_ERR_CHANNEL_STOLEN))
+                    {
+                        ERRCHECK(result);
+                    }
+                }
+
+                result = channel->addDSP(0, panner, 0);
+                ERRCHECK(result);
+                pannedchannel = channel;
+
                 result = channel->setPaused(false);
                 ERRCHECK(result);
             }
         }
 
+        azimuth += PANNER_DEGREES_PER_UPDATE;
+        if (azimuth > 180.0f)
+        {
+            azimuth -= 360.0f;
+        }
+        result = panner->setParameterFloat(PANNER_PARAM_AZIMUTH, azimuth);
+        ERRCHECK(result);
+
         result = system->update();
         ERRCHECK(result);
 
@@ -275,6 +336,12 @@ int FMOD_Main()
             Common_Draw("");
             Common_Draw("Time %02d:%02d:%02d/%02d:%02d:%02d : %s", ms / 1000 / 60, ms / 1000 % 60, ms / 10 % 100, lenms / 1000 / 60, lenms / 1000 % 60, lenms / 10 % 100, paused ? "Paused " : playing ? "Playing" : "Stopped");
             Common_Draw("Channels playing: %d", channelsplaying);
+
+            float cost = 0.0f;
+            result = panner->getParameterFloat(PANNER_PARAM_COST, &cost, 0, 0);
+            ERRCHECK(result);
+
+            Common_Draw("Panner at %4.0f degrees, %.1f ns per sample frame", azimuth, cost);
         }
 
         Common_Sleep(50);
@@ -283,10 +350,23 @@ int FMOD_Main()
     /*
         Shut down
     */
+    if (pannedchannel)
+    {
+        /*
+            The panner can't be released while it's still on a channel that is playing.
+        */
+        result = pannedchannel->removeDSP(panner);
+        if ((result != FMOD_OK) && (result != FMOD_ERR_INVALID_HANDLE) && (result != FMOD_ERR_CHANNEL_STOLEN))
+        {
+            ERRCHECK(result);
+        }
+    }
     result = sound1->release();
     ERRCHECK(result);
     result = sound2->release();
     ERRCHECK(result);
+    result = panner->release();
+    ERRCHECK(result);
     result = system->close();
     ERRCHECK(result);
     result = system->release();
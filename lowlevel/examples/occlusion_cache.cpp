@@ -0,0 +1,254 @@
+/*==============================================================================
+Occlusion Cache
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "occlusion_cache.h"
+#include "monotonic_clock.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void OcclusionCache_Cell(const FMOD_VECTOR *position, float scale, int *cell)
+{
+    cell[0] = (int)floorf(position->x * scale);
+    cell[1] = (int)floorf(position->y * scale);
+    cell[2] = (int)floorf(position->z * scale);
+}
+
+static bool OcclusionCache_SameCell(const int *a, const int *b)
+{
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+OcclusionCache::OcclusionCache()
+{
+    m_engine = 0;
+    m_entries = 0;
+    m_maxemitters = 0;
+    m_cellsize = 1.0f;
+    m_refreshframes = 0;
+    m_maxtraces = 0;
+    m_smoothing = 0.0f;
+    m_moved = 0;
+    m_due = 0;
+    m_trace = 0;
+    m_positions = 0;
+    m_tracedirect = 0;
+    m_tracereverb = 0;
+    m_frame = 0;
+    m_cursor = 0;
+    m_lastupdate = 0.0;
+    m_tracecost = 0.0f;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+FMOD_RESULT OcclusionCache::init(OcclusionEngine *engine, int maxemitters, float cellsize, int refreshframes, int maxtraces, float smoothing)
+{
+    if (!engine || maxemitters <= 0 || cellsize <= 0.0f || refreshframes <= 0 || maxtraces < 0)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    m_entries = (OcclusionCacheEntry *)malloc(maxemitters * sizeof(OcclusionCacheEntry));
+    m_moved = (int *)malloc(maxemitters * sizeof(int));
+    m_due = (int *)malloc(maxemitters * sizeof(int));
+    m_trace = (int *)malloc(maxemitters * sizeof(int));
+    m_positions = (FMOD_VECTOR *)malloc(maxemitters * sizeof(FMOD_VECTOR));
+    m_tracedirect = (float *)malloc(maxemitters * sizeof(float));
+    m_tracereverb = (float *)malloc(maxemitters * sizeof(float));
+    if (!m_entries || !m_moved || !m_due || !m_trace || !m_positions || !m_tracedirect || !m_tracereverb)
+    {
+        release();
+        return FMOD_ERR_MEMORY;
+    }
+
+    m_engine = engine;
+    m_maxemitters = maxemitters;
+    m_cellsize = cellsize;
+    m_refreshframes = refreshframes;
+    m_maxtraces = maxtraces;
+    m_smoothing = smoothing;
+    m_frame = 0;
+    m_cursor = 0;
+    m_lastupdate = 0.0;
+    m_tracecost = 0.0f;
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    invalidateAll();
+    return FMOD_OK;
+}
+
+void OcclusionCache::release()
+{
+    free(m_entries);
+    free(m_moved);
+    free(m_due);
+    free(m_trace);
+    free(m_positions);
+    free(m_tracedirect);
+    free(m_tracereverb);
+    m_entries = 0;
+    m_moved = 0;
+    m_due = 0;
+    m_trace = 0;
+    m_positions = 0;
+    m_tracedirect = 0;
+    m_tracereverb = 0;
+    m_engine = 0;
+    m_maxemitters = 0;
+}
+
+void OcclusionCache::invalidateAll()
+{
+    for (int i = 0; i < m_maxemitters; i++)
+    {
+        m_entries[i].valid = false;
+    }
+}
+
+FMOD_RESULT OcclusionCache::update(const FMOD_VECTOR *listener, const FMOD_VECTOR *sources, int count, float *direct, float *reverb)
+{
+    FMOD_RESULT result;
+
+    if (!m_engine)
+    {
+        return FMOD_ERR_UNINITIALIZED;
+    }
+    if (count < 0 || count > m_maxemitters || (count && (!sources || !direct)))
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    double start = MonotonicClock_Now();
+    float elapsed = m_lastupdate > 0.0 ? (float)(start - m_lastupdate) : 0.0f;
+    float blend = m_smoothing > 0.0f ? 1.0f - expf(-elapsed / m_smoothing) : 1.0f;
+    float scale = 1.0f / m_cellsize;
+    int listenercell[3];
+    int nummoved = 0, numdue = 0, numtrace = 0;
+
+    m_lastupdate = start;
+    m_frame++;
+
+    /*
+        Sort out who needs tracing, starting from the cursor so a cap takes each emitter in turn.
+    */
+    OcclusionCache_Cell(listener, scale, listenercell);
+    if (m_cursor >= count)
+    {
+        m_cursor = 0;
+    }
+    for (int n = 0; n < count; n++)
+    {
+        int index = (m_cursor + n < count) ? m_cursor + n : m_cursor + n - count;
+        OcclusionCacheEntry *e = &m_entries[index];
+        int sourcecell[3];
+
+        OcclusionCache_Cell(&sources[index], scale, sourcecell);
+
+        if (!e->valid)
+        {
+            m_trace[numtrace++] = index;
+        }
+        else if (!OcclusionCache_SameCell(e->listenercell, listenercell) || !OcclusionCache_SameCell(e->sourcecell, sourcecell))
+        {
+            m_moved[nummoved++] = index;
+        }
+        else if (m_frame - e->frame >= (unsigned int)m_refreshframes)
+        {
+            m_due[numdue++] = index;
+        }
+    }
+
+    /*
+        New emitters, then moved ones, then the ones due a refresh, as far as the cap goes. The cursor moves to the
+        first one left out.
+    */
+    int budget = m_maxtraces ? m_maxtraces - numtrace : count;
+    budget = budget < 0 ? 0 : budget;
+
+    int moved = nummoved < budget ? nummoved : budget;
+    memcpy(m_trace + numtrace, m_moved, moved * sizeof(int));
+    numtrace += moved;
+    budget -= moved;
+
+    int due = numdue < budget ? numdue : budget;
+    memcpy(m_trace + numtrace, m_due, due * sizeof(int));
+    numtrace += due;
+
+    if (moved < nummoved)
+    {
+        m_cursor = m_moved[moved];
+    }
+    else if (due < numdue)
+    {
+        m_cursor = m_due[due];
+    }
+
+    if (numtrace)
+    {
+        for (int i = 0; i < numtrace; i++)
+        {
+            m_positions[i] = sources[m_trace[i]];
+        }
+
+        result = m_engine->occlude(listener, m_positions, numtrace, m_tracedirect, m_tracereverb);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+
+        OcclusionStats enginestats;
+        m_engine->getStats(&enginestats);
+        float cost = enginestats.elapsed / numtrace;
+        m_tracecost = (m_tracecost > 0.0f) ? m_tracecost + (cost - m_tracecost) * 0.1f : cost;
+
+        for (int i = 0; i < numtrace; i++)
+        {
+            OcclusionCacheEntry *e = &m_entries[m_trace[i]];
+
+            e->frame = m_frame;
+            if (!e->valid)
+            {
+                e->currentdirect = m_tracedirect[i];
+                e->currentreverb = m_tracereverb[i];
+
+                /*
+                    Backdate new ones by different amounts, so a crowd added in one frame isn't all due a refresh in
+                    the same frame too.
+                */
+                e->frame -= (unsigned int)(m_trace[i] % m_refreshframes);
+            }
+            e->direct = m_tracedirect[i];
+            e->reverb = m_tracereverb[i];
+            e->listenercell[0] = listenercell[0];
+            e->listenercell[1] = listenercell[1];
+            e->listenercell[2] = listenercell[2];
+            OcclusionCache_Cell(&sources[m_trace[i]], scale, e->sourcecell);
+            e->valid = true;
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        OcclusionCacheEntry *e = &m_entries[i];
+
+        e->currentdirect += (e->direct - e->currentdirect) * blend;
+        e->currentreverb += (e->reverb - e->currentreverb) * blend;
+        direct[i] = e->currentdirect;
+        if (reverb)
+        {
+            reverb[i] = e->currentreverb;
+        }
+    }
+
+    int hits = count - numtrace - (nummoved - moved);
+    m_stats.queries = count;
+    m_stats.hits = hits;
+    m_stats.traced = numtrace;
+    m_stats.refreshed = due;
+    m_stats.deferred = nummoved - moved;
+    m_stats.hitrate = count ? (float)hits / count : 0.0f;
+    m_stats.saved = hits * m_tracecost;
+    m_stats.elapsed = (float)(MonotonicClock_Now() - start);
+    return FMOD_OK;
+}
@@ -0,0 +1,102 @@
+/*==============================================================================
+Occlusion Cache
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Keeps each emitter's occlusion from one frame to the next, so an
+OcclusionEngine (see occlusion_engine.h) only traces the ones that need it.
+
+Each result is kept with the cells the listener and the emitter were in when
+it was traced, their positions rounded down to 'cellsize'. While neither
+leaves its cell the result is reused. Every result is traced again after
+'refreshframes' regardless, so moving geometry or a slow drift doesn't leave
+it wrong for long.
+
+'maxtraces' caps the rays traced in a frame. When the listener crosses a cell
+every emitter needs tracing, and with a cap they are taken a slice a frame in
+rotation rather than all in one frame. Emitters seen for the first time are
+always traced, they have nothing to fall back on.
+
+The values handed back glide towards the traced ones with a 'smoothing'
+second time constant, so a step in occlusion, an emitter passing behind a
+wall or a stale result being replaced, doesn't click. New emitters start at
+their traced value.
+
+Emitters are identified by their index in the array given to update. Call
+invalidate when an index is reused for a different emitter, and invalidateAll
+after rebuilding the engine's geometry.
+==============================================================================*/
+#ifndef _OCCLUSION_CACHE_H
+#define _OCCLUSION_CACHE_H
+
+#include "fmod.hpp"
+#include "occlusion_engine.h"
+
+struct OcclusionCacheEntry
+{
+    int                 listenercell[3];
+    int                 sourcecell[3];
+    float               direct;             /* Traced. */
+    float               reverb;
+    float               currentdirect;      /* Handed back, heading for the traced values. */
+    float               currentreverb;
+    unsigned int        frame;              /* Traced on. */
+    bool                valid;
+};
+
+struct OcclusionCacheStats
+{
+    int                 queries;            /* Last update. */
+    int                 hits;               /* Reused without tracing. */
+    int                 traced;
+    int                 refreshed;          /* Of those traced, ones that were only due a refresh. */
+    int                 deferred;           /* Needed tracing but were over maxtraces. */
+    float               hitrate;
+    float               elapsed;            /* Seconds the update took. */
+    float               saved;              /* Seconds the hits would have cost to trace. */
+};
+
+class OcclusionCache
+{
+public:
+    OcclusionCache();
+
+    /*
+        'maxtraces' 0 = no cap.
+    */
+    FMOD_RESULT init(OcclusionEngine *engine, int maxemitters, float cellsize, int refreshframes, int maxtraces, float smoothing);
+    void        release();
+
+    void        invalidate(int emitter)     { m_entries[emitter].valid = false; }
+    void        invalidateAll();
+
+    /*
+        'reverb' can be 0. Emitters past the last update's count are kept, ready for when it grows again.
+    */
+    FMOD_RESULT update(const FMOD_VECTOR *listener, const FMOD_VECTOR *sources, int count, float *direct, float *reverb);
+    void        getStats(OcclusionCacheStats *stats) const  { *stats = m_stats; }
+
+private:
+    OcclusionEngine    *m_engine;
+    OcclusionCacheEntry *m_entries;
+    int                 m_maxemitters;
+    float               m_cellsize;
+    int                 m_refreshframes;
+    int                 m_maxtraces;
+    float               m_smoothing;
+
+    int                *m_moved;            /* Scratch for update. */
+    int                *m_due;
+    int                *m_trace;
+    FMOD_VECTOR        *m_positions;
+    float              *m_tracedirect;
+    float              *m_tracereverb;
+
+    unsigned int        m_frame;
+    int                 m_cursor;           /* Where the next capped frame starts taking moved emitters from. */
+    double              m_lastupdate;
+    float               m_tracecost;        /* Average seconds per traced ray. */
+
+    OcclusionCacheStats m_stats;
+};
+
+#endif
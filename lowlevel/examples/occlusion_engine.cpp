@@ -0,0 +1,857 @@
+/*==============================================================================
+Occlusion Engine
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "occlusion_engine.h"
+#include "monotonic_clock.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define OCCLUSION_ENGINE_BINS       16
+#define OCCLUSION_ENGINE_BUCKETS    256     /* Directions queries are sorted into, a 16x16 octahedral map. */
+#define OCCLUSION_ENGINE_OPAQUE     1e-6f   /* Rays letting less than this through stop being traced. */
+#define OCCLUSION_ENGINE_TINY       1e-12f
+
+static float OcclusionEngine_Area(const float *min, const float *max)
+{
+    float x = max[0] - min[0];
+    float y = max[1] - min[1];
+    float z = max[2] - min[2];
+    return x * y + y * z + z * x;
+}
+
+static void OcclusionEngine_Grow(float *min, float *max, const float *point)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (point[axis] < min[axis]) min[axis] = point[axis];
+        if (point[axis] > max[axis]) max[axis] = point[axis];
+    }
+}
+
+static void OcclusionEngine_GrowTriangle(float *min, float *max, const OcclusionTriangle *triangle)
+{
+    float v1[3], v2[3];
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        v1[axis] = triangle->v0[axis] + triangle->edge1[axis];
+        v2[axis] = triangle->v0[axis] + triangle->edge2[axis];
+    }
+    OcclusionEngine_Grow(min, max, triangle->v0);
+    OcclusionEngine_Grow(min, max, v1);
+    OcclusionEngine_Grow(min, max, v2);
+}
+
+static void OcclusionEngine_Empty(float *min, float *max)
+{
+    min[0] = min[1] = min[2] = 1e30f;
+    max[0] = max[1] = max[2] = -1e30f;
+}
+
+/*
+    Folds a direction onto an octahedron and flattens it, so nearby directions get nearby buckets. The 4 bit
+    coordinates are interleaved so neighbouring buckets are near each other in both directions.
+*/
+static int OcclusionEngine_DirectionKey(float x, float y, float z)
+{
+    float sum = fabsf(x) + fabsf(y) + fabsf(z);
+    if (sum <= 0.0f)
+    {
+        return 0;
+    }
+
+    float u = x / sum;
+    float v = z / sum;
+    if (y < 0.0f)
+    {
+        float fu = (1.0f - fabsf(v)) * (u < 0.0f ? -1.0f : 1.0f);
+        float fv = (1.0f - fabsf(u)) * (v < 0.0f ? -1.0f : 1.0f);
+        u = fu;
+        v = fv;
+    }
+
+    int iu = (int)((u + 1.0f) * 8.0f);
+    int iv = (int)((v + 1.0f) * 8.0f);
+    iu = iu < 0 ? 0 : (iu > 15 ? 15 : iu);
+    iv = iv < 0 ? 0 : (iv > 15 ? 15 : iv);
+
+    int key = 0;
+    for (int bit = 0; bit < 4; bit++)
+    {
+        key |= ((iu >> bit) & 1) << (bit * 2);
+        key |= ((iv >> bit) & 1) << (bit * 2 + 1);
+    }
+    return key;
+}
+
+OcclusionEngine::OcclusionEngine()
+{
+    m_triangles = 0;
+    m_centroids = 0;
+    m_order = 0;
+    m_numtriangles = 0;
+    m_maxtriangles = 0;
+    m_nodes = 0;
+    m_numnodes = 0;
+    m_depth = 0;
+    m_built = false;
+    m_haspool = false;
+    m_running = 0;
+    m_sources = 0;
+    m_direct = 0;
+    m_reverb = 0;
+    m_sorted = 0;
+    m_keys = 0;
+    m_maxqueries = 0;
+    m_count = 0;
+    m_numpackets = 0;
+    m_nextpacket = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+FMOD_RESULT OcclusionEngine::init(int maxtriangles, int numthreads)
+{
+    if (maxtriangles <= 0)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    m_triangles = (OcclusionTriangle *)malloc(maxtriangles * sizeof(OcclusionTriangle));
+    m_centroids = (float *)malloc(maxtriangles * 3 * sizeof(float));
+    m_order = (int *)malloc(maxtriangles * sizeof(int));
+    m_nodes = (OcclusionNode *)malloc(maxtriangles * 2 * sizeof(OcclusionNode));
+    if (!m_triangles || !m_centroids || !m_order || !m_nodes)
+    {
+        release();
+        return FMOD_ERR_MEMORY;
+    }
+    m_maxtriangles = maxtriangles;
+
+    pthread_mutex_init(&m_lock, 0);
+    pthread_cond_init(&m_done, 0);
+
+    /*
+        The calling thread is one of them, it traces packets too rather than waiting.
+    */
+    if (numthreads <= 0)
+    {
+        numthreads = WorkerPool::numCores();
+    }
+    if (numthreads > 1)
+    {
+        FMOD_RESULT result = m_pool.init(numthreads - 1);
+        if (result != FMOD_OK)
+        {
+            release();
+            return result;
+        }
+        m_haspool = true;
+    }
+
+    clear();
+    return FMOD_OK;
+}
+
+void OcclusionEngine::release()
+{
+    if (m_maxtriangles)
+    {
+        if (m_haspool)
+        {
+            m_pool.release();
+            m_haspool = false;
+        }
+        pthread_cond_destroy(&m_done);
+        pthread_mutex_destroy(&m_lock);
+    }
+
+    free(m_triangles);
+    free(m_centroids);
+    free(m_order);
+    free(m_nodes);
+    free(m_sorted);
+    free(m_keys);
+    m_triangles = 0;
+    m_centroids = 0;
+    m_order = 0;
+    m_nodes = 0;
+    m_sorted = 0;
+    m_keys = 0;
+    m_maxtriangles = 0;
+    m_maxqueries = 0;
+    m_numtriangles = 0;
+    m_numnodes = 0;
+    m_built = false;
+}
+
+void OcclusionEngine::clear()
+{
+    m_numtriangles = 0;
+    m_numnodes = 0;
+    m_depth = 0;
+    m_built = false;
+}
+
+FMOD_RESULT OcclusionEngine::addPolygon(float directocclusion, float reverbocclusion, bool doublesided, int numvertices, const FMOD_VECTOR *vertices)
+{
+    if (numvertices < 3 || !vertices)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    if (m_numtriangles + numvertices - 2 > m_maxtriangles)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    directocclusion = directocclusion < 0.0f ? 0.0f : (directocclusion > 1.0f ? 1.0f : directocclusion);
+    reverbocclusion = reverbocclusion < 0.0f ? 0.0f : (reverbocclusion > 1.0f ? 1.0f : reverbocclusion);
+
+    for (int i = 2; i < numvertices; i++)
+    {
+        OcclusionTriangle *triangle = &m_triangles[m_numtriangles];
+        const FMOD_VECTOR *v0 = &vertices[0];
+        const FMOD_VECTOR *v1 = &vertices[i - 1];
+        const FMOD_VECTOR *v2 = &vertices[i];
+
+        triangle->v0[0] = v0->x;
+        triangle->v0[1] = v0->y;
+        triangle->v0[2] = v0->z;
+        triangle->edge1[0] = v1->x - v0->x;
+        triangle->edge1[1] = v1->y - v0->y;
+        triangle->edge1[2] = v1->z - v0->z;
+        triangle->edge2[0] = v2->x - v0->x;
+        triangle->edge2[1] = v2->y - v0->y;
+        triangle->edge2[2] = v2->z - v0->z;
+        triangle->direct = directocclusion;
+        triangle->reverb = reverbocclusion;
+        triangle->doublesided = doublesided ? 1 : 0;
+
+        /*
+            Nothing can cross a triangle with no area, leave it out.
+        */
+        float nx = triangle->edge1[1] * triangle->edge2[2] - triangle->edge1[2] * triangle->edge2[1];
+        float ny = triangle->edge1[2] * triangle->edge2[0] - triangle->edge1[0] * triangle->edge2[2];
+        float nz = triangle->edge1[0] * triangle->edge2[1] - triangle->edge1[1] * triangle->edge2[0];
+        if (nx * nx + ny * ny + nz * nz > 0.0f)
+        {
+            m_numtriangles++;
+        }
+    }
+
+    m_built = false;
+    return FMOD_OK;
+}
+
+FMOD_RESULT OcclusionEngine::build()
+{
+    if (!m_maxtriangles)
+    {
+        return FMOD_ERR_UNINITIALIZED;
+    }
+
+    for (int i = 0; i < m_numtriangles; i++)
+    {
+        const OcclusionTriangle *triangle = &m_triangles[i];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            m_centroids[i * 3 + axis] = triangle->v0[axis] + (triangle->edge1[axis] + triangle->edge2[axis]) * (1.0f / 3.0f);
+        }
+        m_order[i] = i;
+    }
+
+    m_depth = 0;
+    m_numnodes = 1;
+    if (m_numtriangles)
+    {
+        buildNode(0, 0, m_numtriangles, 1);
+    }
+    else
+    {
+        OcclusionEngine_Empty(m_nodes[0].min, m_nodes[0].max);
+        m_nodes[0].index = 0;
+        m_nodes[0].count = 0;
+    }
+
+    /*
+        Put the triangles in leaf order so a leaf's are next to each other, following each cycle of the permutation.
+    */
+    for (int i = 0; i < m_numtriangles; i++)
+    {
+        if (m_order[i] < 0)
+        {
+            continue;
+        }
+
+        OcclusionTriangle first = m_triangles[i];
+        int to = i;
+        for (;;)
+        {
+            int from = m_order[to];
+            m_order[to] = -1;
+            if (from == i)
+            {
+                m_triangles[to] = first;
+                break;
+            }
+            m_triangles[to] = m_triangles[from];
+            to = from;
+        }
+    }
+
+    m_stats.triangles = m_numtriangles;
+    m_stats.nodes = m_numnodes;
+    m_stats.depth = m_depth;
+    m_built = true;
+    return FMOD_OK;
+}
+
+/*
+    Binned surface area heuristic: try a split at each bin boundary along the axis the centroids spread furthest on,
+    and keep the one that makes a ray least likely to have to visit triangles.
+*/
+void OcclusionEngine::buildNode(int nodeindex, int first, int count, int depth)
+{
+    OcclusionNode *node = &m_nodes[nodeindex];
+    float cmin[3], cmax[3];
+
+    if (depth > m_depth)
+    {
+        m_depth = depth;
+    }
+
+    OcclusionEngine_Empty(node->min, node->max);
+    OcclusionEngine_Empty(cmin, cmax);
+    for (int i = first; i < first + count; i++)
+    {
+        OcclusionEngine_GrowTriangle(node->min, node->max, &m_triangles[m_order[i]]);
+        OcclusionEngine_Grow(cmin, cmax, &m_centroids[m_order[i] * 3]);
+    }
+
+    node->index = first;
+    node->count = count;
+
+    int axis = 0;
+    for (int i = 1; i < 3; i++)
+    {
+        if (cmax[i] - cmin[i] > cmax[axis] - cmin[axis])
+        {
+            axis = i;
+        }
+    }
+    float extent = cmax[axis] - cmin[axis];
+
+    if (count <= 1 || depth >= OCCLUSION_ENGINE_MAX_DEPTH || extent <= 0.0f)
+    {
+        return;     /* Leaf, however many triangles it has. */
+    }
+
+    int   bincount[OCCLUSION_ENGINE_BINS];
+    float binmin[OCCLUSION_ENGINE_BINS][3], binmax[OCCLUSION_ENGINE_BINS][3];
+    float scale = OCCLUSION_ENGINE_BINS / extent;
+
+    for (int b = 0; b < OCCLUSION_ENGINE_BINS; b++)
+    {
+        bincount[b] = 0;
+        OcclusionEngine_Empty(binmin[b], binmax[b]);
+    }
+    for (int i = first; i < first + count; i++)
+    {
+        int b = (int)((m_centroids[m_order[i] * 3 + axis] - cmin[axis]) * scale);
+        b = b >= OCCLUSION_ENGINE_BINS ? OCCLUSION_ENGINE_BINS - 1 : b;
+        bincount[b]++;
+        OcclusionEngine_GrowTriangle(binmin[b], binmax[b], &m_triangles[m_order[i]]);
+    }
+
+    /*
+        Right hand sides swept from the end, then left hand sides from the start against them.
+    */
+    float rightarea[OCCLUSION_ENGINE_BINS];
+    int   rightcount[OCCLUSION_ENGINE_BINS];
+    float min[3], max[3];
+    int   total = 0;
+
+    OcclusionEngine_Empty(min, max);
+    for (int b = OCCLUSION_ENGINE_BINS - 1; b > 0; b--)
+    {
+        total += bincount[b];
+        if (bincount[b])
+        {
+            OcclusionEngine_Grow(min, max, binmin[b]);
+            OcclusionEngine_Grow(min, max, binmax[b]);
+        }
+        rightcount[b] = total;
+        rightarea[b] = total ? OcclusionEngine_Area(min, max) : 0.0f;
+    }
+
+    float bestcost = 1e30f;
+    int   bestsplit = -1;
+
+    OcclusionEngine_Empty(min, max);
+    total = 0;
+    for (int b = 1; b < OCCLUSION_ENGINE_BINS; b++)
+    {
+        total += bincount[b - 1];
+        if (bincount[b - 1])
+        {
+            OcclusionEngine_Grow(min, max, binmin[b - 1]);
+            OcclusionEngine_Grow(min, max, binmax[b - 1]);
+        }
+        if (!total || !rightcount[b])
+        {
+            continue;
+        }
+
+        float cost = total * OcclusionEngine_Area(min, max) + rightcount[b] * rightarea[b];
+        if (cost < bestcost)
+        {
+            bestcost = cost;
+            bestsplit = b;
+        }
+    }
+
+    /*
+        Visiting a node costs about as much as testing a triangle. Small sets stay a leaf unless splitting pays.
+    */
+    float area = OcclusionEngine_Area(node->min, node->max);
+    if (bestsplit < 0 || (count <= OCCLUSION_ENGINE_LEAF_SIZE && area + bestcost >= count * area))
+    {
+        return;
+    }
+
+    int i = first;
+    int j = first + count - 1;
+    while (i <= j)
+    {
+        int b = (int)((m_centroids[m_order[i] * 3 + axis] - cmin[axis]) * scale);
+        b = b >= OCCLUSION_ENGINE_BINS ? OCCLUSION_ENGINE_BINS - 1 : b;
+        if (b < bestsplit)
+        {
+            i++;
+        }
+        else
+        {
+            int swap = m_order[i];
+            m_order[i] = m_order[j];
+            m_order[j] = swap;
+            j--;
+        }
+    }
+
+    int left = i - first;
+    int child = m_numnodes;
+    m_numnodes += 2;
+
+    node->index = child;
+    node->count = 0;
+
+    buildNode(child, first, left, depth + 1);
+    buildNode(child + 1, first + left, count - left, depth + 1);
+}
+
+FMOD_RESULT OcclusionEngine::getOcclusion(const FMOD_VECTOR *listener, const FMOD_VECTOR *source, float *direct, float *reverb)
+{
+    return occlude(listener, source, 1, direct, reverb);
+}
+
+FMOD_RESULT OcclusionEngine::occlude(const FMOD_VECTOR *listener, const FMOD_VECTOR *sources, int count, float *direct, float *reverb)
+{
+    if (!m_built)
+    {
+        return FMOD_ERR_NOTREADY;
+    }
+    if (count < 0 || (count && (!sources || !direct)))
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    double start = MonotonicClock_Now();
+
+    if (count > m_maxqueries)
+    {
+        int *sorted = (int *)realloc(m_sorted, count * sizeof(int));
+        if (sorted)
+        {
+            m_sorted = sorted;
+        }
+        int *keys = (int *)realloc(m_keys, count * sizeof(int));
+        if (keys)
+        {
+            m_keys = keys;
+        }
+        if (!sorted || !keys)
+        {
+            return FMOD_ERR_MEMORY;
+        }
+        m_maxqueries = count;
+    }
+
+    /*
+        Counting sort by direction, so the rays in a packet point the same way and mostly visit the same nodes.
+    */
+    int offsets[OCCLUSION_ENGINE_BUCKETS + 1];
+    memset(offsets, 0, sizeof(offsets));
+    for (int i = 0; i < count; i++)
+    {
+        m_keys[i] = OcclusionEngine_DirectionKey(sources[i].x - listener->x, sources[i].y - listener->y, sources[i].z - listener->z);
+        offsets[m_keys[i] + 1]++;
+    }
+    for (int b = 0; b < OCCLUSION_ENGINE_BUCKETS; b++)
+    {
+        offsets[b + 1] += offsets[b];
+    }
+    for (int i = 0; i < count; i++)
+    {
+        m_sorted[offsets[m_keys[i]]++] = i;
+    }
+
+    m_listener = *listener;
+    m_sources = sources;
+    m_direct = direct;
+    m_reverb = reverb;
+    m_count = count;
+    m_numpackets = (count + OCCLUSION_ENGINE_PACKET - 1) / OCCLUSION_ENGINE_PACKET;
+    m_nextpacket = 0;
+
+    /*
+        No more helpers than there are grabs to go round after the calling thread's first one.
+    */
+    int grabs = (m_numpackets + OCCLUSION_ENGINE_GRAB - 1) / OCCLUSION_ENGINE_GRAB;
+    int helpers = m_haspool ? m_pool.numThreads() : 0;
+    if (helpers > grabs - 1)
+    {
+        helpers = grabs - 1;
+    }
+
+    m_running = helpers;
+    for (int i = 0; i < helpers; i++)
+    {
+        m_jobs[i].func = jobMain;
+        m_jobs[i].arg = this;
+        m_pool.submit(&m_jobs[i]);
+    }
+
+    work();
+
+    if (helpers > 0)
+    {
+        pthread_mutex_lock(&m_lock);
+        while (m_running)
+        {
+            pthread_cond_wait(&m_done, &m_lock);
+        }
+        pthread_mutex_unlock(&m_lock);
+    }
+
+    m_stats.queries = count;
+    m_stats.threads = helpers + 1;
+    m_stats.elapsed = (float)(MonotonicClock_Now() - start);
+    return FMOD_OK;
+}
+
+void OcclusionEngine::jobMain(void *arg)
+{
+    OcclusionEngine *engine = (OcclusionEngine *)arg;
+
+    engine->work();
+
+    pthread_mutex_lock(&engine->m_lock);
+    if (--engine->m_running == 0)
+    {
+        pthread_cond_signal(&engine->m_done);
+    }
+    pthread_mutex_unlock(&engine->m_lock);
+}
+
+void OcclusionEngine::work()
+{
+    for (;;)
+    {
+        int packet = (int)__atomic_fetch_add(&m_nextpacket, OCCLUSION_ENGINE_GRAB, __ATOMIC_RELAXED);
+        if (packet >= m_numpackets)
+        {
+            break;
+        }
+
+        int end = packet + OCCLUSION_ENGINE_GRAB;
+        end = end > m_numpackets ? m_numpackets : end;
+        for (; packet < end; packet++)
+        {
+            int first = packet * OCCLUSION_ENGINE_PACKET;
+            int count = m_count - first;
+            tracePacket(first, count > OCCLUSION_ENGINE_PACKET ? OCCLUSION_ENGINE_PACKET : count);
+        }
+    }
+}
+
+/*
+    Moller-Trumbore against every triangle in the leaves the packet's segments pass through. Every ray in a packet
+    starts at the listener, so the parts of the test that only depend on the origin and the triangle are worked out
+    once per triangle rather than once per ray.
+*/
+void OcclusionEngine::tracePacket(int first, int count)
+{
+    const float ox = m_listener.x, oy = m_listener.y, oz = m_listener.z;
+    float dir[3][OCCLUSION_ENGINE_PACKET], inv[3][OCCLUSION_ENGINE_PACKET];
+    float transdirect[OCCLUSION_ENGINE_PACKET], transreverb[OCCLUSION_ENGINE_PACKET];
+    int stack[OCCLUSION_ENGINE_MAX_DEPTH + 2];
+    int sp = 0;
+
+    for (int i = 0; i < OCCLUSION_ENGINE_PACKET; i++)
+    {
+        float d[3] = { 0.0f, 0.0f, 0.0f };
+        if (i < count)
+        {
+            const FMOD_VECTOR *source = &m_sources[m_sorted[first + i]];
+            d[0] = source->x - ox;
+            d[1] = source->y - oy;
+            d[2] = source->z - oz;
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            /*
+                A ray parallel to a slab gets a huge rather than infinite inverse, which keeps 0 * inf out of the box test.
+            */
+            float safe = fabsf(d[axis]) > OCCLUSION_ENGINE_TINY ? d[axis] : (d[axis] < 0.0f ? -OCCLUSION_ENGINE_TINY : OCCLUSION_ENGINE_TINY);
+            dir[axis][i] = d[axis];
+            inv[axis][i] = 1.0f / safe;
+        }
+        transdirect[i] = 1.0f;
+        transreverb[i] = 1.0f;
+    }
+
+    stack[sp++] = 0;
+
+#if defined(__SSE2__)
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 opaque = _mm_set1_ps(OCCLUSION_ENGINE_OPAQUE);
+    const __m128 tiny = _mm_set1_ps(OCCLUSION_ENGINE_TINY);
+    const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 dx[2], dy[2], dz[2], ix[2], iy[2], iz[2], td[2], tr[2], active[2], inbox[2];
+
+    for (int h = 0; h < 2; h++)
+    {
+        dx[h] = _mm_loadu_ps(&dir[0][h * 4]);
+        dy[h] = _mm_loadu_ps(&dir[1][h * 4]);
+        dz[h] = _mm_loadu_ps(&dir[2][h * 4]);
+        ix[h] = _mm_loadu_ps(&inv[0][h * 4]);
+        iy[h] = _mm_loadu_ps(&inv[1][h * 4]);
+        iz[h] = _mm_loadu_ps(&inv[2][h * 4]);
+        td[h] = one;
+        tr[h] = one;
+        active[h] = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_setr_epi32(h * 4, h * 4 + 1, h * 4 + 2, h * 4 + 3), _mm_set1_epi32(count)));
+    }
+
+    while (sp)
+    {
+        const OcclusionNode *node = &m_nodes[stack[--sp]];
+        const __m128 minx = _mm_set1_ps(node->min[0] - ox), maxx = _mm_set1_ps(node->max[0] - ox);
+        const __m128 miny = _mm_set1_ps(node->min[1] - oy), maxy = _mm_set1_ps(node->max[1] - oy);
+        const __m128 minz = _mm_set1_ps(node->min[2] - oz), maxz = _mm_set1_ps(node->max[2] - oz);
+        int hit = 0;
+
+        for (int h = 0; h < 2; h++)
+        {
+            __m128 t1 = _mm_mul_ps(minx, ix[h]), t2 = _mm_mul_ps(maxx, ix[h]);
+            __m128 tmin = _mm_min_ps(t1, t2), tmax = _mm_max_ps(t1, t2);
+            t1 = _mm_mul_ps(miny, iy[h]);
+            t2 = _mm_mul_ps(maxy, iy[h]);
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+            tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+            t1 = _mm_mul_ps(minz, iz[h]);
+            t2 = _mm_mul_ps(maxz, iz[h]);
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+            tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+            /*
+                Only the segment between the listener and the emitter counts.
+            */
+            tmin = _mm_max_ps(tmin, zero);
+            tmax = _mm_min_ps(tmax, one);
+            inbox[h] = _mm_and_ps(_mm_cmple_ps(tmin, tmax), active[h]);
+            hit |= _mm_movemask_ps(inbox[h]);
+        }
+
+        if (!hit)
+        {
+            continue;
+        }
+        if (!node->count)
+        {
+            stack[sp++] = node->index;
+            stack[sp++] = node->index + 1;
+            continue;
+        }
+
+        for (int t = node->index; t < node->index + node->count; t++)
+        {
+            const OcclusionTriangle *triangle = &m_triangles[t];
+            const float *e1 = triangle->edge1;
+            const float *e2 = triangle->edge2;
+            float sx = ox - triangle->v0[0], sy = oy - triangle->v0[1], sz = oz - triangle->v0[2];
+            float qx = sy * e1[2] - sz * e1[1];
+            float qy = sz * e1[0] - sx * e1[2];
+            float qz = sx * e1[1] - sy * e1[0];
+
+            const __m128 e1x = _mm_set1_ps(e1[0]), e1y = _mm_set1_ps(e1[1]), e1z = _mm_set1_ps(e1[2]);
+            const __m128 e2x = _mm_set1_ps(e2[0]), e2y = _mm_set1_ps(e2[1]), e2z = _mm_set1_ps(e2[2]);
+            const __m128 vqx = _mm_set1_ps(qx), vqy = _mm_set1_ps(qy), vqz = _mm_set1_ps(qz);
+            const __m128 vsx = _mm_set1_ps(sx), vsy = _mm_set1_ps(sy), vsz = _mm_set1_ps(sz);
+            const __m128 tnum = _mm_set1_ps(e2[0] * qx + e2[1] * qy + e2[2] * qz);
+            const __m128 passdirect = _mm_set1_ps(1.0f - triangle->direct);
+            const __m128 passreverb = _mm_set1_ps(1.0f - triangle->reverb);
+
+            for (int h = 0; h < 2; h++)
+            {
+                if (!_mm_movemask_ps(inbox[h]))
+                {
+                    continue;
+                }
+
+                __m128 px = _mm_sub_ps(_mm_mul_ps(dy[h], e2z), _mm_mul_ps(dz[h], e2y));
+                __m128 py = _mm_sub_ps(_mm_mul_ps(dz[h], e2x), _mm_mul_ps(dx[h], e2z));
+                __m128 pz = _mm_sub_ps(_mm_mul_ps(dx[h], e2y), _mm_mul_ps(dy[h], e2x));
+                __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+                __m128 facing = triangle->doublesided ? _mm_cmpgt_ps(_mm_and_ps(det, absmask), tiny) : _mm_cmpgt_ps(det, tiny);
+                __m128 rdet = _mm_div_ps(one, det);
+
+                __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vsx, px), _mm_mul_ps(vsy, py)), _mm_mul_ps(vsz, pz)), rdet);
+                __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx[h], vqx), _mm_mul_ps(dy[h], vqy)), _mm_mul_ps(dz[h], vqz)), rdet);
+                __m128 tt = _mm_mul_ps(tnum, rdet);
+
+                __m128 crossed = _mm_and_ps(inbox[h], facing);
+                crossed = _mm_and_ps(crossed, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+                crossed = _mm_and_ps(crossed, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                crossed = _mm_and_ps(crossed, _mm_and_ps(_mm_cmpgt_ps(tt, zero), _mm_cmplt_ps(tt, one)));
+                if (!_mm_movemask_ps(crossed))
+                {
+                    continue;
+                }
+
+                td[h] = _mm_mul_ps(td[h], _mm_or_ps(_mm_and_ps(crossed, passdirect), _mm_andnot_ps(crossed, one)));
+                tr[h] = _mm_mul_ps(tr[h], _mm_or_ps(_mm_and_ps(crossed, passreverb), _mm_andnot_ps(crossed, one)));
+
+                /*
+                    Nothing more can happen to a ray that lets nothing through.
+                */
+                __m128 open = _mm_or_ps(_mm_cmpgt_ps(td[h], opaque), _mm_cmpgt_ps(tr[h], opaque));
+                active[h] = _mm_and_ps(active[h], open);
+                inbox[h] = _mm_and_ps(inbox[h], open);
+            }
+        }
+    }
+
+    for (int h = 0; h < 2; h++)
+    {
+        _mm_storeu_ps(&transdirect[h * 4], td[h]);
+        _mm_storeu_ps(&transreverb[h * 4], tr[h]);
+    }
+#else
+    bool active[OCCLUSION_ENGINE_PACKET], inbox[OCCLUSION_ENGINE_PACKET];
+
+    for (int i = 0; i < OCCLUSION_ENGINE_PACKET; i++)
+    {
+        active[i] = i < count;
+    }
+
+    while (sp)
+    {
+        const OcclusionNode *node = &m_nodes[stack[--sp]];
+        bool hit = false;
+
+        for (int i = 0; i < OCCLUSION_ENGINE_PACKET; i++)
+        {
+            float tmin = 0.0f, tmax = 1.0f;
+            const float origin[3] = { ox, oy, oz };
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float t1 = (node->min[axis] - origin[axis]) * inv[axis][i];
+                float t2 = (node->max[axis] - origin[axis]) * inv[axis][i];
+                if (t1 > t2)
+                {
+                    float swap = t1;
+                    t1 = t2;
+                    t2 = swap;
+                }
+                tmin = t1 > tmin ? t1 : tmin;
+                tmax = t2 < tmax ? t2 : tmax;
+            }
+            inbox[i] = active[i] && tmin <= tmax;
+            hit |= inbox[i];
+        }
+
+        if (!hit)
+        {
+            continue;
+        }
+        if (!node->count)
+        {
+            stack[sp++] = node->index;
+            stack[sp++] = node->index + 1;
+            continue;
+        }
+
+        for (int t = node->index; t < node->index + node->count; t++)
+        {
+            const OcclusionTriangle *triangle = &m_triangles[t];
+            const float *e1 = triangle->edge1;
+            const float *e2 = triangle->edge2;
+            float sx = ox - triangle->v0[0], sy = oy - triangle->v0[1], sz = oz - triangle->v0[2];
+            float qx = sy * e1[2] - sz * e1[1];
+            float qy = sz * e1[0] - sx * e1[2];
+            float qz = sx * e1[1] - sy * e1[0];
+            float tnum = e2[0] * qx + e2[1] * qy + e2[2] * qz;
+
+            for (int i = 0; i < OCCLUSION_ENGINE_PACKET; i++)
+            {
+                if (!inbox[i])
+                {
+                    continue;
+                }
+
+                float px = dir[1][i] * e2[2] - dir[2][i] * e2[1];
+                float py = dir[2][i] * e2[0] - dir[0][i] * e2[2];
+                float pz = dir[0][i] * e2[1] - dir[1][i] * e2[0];
+                float det = e1[0] * px + e1[1] * py + e1[2] * pz;
+                if (triangle->doublesided ? fabsf(det) <= OCCLUSION_ENGINE_TINY : det <= OCCLUSION_ENGINE_TINY)
+                {
+                    continue;
+                }
+
+                float rdet = 1.0f / det;
+                float u = (sx * px + sy * py + sz * pz) * rdet;
+                float v = (dir[0][i] * qx + dir[1][i] * qy + dir[2][i] * qz) * rdet;
+                float tt = tnum * rdet;
+                if (u < 0.0f || v < 0.0f || u + v > 1.0f || tt <= 0.0f || tt >= 1.0f)
+                {
+                    continue;
+                }
+
+                transdirect[i] *= 1.0f - triangle->direct;
+                transreverb[i] *= 1.0f - triangle->reverb;
+                if (transdirect[i] <= OCCLUSION_ENGINE_OPAQUE && transreverb[i] <= OCCLUSION_ENGINE_OPAQUE)
+                {
+                    active[i] = false;
+                    inbox[i] = false;
+                }
+            }
+        }
+    }
+#endif
+
+    for (int i = 0; i < count; i++)
+    {
+        int query = m_sorted[first + i];
+        m_direct[query] = 1.0f - transdirect[i];
+        if (m_reverb)
+        {
+            m_reverb[query] = 1.0f - transreverb[i];
+        }
+    }
+}
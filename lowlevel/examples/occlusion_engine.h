@@ -0,0 +1,126 @@
+/*==============================================================================
+Occlusion Engine
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Works out the occlusion between the listener and every emitter in a frame in
+one call, where System::getGeometryOcclusion answers one pair at a time.
+
+Level geometry is added as polygons, like Geometry::addPolygon, and build
+puts the triangles in a bounding volume hierarchy. A query is the segment
+from the listener to an emitter, and like FMOD's geometry every polygon it
+crosses counts: the occlusions multiply, (1 - a) * (1 - b) of the sound
+gets through two walls. A single sided polygon only occludes while the
+listener is on its front, the side its vertices wind anti-clockwise seen
+from.
+
+Queries are sorted by direction from the listener and traced in packets of
+OCCLUSION_ENGINE_PACKET rays, so one walk of the tree and one load of each
+triangle serves the whole packet, four rays to an SSE register. Packets are
+shared out between the calling thread and a WorkerPool (see worker_pool.h).
+The results are the direct and reverb values Channel::set3DOcclusion and
+VoiceManager::setOcclusion take.
+
+The geometry is static. Add to it and call build again to change it, not
+while a query is running.
+==============================================================================*/
+#ifndef _OCCLUSION_ENGINE_H
+#define _OCCLUSION_ENGINE_H
+
+#include "fmod.hpp"
+#include "worker_pool.h"
+#include <pthread.h>
+
+#define OCCLUSION_ENGINE_PACKET         8       /* Rays traced together. */
+#define OCCLUSION_ENGINE_GRAB           4       /* Packets a thread takes at a time. */
+#define OCCLUSION_ENGINE_LEAF_SIZE      4       /* Triangles a leaf can hold before it's worth splitting. */
+#define OCCLUSION_ENGINE_MAX_DEPTH      48
+
+struct OcclusionNode
+{
+    float               min[3];
+    int                 index;          /* First child, the second follows it. First triangle for a leaf. */
+    float               max[3];
+    int                 count;          /* Triangles, 0 for an inner node. */
+};
+
+struct OcclusionTriangle
+{
+    float               v0[3];
+    float               edge1[3];       /* v1 - v0 */
+    float               edge2[3];       /* v2 - v0 */
+    float               direct;
+    float               reverb;
+    int                 doublesided;
+};
+
+struct OcclusionStats
+{
+    int                 triangles;
+    int                 nodes;
+    int                 depth;
+    int                 queries;        /* Last occlude. */
+    int                 threads;        /* That took part in it, the caller included. */
+    float               elapsed;        /* Seconds it took. */
+};
+
+class OcclusionEngine
+{
+public:
+    OcclusionEngine();
+
+    /*
+        'numthreads' counts the calling thread, 0 = one per online core, 1 = everything on the calling thread.
+    */
+    FMOD_RESULT init(int maxtriangles, int numthreads);
+    void        release();
+
+    FMOD_RESULT addPolygon(float directocclusion, float reverbocclusion, bool doublesided, int numvertices, const FMOD_VECTOR *vertices);  /* Convex, fanned into triangles. */
+    void        clear();
+    FMOD_RESULT build();
+
+    /*
+        'reverb' can be 0. Blocks until every query is done.
+    */
+    FMOD_RESULT occlude(const FMOD_VECTOR *listener, const FMOD_VECTOR *sources, int count, float *direct, float *reverb);
+    FMOD_RESULT getOcclusion(const FMOD_VECTOR *listener, const FMOD_VECTOR *source, float *direct, float *reverb);
+    void        getStats(OcclusionStats *stats) const   { *stats = m_stats; }
+
+private:
+    void        buildNode(int node, int first, int count, int depth);
+    void        tracePacket(int first, int count);
+    void        work();
+    static void jobMain(void *arg);
+
+    OcclusionTriangle  *m_triangles;        /* In leaf order after build. */
+    float              *m_centroids;        /* Build scratch, 3 per triangle. */
+    int                *m_order;
+    int                 m_numtriangles;
+    int                 m_maxtriangles;
+    OcclusionNode      *m_nodes;
+    int                 m_numnodes;
+    int                 m_depth;
+    bool                m_built;
+
+    WorkerPool          m_pool;
+    WorkerJob           m_jobs[WORKER_POOL_MAX_THREADS];
+    bool                m_haspool;
+    pthread_mutex_t     m_lock;
+    pthread_cond_t      m_done;
+    int                 m_running;          /* Jobs not finished. */
+
+    /* The query being run */
+    FMOD_VECTOR         m_listener;
+    const FMOD_VECTOR  *m_sources;
+    float              *m_direct;
+    float              *m_reverb;
+    int                *m_sorted;           /* Query indices by direction from the listener. */
+    int                *m_keys;
+    int                 m_maxqueries;
+    int                 m_count;
+    int                 m_numpackets;
+    unsigned int        m_nextpacket;
+
+    OcclusionStats      m_stats;
+};
+
+#endif
@@ -0,0 +1,786 @@
+/*==============================================================================
+PCM Block Cache
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "pcm_block_cache.h"
+#include "mix_matrix.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct PcmCacheBlock
+{
+    const PcmCacheSource   *source;
+    unsigned int            index;
+    unsigned int            samples;
+    unsigned int            size;       /* Bytes counted against the budget. */
+    int                     refs;       /* Voices holding it, it isn't evicted while above 0. */
+    PcmCacheBlock          *hashnext;
+    PcmCacheBlock          *newer;
+    PcmCacheBlock          *older;
+    short                   data[1];    /* samples * channels, allocated with the block. */
+};
+
+static unsigned int PcmBlockCache_Hash(const PcmCacheSource *source, unsigned int index)
+{
+    unsigned long long key = (unsigned long long)(size_t)source ^ ((unsigned long long)index * 2654435761u);
+    key ^= key >> 17;
+    return (unsigned int)(key % PCM_BLOCK_CACHE_HASH_SIZE);
+}
+
+static unsigned int PcmBlockCache_NumBlocks(const PcmCacheSource *source)
+{
+    return (source->length + PCM_BLOCK_CACHE_BLOCK_SAMPLES - 1) / PCM_BLOCK_CACHE_BLOCK_SAMPLES;
+}
+
+PcmBlockCache::PcmBlockCache()
+{
+    m_initialized = false;
+    m_sources = 0;
+    m_budget = 0;
+    m_bytes = 0;
+    m_numblocks = 0;
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+    m_starved = 0;
+    m_newest = 0;
+    m_oldest = 0;
+    memset(m_hash, 0, sizeof(m_hash));
+}
+
+FMOD_RESULT PcmBlockCache::init(unsigned int budget, int numthreads)
+{
+    FMOD_RESULT result = m_pool.init(numthreads);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+    m_pool.attach(&m_inbox);
+
+    pthread_mutex_init(&m_lock, 0);
+    pthread_cond_init(&m_jobdone, 0);
+    m_budget = budget;
+    m_initialized = true;
+    return FMOD_OK;
+}
+
+void PcmBlockCache::release()
+{
+    if (!m_initialized)
+    {
+        return;
+    }
+
+    while (m_sources)
+    {
+        removeSource(m_sources);
+    }
+
+    m_pool.detach(&m_inbox);
+    m_pool.release();
+
+    pthread_cond_destroy(&m_jobdone);
+    pthread_mutex_destroy(&m_lock);
+    m_initialized = false;
+}
+
+FMOD_RESULT PcmBlockCache::addSource(const char *path, PcmCacheSource **source)
+{
+    FMOD_RESULT result;
+
+    *source = 0;
+
+    MappedFile *file = MappedFile_Acquire(path);
+    if (!file)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+    if (file->length < 4 || memcmp(file->data, "OggS", 4) != 0)
+    {
+        MappedFile_Release(file);
+        return FMOD_ERR_FORMAT;
+    }
+
+    /*
+        Only the headers and the last page are read here, to get the format and length.
+    */
+    PcmCacheReader reader;
+    reader.handle = 0;
+    unsigned int filesize;
+    result = MappedFile_Open(path, 0, &filesize, &reader.handle, 0);
+    if (result == FMOD_OK)
+    {
+        result = reader.decoder.open(MappedFile_Read, MappedFile_Seek, reader.handle, 0, filesize);
+    }
+    if (result == FMOD_OK && !reader.decoder.getLength())
+    {
+        result = FMOD_ERR_FORMAT;      /* Needs a known length to be played from blocks. */
+    }
+
+    PcmCacheSource *s = 0;
+    if (result == FMOD_OK)
+    {
+        s = (PcmCacheSource *)malloc(sizeof(PcmCacheSource));
+        if (!s)
+        {
+            result = FMOD_ERR_MEMORY;
+        }
+    }
+    if (result == FMOD_OK)
+    {
+        s->cache    = this;
+        s->file     = file;
+        s->channels = reader.decoder.getChannels();
+        s->rate     = reader.decoder.getRate();
+        s->length   = reader.decoder.getLength();
+    }
+
+    closeReader(&reader);
+
+    if (result != FMOD_OK)
+    {
+        MappedFile_Release(file);
+        return result;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    s->next = m_sources;
+    m_sources = s;
+    pthread_mutex_unlock(&m_lock);
+
+    *source = s;
+    return FMOD_OK;
+}
+
+void PcmBlockCache::removeSource(PcmCacheSource *source)
+{
+    pthread_mutex_lock(&m_lock);
+    for (PcmCacheSource **link = &m_sources; *link; link = &(*link)->next)
+    {
+        if (*link == source)
+        {
+            *link = source->next;
+            break;
+        }
+    }
+
+    PcmCacheBlock *block = m_newest;
+    while (block)
+    {
+        PcmCacheBlock *older = block->older;
+        if (block->source == source)
+        {
+            unlink(block);
+            free(block);
+        }
+        block = older;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    MappedFile_Release(source->file);
+    free(source);
+}
+
+void PcmBlockCache::getStats(PcmBlockCacheStats *stats)
+{
+    pthread_mutex_lock(&m_lock);
+    stats->hits         = m_hits;
+    stats->misses       = m_misses;
+    stats->evictions    = m_evictions;
+    stats->starved      = __atomic_load_n(&m_starved, __ATOMIC_RELAXED);
+    stats->blocks       = m_numblocks;
+    stats->bytes        = m_bytes;
+    stats->budget       = m_budget;
+
+    stats->compressedbytes = 0;
+    stats->decodedbytes = 0;
+    for (PcmCacheSource *source = m_sources; source; source = source->next)
+    {
+        stats->compressedbytes += source->file->length;
+        stats->decodedbytes += source->length * source->channels * sizeof(short);
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+void PcmBlockCache::closeReader(PcmCacheReader *reader)
+{
+    reader->decoder.release();
+    if (reader->handle)
+    {
+        MappedFile_Close(reader->handle, 0);
+        reader->handle = 0;
+    }
+}
+
+PcmCacheBlock *PcmBlockCache::lookup(const PcmCacheSource *source, unsigned int index, unsigned int *hash)
+{
+    *hash = PcmBlockCache_Hash(source, index);
+
+    for (PcmCacheBlock *block = m_hash[*hash]; block; block = block->hashnext)
+    {
+        if (block->source == source && block->index == index)
+        {
+            return block;
+        }
+    }
+    return 0;
+}
+
+void PcmBlockCache::touch(PcmCacheBlock *block)
+{
+    if (block == m_newest)
+    {
+        return;
+    }
+
+    /* Take it out of the LRU list */
+    if (block->newer)
+    {
+        block->newer->older = block->older;
+    }
+    if (block->older)
+    {
+        block->older->newer = block->newer;
+    }
+    if (m_oldest == block)
+    {
+        m_oldest = block->newer;
+    }
+
+    /* And put it back at the front */
+    block->newer = 0;
+    block->older = m_newest;
+    if (m_newest)
+    {
+        m_newest->newer = block;
+    }
+    m_newest = block;
+    if (!m_oldest)
+    {
+        m_oldest = block;
+    }
+}
+
+void PcmBlockCache::unlink(PcmCacheBlock *block)
+{
+    if (block->newer)
+    {
+        block->newer->older = block->older;
+    }
+    else
+    {
+        m_newest = block->older;
+    }
+    if (block->older)
+    {
+        block->older->newer = block->newer;
+    }
+    else
+    {
+        m_oldest = block->newer;
+    }
+
+    PcmCacheBlock **link = &m_hash[PcmBlockCache_Hash(block->source, block->index)];
+    while (*link != block)
+    {
+        link = &(*link)->hashnext;
+    }
+    *link = block->hashnext;
+
+    m_bytes -= block->size;
+    m_numblocks--;
+}
+
+/*
+    Frees the oldest blocks until the cache fits its budget, skipping any a voice holds. Blocks are only pinned
+    under the lock, so one seen unpinned here stays that way until it is freed.
+*/
+void PcmBlockCache::evict()
+{
+    PcmCacheBlock *block = m_oldest;
+
+    while (m_bytes > m_budget && block)
+    {
+        PcmCacheBlock *newer = block->newer;
+        if (!__atomic_load_n(&block->refs, __ATOMIC_ACQUIRE))
+        {
+            unlink(block);
+            free(block);
+            m_evictions++;
+        }
+        block = newer;
+    }
+}
+
+/*
+    Runs without the lock held, so one voice decoding doesn't hold up others fetching cached blocks.
+*/
+FMOD_RESULT PcmBlockCache::decode(PcmCacheSource *source, PcmCacheReader *reader, unsigned int index, PcmCacheBlock **block)
+{
+    FMOD_RESULT result;
+    unsigned int start = index * PCM_BLOCK_CACHE_BLOCK_SAMPLES;
+    unsigned int samples = source->length - start;
+
+    if (samples > PCM_BLOCK_CACHE_BLOCK_SAMPLES)
+    {
+        samples = PCM_BLOCK_CACHE_BLOCK_SAMPLES;
+    }
+
+    if (!reader->handle)
+    {
+        unsigned int filesize;
+
+        result = MappedFile_Open(source->file->path, 0, &filesize, &reader->handle, 0);
+        if (result != FMOD_OK)
+        {
+            reader->handle = 0;
+            return result;
+        }
+        result = reader->decoder.open(MappedFile_Read, MappedFile_Seek, reader->handle, 0, filesize);
+        if (result != FMOD_OK)
+        {
+            closeReader(reader);
+            return result;
+        }
+        reader->position = 0;
+    }
+
+    if (reader->position != start)
+    {
+        result = reader->decoder.setPosition(start);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+        reader->position = start;
+    }
+
+    unsigned int datasize = samples * source->channels * sizeof(short);
+    PcmCacheBlock *b = (PcmCacheBlock *)malloc(sizeof(PcmCacheBlock) + datasize);
+    if (!b)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    unsigned int samplesread = 0;
+    result = reader->decoder.readPCM16(b->data, samples, &samplesread);
+    reader->position += samplesread;
+    if (result == FMOD_ERR_FILE_EOF)
+    {
+        /*
+            The length came from the last page's granule, a damaged file can end a little early.
+        */
+        memset(b->data + samplesread * source->channels, 0, (samples - samplesread) * source->channels * sizeof(short));
+        result = FMOD_OK;
+    }
+    if (result != FMOD_OK)
+    {
+        free(b);
+        return result;
+    }
+
+    b->source   = source;
+    b->index    = index;
+    b->samples  = samples;
+    b->size     = sizeof(PcmCacheBlock) + datasize;
+    b->refs     = 0;
+    b->hashnext = 0;
+    b->newer    = 0;
+    b->older    = 0;
+
+    *block = b;
+    return FMOD_OK;
+}
+
+/*
+    Returns the block pinned, the caller unpins it when done with it. Never called from the mixer.
+*/
+FMOD_RESULT PcmBlockCache::fetch(PcmCacheSource *source, PcmCacheReader *reader, unsigned int index, PcmCacheBlock **block)
+{
+    unsigned int hash;
+
+    pthread_mutex_lock(&m_lock);
+    PcmCacheBlock *b = lookup(source, index, &hash);
+    if (b)
+    {
+        m_hits++;
+    }
+    else
+    {
+        pthread_mutex_unlock(&m_lock);
+
+        PcmCacheBlock *decoded;
+        FMOD_RESULT result = decode(source, reader, index, &decoded);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+
+        /*
+            Another voice may have decoded the same block meanwhile, keep whichever got there first.
+        */
+        pthread_mutex_lock(&m_lock);
+        b = lookup(source, index, &hash);
+        if (b)
+        {
+            free(decoded);
+        }
+        else
+        {
+            b = decoded;
+            b->hashnext = m_hash[hash];
+            m_hash[hash] = b;
+            m_bytes += b->size;
+            m_numblocks++;
+        }
+        m_misses++;
+    }
+
+    __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+    touch(b);
+    evict();
+    pthread_mutex_unlock(&m_lock);
+
+    *block = b;
+    return FMOD_OK;
+}
+
+void PcmBlockCache::unpin(PcmCacheBlock *block)
+{
+    if (block)
+    {
+        __atomic_sub_fetch(&block->refs, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+    Called by a voice's fetch job each time round, true to go again. m_busy is cleared before the voice is looked at,
+    so a kick the mixer made meanwhile either sees it clear and submits the job again, leaving this run to finish, or
+    is seen here. Under the lock, so once stop sees m_busy clear the job has finished with the voice.
+*/
+bool PcmBlockCache::jobDone(PcmCacheVoice *voice)
+{
+    pthread_mutex_lock(&m_lock);
+    __atomic_store_n(&voice->m_busy, false, __ATOMIC_SEQ_CST);
+
+    bool again = !__atomic_load_n(&voice->m_stopping, __ATOMIC_SEQ_CST) &&
+                 !__atomic_load_n(&voice->m_finished, __ATOMIC_ACQUIRE) &&
+                 !__atomic_load_n(&voice->m_next, __ATOMIC_SEQ_CST) &&
+                 __atomic_load_n(&voice->m_want, __ATOMIC_SEQ_CST) < PcmBlockCache_NumBlocks(voice->m_source) &&
+                 !__atomic_exchange_n(&voice->m_busy, true, __ATOMIC_SEQ_CST);
+    if (!again)
+    {
+        pthread_cond_broadcast(&m_jobdone);
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    return again;
+}
+
+void PcmBlockCache::waitForJob(PcmCacheVoice *voice)
+{
+    pthread_mutex_lock(&m_lock);
+    while (__atomic_load_n(&voice->m_busy, __ATOMIC_SEQ_CST))
+    {
+        pthread_cond_wait(&m_jobdone, &m_lock);
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+PcmCacheVoice::PcmCacheVoice()
+{
+    m_source = 0;
+    m_dsp = 0;
+    m_channel = 0;
+    m_reader.handle = 0;
+    m_reader.position = 0;
+    m_job.func = fetchJob;
+    m_job.arg = this;
+    m_current = 0;
+    m_position = 0;
+    m_step = 0;
+    m_next = 0;
+    m_want = 0;
+    m_busy = false;
+    m_stopping = false;
+    m_finished = false;
+}
+
+FMOD_RESULT PcmCacheVoice::play(FMOD::System *system, PcmCacheSource *source, FMOD::ChannelGroup *group, FMOD::Channel **channel)
+{
+    FMOD_RESULT result;
+    int mixrate;
+
+    stop();
+    *channel = 0;
+
+    result = system->getSoftwareFormat(&mixrate, 0, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_source = source;
+    m_reader.handle = 0;
+    m_reader.position = 0;
+    m_position = 0;
+    m_step = ((unsigned long long)source->rate << 32) / mixrate;
+    m_next = 0;
+    m_want = 1;
+    m_busy = false;
+    m_stopping = false;
+    m_finished = false;
+
+    result = source->cache->fetch(source, &m_reader, 0, &m_current);
+    if (result != FMOD_OK)
+    {
+        m_current = 0;
+        PcmBlockCache::closeReader(&m_reader);
+        return result;
+    }
+
+    FMOD_DSP_DESCRIPTION desc;
+    memset(&desc, 0, sizeof(FMOD_DSP_DESCRIPTION));
+    strncpy(desc.name, "PCM Block Cache Voice", sizeof(desc.name));
+    desc.version = 0x00010000;
+    desc.numinputbuffers = 0;
+    desc.numoutputbuffers = 1;
+    desc.process = processCallback;
+    desc.userdata = this;
+
+    result = system->createDSP(&desc, &m_dsp);
+    if (result != FMOD_OK)
+    {
+        m_dsp = 0;
+        PcmBlockCache::unpin(m_current);
+        m_current = 0;
+        PcmBlockCache::closeReader(&m_reader);
+        return result;
+    }
+
+    /*
+        Get the second block on its way before the mixer can reach the end of the first.
+    */
+    if (m_want < PcmBlockCache_NumBlocks(source))
+    {
+        m_busy = true;
+        source->cache->m_pool.submit(&m_job);
+    }
+
+    result = system->playDSP(m_dsp, group, false, &m_channel);
+    if (result != FMOD_OK)
+    {
+        m_channel = 0;
+        stop();
+        return result;
+    }
+
+    *channel = m_channel;
+    return FMOD_OK;
+}
+
+void PcmCacheVoice::stop()
+{
+    if (!m_dsp)
+    {
+        return;
+    }
+
+    __atomic_store_n(&m_stopping, true, __ATOMIC_SEQ_CST);
+
+    /*
+        Once the DSP is released the mixer can't kick another fetch, then the one in flight, if any, is waited for.
+    */
+    if (m_channel)
+    {
+        m_channel->stop();      /* Fails harmlessly if the channel has already gone. */
+    }
+    m_dsp->disconnectAll(true, true);
+    m_dsp->release();
+    m_dsp = 0;
+    m_channel = 0;
+
+    m_source->cache->waitForJob(this);
+
+    PcmBlockCache::unpin(m_current);
+    PcmBlockCache::unpin(m_next);
+    m_current = 0;
+    m_next = 0;
+    PcmBlockCache::closeReader(&m_reader);
+}
+
+bool PcmCacheVoice::isPlaying()
+{
+    bool playing = false;
+
+    if (!m_dsp || __atomic_load_n(&m_finished, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    FMOD_RESULT result = m_channel->isPlaying(&playing);
+    return (result == FMOD_OK) && playing;
+}
+
+/*
+    Runs on a pool thread, fetching the block the mixer wants next into m_next.
+*/
+void PcmCacheVoice::fetchJob(void *arg)
+{
+    PcmCacheVoice *voice = (PcmCacheVoice *)arg;
+    PcmBlockCache *cache = voice->m_source->cache;
+
+    do
+    {
+        unsigned int want = __atomic_load_n(&voice->m_want, __ATOMIC_SEQ_CST);
+        PcmCacheBlock *block;
+
+        if (__atomic_load_n(&voice->m_stopping, __ATOMIC_SEQ_CST) || want >= PcmBlockCache_NumBlocks(voice->m_source))
+        {
+            continue;
+        }
+
+        if (cache->fetch(voice->m_source, &voice->m_reader, want, &block) == FMOD_OK)
+        {
+            __atomic_store_n(&voice->m_next, block, __ATOMIC_SEQ_CST);
+        }
+        else
+        {
+            __atomic_store_n(&voice->m_finished, true, __ATOMIC_RELEASE);     /* A block that can't be decoded ends the voice. */
+        }
+    } while (cache->jobDone(voice));
+}
+
+void PcmCacheVoice::kick()
+{
+    if (__atomic_exchange_n(&m_busy, true, __ATOMIC_SEQ_CST))
+    {
+        return;     /* The job running will see the new m_want before it finishes. */
+    }
+    if (!m_source->cache->m_pool.submit(&m_source->cache->m_inbox, &m_job))
+    {
+        __atomic_store_n(&m_busy, false, __ATOMIC_SEQ_CST);     /* Inbox full, tried again next mix. */
+    }
+}
+
+/*
+    Moves the voice onto block 'index', which is always the one after m_current. False if it hasn't been fetched.
+*/
+bool PcmCacheVoice::advance(unsigned int index)
+{
+    PcmCacheBlock *next = __atomic_load_n(&m_next, __ATOMIC_SEQ_CST);
+
+    if (!next || next->index != index)
+    {
+        kick();
+        return false;
+    }
+
+    PcmBlockCache::unpin(m_current);
+    m_current = next;
+
+    /*
+        m_want is written before m_next is cleared, a job that sees m_next cleared fetches the new block.
+    */
+    __atomic_store_n(&m_want, index + 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&m_next, (PcmCacheBlock *)0, __ATOMIC_SEQ_CST);
+    if (index + 1 < PcmBlockCache_NumBlocks(m_source))
+    {
+        kick();
+    }
+    return true;
+}
+
+void PcmCacheVoice::render(float *outbuffer, unsigned int length, int outchannels)
+{
+    int channels = m_source->channels;
+    unsigned int s;
+
+    for (s = 0; s < length; s++)
+    {
+        unsigned int sample = (unsigned int)(m_position >> 32);
+        if (sample >= m_source->length)
+        {
+            __atomic_store_n(&m_finished, true, __ATOMIC_RELEASE);
+            break;
+        }
+
+        unsigned int index = sample / PCM_BLOCK_CACHE_BLOCK_SAMPLES;
+        if (index != m_current->index && !advance(index))
+        {
+            __atomic_add_fetch(&m_source->cache->m_starved, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        /*
+            Linear interpolation, the sample after the last in a block is the first of the next if it's here yet.
+        */
+        unsigned int offset = sample - index * PCM_BLOCK_CACHE_BLOCK_SAMPLES;
+        const short *a = m_current->data + offset * channels;
+        const short *b = a;
+        if (offset + 1 < m_current->samples)
+        {
+            b = a + channels;
+        }
+        else
+        {
+            PcmCacheBlock *next = __atomic_load_n(&m_next, __ATOMIC_SEQ_CST);
+            if (next && next->index == index + 1)
+            {
+                b = next->data;
+            }
+        }
+
+        float frac = (float)(m_position & 0xFFFFFFFFULL) * (1.0f / 4294967296.0f);
+        float *out = outbuffer + s * outchannels;
+        for (int ch = 0; ch < outchannels; ch++)
+        {
+            if (ch < channels)
+            {
+                out[ch] = ((float)a[ch] + ((float)b[ch] - (float)a[ch]) * frac) * (1.0f / 32768.0f);
+            }
+            else
+            {
+                out[ch] = 0.0f;
+            }
+        }
+
+        m_position += m_step;
+    }
+
+    /*
+        Starved or finished, the rest is silence.
+    */
+    memset(outbuffer + s * outchannels, 0, (length - s) * outchannels * sizeof(float));
+}
+
+FMOD_RESULT F_CALLBACK PcmCacheVoice::processCallback(FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY * /*inbufferarray*/, FMOD_DSP_BUFFER_ARRAY *outbufferarray, bool /*inputsidle*/, FMOD_DSP_PROCESS_OPERATION op)
+{
+    PcmCacheVoice *voice;
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&voice);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    if (op == FMOD_DSP_PROCESS_QUERY)
+    {
+        if (__atomic_load_n(&voice->m_finished, __ATOMIC_ACQUIRE))
+        {
+            return FMOD_ERR_DSP_DONTPROCESS;
+        }
+
+        if (outbufferarray)
+        {
+            outbufferarray->speakermode = MixMatrix_ModeFromChannels(voice->m_source->channels);
+            outbufferarray->buffernumchannels[0] = voice->m_source->channels;
+            outbufferarray->bufferchannelmask[0] = 0;
+        }
+        return FMOD_OK;
+    }
+
+    voice->render(outbufferarray->buffers[0], length, outbufferarray->buffernumchannels[0]);
+
+    return FMOD_OK;
+}
@@ -0,0 +1,164 @@
+/*==============================================================================
+PCM Block Cache
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+A middle ground between decoding a sample in full and streaming it from disk.
+Each source stays compressed in memory, an mmapped Ogg Vorbis file (see
+mapped_file.h), and is decoded to PCM16 in blocks of
+PCM_BLOCK_CACHE_BLOCK_SAMPLES when they are first needed, into a cache shared
+by every source and every voice. Once the cache goes over its byte budget the
+least recently used blocks are freed. Voices playing the same source share
+its blocks, so a sound played ten times over is decoded once.
+
+A PcmCacheVoice plays a source without an FMOD stream. It is a generator DSP
+started with System::playDSP, so there is no stream thread involved at all.
+The mixer only ever copies out of blocks the voice already holds, it never
+decodes, waits or takes a lock. Each voice holds the block it is playing and
+the one after it. As it moves into the next block it asks the cache's
+WorkerPool, through a WorkerInbox, to fetch the one after that, which is a
+copy if another voice has it cached and a decode on the worker if not. If the
+worker hasn't got there in time the voice plays silence until it has, and
+counts it in PcmBlockCacheStats::starved. Blocks a voice holds are never
+evicted, so the cache can go over its budget by up to two blocks a voice.
+
+Every voice of one cache must be played on the same System, the inbox only
+takes jobs from one mixer thread. removeSource must only be called once every
+voice playing that source has been stopped.
+==============================================================================*/
+#ifndef _PCM_BLOCK_CACHE_H
+#define _PCM_BLOCK_CACHE_H
+
+#include "fmod.hpp"
+#include "mapped_file.h"
+#include "vorbis_decoder.h"
+#include "worker_pool.h"
+#include <pthread.h>
+
+#define PCM_BLOCK_CACHE_BLOCK_SAMPLES   4096
+#define PCM_BLOCK_CACHE_HASH_SIZE       1024
+
+class PcmBlockCache;
+struct PcmCacheBlock;
+
+struct PcmCacheSource
+{
+    PcmBlockCache      *cache;
+    MappedFile         *file;
+    int                 channels;
+    int                 rate;
+    unsigned int        length;         /* Samples. */
+    PcmCacheSource     *next;           /* The cache's sources. */
+};
+
+/*
+    One voice's decoder. It is only opened on the voice's first cache miss, and stays where the last miss left it
+    so a voice missing block after block decodes straight through without seeking.
+*/
+struct PcmCacheReader
+{
+    VorbisDecoder       decoder;
+    void               *handle;         /* MappedFile_Open handle, 0 until the first miss. */
+    unsigned int        position;       /* Sample the decoder will produce next. */
+};
+
+struct PcmBlockCacheStats
+{
+    unsigned int        hits;           /* Block fetches served from the cache. */
+    unsigned int        misses;         /* Block fetches that had to decode. */
+    unsigned int        evictions;
+    unsigned int        starved;        /* Times a voice reached a block its worker hadn't fetched yet. */
+    int                 blocks;
+    unsigned int        bytes;          /* PCM held, including per block overhead. */
+    unsigned int        budget;
+    unsigned int        compressedbytes;    /* Every source's file. */
+    unsigned int        decodedbytes;       /* What every source would take decoded in full. */
+};
+
+class PcmCacheVoice
+{
+public:
+    PcmCacheVoice();
+
+    /*
+        The first block is fetched here, on the calling thread, so the voice has something to play straight away.
+    */
+    FMOD_RESULT     play(FMOD::System *system, PcmCacheSource *source, FMOD::ChannelGroup *group, FMOD::Channel **channel);
+    void            stop();                     /* Waits for the voice's fetch to finish. Safe to call when stopped. */
+    bool            isPlaying();                /* False once it has played to the end, or the channel has gone. */
+
+    static FMOD_RESULT F_CALLBACK processCallback(FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, bool inputsidle, FMOD_DSP_PROCESS_OPERATION op);
+
+private:
+    friend class PcmBlockCache;
+
+    static void     fetchJob(void *arg);
+    void            kick();                     /* Mixer thread. */
+    bool            advance(unsigned int index);    /* Mixer thread. */
+    void            render(float *outbuffer, unsigned int length, int outchannels);  /* Mixer thread. */
+
+    PcmCacheSource     *m_source;
+    FMOD::DSP          *m_dsp;
+    FMOD::Channel      *m_channel;
+    PcmCacheReader      m_reader;
+    WorkerJob           m_job;
+
+    /* Mixer thread. */
+    PcmCacheBlock      *m_current;
+    unsigned long long  m_position;             /* Samples of the source, 32.32 fixed point. */
+    unsigned long long  m_step;                 /* Source samples per output sample, 32.32. */
+
+    /* Handed between the mixer and the fetch job. */
+    PcmCacheBlock      *m_next;                 /* Set by the job, taken by the mixer. */
+    unsigned int        m_want;                 /* Block the job should fetch into m_next. */
+    bool                m_busy;                 /* A fetch job is queued or running. */
+    bool                m_stopping;
+    bool                m_finished;
+};
+
+class PcmBlockCache
+{
+public:
+    PcmBlockCache();
+
+    FMOD_RESULT     init(unsigned int budget, int numthreads);     /* Bytes, and decode threads, 0 = one per core. */
+    void            release();                      /* Removes any sources left. */
+
+    FMOD_RESULT     addSource(const char *path, PcmCacheSource **source);
+    void            removeSource(PcmCacheSource *source);
+    void            getStats(PcmBlockCacheStats *stats);
+
+private:
+    friend class PcmCacheVoice;
+
+    FMOD_RESULT     fetch(PcmCacheSource *source, PcmCacheReader *reader, unsigned int index, PcmCacheBlock **block);
+    static void     unpin(PcmCacheBlock *block);    /* Any thread, without the lock. */
+    static void     closeReader(PcmCacheReader *reader);
+    bool            jobDone(PcmCacheVoice *voice);
+    void            waitForJob(PcmCacheVoice *voice);
+
+    PcmCacheBlock  *lookup(const PcmCacheSource *source, unsigned int index, unsigned int *hash);
+    void            touch(PcmCacheBlock *block);
+    void            unlink(PcmCacheBlock *block);
+    void            evict();
+    FMOD_RESULT     decode(PcmCacheSource *source, PcmCacheReader *reader, unsigned int index, PcmCacheBlock **block);
+
+    pthread_mutex_t m_lock;
+    pthread_cond_t  m_jobdone;
+    bool            m_initialized;
+    WorkerPool      m_pool;
+    WorkerInbox     m_inbox;                /* Fetches asked for by the mixer. */
+    PcmCacheSource *m_sources;
+    unsigned int    m_budget;
+    unsigned int    m_bytes;
+    int             m_numblocks;
+    unsigned int    m_hits;
+    unsigned int    m_misses;
+    unsigned int    m_evictions;
+    unsigned int    m_starved;              /* Bumped by the mixer. */
+
+    PcmCacheBlock  *m_hash[PCM_BLOCK_CACHE_HASH_SIZE];
+    PcmCacheBlock  *m_newest;           /* LRU list, newest to oldest. */
+    PcmCacheBlock  *m_oldest;
+};
+
+#endif
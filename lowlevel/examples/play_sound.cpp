@@ -7,14 +7,67 @@ usage of FMOD. By default FMOD will decode the entire file into memory when it
 loads. If the sounds are big and possibly take up a lot of RAM it would be
 better to use the FMOD_CREATESTREAM flag, this will stream the file in realtime
 as it plays.
+
+#define USE_BLOCK_CACHE = Play Ogg Vorbis sounds kept compressed in memory. Each
+                          play is a PcmCacheVoice, a DSP that plays from a
+                          PcmBlockCache shared by all the voices, with blocks
+                          decoded ahead on the cache's worker threads rather
+                          than on a stream thread (see pcm_block_cache.h).
+                          Voices playing the same sound share its decoded
+                          blocks, and the cache keeps to BLOCK_CACHE_BUDGET
+                          apart from the blocks voices are holding.
+//#define USE_BLOCK_CACHE = Load the wavs fully into memory.
 ==============================================================================*/
 #include "fmod.hpp"
 #include "common.h"
 
+//#define USE_BLOCK_CACHE
+
+#ifdef USE_BLOCK_CACHE
+#include "pcm_block_cache.h"
+
+#define BLOCK_CACHE_BUDGET  (128 * 1024)
+#define BLOCK_CACHE_THREADS 2
+#define MAX_VOICES          32
+
+static FMOD_RESULT playVoice(FMOD::System *system, PcmCacheSource *source, PcmCacheVoice *voices, FMOD::Channel **channel)
+{
+    for (int i = 0; i < MAX_VOICES; i++)
+    {
+        if (!voices[i].isPlaying())
+        {
+            return voices[i].play(system, source, 0, channel);
+        }
+    }
+
+    return FMOD_OK;     /* All voices busy, drop it. */
+}
+
+/*
+    Stops the voices that have played to the end, so their blocks can be evicted.
+*/
+static void stopFinishedVoices(PcmCacheVoice *voices)
+{
+    for (int i = 0; i < MAX_VOICES; i++)
+    {
+        if (!voices[i].isPlaying())
+        {
+            voices[i].stop();
+        }
+    }
+}
+#endif
+
 int FMOD_Main()
 {
     FMOD::System     *system;
+#ifdef USE_BLOCK_CACHE
+    PcmBlockCache     cache;
+    PcmCacheSource   *source[4];
+    PcmCacheVoice     voices[MAX_VOICES];
+#else
     FMOD::Sound      *sound1, *sound2, *sound3;
+#endif
     FMOD::Channel    *channel = 0;
     FMOD_RESULT       result;
     unsigned int      version;
@@ -39,6 +92,19 @@ int FMOD_Main()
     result = system->init(32, FMOD_INIT_NORMAL, extradriverdata);
     ERRCHECK(result);
 
+#ifdef USE_BLOCK_CACHE
+    result = cache.init(BLOCK_CACHE_BUDGET, BLOCK_CACHE_THREADS);
+    ERRCHECK(result);
+
+    result = cache.addSource(Common_MediaPath("c.ogg"), &source[0]);
+    ERRCHECK(result);
+    result = cache.addSource(Common_MediaPath("d.ogg"), &source[1]);
+    ERRCHECK(result);
+    result = cache.addSource(Common_MediaPath("e.ogg"), &source[2]);
+    ERRCHECK(result);
+    result = cache.addSource(Common_MediaPath("stereo.ogg"), &source[3]);
+    ERRCHECK(result);
+#else
     result = system->createSound(Common_MediaPath("drumloop.wav"), FMOD_HARDWARE, 0, &sound1);
     ERRCHECK(result);
 
@@ -50,6 +116,7 @@ int FMOD_Main()
 
     result = system->createSound(Common_MediaPath("swish.wav"), FMOD_HARDWARE, 0, &sound3);
     ERRCHECK(result);
+#endif
 
     /*
         Main loop
@@ -58,6 +125,16 @@ int FMOD_Main()
     {
         Common_Update();
 
+#ifdef USE_BLOCK_CACHE
+        for (int i = 0; i < 4; i++)
+        {
+            if (Common_BtnPress((Common_Button)(BTN_ACTION1 + i)))
+            {
+                result = playVoice(system, source[i], voices, &channel);
+                ERRCHECK(result);
+            }
+        }
+#else
         if (Common_BtnPress(BTN_ACTION1))
         {
             result = system->playSound(sound1, 0, false, &channel);
@@ -75,10 +152,15 @@ int FMOD_Main()
             result = system->playSound(sound3, 0, false, &channel);
             ERRCHECK(result);
         }
+#endif
 
         result = system->update();
         ERRCHECK(result);
 
+#ifdef USE_BLOCK_CACHE
+        stopFinishedVoices(voices);
+#endif
+
         {
             unsigned int ms = 0;
             unsigned int lenms = 0;
@@ -126,13 +208,32 @@ int FMOD_Main()
             Common_Draw("Copyright (c) Firelight Technologies 2004-2014.");
             Common_Draw("==================================================");
             Common_Draw("");
+#ifdef USE_BLOCK_CACHE
+            Common_Draw("Press %s to play a mono sound (c)", Common_BtnStr(BTN_ACTION1));
+            Common_Draw("Press %s to play a mono sound (d)", Common_BtnStr(BTN_ACTION2));
+            Common_Draw("Press %s to play a mono sound (e)", Common_BtnStr(BTN_ACTION3));
+            Common_Draw("Press %s to play a stereo sound (stereo)", Common_BtnStr(BTN_ACTION4));
+#else
             Common_Draw("Press %s to play a mono sound (drumloop)", Common_BtnStr(BTN_ACTION1));
             Common_Draw("Press %s to play a mono sound (jaguar)", Common_BtnStr(BTN_ACTION2));
             Common_Draw("Press %s to play a stereo sound (swish)", Common_BtnStr(BTN_ACTION3));
+#endif
             Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
             Common_Draw("");
             Common_Draw("Time %02d:%02d:%02d/%02d:%02d:%02d : %s", ms / 1000 / 60, ms / 1000 % 60, ms / 10 % 100, lenms / 1000 / 60, lenms / 1000 % 60, lenms / 10 % 100, paused ? "Paused " : playing ? "Playing" : "Stopped");
             Common_Draw("Channels Playing %d", channelsplaying);
+#ifdef USE_BLOCK_CACHE
+            {
+                PcmBlockCacheStats stats;
+                cache.getStats(&stats);
+
+                unsigned int lookups = stats.hits + stats.misses;
+                Common_Draw("");
+                Common_Draw("Cache %3d KB of %3d KB, %3d blocks, %3d%% hits", stats.bytes / 1024, stats.budget / 1024, stats.blocks, lookups ? (int)((unsigned long long)stats.hits * 100 / lookups) : 0);
+                Common_Draw("Compressed %3d KB, decoded in full would be %3d KB", stats.compressedbytes / 1024, stats.decodedbytes / 1024);
+                Common_Draw("Blocks not fetched in time %d", stats.starved);
+            }
+#endif
         }
 
         Common_Sleep(50);
@@ -141,12 +242,23 @@ int FMOD_Main()
     /*
         Shut down
     */
+#ifdef USE_BLOCK_CACHE
+    /*
+        The voices hold blocks of the sources, stop them first.
+    */
+    for (int i = 0; i < MAX_VOICES; i++)
+    {
+        voices[i].stop();
+    }
+    cache.release();
+#else
     result = sound1->release();
     ERRCHECK(result);
     result = sound2->release();
     ERRCHECK(result);
     result = sound3->release();
     ERRCHECK(result);
+#endif
     result = system->close();
     ERRCHECK(result);
     result = system->release();
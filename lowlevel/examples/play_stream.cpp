@@ -7,9 +7,45 @@ behaviour is achieved by specifying FMOD_CREATESTREAM in the call to
 System::createSound. This makes FMOD decode the file in realtime as it plays,
 instead of loading it all at once which uses far less memory in exchange for a
 small runtime CPU hit.
+
+#define USE_ASYNC_READS = File reads are queued to a pool of I/O threads, see
+                          async_file.h.
+//#define USE_ASYNC_READS = File reads are memcpys from an mmapped file, see
+                          mapped_file.h.
+
+#define USE_VORBIS_PLUGIN = Streams an Ogg Vorbis file through the example codec
+                            plugin (see plugins/fmod_codec_vorbis.cpp). Press
+                            the switch button to reopen it with FMOD's built in
+                            Vorbis decoder and compare the stream CPU usage.
+//#define USE_VORBIS_PLUGIN = Plays wave.mp3 with FMOD's own codecs.
 ==============================================================================*/
 #include "fmod.hpp"
 #include "common.h"
+#include "async_file.h"
+#include "mapped_file.h"
+#include <string.h>
+
+#define USE_ASYNC_READS
+//#define USE_VORBIS_PLUGIN
+
+#ifdef USE_VORBIS_PLUGIN
+extern "C" FMOD_CODEC_DESCRIPTION* F_STDCALL FMODGetCodecDescription();
+
+/*
+    The plugin is registered ahead of FMOD's codecs so it gets the file first. Suggesting FMOD_SOUND_TYPE_OGGVORBIS
+    sends it straight to the built in decoder instead.
+*/
+FMOD_RESULT open_vorbis_stream(FMOD::System *system, bool builtin, FMOD::Sound **sound)
+{
+    FMOD_CREATESOUNDEXINFO exinfo;
+
+    memset(&exinfo, 0, sizeof(FMOD_CREATESOUNDEXINFO));
+    exinfo.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);
+    exinfo.suggestedsoundtype = builtin ? FMOD_SOUND_TYPE_OGGVORBIS : FMOD_SOUND_TYPE_UNKNOWN;
+
+    return system->createSound(Common_MediaPath("stereo.ogg"), FMOD_CREATESTREAM | FMOD_LOOP_NORMAL | FMOD_2D, &exinfo, sound);
+}
+#endif
 
 int FMOD_Main()
 {
@@ -19,6 +55,10 @@ int FMOD_Main()
     FMOD_RESULT       result;
     unsigned int      version;
     void             *extradriverdata = 0;
+#ifdef USE_VORBIS_PLUGIN
+    unsigned int      codechandle;
+    bool              builtin = false;
+#endif
     
     Common_Init(&extradriverdata);
 
@@ -36,11 +76,26 @@ int FMOD_Main()
         Common_Fatal("FMOD lib version %08x doesn't match header version %08x", version, FMOD_VERSION);
     }
 
+#ifdef USE_ASYNC_READS
+    result = AsyncFile_InstallFileSystem(system, 0);
+#else
+    result = MappedFile_InstallFileSystem(system);
+#endif
+    ERRCHECK(result);
+
     result = system->init(32, FMOD_INIT_NORMAL, extradriverdata);
     ERRCHECK(result);
 
+#ifdef USE_VORBIS_PLUGIN
+    result = system->registerCodec(FMODGetCodecDescription(), &codechandle, 0);
+    ERRCHECK(result);
+
+    result = open_vorbis_stream(system, builtin, &sound);
+    ERRCHECK(result);
+#else
     result = system->createSound(Common_MediaPath("wave.mp3"), FMOD_HARDWARE | FMOD_LOOP_NORMAL | FMOD_2D, 0, &sound);
     ERRCHECK(result);
+#endif
 
     /*
         Play the sound.
@@ -64,6 +119,28 @@ int FMOD_Main()
             ERRCHECK(result);
         }
 
+#ifdef USE_VORBIS_PLUGIN
+        if (Common_BtnPress(BTN_ACTION2))
+        {
+            unsigned int position;
+
+            result = channel->getPosition(&position, FMOD_TIMEUNIT_PCM);
+            ERRCHECK(result);
+            result = sound->release();
+            ERRCHECK(result);
+
+            builtin = !builtin;
+            result = open_vorbis_stream(system, builtin, &sound);
+            ERRCHECK(result);
+            result = system->playSound(sound, 0, true, &channel);
+            ERRCHECK(result);
+            result = channel->setPosition(position, FMOD_TIMEUNIT_PCM);
+            ERRCHECK(result);
+            result = channel->setPaused(false);
+            ERRCHECK(result);
+        }
+#endif
+
         result = system->update();
         ERRCHECK(result);
 
@@ -106,9 +183,28 @@ int FMOD_Main()
             Common_Draw("==================================================");
             Common_Draw("");
             Common_Draw("Press %s to toggle pause", Common_BtnStr(BTN_ACTION1));
+#ifdef USE_VORBIS_PLUGIN
+            Common_Draw("Press %s to switch Vorbis decoders", Common_BtnStr(BTN_ACTION2));
+#endif
             Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
             Common_Draw("");
             Common_Draw("Time %02d:%02d:%02d/%02d:%02d:%02d : %s", ms / 1000 / 60, ms / 1000 % 60, ms / 10 % 100, lenms / 1000 / 60, lenms / 1000 % 60, lenms / 10 % 100, paused ? "Paused " : playing ? "Playing" : "Stopped");
+#ifdef USE_ASYNC_READS
+            {
+                AsyncFileStats stats;
+                AsyncFile_GetStats(&stats);
+                Common_Draw("Async reads %d (%d inline, %d late), %d KB", stats.reads, stats.inlinereads, stats.missed, (int)(stats.bytes / 1024));
+            }
+#endif
+#ifdef USE_VORBIS_PLUGIN
+            {
+                float streamcpu;
+
+                result = system->getCPUUsage(0, &streamcpu, 0, 0, 0);
+                ERRCHECK(result);
+                Common_Draw("Decoder: %s, stream CPU %5.2f%%", builtin ? "FMOD built in" : "example plugin", streamcpu);
+            }
+#endif
         }
 
         Common_Sleep(50);
@@ -123,6 +219,9 @@ int FMOD_Main()
     ERRCHECK(result);
     result = system->release();
     ERRCHECK(result);
+#ifdef USE_ASYNC_READS
+    AsyncFile_Shutdown();
+#endif
 
     Common_Close();
 
@@ -0,0 +1,248 @@
+/*==============================================================================
+FSB5 Codec Plugin Example
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+This example shows how to create a codec plugin for a container format. It
+opens PCM FSB5 files, like the ones embedded in banks, with the reader in
+fsb5_reader.h.
+
+FMOD_CODEC_STATE::waveformat is left at 0 and FMOD asks for each subsound's
+format through getwaveformat when it needs it, so nothing proportional to
+the number of subsounds is built at open. Open the container as a stream, or
+pass an inclusion list, and FMOD only asks about the subsounds that are used.
+
+Reads go straight from the source into FMOD's buffer. Open the file through
+the mapped file system (see mapped_file.h) and the only copy the PCM data
+ever makes is the one out of the mapping.
+
+Compressed containers fail with FMOD_ERR_FORMAT, so FMOD's own FSB codec
+takes them.
+==============================================================================*/
+
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fmod.hpp"
+#include "../fsb5_reader.h"
+
+extern "C" {
+    F_DECLSPEC F_DLLEXPORT FMOD_CODEC_DESCRIPTION* F_STDCALL FMODGetCodecDescription();
+}
+
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_open         (FMOD_CODEC_STATE *codec, FMOD_MODE usermode, FMOD_CREATESOUNDEXINFO *userexinfo);
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_close        (FMOD_CODEC_STATE *codec);
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_read         (FMOD_CODEC_STATE *codec, void *buffer, unsigned int sizebytes, unsigned int *bytesread);
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_setposition  (FMOD_CODEC_STATE *codec, int subsound, unsigned int position, FMOD_TIMEUNIT postype);
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_getwaveformat(FMOD_CODEC_STATE *codec, int index, FMOD_CODEC_WAVEFORMAT *waveformat);
+
+FMOD_CODEC_DESCRIPTION FMOD_CodecFsb5_Desc =
+{
+    "FMOD FSB5 Example",    // name
+    0x00010000,             // plug-in version
+    0,                      // don't force everything using this codec to be a stream
+    FMOD_TIMEUNIT_PCM,      // setposition units
+    FMOD_CodecFsb5_open,
+    FMOD_CodecFsb5_close,
+    FMOD_CodecFsb5_read,
+    0,                      // getlength, lengthpcm is enough
+    FMOD_CodecFsb5_setposition,
+    0,                      // getposition, FMOD keeps track of it
+    0,                      // soundcreate
+    FMOD_CodecFsb5_getwaveformat
+};
+
+extern "C"
+{
+
+F_DECLSPEC F_DLLEXPORT FMOD_CODEC_DESCRIPTION* F_STDCALL FMODGetCodecDescription()
+{
+    return &FMOD_CodecFsb5_Desc;
+}
+
+}
+
+struct FMODCodecFsb5State
+{
+    Fsb5Reader      reader;
+    int             current;        /* Subsound being read, -1 for none yet. */
+    Fsb5Subsound    subsound;
+    unsigned int    framesize;
+    unsigned int    position;       /* Bytes into the subsound's data. */
+};
+
+static unsigned int FMOD_CodecFsb5_FrameSize(const Fsb5Subsound *subsound)
+{
+    static const unsigned int bytes[] = { 0, 1, 2, 3, 4, 4 };     /* NONE to PCMFLOAT */
+    return bytes[subsound->format] * subsound->channels;
+}
+
+static FMOD_RESULT FMOD_CodecFsb5_select(FMODCodecFsb5State *state, int index)
+{
+    if (index == state->current)
+    {
+        return FMOD_OK;
+    }
+
+    FMOD_RESULT result = state->reader.getSubsound(index, &state->subsound);
+    if (result != FMOD_OK)
+    {
+        state->current = -1;
+        return result;
+    }
+
+    state->current = index;
+    state->framesize = FMOD_CodecFsb5_FrameSize(&state->subsound);
+    state->position = 0;
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_open(FMOD_CODEC_STATE *codec, FMOD_MODE /*usermode*/, FMOD_CREATESOUNDEXINFO * /*userexinfo*/)
+{
+    FMOD_RESULT result;
+
+    void *memory = malloc(sizeof(FMODCodecFsb5State));
+    if (!memory)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    FMODCodecFsb5State *state = new (memory) FMODCodecFsb5State;
+
+    /*
+        Only the fixed header is read here, subsounds are looked at when FMOD asks for them.
+    */
+    result = state->reader.open(codec->fileread, codec->fileseek, codec->filehandle, 0, 0);
+    if (result == FMOD_OK && (state->reader.getFormat() < FMOD_SOUND_FORMAT_PCM8 || state->reader.getFormat() > FMOD_SOUND_FORMAT_PCMFLOAT))
+    {
+        result = FMOD_ERR_FORMAT;
+    }
+    if (result != FMOD_OK)
+    {
+        state->reader.release();
+        free(state);
+        return result;
+    }
+
+    state->current = -1;
+    state->framesize = 0;
+    state->position = 0;
+
+    codec->numsubsounds = state->reader.getNumSubsounds();
+    codec->waveformat = 0;
+    codec->plugindata = state;
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_close(FMOD_CODEC_STATE *codec)
+{
+    FMODCodecFsb5State *state = (FMODCodecFsb5State *)codec->plugindata;
+
+    if (state)
+    {
+        state->reader.release();
+        free(state);
+        codec->plugindata = 0;
+    }
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_getwaveformat(FMOD_CODEC_STATE *codec, int index, FMOD_CODEC_WAVEFORMAT *waveformat)
+{
+    FMODCodecFsb5State *state = (FMODCodecFsb5State *)codec->plugindata;
+    Fsb5Subsound subsound;
+    FMOD_RESULT result;
+
+    result = state->reader.getSubsound(index, &subsound);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    memset(waveformat, 0, sizeof(FMOD_CODEC_WAVEFORMAT));
+
+    result = state->reader.getName(index, waveformat->name, sizeof(waveformat->name));
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    waveformat->format      = subsound.format;
+    waveformat->channels    = subsound.channels;
+    waveformat->frequency   = subsound.frequency;
+    waveformat->lengthbytes = subsound.datalength;
+    waveformat->lengthpcm   = subsound.lengthpcm;
+    waveformat->blockalign  = 1;
+    waveformat->loopstart   = subsound.loopstart;
+    waveformat->loopend     = subsound.loopend;
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_read(FMOD_CODEC_STATE *codec, void *buffer, unsigned int sizebytes, unsigned int *bytesread)
+{
+    FMODCodecFsb5State *state = (FMODCodecFsb5State *)codec->plugindata;
+    FMOD_RESULT result;
+
+    *bytesread = 0;
+
+    if (state->current < 0)
+    {
+        result = FMOD_CodecFsb5_select(state, 0);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    unsigned int size = state->subsound.datalength - state->position;
+    if (size > sizebytes)
+    {
+        size = sizebytes;
+    }
+    size -= size % state->framesize;
+    if (!size)
+    {
+        return FMOD_ERR_FILE_EOF;
+    }
+
+    /*
+        getwaveformat moves the file pointer, so seek every time. Against memory that's just setting an offset.
+    */
+    result = codec->fileseek(codec->filehandle, state->subsound.dataoffset + state->position, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    result = codec->fileread(codec->filehandle, buffer, size, bytesread, 0);
+    state->position += *bytesread;
+
+    if (result == FMOD_ERR_FILE_EOF && *bytesread)
+    {
+        return FMOD_OK;
+    }
+    return result;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_CodecFsb5_setposition(FMOD_CODEC_STATE *codec, int subsound, unsigned int position, FMOD_TIMEUNIT postype)
+{
+    FMODCodecFsb5State *state = (FMODCodecFsb5State *)codec->plugindata;
+    FMOD_RESULT result;
+
+    if (postype != FMOD_TIMEUNIT_PCM)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    result = FMOD_CodecFsb5_select(state, (subsound < 0) ? (state->current < 0 ? 0 : state->current) : subsound);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    unsigned long long offset = (unsigned long long)position * state->framesize;
+    state->position = (offset < state->subsound.datalength) ? (unsigned int)offset : state->subsound.datalength;
+
+    return FMOD_OK;
+}
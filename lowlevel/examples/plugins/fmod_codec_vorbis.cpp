@@ -0,0 +1,170 @@
+/*==============================================================================
+Vorbis Codec Plugin Example
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+This example shows how to create a codec plugin. It decodes Ogg Vorbis with
+the decoder in vorbis_decoder.h, straight into FMOD's buffer as float PCM.
+
+Register it with System::registerCodec, or build it as a plugin library and
+load it with System::loadPlugin. At priority 0 it is tried before FMOD's own
+codecs. Files it can't handle fail with FMOD_ERR_FORMAT, so FMOD carries on
+to the next codec, and a sound created with suggestedsoundtype set to
+FMOD_SOUND_TYPE_OGGVORBIS still goes to the built in decoder.
+==============================================================================*/
+
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fmod.hpp"
+#include "../vorbis_decoder.h"
+
+extern "C" {
+    F_DECLSPEC F_DLLEXPORT FMOD_CODEC_DESCRIPTION* F_STDCALL FMODGetCodecDescription();
+}
+
+#define FMOD_CODEC_VORBIS_BLOCKALIGN    1024    /* Samples, FMOD reads in multiples of this. */
+
+FMOD_RESULT F_CALLBACK FMOD_CodecVorbis_open       (FMOD_CODEC_STATE *codec, FMOD_MODE usermode, FMOD_CREATESOUNDEXINFO *userexinfo);
+FMOD_RESULT F_CALLBACK FMOD_CodecVorbis_close      (FMOD_CODEC_STATE *codec);
+FMOD_RESULT F_CALLBACK FMOD_CodecVorbis_read       (FMOD_CODEC_STATE *codec, void *buffer, unsigned int sizebytes, unsigned int *bytesread);
+FMOD_RESULT F_CALLBACK FMOD_CodecVorbis_setposition(FMOD_CODEC_STATE *codec, int subsound, unsigned int position, FMOD_TIMEUNIT postype);
+
+FMOD_CODEC_DESCRIPTION FMOD_CodecVorbis_Desc =
+{
+    "FMOD Vorbis Example",  // name
+    0x00010000,             // plug-in version
+    0,                      // don't force everything using this codec to be a stream
+    FMOD_TIMEUNIT_PCM,      // setposition units
+    FMOD_CodecVorbis_open,
+    FMOD_CodecVorbis_close,
+    FMOD_CodecVorbis_read,
+    0,                      // getlength, lengthpcm is enough
+    FMOD_CodecVorbis_setposition,
+    0,                      // getposition, FMOD keeps track of it
+    0,                      // soundcreate
+    0                       // getwaveformat, the waveformat pointer is set in open
+};
+
+extern "C"
+{
+
+F_DECLSPEC F_DLLEXPORT FMOD_CODEC_DESCRIPTION* F_STDCALL FMODGetCodecDescription()
+{
+    return &FMOD_CodecVorbis_Desc;
+}
+
+}
+
+struct FMODCodecVorbisState
+{
+    VorbisDecoder           decoder;
+    FMOD_CODEC_WAVEFORMAT   waveformat;
+};
+
+FMOD_RESULT F_CALLBACK FMOD_CodecVorbis_open(FMOD_CODEC_STATE *codec, FMOD_MODE usermode, FMOD_CREATESOUNDEXINFO * /*userexinfo*/)
+{
+    FMOD_RESULT result;
+
+    result = codec->fileseek(codec->filehandle, 0, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    void *memory = malloc(sizeof(FMODCodecVorbisState));
+    if (!memory)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    FMODCodecVorbisState *state = new (memory) FMODCodecVorbisState;
+
+    result = state->decoder.open(codec->fileread, codec->fileseek, codec->filehandle, 0, codec->filesize);
+    if (result != FMOD_OK)
+    {
+        state->decoder.release();
+        free(state);
+        return result;
+    }
+
+    FMOD_CODEC_WAVEFORMAT *waveformat = &state->waveformat;
+    unsigned int length = state->decoder.getLength();
+
+    memset(waveformat, 0, sizeof(FMOD_CODEC_WAVEFORMAT));
+    waveformat->format      = FMOD_SOUND_FORMAT_PCMFLOAT;
+    waveformat->channels    = state->decoder.getChannels();
+    waveformat->frequency   = state->decoder.getRate();
+    waveformat->lengthbytes = codec->filesize;
+    waveformat->lengthpcm   = length ? length : 0xFFFFFFFF;     /* Unknown, like a net stream. */
+    waveformat->blockalign  = FMOD_CODEC_VORBIS_BLOCKALIGN;
+    waveformat->loopstart   = 0;
+    waveformat->loopend     = length ? length - 1 : 0;
+
+    codec->numsubsounds = 0;
+    codec->waveformat = waveformat;
+    codec->plugindata = state;
+
+    /*
+        Comments are "NAME=value", FMOD wants them split.
+    */
+    if (!(usermode & FMOD_IGNORETAGS))
+    {
+        for (int index = 0; index < state->decoder.getNumComments(); index++)
+        {
+            const char *comment = state->decoder.getComment(index);
+            const char *equals = strchr(comment, '=');
+            char name[256];
+
+            if (!equals || equals - comment >= (int)sizeof(name))
+            {
+                continue;
+            }
+            memcpy(name, comment, equals - comment);
+            name[equals - comment] = 0;
+
+            codec->metadata(codec, FMOD_TAGTYPE_VORBISCOMMENT, name, (void *)(equals + 1), (unsigned int)strlen(equals + 1) + 1, FMOD_TAGDATATYPE_STRING_UTF8, 0);
+        }
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_CodecVorbis_close(FMOD_CODEC_STATE *codec)
+{
+    FMODCodecVorbisState *state = (FMODCodecVorbisState *)codec->plugindata;
+
+    if (state)
+    {
+        state->decoder.release();
+        free(state);
+        codec->plugindata = 0;
+    }
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_CodecVorbis_read(FMOD_CODEC_STATE *codec, void *buffer, unsigned int sizebytes, unsigned int *bytesread)
+{
+    FMODCodecVorbisState *state = (FMODCodecVorbisState *)codec->plugindata;
+    unsigned int framesize = state->waveformat.channels * sizeof(float);
+    unsigned int samplesread = 0;
+
+    FMOD_RESULT result = state->decoder.read((float *)buffer, sizebytes / framesize, &samplesread);
+    *bytesread = samplesread * framesize;
+
+    if (result == FMOD_ERR_FILE_EOF && samplesread)
+    {
+        return FMOD_OK;     /* Report the end on the next read. */
+    }
+    return result;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_CodecVorbis_setposition(FMOD_CODEC_STATE *codec, int /*subsound*/, unsigned int position, FMOD_TIMEUNIT postype)
+{
+    FMODCodecVorbisState *state = (FMODCodecVorbisState *)codec->plugindata;
+
+    if (postype != FMOD_TIMEUNIT_PCM)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+    return state->decoder.setPosition(position);
+}
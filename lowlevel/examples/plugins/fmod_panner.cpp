@@ -0,0 +1,317 @@
+/*==============================================================================
+Panner Plugin Example
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+This example shows how to create a plugin effect that changes the channel
+count, with a process callback. It pans whatever comes in, mono to 7.1, to
+the speaker mode set with the "Speaker Mode" parameter, turned by "Azimuth"
+degrees, using the compiled pan laws and matrix kernel in mix_matrix.h.
+
+The matrix is only compiled again when the input format, the output format
+or the azimuth changes, and it moves to the new one across the next block.
+"Cost" reads back how long a sample frame takes to pan, in nanoseconds,
+averaged over recent blocks.
+==============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <new>
+
+#include "fmod.hpp"
+#include "../mix_matrix.h"
+#include "../monotonic_clock.h"
+
+extern "C" {
+    F_DECLSPEC F_DLLEXPORT FMOD_DSP_DESCRIPTION* F_STDCALL FMODGetDSPDescription();
+}
+
+const float FMOD_PANNER_PARAM_AZIMUTH_MIN     = -180.0f;
+const float FMOD_PANNER_PARAM_AZIMUTH_MAX     = 180.0f;
+const float FMOD_PANNER_PARAM_AZIMUTH_DEFAULT = 0.0f;
+
+enum
+{
+    FMOD_PANNER_PARAM_AZIMUTH = 0,
+    FMOD_PANNER_PARAM_SPEAKERMODE,
+    FMOD_PANNER_PARAM_COST,
+    FMOD_PANNER_NUM_PARAMETERS
+};
+
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspcreate       (FMOD_DSP_STATE *dsp);
+FMOD_RESULT F_CALLBACK FMOD_Panner_dsprelease      (FMOD_DSP_STATE *dsp);
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspreset        (FMOD_DSP_STATE *dsp);
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspprocess      (FMOD_DSP_STATE *dsp, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, bool inputsidle, FMOD_DSP_PROCESS_OPERATION op);
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspsetparamfloat(FMOD_DSP_STATE *dsp, int index, float value);
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspsetparamint  (FMOD_DSP_STATE *dsp, int index, int value);
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspgetparamfloat(FMOD_DSP_STATE *dsp, int index, float *value, char *valuestr);
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspgetparamint  (FMOD_DSP_STATE *dsp, int index, int *value, char *valuestr);
+
+static FMOD_DSP_PARAMETER_DESC p_azimuth;
+static FMOD_DSP_PARAMETER_DESC p_speakermode;
+static FMOD_DSP_PARAMETER_DESC p_cost;
+
+FMOD_DSP_PARAMETER_DESC *FMOD_Panner_dspparam[FMOD_PANNER_NUM_PARAMETERS] =
+{
+    &p_azimuth,
+    &p_speakermode,
+    &p_cost
+};
+
+FMOD_DSP_DESCRIPTION FMOD_Panner_Desc =
+{
+    FMOD_PLUGIN_SDK_VERSION,
+    "FMOD Panner",  // name
+    0x00010000,     // plug-in version
+    1,              // number of input buffers to process
+    1,              // number of output buffers to process
+    FMOD_Panner_dspcreate,
+    FMOD_Panner_dsprelease,
+    FMOD_Panner_dspreset,
+    0,              // read, process is used instead as the channel count changes
+    FMOD_Panner_dspprocess,
+    0,
+    FMOD_PANNER_NUM_PARAMETERS,
+    FMOD_Panner_dspparam,
+    FMOD_Panner_dspsetparamfloat,
+    FMOD_Panner_dspsetparamint,
+    0, // FMOD_Panner_dspsetparambool,
+    0, // FMOD_Panner_dspsetparamdata,
+    FMOD_Panner_dspgetparamfloat,
+    FMOD_Panner_dspgetparamint,
+    0, // FMOD_Panner_dspgetparambool,
+    0, // FMOD_Panner_dspgetparamdata,
+    0, // shouldiprocess, process handles idle inputs itself
+    0
+};
+
+extern "C"
+{
+
+F_DECLSPEC F_DLLEXPORT FMOD_DSP_DESCRIPTION* F_STDCALL FMODGetDSPDescription()
+{
+    static const char *speakermodes[] = { "Mono", "Stereo", "Quad", "Surround", "5.1", "7.1" };
+
+    FMOD_DSP_INIT_PARAMDESC_FLOAT(p_azimuth, "Azimuth", "deg", "Direction to pan to, clockwise from straight ahead. -180 to 180. Default = 0", FMOD_PANNER_PARAM_AZIMUTH_MIN, FMOD_PANNER_PARAM_AZIMUTH_MAX, FMOD_PANNER_PARAM_AZIMUTH_DEFAULT);
+    FMOD_DSP_INIT_PARAMDESC_INT(p_speakermode, "Speaker Mode", "", "Output speaker mode. Mono to 7.1. Default = Stereo", FMOD_SPEAKERMODE_MONO, FMOD_SPEAKERMODE_7POINT1, FMOD_SPEAKERMODE_STEREO, false, speakermodes);
+    FMOD_DSP_INIT_PARAMDESC_FLOAT(p_cost, "Cost", "ns", "Read only. Time to pan one sample frame, in nanoseconds.", 0.0f, 1000000.0f, 0.0f);
+    return &FMOD_Panner_Desc;
+}
+
+}
+
+class FMODPannerState
+{
+public:
+    FMODPannerState();
+
+    FMOD_RESULT process(unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, bool inputsidle, FMOD_DSP_PROCESS_OPERATION op);
+    void reset();
+    void setAzimuth(float azimuth)              { __atomic_store(&m_azimuth, &azimuth, __ATOMIC_RELAXED); }
+    void setSpeakerMode(FMOD_SPEAKERMODE mode)  { __atomic_store_n(&m_outmode, mode, __ATOMIC_RELAXED); }
+    float azimuth() const                       { float azimuth; __atomic_load(&m_azimuth, &azimuth, __ATOMIC_RELAXED); return azimuth; }
+    FMOD_SPEAKERMODE speakerMode() const        { return __atomic_load_n(&m_outmode, __ATOMIC_RELAXED); }
+    float cost() const                          { float cost; __atomic_load(&m_cost, &cost, __ATOMIC_RELAXED); return cost; }
+
+private:
+    float m_azimuth;                /* Set from the game thread, read by the mixer. */
+    FMOD_SPEAKERMODE m_outmode;
+    float m_cost;
+    MixMatrix m_current;            /* What the last block ended on. */
+    MixMatrix m_target;
+    bool m_compiled;
+};
+
+FMODPannerState::FMODPannerState()
+{
+    m_azimuth = FMOD_PANNER_PARAM_AZIMUTH_DEFAULT;
+    m_outmode = FMOD_SPEAKERMODE_STEREO;
+    m_cost = 0.0f;
+    m_compiled = false;
+}
+
+FMOD_RESULT FMODPannerState::process(unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, bool inputsidle, FMOD_DSP_PROCESS_OPERATION op)
+{
+    FMOD_SPEAKERMODE outmode = speakerMode();
+
+    if (op == FMOD_DSP_PROCESS_QUERY)
+    {
+        if (inputsidle)
+        {
+            return FMOD_ERR_DSP_DONTPROCESS;
+        }
+
+        if (outbufferarray)
+        {
+            outbufferarray->speakermode = outmode;
+            outbufferarray->buffernumchannels[0] = MixMatrix_Channels(outmode);
+            outbufferarray->bufferchannelmask[0] = 0;
+        }
+        return FMOD_OK;
+    }
+
+    double start = MonotonicClock_Now();
+
+    /*
+        Go by the channel counts, a speaker mode that doesn't match them, RAW for example, is guessed from the count.
+    */
+    int inchannels = inbufferarray->buffernumchannels[0];
+    int outchannels = outbufferarray->buffernumchannels[0];
+    FMOD_SPEAKERMODE inmode = inbufferarray->speakermode;
+    if (MixMatrix_Channels(inmode) != inchannels)
+    {
+        inmode = MixMatrix_ModeFromChannels(inchannels);
+    }
+    if (MixMatrix_Channels(outmode) != outchannels)
+    {
+        outmode = MixMatrix_ModeFromChannels(outchannels);
+    }
+
+    float *inbuffer = inbufferarray->buffers[0];
+    float *outbuffer = outbufferarray->buffers[0];
+
+    if (inmode == FMOD_SPEAKERMODE_RAW || outmode == FMOD_SPEAKERMODE_RAW)
+    {
+        /*
+            No layout to pan with, channels go straight across.
+        */
+        for (unsigned int s = 0; s < length; s++)
+        {
+            for (int ch = 0; ch < outchannels; ch++)
+            {
+                outbuffer[s * outchannels + ch] = (ch < inchannels) ? inbuffer[s * inchannels + ch] : 0.0f;
+            }
+        }
+        m_compiled = false;
+        return FMOD_OK;
+    }
+
+    float target = azimuth();
+    if (!m_compiled || m_target.inmode != inmode || m_target.outmode != outmode || m_target.azimuth != target)
+    {
+        FMOD_RESULT result = MixMatrix_Compile(&m_target, inmode, outmode, target);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+        if (!m_compiled)
+        {
+            m_current = m_target;
+            m_compiled = true;
+        }
+    }
+
+    MixMatrix_Apply(&m_current, &m_target, inbuffer, outbuffer, length);
+    m_current = m_target;
+
+    if (length)
+    {
+        float ns = (float)((MonotonicClock_Now() - start) * 1e9 / length);
+        float cost = m_cost + (ns - m_cost) * 0.05f;
+        __atomic_store(&m_cost, &cost, __ATOMIC_RELAXED);
+    }
+
+    return FMOD_OK;
+}
+
+void FMODPannerState::reset()
+{
+    m_current = m_target;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspcreate(FMOD_DSP_STATE *dsp)
+{
+    void *memory = FMOD_DSP_STATE_MEMALLOC(dsp, sizeof(FMODPannerState), FMOD_MEMORY_NORMAL, "FMODPannerState");
+    if (!memory)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    dsp->plugindata = new (memory) FMODPannerState;
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_Panner_dsprelease(FMOD_DSP_STATE *dsp)
+{
+    FMODPannerState *state = (FMODPannerState *)dsp->plugindata;
+    FMOD_DSP_STATE_MEMFREE(dsp, state, FMOD_MEMORY_NORMAL, "FMODPannerState");
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspprocess(FMOD_DSP_STATE *dsp, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, bool inputsidle, FMOD_DSP_PROCESS_OPERATION op)
+{
+    FMODPannerState *state = (FMODPannerState *)dsp->plugindata;
+    return state->process(length, inbufferarray, outbufferarray, inputsidle, op);
+}
+
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspreset(FMOD_DSP_STATE *dsp)
+{
+    FMODPannerState *state = (FMODPannerState *)dsp->plugindata;
+    state->reset();
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspsetparamfloat(FMOD_DSP_STATE *dsp, int index, float value)
+{
+    FMODPannerState *state = (FMODPannerState *)dsp->plugindata;
+
+    switch (index)
+    {
+    case FMOD_PANNER_PARAM_AZIMUTH:
+        state->setAzimuth(value);
+        return FMOD_OK;
+    }
+
+    return FMOD_ERR_INVALID_PARAM;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspgetparamfloat(FMOD_DSP_STATE *dsp, int index, float *value, char *valuestr)
+{
+    FMODPannerState *state = (FMODPannerState *)dsp->plugindata;
+
+    switch (index)
+    {
+    case FMOD_PANNER_PARAM_AZIMUTH:
+        *value = state->azimuth();
+        if (valuestr) sprintf(valuestr, "%.0f deg", state->azimuth());
+        return FMOD_OK;
+
+    case FMOD_PANNER_PARAM_COST:
+        *value = state->cost();
+        if (valuestr) sprintf(valuestr, "%.1f ns", state->cost());
+        return FMOD_OK;
+    }
+
+    return FMOD_ERR_INVALID_PARAM;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspsetparamint(FMOD_DSP_STATE *dsp, int index, int value)
+{
+    FMODPannerState *state = (FMODPannerState *)dsp->plugindata;
+
+    switch (index)
+    {
+    case FMOD_PANNER_PARAM_SPEAKERMODE:
+        if (value < FMOD_SPEAKERMODE_MONO || value > FMOD_SPEAKERMODE_7POINT1)
+        {
+            return FMOD_ERR_INVALID_PARAM;
+        }
+        state->setSpeakerMode((FMOD_SPEAKERMODE)value);
+        return FMOD_OK;
+    }
+
+    return FMOD_ERR_INVALID_PARAM;
+}
+
+FMOD_RESULT F_CALLBACK FMOD_Panner_dspgetparamint(FMOD_DSP_STATE *dsp, int index, int *value, char *valuestr)
+{
+    FMODPannerState *state = (FMODPannerState *)dsp->plugindata;
+
+    switch (index)
+    {
+    case FMOD_PANNER_PARAM_SPEAKERMODE:
+        *value = state->speakerMode();
+        if (valuestr) sprintf(valuestr, "%d channels", MixMatrix_Channels(state->speakerMode()));
+        return FMOD_OK;
+    }
+
+    return FMOD_ERR_INVALID_PARAM;
+}
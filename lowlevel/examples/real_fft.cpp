@@ -0,0 +1,358 @@
+/*==============================================================================
+Real FFT
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "real_fft.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+RealFFT::RealFFT()
+{
+    m_size = 0;
+    m_half = 0;
+    m_memory = 0;
+    m_re = m_im = m_re2 = m_im2 = 0;
+    m_outre = m_outim = 0;
+    m_twiddles = 0;
+    m_split = 0;
+}
+
+FMOD_RESULT RealFFT::init(int size)
+{
+    if (size < REAL_FFT_MIN_SIZE || size > REAL_FFT_MAX_SIZE || (size & (size - 1)))
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    int half = size >> 1;
+    int numtwiddles = 0;
+    for (int n = half; n >= 4; n >>= 2)
+    {
+        numtwiddles += 6 * (n >> 2);
+    }
+
+    release();
+
+    m_memory = (float *)malloc((4 * half + numtwiddles + 2 * (half + 1)) * sizeof(float));
+    if (!m_memory)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    m_size = size;
+    m_half = half;
+    m_re = m_memory;
+    m_im = m_re + half;
+    m_re2 = m_im + half;
+    m_im2 = m_re2 + half;
+    m_twiddles = m_im2 + half;
+    m_split = m_twiddles + numtwiddles;
+
+    float *twiddles = m_twiddles;
+    for (int n = half; n >= 4; n >>= 2)
+    {
+        int m = n >> 2;
+        for (int p = 0; p < m; p++)
+        {
+            for (int k = 1; k <= 3; k++)
+            {
+                double angle = -2.0 * M_PI * k * p / n;
+                twiddles[(k - 1) * m + p] = (float)cos(angle);
+                twiddles[(k + 2) * m + p] = (float)sin(angle);
+            }
+        }
+        twiddles += 6 * m;
+    }
+
+    for (int k = 0; k <= half; k++)
+    {
+        double angle = -2.0 * M_PI * k / size;
+        m_split[k] = (float)cos(angle);
+        m_split[half + 1 + k] = (float)sin(angle);
+    }
+
+    return FMOD_OK;
+}
+
+void RealFFT::release()
+{
+    free(m_memory);
+    m_memory = 0;
+    m_size = 0;
+    m_half = 0;
+}
+
+void RealFFT::transform()
+{
+    float *xr = m_re, *xi = m_im;
+    float *yr = m_re2, *yi = m_im2;
+    const float *twiddles = m_twiddles;
+    int n = m_half;
+    int s = 1;
+
+    /*
+        Radix 4 passes. Pass inputs are x[q + s * (p + k * m)] for k = 0..3, outputs y[q + s * (4 * p + k)].
+    */
+    for (; n >= 4; n >>= 2, s <<= 2)
+    {
+        int m = n >> 2;
+        const float *w1r = twiddles, *w2r = twiddles + m, *w3r = twiddles + 2 * m;
+        const float *w1i = twiddles + 3 * m, *w2i = twiddles + 4 * m, *w3i = twiddles + 5 * m;
+
+        if (s == 1)
+        {
+            /*
+                First pass, every butterfly has its own twiddles and writes four neighbouring outputs. Four of them
+                are done side by side and their outputs transposed back into order.
+            */
+            int p = 0;
+#if defined(__SSE2__)
+            for (; p + 4 <= m; p += 4)
+            {
+                __m128 ar = _mm_loadu_ps(xr + p),         ai = _mm_loadu_ps(xi + p);
+                __m128 br = _mm_loadu_ps(xr + p + m),     bi = _mm_loadu_ps(xi + p + m);
+                __m128 cr = _mm_loadu_ps(xr + p + 2 * m), ci = _mm_loadu_ps(xi + p + 2 * m);
+                __m128 dr = _mm_loadu_ps(xr + p + 3 * m), di = _mm_loadu_ps(xi + p + 3 * m);
+
+                __m128 apcr = _mm_add_ps(ar, cr), apci = _mm_add_ps(ai, ci);
+                __m128 amcr = _mm_sub_ps(ar, cr), amci = _mm_sub_ps(ai, ci);
+                __m128 bpdr = _mm_add_ps(br, dr), bpdi = _mm_add_ps(bi, di);
+                __m128 bmdr = _mm_sub_ps(br, dr), bmdi = _mm_sub_ps(bi, di);
+
+                __m128 y0r = _mm_add_ps(apcr, bpdr), y0i = _mm_add_ps(apci, bpdi);
+                __m128 t1r = _mm_add_ps(amcr, bmdi), t1i = _mm_sub_ps(amci, bmdr);
+                __m128 t2r = _mm_sub_ps(apcr, bpdr), t2i = _mm_sub_ps(apci, bpdi);
+                __m128 t3r = _mm_sub_ps(amcr, bmdi), t3i = _mm_add_ps(amci, bmdr);
+
+                __m128 wr = _mm_loadu_ps(w1r + p), wi = _mm_loadu_ps(w1i + p);
+                __m128 y1r = _mm_sub_ps(_mm_mul_ps(t1r, wr), _mm_mul_ps(t1i, wi));
+                __m128 y1i = _mm_add_ps(_mm_mul_ps(t1r, wi), _mm_mul_ps(t1i, wr));
+                wr = _mm_loadu_ps(w2r + p); wi = _mm_loadu_ps(w2i + p);
+                __m128 y2r = _mm_sub_ps(_mm_mul_ps(t2r, wr), _mm_mul_ps(t2i, wi));
+                __m128 y2i = _mm_add_ps(_mm_mul_ps(t2r, wi), _mm_mul_ps(t2i, wr));
+                wr = _mm_loadu_ps(w3r + p); wi = _mm_loadu_ps(w3i + p);
+                __m128 y3r = _mm_sub_ps(_mm_mul_ps(t3r, wr), _mm_mul_ps(t3i, wi));
+                __m128 y3i = _mm_add_ps(_mm_mul_ps(t3r, wi), _mm_mul_ps(t3i, wr));
+
+                _MM_TRANSPOSE4_PS(y0r, y1r, y2r, y3r);
+                _MM_TRANSPOSE4_PS(y0i, y1i, y2i, y3i);
+                _mm_storeu_ps(yr + 4 * p,      y0r);  _mm_storeu_ps(yi + 4 * p,      y0i);
+                _mm_storeu_ps(yr + 4 * p + 4,  y1r);  _mm_storeu_ps(yi + 4 * p + 4,  y1i);
+                _mm_storeu_ps(yr + 4 * p + 8,  y2r);  _mm_storeu_ps(yi + 4 * p + 8,  y2i);
+                _mm_storeu_ps(yr + 4 * p + 12, y3r);  _mm_storeu_ps(yi + 4 * p + 12, y3i);
+            }
+#endif
+            for (; p < m; p++)
+            {
+                float apcr = xr[p] + xr[p + 2 * m], apci = xi[p] + xi[p + 2 * m];
+                float amcr = xr[p] - xr[p + 2 * m], amci = xi[p] - xi[p + 2 * m];
+                float bpdr = xr[p + m] + xr[p + 3 * m], bpdi = xi[p + m] + xi[p + 3 * m];
+                float bmdr = xr[p + m] - xr[p + 3 * m], bmdi = xi[p + m] - xi[p + 3 * m];
+                float t1r = amcr + bmdi, t1i = amci - bmdr;
+                float t2r = apcr - bpdr, t2i = apci - bpdi;
+                float t3r = amcr - bmdi, t3i = amci + bmdr;
+
+                yr[4 * p] = apcr + bpdr;
+                yi[4 * p] = apci + bpdi;
+                yr[4 * p + 1] = t1r * w1r[p] - t1i * w1i[p];
+                yi[4 * p + 1] = t1r * w1i[p] + t1i * w1r[p];
+                yr[4 * p + 2] = t2r * w2r[p] - t2i * w2i[p];
+                yi[4 * p + 2] = t2r * w2i[p] + t2i * w2r[p];
+                yr[4 * p + 3] = t3r * w3r[p] - t3i * w3i[p];
+                yi[4 * p + 3] = t3r * w3i[p] + t3i * w3r[p];
+            }
+        }
+        else
+        {
+            /*
+                Later passes, the s butterflies sharing a twiddle sit next to each other.
+            */
+            for (int p = 0; p < m; p++)
+            {
+                const float *ar = xr + s * p,           *ai = xi + s * p;
+                const float *br = xr + s * (p + m),     *bi = xi + s * (p + m);
+                const float *cr = xr + s * (p + 2 * m), *ci = xi + s * (p + 2 * m);
+                const float *dr = xr + s * (p + 3 * m), *di = xi + s * (p + 3 * m);
+                float *y0r = yr + s * 4 * p, *y0i = yi + s * 4 * p;
+                float *y1r = y0r + s, *y1i = y0i + s;
+                float *y2r = y1r + s, *y2i = y1i + s;
+                float *y3r = y2r + s, *y3i = y2i + s;
+                int q = 0;
+
+#if defined(__SSE2__)
+                __m128 v1r = _mm_set1_ps(w1r[p]), v1i = _mm_set1_ps(w1i[p]);
+                __m128 v2r = _mm_set1_ps(w2r[p]), v2i = _mm_set1_ps(w2i[p]);
+                __m128 v3r = _mm_set1_ps(w3r[p]), v3i = _mm_set1_ps(w3i[p]);
+
+                for (; q + 4 <= s; q += 4)
+                {
+                    __m128 xar = _mm_loadu_ps(ar + q), xai = _mm_loadu_ps(ai + q);
+                    __m128 xbr = _mm_loadu_ps(br + q), xbi = _mm_loadu_ps(bi + q);
+                    __m128 xcr = _mm_loadu_ps(cr + q), xci = _mm_loadu_ps(ci + q);
+                    __m128 xdr = _mm_loadu_ps(dr + q), xdi = _mm_loadu_ps(di + q);
+
+                    __m128 apcr = _mm_add_ps(xar, xcr), apci = _mm_add_ps(xai, xci);
+                    __m128 amcr = _mm_sub_ps(xar, xcr), amci = _mm_sub_ps(xai, xci);
+                    __m128 bpdr = _mm_add_ps(xbr, xdr), bpdi = _mm_add_ps(xbi, xdi);
+                    __m128 bmdr = _mm_sub_ps(xbr, xdr), bmdi = _mm_sub_ps(xbi, xdi);
+
+                    __m128 t1r = _mm_add_ps(amcr, bmdi), t1i = _mm_sub_ps(amci, bmdr);
+                    __m128 t2r = _mm_sub_ps(apcr, bpdr), t2i = _mm_sub_ps(apci, bpdi);
+                    __m128 t3r = _mm_sub_ps(amcr, bmdi), t3i = _mm_add_ps(amci, bmdr);
+
+                    _mm_storeu_ps(y0r + q, _mm_add_ps(apcr, bpdr));
+                    _mm_storeu_ps(y0i + q, _mm_add_ps(apci, bpdi));
+                    _mm_storeu_ps(y1r + q, _mm_sub_ps(_mm_mul_ps(t1r, v1r), _mm_mul_ps(t1i, v1i)));
+                    _mm_storeu_ps(y1i + q, _mm_add_ps(_mm_mul_ps(t1r, v1i), _mm_mul_ps(t1i, v1r)));
+                    _mm_storeu_ps(y2r + q, _mm_sub_ps(_mm_mul_ps(t2r, v2r), _mm_mul_ps(t2i, v2i)));
+                    _mm_storeu_ps(y2i + q, _mm_add_ps(_mm_mul_ps(t2r, v2i), _mm_mul_ps(t2i, v2r)));
+                    _mm_storeu_ps(y3r + q, _mm_sub_ps(_mm_mul_ps(t3r, v3r), _mm_mul_ps(t3i, v3i)));
+                    _mm_storeu_ps(y3i + q, _mm_add_ps(_mm_mul_ps(t3r, v3i), _mm_mul_ps(t3i, v3r)));
+                }
+#endif
+                for (; q < s; q++)
+                {
+                    float apcr = ar[q] + cr[q], apci = ai[q] + ci[q];
+                    float amcr = ar[q] - cr[q], amci = ai[q] - ci[q];
+                    float bpdr = br[q] + dr[q], bpdi = bi[q] + di[q];
+                    float bmdr = br[q] - dr[q], bmdi = bi[q] - di[q];
+                    float t1r = amcr + bmdi, t1i = amci - bmdr;
+                    float t2r = apcr - bpdr, t2i = apci - bpdi;
+                    float t3r = amcr - bmdi, t3i = amci + bmdr;
+
+                    y0r[q] = apcr + bpdr;
+                    y0i[q] = apci + bpdi;
+                    y1r[q] = t1r * w1r[p] - t1i * w1i[p];
+                    y1i[q] = t1r * w1i[p] + t1i * w1r[p];
+                    y2r[q] = t2r * w2r[p] - t2i * w2i[p];
+                    y2i[q] = t2r * w2i[p] + t2i * w2r[p];
+                    y3r[q] = t3r * w3r[p] - t3i * w3i[p];
+                    y3i[q] = t3r * w3i[p] + t3i * w3r[p];
+                }
+            }
+        }
+
+        float *swap;
+        swap = xr; xr = yr; yr = swap;
+        swap = xi; xi = yi; yi = swap;
+        twiddles += 6 * m;
+    }
+
+    /*
+        A last radix 2 pass when the length wasn't a power of four. Its only twiddle is 1.
+    */
+    if (n == 2)
+    {
+        int q = 0;
+#if defined(__SSE2__)
+        for (; q + 4 <= s; q += 4)
+        {
+            __m128 ar = _mm_loadu_ps(xr + q), ai = _mm_loadu_ps(xi + q);
+            __m128 br = _mm_loadu_ps(xr + q + s), bi = _mm_loadu_ps(xi + q + s);
+
+            _mm_storeu_ps(yr + q, _mm_add_ps(ar, br));
+            _mm_storeu_ps(yi + q, _mm_add_ps(ai, bi));
+            _mm_storeu_ps(yr + q + s, _mm_sub_ps(ar, br));
+            _mm_storeu_ps(yi + q + s, _mm_sub_ps(ai, bi));
+        }
+#endif
+        for (; q < s; q++)
+        {
+            float ar = xr[q], ai = xi[q];
+            float br = xr[q + s], bi = xi[q + s];
+
+            yr[q] = ar + br;
+            yi[q] = ai + bi;
+            yr[q + s] = ar - br;
+            yi[q + s] = ai - bi;
+        }
+
+        xr = yr;
+        xi = yi;
+    }
+
+    m_outre = xr;
+    m_outim = xi;
+}
+
+void RealFFT::forward(const float *in, const float *window, float *re, float *im)
+{
+    const int half = m_half;
+    int k = 0;
+
+    /*
+        Window, and pack even samples into the real parts and odd ones into the imaginary.
+    */
+#if defined(__SSE2__)
+    for (; k + 4 <= half; k += 4)
+    {
+        __m128 lo = _mm_loadu_ps(in + 2 * k);
+        __m128 hi = _mm_loadu_ps(in + 2 * k + 4);
+        if (window)
+        {
+            lo = _mm_mul_ps(lo, _mm_loadu_ps(window + 2 * k));
+            hi = _mm_mul_ps(hi, _mm_loadu_ps(window + 2 * k + 4));
+        }
+        _mm_storeu_ps(m_re + k, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(m_im + k, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#endif
+    for (; k < half; k++)
+    {
+        m_re[k] = window ? in[2 * k] * window[2 * k] : in[2 * k];
+        m_im[k] = window ? in[2 * k + 1] * window[2 * k + 1] : in[2 * k + 1];
+    }
+
+    transform();
+
+    /*
+        Split the real transform out. With Z the half length transform and B = conj(Z[half - k]):
+        X[k] = (Z[k] + B) / 2 - i W^k (Z[k] - B) / 2.
+    */
+    const float *zr = m_outre, *zi = m_outim;
+    const float *wr = m_split, *wi = m_split + half + 1;
+
+    re[0] = zr[0] + zi[0];
+    im[0] = 0.0f;
+    re[half] = zr[0] - zi[0];
+    im[half] = 0.0f;
+
+    k = 1;
+#if defined(__SSE2__)
+    const __m128 point5 = _mm_set1_ps(0.5f);
+    for (; k + 4 <= half; k += 4)
+    {
+        __m128 ar = _mm_loadu_ps(zr + k), ai = _mm_loadu_ps(zi + k);
+        __m128 br = _mm_loadu_ps(zr + half - k - 3), bi = _mm_loadu_ps(zi + half - k - 3);
+        br = _mm_shuffle_ps(br, br, _MM_SHUFFLE(0, 1, 2, 3));
+        bi = _mm_sub_ps(_mm_setzero_ps(), _mm_shuffle_ps(bi, bi, _MM_SHUFFLE(0, 1, 2, 3)));
+
+        __m128 er = _mm_mul_ps(_mm_add_ps(ar, br), point5);
+        __m128 ei = _mm_mul_ps(_mm_add_ps(ai, bi), point5);
+        __m128 or_ = _mm_mul_ps(_mm_sub_ps(ai, bi), point5);
+        __m128 oi = _mm_mul_ps(_mm_sub_ps(br, ar), point5);
+        __m128 cr = _mm_loadu_ps(wr + k), ci = _mm_loadu_ps(wi + k);
+
+        _mm_storeu_ps(re + k, _mm_add_ps(er, _mm_sub_ps(_mm_mul_ps(or_, cr), _mm_mul_ps(oi, ci))));
+        _mm_storeu_ps(im + k, _mm_add_ps(ei, _mm_add_ps(_mm_mul_ps(or_, ci), _mm_mul_ps(oi, cr))));
+    }
+#endif
+    for (; k < half; k++)
+    {
+        float ar = zr[k], ai = zi[k];
+        float br = zr[half - k], bi = -zi[half - k];
+        float er = (ar + br) * 0.5f, ei = (ai + bi) * 0.5f;
+        float or_ = (ai - bi) * 0.5f, oi = (br - ar) * 0.5f;
+
+        re[k] = er + or_ * wr[k] - oi * wi[k];
+        im[k] = ei + or_ * wi[k] + oi * wr[k];
+    }
+}
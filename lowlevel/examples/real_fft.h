@@ -0,0 +1,55 @@
+/*==============================================================================
+Real FFT
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Forward FFT of a block of real samples, for analysis. A real block of n
+samples is packed into an n/2 point complex sequence, evens as the real parts
+and odds as the imaginary, transformed, and split back into the n/2 + 1 bins
+of the real transform.
+
+The complex transform is a radix 4 Stockham FFT, with one radix 2 pass at the
+end when n/2 isn't a power of four. Stockham passes read one buffer and write
+the other, already in order, so there is no bit reversal pass. Each pass
+works on split real and imaginary arrays four butterflies to an SSE register:
+the first pass across neighbouring butterflies, the rest across the
+butterflies that share a twiddle, which are next to each other in memory.
+==============================================================================*/
+#ifndef _REAL_FFT_H
+#define _REAL_FFT_H
+
+#include "fmod.h"
+
+#define REAL_FFT_MIN_SIZE   32
+#define REAL_FFT_MAX_SIZE   65536
+
+class RealFFT
+{
+public:
+    RealFFT();
+
+    FMOD_RESULT init(int size);             /* A power of two from REAL_FFT_MIN_SIZE to REAL_FFT_MAX_SIZE. */
+    void        release();
+    int         size() const                { return m_size; }
+
+    /*
+        'window' can be 0 for none. 're' and 'im' get size / 2 + 1 bins, DC to Nyquist, unscaled.
+    */
+    void        forward(const float *in, const float *window, float *re, float *im);
+
+private:
+    void        transform();                /* Complex FFT of m_re/m_im, result left in m_outre/m_outim. */
+
+    int         m_size;
+    int         m_half;
+    float      *m_memory;
+    float      *m_re;                       /* Ping pong buffers for the Stockham passes. */
+    float      *m_im;
+    float      *m_re2;
+    float      *m_im2;
+    float      *m_outre;
+    float      *m_outim;
+    float      *m_twiddles;                 /* For each radix 4 pass of length n, n/4 each of w1, w2, w3 as cosines then sines. */
+    float      *m_split;                    /* size / 2 + 1 cosines then sines, to split the real transform out. */
+};
+
+#endif
@@ -0,0 +1,574 @@
+/*==============================================================================
+Sidechain Ducker
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "sidechain_ducker.h"
+#include "monotonic_clock.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SIDECHAIN_DUCKER_BENCHMARK_READ     1024    /* Samples per read, as the mixer would ask for. */
+
+static const struct
+{
+    const char *name;
+    const char *label;
+    const char *description;
+    float       min;
+    float       max;
+    float       defaultval;
+} SIDECHAIN_DUCKER_FLOAT[SIDECHAIN_DUCKER_PARAM_SIDECHAIN] =
+{
+    { "Threshold", "dB", "Sidechain level ducking starts at. -60 to 0. Default = -30",       -60.0f, 0.0f,                           -30.0f },
+    { "Ratio",     ":1", "dB over the threshold per dB of ducking. 1 to 20. Default = 4",    1.0f,   20.0f,                          4.0f },
+    { "Depth",     "dB", "The most the input is turned down by. 0 to 40. Default = 12",      0.0f,   40.0f,                          12.0f },
+    { "Attack",    "ms", "Time to duck. 0.1 to 100. Default = 5",                            0.1f,   100.0f,                         5.0f },
+    { "Release",   "ms", "Time to come back up. 10 to 2000. Default = 250",                  10.0f,  2000.0f,                        250.0f },
+    { "Lookahead", "ms", "Delay on the input so ducking starts early. 0 to 20. Default = 0", 0.0f,   SIDECHAIN_DUCKER_MAX_LOOKAHEAD, 0.0f }
+};
+
+#if defined(__SSE2__)
+/*
+    Polynomials fitted to log2 over [1, 2) and exp2 over [0, 1), good to a few thousandths of a dB, which is
+    plenty for a gain.
+*/
+static inline __m128 SidechainDucker_Log2(__m128 x)
+{
+    __m128i bits = _mm_castps_si128(x);
+    __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    __m128 t = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000))), _mm_set1_ps(1.0f));
+    __m128 p = _mm_set1_ps(0.04588553f);
+
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-0.19442267f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(0.41542195f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-0.7086821f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.4418258f));
+
+    return _mm_add_ps(exponent, _mm_mul_ps(p, t));
+}
+
+/*
+    'x' <= 0 only.
+*/
+static inline __m128 SidechainDucker_Exp2(__m128 x)
+{
+    x = _mm_max_ps(x, _mm_set1_ps(-126.0f));
+
+    __m128i whole = _mm_cvttps_epi32(x);
+    __m128 wholef = _mm_cvtepi32_ps(whole);
+    __m128 over = _mm_cmpgt_ps(wholef, x);                              /* Truncated up, make it floor. */
+    whole = _mm_add_epi32(whole, _mm_castps_si128(over));
+    wholef = _mm_sub_ps(wholef, _mm_and_ps(over, _mm_set1_ps(1.0f)));
+
+    __m128 f = _mm_sub_ps(x, wholef);
+    __m128 p = _mm_set1_ps(0.01349301f);
+
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.05207471f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.24140438f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.69301869f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+    return _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(whole, _mm_set1_epi32(127)), 23)));
+}
+#endif
+
+SidechainDucker::SidechainDucker()
+{
+    m_samplerate = 0;
+    m_memory = 0;
+    m_stage = 0;
+    m_peak = 0;
+    m_gain = 0;
+    m_history = 0;
+    m_channels = 0;
+    m_envelope = 0.0f;
+    m_lowest = 1.0f;
+    m_attack = 0.0f;
+    m_release = 0.0f;
+    m_invthreshold = 1.0f;
+    m_slope = 0.0f;
+    m_floor = 1.0f;
+    m_lookahead = 0;
+    for (int i = 0; i < SIDECHAIN_DUCKER_PARAM_SIDECHAIN; i++)
+    {
+        m_values[i] = SIDECHAIN_DUCKER_FLOAT[i].defaultval;
+    }
+    m_sidechain.sidechainenable = false;
+    m_reduction = 0.0f;
+    m_blocks = 0;
+    m_unducked = 0;
+}
+
+FMOD_RESULT SidechainDucker::init(int samplerate)
+{
+    if (samplerate < 1)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    m_samplerate = samplerate;
+    m_history = (int)ceilf(SIDECHAIN_DUCKER_MAX_LOOKAHEAD * samplerate / 1000.0f);
+
+    m_memory = (float *)calloc((m_history + SIDECHAIN_DUCKER_BLOCK) * SIDECHAIN_DUCKER_MAX_CHANNELS + 2 * SIDECHAIN_DUCKER_BLOCK, sizeof(float));
+    if (!m_memory)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    m_stage = m_memory;
+    m_peak = m_stage + (m_history + SIDECHAIN_DUCKER_BLOCK) * SIDECHAIN_DUCKER_MAX_CHANNELS;
+    m_gain = m_peak + SIDECHAIN_DUCKER_BLOCK;
+
+    clear();
+
+    return FMOD_OK;
+}
+
+void SidechainDucker::release()
+{
+    free(m_memory);
+    m_memory = 0;
+    m_samplerate = 0;
+}
+
+void SidechainDucker::describe(FMOD_DSP_DESCRIPTION *desc)
+{
+    for (int i = 0; i < SIDECHAIN_DUCKER_PARAM_SIDECHAIN; i++)
+    {
+        FMOD_DSP_INIT_PARAMDESC_FLOAT(m_paramdesc[i], SIDECHAIN_DUCKER_FLOAT[i].name, SIDECHAIN_DUCKER_FLOAT[i].label, SIDECHAIN_DUCKER_FLOAT[i].description,
+                                      SIDECHAIN_DUCKER_FLOAT[i].min, SIDECHAIN_DUCKER_FLOAT[i].max, SIDECHAIN_DUCKER_FLOAT[i].defaultval);
+    }
+    FMOD_DSP_INIT_PARAMDESC_DATA(m_paramdesc[SIDECHAIN_DUCKER_PARAM_SIDECHAIN], "Sidechain", "", "Enables the sidechain. Off = no ducking.", FMOD_DSP_PARAMETER_DATA_TYPE_SIDECHAIN);
+    for (int i = 0; i < SIDECHAIN_DUCKER_NUM_PARAMETERS; i++)
+    {
+        m_params[i] = &m_paramdesc[i];
+    }
+
+    memset(desc, 0, sizeof(FMOD_DSP_DESCRIPTION));
+    strncpy(desc->name, "Sidechain Ducker", sizeof(desc->name));
+    desc->version = 0x00010000;
+    desc->numinputbuffers = 1;
+    desc->numoutputbuffers = 1;
+    desc->reset = resetCallback;
+    desc->read = readCallback;
+    desc->numparameters = SIDECHAIN_DUCKER_NUM_PARAMETERS;
+    desc->paramdesc = m_params;
+    desc->setparameterfloat = setParamFloatCallback;
+    desc->setparameterdata = setParamDataCallback;
+    desc->getparameterfloat = getParamFloatCallback;
+    desc->getparameterdata = getParamDataCallback;
+    desc->userdata = this;
+}
+
+void SidechainDucker::getStats(SidechainDuckerStats *stats)
+{
+    float lowest = 1.0f;
+
+    __atomic_load(&m_reduction, &stats->reduction, __ATOMIC_RELAXED);
+    __atomic_exchange(&m_lowest, &lowest, &lowest, __ATOMIC_RELAXED);
+    stats->maxreduction = (lowest < 1.0f) ? -20.0f * log10f(lowest) : 0.0f;
+    stats->blocks = __atomic_load_n(&m_blocks, __ATOMIC_RELAXED);
+    stats->unducked = __atomic_load_n(&m_unducked, __ATOMIC_RELAXED);
+}
+
+float SidechainDucker::benchmark(int samplerate, int channels, float seconds)
+{
+    SidechainDucker ducker;
+
+    if (channels < 1 || channels > SIDECHAIN_DUCKER_MAX_CHANNELS || seconds <= 0.0f || ducker.init(samplerate) != FMOD_OK)
+    {
+        return 0.0f;
+    }
+
+    float *memory = (float *)malloc(SIDECHAIN_DUCKER_BENCHMARK_READ * (2 * channels + 2) * sizeof(float));
+    if (!memory)
+    {
+        ducker.release();
+        return 0.0f;
+    }
+
+    float *in = memory;
+    float *out = in + SIDECHAIN_DUCKER_BENCHMARK_READ * channels;
+    float *sidechain = out + SIDECHAIN_DUCKER_BENCHMARK_READ * channels;
+
+    /*
+        Noise under a sidechain that comes and goes every read, so the gain is always moving.
+    */
+    for (int i = 0; i < SIDECHAIN_DUCKER_BENCHMARK_READ * channels; i++)
+    {
+        in[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+    }
+    for (int i = 0; i < SIDECHAIN_DUCKER_BENCHMARK_READ * 2; i++)
+    {
+        float level = (i < SIDECHAIN_DUCKER_BENCHMARK_READ) ? 0.5f : 0.001f;
+        sidechain[i] = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * level;
+    }
+    ducker.m_sidechain.sidechainenable = true;
+
+    int reads = (int)(seconds * samplerate / SIDECHAIN_DUCKER_BENCHMARK_READ);
+    if (reads < 1)
+    {
+        reads = 1;
+    }
+
+    ducker.process(in, out, SIDECHAIN_DUCKER_BENCHMARK_READ, channels, sidechain, 2);
+
+    double start = MonotonicClock_Now();
+    for (int i = 0; i < reads; i++)
+    {
+        ducker.process(in, out, SIDECHAIN_DUCKER_BENCHMARK_READ, channels, sidechain, 2);
+    }
+    double elapsed = MonotonicClock_Now() - start;
+
+    free(memory);
+    ducker.release();
+
+    return (float)(elapsed * 100.0 * samplerate / ((double)reads * SIDECHAIN_DUCKER_BENCHMARK_READ));
+}
+
+void SidechainDucker::process(const float *inbuffer, float *outbuffer, unsigned int length, int channels, const float *sidechain, int sidechainchannels)
+{
+    float values[SIDECHAIN_DUCKER_PARAM_SIDECHAIN];
+
+    __atomic_store_n(&m_blocks, m_blocks + 1, __ATOMIC_RELAXED);
+
+    if (!m_memory || channels < 1 || channels > SIDECHAIN_DUCKER_MAX_CHANNELS)
+    {
+        memcpy(outbuffer, inbuffer, length * channels * sizeof(float));
+        __atomic_store_n(&m_unducked, m_unducked + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    if (channels != m_channels)
+    {
+        memset(m_stage, 0, m_history * channels * sizeof(float));
+        m_channels = channels;
+    }
+
+    if (!__atomic_load_n(&m_sidechain.sidechainenable, __ATOMIC_RELAXED) || sidechainchannels < 1)
+    {
+        sidechain = 0;
+        __atomic_store_n(&m_unducked, m_unducked + 1, __ATOMIC_RELAXED);
+    }
+
+    for (int i = 0; i < SIDECHAIN_DUCKER_PARAM_SIDECHAIN; i++)
+    {
+        __atomic_load(&m_values[i], &values[i], __ATOMIC_RELAXED);
+    }
+
+    /*
+        Time constants are to 1 - 1/e of the way there.
+    */
+    m_attack = expf(-1000.0f / (values[SIDECHAIN_DUCKER_PARAM_ATTACK] * m_samplerate));
+    m_release = expf(-1000.0f / (values[SIDECHAIN_DUCKER_PARAM_RELEASE] * m_samplerate));
+    m_invthreshold = powf(10.0f, -values[SIDECHAIN_DUCKER_PARAM_THRESHOLD] / 20.0f);
+    m_slope = 1.0f - 1.0f / values[SIDECHAIN_DUCKER_PARAM_RATIO];
+    m_floor = powf(10.0f, -values[SIDECHAIN_DUCKER_PARAM_DEPTH] / 20.0f);
+    m_lookahead = (int)(values[SIDECHAIN_DUCKER_PARAM_LOOKAHEAD] * m_samplerate / 1000.0f + 0.5f);
+    if (m_lookahead > m_history)
+    {
+        m_lookahead = m_history;
+    }
+
+    float lowest = 1.0f;
+    for (unsigned int offset = 0; offset < length; offset += SIDECHAIN_DUCKER_BLOCK)
+    {
+        int count = (length - offset < SIDECHAIN_DUCKER_BLOCK) ? length - offset : SIDECHAIN_DUCKER_BLOCK;
+
+        block(inbuffer + offset * channels, outbuffer + offset * channels, count, channels, sidechain ? sidechain + offset * sidechainchannels : 0, sidechainchannels);
+
+        for (int i = 0; i < count; i++)
+        {
+            lowest = (m_gain[i] < lowest) ? m_gain[i] : lowest;
+        }
+    }
+
+    /*
+        Stop the envelope decaying into denormals once the sidechain goes quiet.
+    */
+    if (m_envelope < 1e-10f)
+    {
+        m_envelope = 0.0f;
+    }
+
+    float last = length ? m_gain[(length - 1) % SIDECHAIN_DUCKER_BLOCK] : 1.0f;
+    float reduction = (last < 1.0f) ? -20.0f * log10f(last) : 0.0f;
+    __atomic_store(&m_reduction, &reduction, __ATOMIC_RELAXED);
+
+    /*
+        getStats can put 1 back in between, then this keeps an older lowest for one more call, which does no
+        harm.
+    */
+    float current;
+    __atomic_load(&m_lowest, &current, __ATOMIC_RELAXED);
+    if (lowest < current)
+    {
+        __atomic_store(&m_lowest, &lowest, __ATOMIC_RELAXED);
+    }
+}
+
+void SidechainDucker::block(const float *inbuffer, float *outbuffer, int length, int channels, const float *sidechain, int sidechainchannels)
+{
+    float *stage = m_stage + m_history * channels;
+    const float *delayed = m_stage + (m_history - m_lookahead) * channels;
+    int i;
+
+    memcpy(stage, inbuffer, length * channels * sizeof(float));
+
+    /*
+        Loudest sidechain channel of each sample.
+    */
+    if (!sidechain)
+    {
+        memset(m_peak, 0, length * sizeof(float));
+    }
+    else
+    {
+        i = 0;
+#if defined(__SSE2__)
+        __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        if (sidechainchannels == 1)
+        {
+            for (; i + 4 <= length; i += 4)
+            {
+                _mm_storeu_ps(m_peak + i, _mm_and_ps(_mm_loadu_ps(sidechain + i), absmask));
+            }
+        }
+        else if (sidechainchannels == 2)
+        {
+            for (; i + 4 <= length; i += 4)
+            {
+                __m128 a = _mm_and_ps(_mm_loadu_ps(sidechain + 2 * i), absmask);
+                __m128 b = _mm_and_ps(_mm_loadu_ps(sidechain + 2 * i + 4), absmask);
+                __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+                __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+                _mm_storeu_ps(m_peak + i, _mm_max_ps(left, right));
+            }
+        }
+#endif
+        for (; i < length; i++)
+        {
+            const float *sample = sidechain + i * sidechainchannels;
+            float peak = 0.0f;
+
+            for (int c = 0; c < sidechainchannels; c++)
+            {
+                peak = (fabsf(sample[c]) > peak) ? fabsf(sample[c]) : peak;
+            }
+            m_peak[i] = peak;
+        }
+    }
+
+    /*
+        The envelope, one sample at a time.
+    */
+    float envelope = m_envelope;
+    for (i = 0; i < length; i++)
+    {
+        float peak = m_peak[i];
+        float coefficient = (peak > envelope) ? m_attack : m_release;
+
+        envelope = peak + coefficient * (envelope - peak);
+        m_gain[i] = envelope;
+    }
+    m_envelope = envelope;
+
+    /*
+        Gain = (envelope / threshold) ^ -(1 - 1 / ratio) above the threshold, 1 below, no lower than the depth.
+    */
+    i = 0;
+#if defined(__SSE2__)
+    {
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 invthreshold = _mm_set1_ps(m_invthreshold);
+        __m128 slope = _mm_set1_ps(-m_slope);
+        __m128 depth = _mm_set1_ps(m_floor);
+
+        for (; i + 4 <= length; i += 4)
+        {
+            __m128 over = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(m_gain + i), invthreshold), one);
+            __m128 gain = SidechainDucker_Exp2(_mm_mul_ps(SidechainDucker_Log2(over), slope));
+            _mm_storeu_ps(m_gain + i, _mm_max_ps(gain, depth));
+        }
+    }
+#endif
+    for (; i < length; i++)
+    {
+        float over = m_gain[i] * m_invthreshold;
+        float gain = (over > 1.0f) ? powf(over, -m_slope) : 1.0f;
+
+        m_gain[i] = (gain > m_floor) ? gain : m_floor;
+    }
+
+    /*
+        Apply it to the input from the lookahead ago.
+    */
+    i = 0;
+#if defined(__SSE2__)
+    if (channels == 1)
+    {
+        for (; i + 4 <= length; i += 4)
+        {
+            _mm_storeu_ps(outbuffer + i, _mm_mul_ps(_mm_loadu_ps(delayed + i), _mm_loadu_ps(m_gain + i)));
+        }
+    }
+    else if (channels == 2)
+    {
+        for (; i + 4 <= length; i += 4)
+        {
+            __m128 gain = _mm_loadu_ps(m_gain + i);
+            _mm_storeu_ps(outbuffer + 2 * i,     _mm_mul_ps(_mm_loadu_ps(delayed + 2 * i),     _mm_unpacklo_ps(gain, gain)));
+            _mm_storeu_ps(outbuffer + 2 * i + 4, _mm_mul_ps(_mm_loadu_ps(delayed + 2 * i + 4), _mm_unpackhi_ps(gain, gain)));
+        }
+    }
+    else if ((channels & 3) == 0)
+    {
+        for (; i < length; i++)
+        {
+            __m128 gain = _mm_set1_ps(m_gain[i]);
+            for (int c = 0; c < channels; c += 4)
+            {
+                _mm_storeu_ps(outbuffer + i * channels + c, _mm_mul_ps(_mm_loadu_ps(delayed + i * channels + c), gain));
+            }
+        }
+    }
+#endif
+    for (; i < length; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            outbuffer[i * channels + c] = delayed[i * channels + c] * m_gain[i];
+        }
+    }
+
+    memmove(m_stage, m_stage + length * channels, m_history * channels * sizeof(float));
+}
+
+void SidechainDucker::clear()
+{
+    if (m_memory)
+    {
+        memset(m_stage, 0, m_history * SIDECHAIN_DUCKER_MAX_CHANNELS * sizeof(float));
+    }
+    m_channels = 0;
+    m_envelope = 0.0f;
+}
+
+FMOD_RESULT F_CALLBACK SidechainDucker::readCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+{
+    SidechainDucker *ducker;
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&ducker);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    ducker->process(inbuffer, outbuffer, length, inchannels, dsp_state->sidechaindata, dsp_state->sidechaindata ? dsp_state->sidechainchannels : 0);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK SidechainDucker::resetCallback(FMOD_DSP_STATE *dsp_state)
+{
+    SidechainDucker *ducker;
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&ducker);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    ducker->clear();
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK SidechainDucker::setParamFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float value)
+{
+    SidechainDucker *ducker;
+
+    if (index < 0 || index >= SIDECHAIN_DUCKER_PARAM_SIDECHAIN)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&ducker);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    value = (value < SIDECHAIN_DUCKER_FLOAT[index].min) ? SIDECHAIN_DUCKER_FLOAT[index].min : value;
+    value = (value > SIDECHAIN_DUCKER_FLOAT[index].max) ? SIDECHAIN_DUCKER_FLOAT[index].max : value;
+    __atomic_store(&ducker->m_values[index], &value, __ATOMIC_RELAXED);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK SidechainDucker::getParamFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float *value, char *valuestr)
+{
+    SidechainDucker *ducker;
+
+    if (index < 0 || index >= SIDECHAIN_DUCKER_PARAM_SIDECHAIN)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&ducker);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    __atomic_load(&ducker->m_values[index], value, __ATOMIC_RELAXED);
+    if (valuestr) sprintf(valuestr, "%.1f %s", *value, SIDECHAIN_DUCKER_FLOAT[index].label);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK SidechainDucker::setParamDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length)
+{
+    SidechainDucker *ducker;
+
+    if (index != SIDECHAIN_DUCKER_PARAM_SIDECHAIN || !data || length != sizeof(FMOD_DSP_PARAMETER_SIDECHAIN))
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&ducker);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    __atomic_store_n(&ducker->m_sidechain.sidechainenable, ((FMOD_DSP_PARAMETER_SIDECHAIN *)data)->sidechainenable, __ATOMIC_RELAXED);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK SidechainDucker::getParamDataCallback(FMOD_DSP_STATE *dsp_state, int index, void **data, unsigned int *length, char *valuestr)
+{
+    SidechainDucker *ducker;
+
+    if (index != SIDECHAIN_DUCKER_PARAM_SIDECHAIN)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&ducker);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    *data = &ducker->m_sidechain;
+    *length = sizeof(FMOD_DSP_PARAMETER_SIDECHAIN);
+    if (valuestr) sprintf(valuestr, ducker->m_sidechain.sidechainenable ? "On" : "Off");
+
+    return FMOD_OK;
+}
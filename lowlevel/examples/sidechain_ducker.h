@@ -0,0 +1,117 @@
+/*==============================================================================
+Sidechain Ducker
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+A DSP that turns down what passes through it whenever its sidechain is loud,
+to keep instruments out of the way of a vocal. Connect the vocal to it with
+FMOD_DSPCONNECTION_TYPE_SIDECHAIN and set SIDECHAIN_DUCKER_PARAM_SIDECHAIN
+to an FMOD_DSP_PARAMETER_SIDECHAIN with sidechainenable set.
+
+The loudest sidechain channel of each sample drives an envelope follower
+with separate attack and release times. Above the threshold, gain comes down
+by the ratio, as in a compressor, but never by more than the depth.
+
+The lookahead delays the input but not the sidechain, so the gain has come
+down by the time the input that went with a sudden vocal comes out. Only
+this DSP's output is delayed. The vocal's own audible path isn't, and FMOD
+doesn't compensate, so anything above 0 puts the ducked input that far
+behind the vocal unless the vocal is delayed by the same amount as well. It
+is 0 by default. Changing it skips or repeats a little of the input.
+
+The envelope depends on the sample before it, so only it is worked out one
+sample at a time. Finding the peak, turning the envelope into a gain and
+applying it are done with SSE2, four at a time. benchmark gives the cost as
+a percentage of one core.
+==============================================================================*/
+#ifndef _SIDECHAIN_DUCKER_H
+#define _SIDECHAIN_DUCKER_H
+
+#include "fmod.hpp"
+
+#define SIDECHAIN_DUCKER_BLOCK          256     /* Samples processed at a time, longer reads are split. */
+#define SIDECHAIN_DUCKER_MAX_CHANNELS   8       /* Input wider than this passes through untouched. */
+#define SIDECHAIN_DUCKER_MAX_LOOKAHEAD  20.0f   /* Milliseconds. */
+
+enum
+{
+    SIDECHAIN_DUCKER_PARAM_THRESHOLD = 0,   /* dB, of the sidechain. */
+    SIDECHAIN_DUCKER_PARAM_RATIO,
+    SIDECHAIN_DUCKER_PARAM_DEPTH,           /* dB, the most gain is brought down by. */
+    SIDECHAIN_DUCKER_PARAM_ATTACK,          /* Milliseconds. */
+    SIDECHAIN_DUCKER_PARAM_RELEASE,
+    SIDECHAIN_DUCKER_PARAM_LOOKAHEAD,
+    SIDECHAIN_DUCKER_PARAM_SIDECHAIN,       /* FMOD_DSP_PARAMETER_SIDECHAIN. */
+    SIDECHAIN_DUCKER_NUM_PARAMETERS
+};
+
+struct SidechainDuckerStats
+{
+    float           reduction;      /* dB, at the end of the last block. */
+    float           maxreduction;   /* dB, the most since the last getStats. */
+    unsigned int    blocks;
+    unsigned int    unducked;       /* Blocks with no sidechain, or too many channels. */
+};
+
+class SidechainDucker
+{
+public:
+    SidechainDucker();
+
+    FMOD_RESULT init(int samplerate);
+    void        release();                  /* Only once the DSP is released. */
+
+    /*
+        Fills in a description for System::createDSP, with this as the userdata.
+    */
+    void        describe(FMOD_DSP_DESCRIPTION *desc);
+    void        getStats(SidechainDuckerStats *stats);
+
+    /*
+        Percent of one core to duck 'channels' of input under a stereo sidechain, timed over 'seconds' of
+        audio.
+    */
+    static float benchmark(int samplerate, int channels, float seconds);
+
+    static FMOD_RESULT F_CALLBACK readCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels);
+    static FMOD_RESULT F_CALLBACK resetCallback(FMOD_DSP_STATE *dsp_state);
+    static FMOD_RESULT F_CALLBACK setParamFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float value);
+    static FMOD_RESULT F_CALLBACK getParamFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float *value, char *valuestr);
+    static FMOD_RESULT F_CALLBACK setParamDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length);
+    static FMOD_RESULT F_CALLBACK getParamDataCallback(FMOD_DSP_STATE *dsp_state, int index, void **data, unsigned int *length, char *valuestr);
+
+private:
+    /* Mixer thread. */
+    void        process(const float *inbuffer, float *outbuffer, unsigned int length, int channels, const float *sidechain, int sidechainchannels);
+    void        block(const float *inbuffer, float *outbuffer, int length, int channels, const float *sidechain, int sidechainchannels);
+    void        clear();
+
+    int                 m_samplerate;
+    float              *m_memory;
+    float              *m_stage;            /* m_history samples of delayed input, then the block. */
+    float              *m_peak;             /* Per sample of the block. */
+    float              *m_gain;
+    int                 m_history;          /* Samples, the longest lookahead. */
+    int                 m_channels;         /* Of the input in m_stage, 0 = nothing yet. */
+    float               m_envelope;         /* Linear. */
+    float               m_lowest;           /* Lowest gain since getStats. */
+
+    /* From m_values, worked out at the start of each read. */
+    float               m_attack;           /* Envelope coefficients per sample. */
+    float               m_release;
+    float               m_invthreshold;     /* Linear. */
+    float               m_slope;            /* 1 - 1 / ratio. */
+    float               m_floor;            /* Linear, the depth. */
+    int                 m_lookahead;        /* Samples. */
+
+    float               m_values[SIDECHAIN_DUCKER_PARAM_SIDECHAIN];        /* The float parameters. */
+    FMOD_DSP_PARAMETER_SIDECHAIN m_sidechain;
+
+    float               m_reduction;
+    unsigned int        m_blocks;
+    unsigned int        m_unducked;
+
+    FMOD_DSP_PARAMETER_DESC  m_paramdesc[SIDECHAIN_DUCKER_NUM_PARAMETERS];
+    FMOD_DSP_PARAMETER_DESC *m_params[SIDECHAIN_DUCKER_NUM_PARAMETERS];
+};
+
+#endif
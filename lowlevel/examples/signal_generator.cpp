@@ -0,0 +1,307 @@
+/*==============================================================================
+Signal Generator
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "signal_generator.h"
+#include <math.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+    sin(2 * pi * x) for x in [-0.25, 0.25] as an odd polynomial, good to about 6e-8.
+*/
+#define SINE_C1     6.28318530717958648f
+#define SINE_C3    -41.3417022403997200f
+#define SINE_C5     81.6052492760750700f
+#define SINE_C7    -76.7058597530612000f
+#define SINE_C9     42.0586939448098500f
+#define SINE_C11   -15.0946425768229800f
+
+static inline float SignalGenerator_Sine(float x)
+{
+    x -= floorf(x + 0.5f);                                      /* -0.5 to 0.5 */
+    x = (x > 0.25f) ? 0.5f - x : (x < -0.25f) ? -0.5f - x : x;  /* Fold into -0.25 to 0.25 */
+
+    float x2 = x * x;
+    return x * (SINE_C1 + x2 * (SINE_C3 + x2 * (SINE_C5 + x2 * (SINE_C7 + x2 * (SINE_C9 + x2 * SINE_C11)))));
+}
+
+#if defined(__SSE2__)
+static inline __m128 SignalGenerator_Sine4(__m128 x)
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+
+    x = _mm_sub_ps(x, _mm_cvtepi32_ps(_mm_cvtps_epi32(x)));    /* Round to nearest, -0.5 to 0.5 */
+    x = _mm_min_ps(x, _mm_sub_ps(half, x));
+    x = _mm_max_ps(x, _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(half, x)));
+
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 p = _mm_set1_ps(SINE_C11);
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SINE_C9));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SINE_C7));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SINE_C5));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SINE_C3));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SINE_C1));
+    return _mm_mul_ps(p, x);
+}
+#endif
+
+SignalGenerator::SignalGenerator()
+{
+    m_channels = 0;
+    m_samplerate = 0;
+    m_format = FMOD_SOUND_FORMAT_NONE;
+    m_sequence = 0;
+    memset(m_pending, 0, sizeof(m_pending));
+    memset(m_voices, 0, sizeof(m_voices));
+    memset(m_state, 0, sizeof(m_state));
+}
+
+FMOD_RESULT SignalGenerator::init(int channels, int samplerate, FMOD_SOUND_FORMAT format)
+{
+    if (channels < 1 || channels > SIGNAL_GENERATOR_MAX_CHANNELS || samplerate <= 0)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    if (format != FMOD_SOUND_FORMAT_PCM16 && format != FMOD_SOUND_FORMAT_PCMFLOAT)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    m_channels = channels;
+    m_samplerate = samplerate;
+    m_format = format;
+
+    return FMOD_OK;
+}
+
+void SignalGenerator::setupExInfo(FMOD_CREATESOUNDEXINFO *exinfo)
+{
+    exinfo->numchannels       = m_channels;
+    exinfo->defaultfrequency  = m_samplerate;
+    exinfo->format            = m_format;
+    exinfo->pcmreadcallback   = pcmReadCallback;
+    exinfo->pcmsetposcallback = pcmSetPosCallback;
+    exinfo->userdata          = this;
+}
+
+void SignalGenerator::setVoice(int channel, const SignalGeneratorVoice &voice)
+{
+    if (channel < 0 || channel >= m_channels)
+    {
+        return;
+    }
+
+    /*
+        Odd while writing, so the stream thread can tell it caught a half written voice. Only one thread may call this.
+    */
+    unsigned int sequence = m_sequence;
+    __atomic_store_n(&m_sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    m_pending[channel] = voice;
+    __atomic_store_n(&m_sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void SignalGenerator::latchVoices()
+{
+    SignalGeneratorVoice voices[SIGNAL_GENERATOR_MAX_CHANNELS];
+
+    unsigned int before = __atomic_load_n(&m_sequence, __ATOMIC_ACQUIRE);
+    if (before & 1)
+    {
+        return;     /* Mid update, keep last block's voices and try again next time. */
+    }
+
+    memcpy(voices, m_pending, sizeof(SignalGeneratorVoice) * m_channels);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&m_sequence, __ATOMIC_RELAXED) == before)
+    {
+        memcpy(m_voices, voices, sizeof(SignalGeneratorVoice) * m_channels);
+    }
+}
+
+void SignalGenerator::renderVoice(int channel, float *out, unsigned int length)
+{
+    const SignalGeneratorVoice &voice = m_voices[channel];
+    SignalGeneratorState &state = m_state[channel];
+
+    float inc = voice.frequency / m_samplerate;
+    float modinc = inc * voice.ratio;
+    float index = (voice.wave == SIGNAL_GENERATOR_FM) ? voice.index : 0.0f;
+    float phase = (float)state.phase;
+    float modphase = (float)state.modphase;
+    float amp = state.amplitude;
+    float ampinc = (voice.amplitude - state.amplitude) / length;
+    unsigned int count = 0;
+
+    /*
+        Phases are computed from the block start rather than accumulated, so rounding doesn't build up across the block.
+    */
+#if defined(__SSE2__)
+    {
+        __m128 step = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        __m128 four = _mm_set1_ps(4.0f);
+        __m128 vinc = _mm_set1_ps(inc);
+        __m128 vmodinc = _mm_set1_ps(modinc);
+        __m128 vindex = _mm_set1_ps(index);
+        __m128 vampinc = _mm_set1_ps(ampinc);
+        __m128 vphase = _mm_set1_ps(phase);
+        __m128 vmodphase = _mm_set1_ps(modphase);
+        __m128 vamp = _mm_set1_ps(amp);
+
+        for (; count + 4 <= length; count += 4)
+        {
+            __m128 p = _mm_add_ps(vphase, _mm_mul_ps(step, vinc));
+            if (index != 0.0f)
+            {
+                __m128 m = SignalGenerator_Sine4(_mm_add_ps(vmodphase, _mm_mul_ps(step, vmodinc)));
+                p = _mm_add_ps(p, _mm_mul_ps(vindex, m));
+            }
+
+            __m128 a = _mm_add_ps(vamp, _mm_mul_ps(step, vampinc));
+            _mm_storeu_ps(out + count, _mm_mul_ps(a, SignalGenerator_Sine4(p)));
+
+            step = _mm_add_ps(step, four);
+        }
+    }
+#endif
+
+    for (; count < length; count++)
+    {
+        float p = phase + count * inc;
+        if (index != 0.0f)
+        {
+            p += index * SignalGenerator_Sine(modphase + count * modinc);
+        }
+        out[count] = (amp + count * ampinc) * SignalGenerator_Sine(p);
+    }
+
+    state.phase += (double)voice.frequency / m_samplerate * length;
+    state.phase -= floor(state.phase);
+    state.modphase += (double)voice.frequency * voice.ratio / m_samplerate * length;
+    state.modphase -= floor(state.modphase);
+    state.amplitude = voice.amplitude;
+}
+
+FMOD_RESULT SignalGenerator::read(void *data, unsigned int datalen)
+{
+    int samplebytes = (m_format == FMOD_SOUND_FORMAT_PCMFLOAT) ? sizeof(float) : sizeof(signed short);
+    unsigned int frames = datalen / (samplebytes * m_channels);
+    unsigned int offset = 0;
+
+    latchVoices();
+
+    while (offset < frames)
+    {
+        unsigned int length = frames - offset;
+        if (length > SIGNAL_GENERATOR_BLOCKSIZE)
+        {
+            length = SIGNAL_GENERATOR_BLOCKSIZE;
+        }
+
+        for (int channel = 0; channel < m_channels; channel++)
+        {
+            renderVoice(channel, m_block[channel], length);
+        }
+
+        /*
+            Interleave into FMOD's buffer.
+        */
+        if (m_format == FMOD_SOUND_FORMAT_PCMFLOAT)
+        {
+            float *dest = (float *)data + offset * m_channels;
+
+            for (unsigned int count = 0; count < length; count++)
+            {
+                for (int channel = 0; channel < m_channels; channel++)
+                {
+                    *dest++ = m_block[channel][count];
+                }
+            }
+        }
+        else
+        {
+            signed short *dest = (signed short *)data + offset * m_channels;
+            unsigned int count = 0;
+
+#if defined(__SSE2__)
+            if (m_channels == 2)
+            {
+                const __m128 scale = _mm_set1_ps(32767.0f);
+
+                for (; count + 4 <= length; count += 4)
+                {
+                    __m128 l = _mm_mul_ps(_mm_loadu_ps(m_block[0] + count), scale);
+                    __m128 r = _mm_mul_ps(_mm_loadu_ps(m_block[1] + count), scale);
+                    __m128i lo = _mm_cvtps_epi32(_mm_unpacklo_ps(l, r));
+                    __m128i hi = _mm_cvtps_epi32(_mm_unpackhi_ps(l, r));
+                    _mm_storeu_si128((__m128i *)(dest + count * 2), _mm_packs_epi32(lo, hi));  /* Saturates */
+                }
+                dest += count * 2;
+            }
+#endif
+
+            for (; count < length; count++)
+            {
+                for (int channel = 0; channel < m_channels; channel++)
+                {
+                    float value = m_block[channel][count] * 32767.0f;
+                    value = (value > 32767.0f) ? 32767.0f : (value < -32768.0f) ? -32768.0f : value;
+                    *dest++ = (signed short)lrintf(value);
+                }
+            }
+        }
+
+        offset += length;
+    }
+
+    return FMOD_OK;
+}
+
+void SignalGenerator::setPosition(unsigned int position)
+{
+    for (int channel = 0; channel < m_channels; channel++)
+    {
+        double inc = (double)m_voices[channel].frequency / m_samplerate;
+        double phase = inc * position;
+        double modphase = phase * m_voices[channel].ratio;
+
+        m_state[channel].phase = phase - floor(phase);
+        m_state[channel].modphase = modphase - floor(modphase);
+    }
+}
+
+FMOD_RESULT F_CALLBACK SignalGenerator::pcmReadCallback(FMOD_SOUND *sound, void *data, unsigned int datalen)
+{
+    SignalGenerator *generator;
+
+    FMOD_RESULT result = ((FMOD::Sound *)sound)->getUserData((void **)&generator);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    return generator->read(data, datalen);
+}
+
+FMOD_RESULT F_CALLBACK SignalGenerator::pcmSetPosCallback(FMOD_SOUND *sound, int subsound, unsigned int position, FMOD_TIMEUNIT postype)
+{
+    SignalGenerator *generator;
+
+    if (postype != FMOD_TIMEUNIT_PCM)
+    {
+        return FMOD_OK;
+    }
+
+    FMOD_RESULT result = ((FMOD::Sound *)sound)->getUserData((void **)&generator);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    generator->setPosition(position);
+    return FMOD_OK;
+}
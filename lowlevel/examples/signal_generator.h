@@ -0,0 +1,80 @@
+/*==============================================================================
+Signal Generator
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Block based oscillator bank for user created sounds. Each channel of a sound
+has one voice, either a plain sine or a two operator FM pair, and every
+callback fills whole blocks per voice: phases for four samples are advanced at
+once and fed through a polynomial sine, using SSE where the compiler has it.
+
+All state lives in the SignalGenerator, which is passed to FMOD through
+FMOD_CREATESOUNDEXINFO::userdata, so any number of sounds can run side by side
+without sharing anything. SignalGenerator::setupExInfo fills in the format,
+callbacks and userdata. Output can be PCM16 or PCMFLOAT.
+
+Voice changes made with setVoice are picked up at the start of the next
+callback, with the amplitude ramped across that block to avoid clicks.
+==============================================================================*/
+#ifndef _SIGNAL_GENERATOR_H
+#define _SIGNAL_GENERATOR_H
+
+#include "fmod.hpp"
+
+#define SIGNAL_GENERATOR_MAX_CHANNELS   8
+#define SIGNAL_GENERATOR_BLOCKSIZE      256     /* Samples per channel generated in one pass. */
+
+enum SignalGeneratorWave
+{
+    SIGNAL_GENERATOR_SINE,
+    SIGNAL_GENERATOR_FM
+};
+
+struct SignalGeneratorVoice
+{
+    SignalGeneratorWave wave;
+    float               frequency;      /* Carrier frequency in Hz. */
+    float               ratio;          /* FM only. Modulator frequency as a multiple of the carrier. */
+    float               index;          /* FM only. Peak phase deviation in cycles. */
+    float               amplitude;      /* 0 to 1. */
+};
+
+struct SignalGeneratorState
+{
+    double              phase;          /* Carrier phase in cycles, 0 to 1. */
+    double              modphase;       /* Modulator phase in cycles, 0 to 1. */
+    float               amplitude;      /* Amplitude reached at the end of the last block. */
+};
+
+class SignalGenerator
+{
+public:
+    SignalGenerator();
+
+    FMOD_RESULT init(int channels, int samplerate, FMOD_SOUND_FORMAT format);
+    void        setupExInfo(FMOD_CREATESOUNDEXINFO *exinfo);
+
+    void        setVoice(int channel, const SignalGeneratorVoice &voice);
+    FMOD_RESULT read(void *data, unsigned int datalen);
+    void        setPosition(unsigned int position);    /* In samples. */
+
+    static FMOD_RESULT F_CALLBACK pcmReadCallback(FMOD_SOUND *sound, void *data, unsigned int datalen);
+    static FMOD_RESULT F_CALLBACK pcmSetPosCallback(FMOD_SOUND *sound, int subsound, unsigned int position, FMOD_TIMEUNIT postype);
+
+private:
+    void        latchVoices();
+    void        renderVoice(int channel, float *out, unsigned int length);
+
+    int                     m_channels;
+    int                     m_samplerate;
+    FMOD_SOUND_FORMAT       m_format;
+
+    /* Written by setVoice, copied by the stream thread under a sequence count. */
+    SignalGeneratorVoice    m_pending[SIGNAL_GENERATOR_MAX_CHANNELS];
+    unsigned int            m_sequence;
+
+    SignalGeneratorVoice    m_voices[SIGNAL_GENERATOR_MAX_CHANNELS];
+    SignalGeneratorState    m_state[SIGNAL_GENERATOR_MAX_CHANNELS];
+    float                   m_block[SIGNAL_GENERATOR_MAX_CHANNELS][SIGNAL_GENERATOR_BLOCKSIZE];
+};
+
+#endif
@@ -0,0 +1,378 @@
+/*==============================================================================
+Sound Loader
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "sound_loader.h"
+#include "asset_store.h"
+#include "vorbis_decoder.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+    Read and seek callbacks for VorbisDecoder over a mapped file.
+*/
+struct SoundLoaderSource
+{
+    const unsigned char    *data;
+    unsigned int            length;
+    unsigned int            position;
+};
+
+static FMOD_RESULT F_CALLBACK SoundLoader_Read(void *handle, void *buffer, unsigned int sizebytes, unsigned int *bytesread, void * /*userdata*/)
+{
+    SoundLoaderSource *source = (SoundLoaderSource *)handle;
+    unsigned int size = source->length - source->position;
+
+    if (size > sizebytes)
+    {
+        size = sizebytes;
+    }
+    memcpy(buffer, source->data + source->position, size);
+    source->position += size;
+    *bytesread = size;
+
+    return (size < sizebytes) ? FMOD_ERR_FILE_EOF : FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK SoundLoader_Seek(void *handle, unsigned int pos, void * /*userdata*/)
+{
+    SoundLoaderSource *source = (SoundLoaderSource *)handle;
+
+    if (pos > source->length)
+    {
+        return FMOD_ERR_FILE_COULDNOTSEEK;
+    }
+    source->position = pos;
+    return FMOD_OK;
+}
+
+/*
+    Decodes an Ogg Vorbis file to a PCM16 sample. Returns FMOD_ERR_FORMAT for anything it doesn't want to decode
+    itself, the caller hands those to FMOD.
+*/
+static FMOD_RESULT SoundLoader_Decode(FMOD::System *system, const MappedFile *file, FMOD_MODE mode, FMOD::Sound **sound, unsigned int *bytes)
+{
+    FMOD_RESULT result;
+
+    if (mode & (FMOD_CREATESTREAM | FMOD_CREATECOMPRESSEDSAMPLE | FMOD_OPENRAW | FMOD_OPENUSER))
+    {
+        return FMOD_ERR_FORMAT;
+    }
+    if (file->length < 4 || memcmp(file->data, "OggS", 4) != 0)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    SoundLoaderSource source;
+    source.data = (const unsigned char *)file->data;
+    source.length = file->length;
+    source.position = 0;
+
+    /*
+        The decoder reads the file from front to back, then jumps to the end once to find the length. The mapping
+        is shared, so the mapping's own advice is put back once the decode is done.
+    */
+    MappedFile_Advise(file, 0, file->length, MADV_SEQUENTIAL);
+
+    VorbisDecoder decoder;
+    result = decoder.open(SoundLoader_Read, SoundLoader_Seek, &source, 0, file->length);
+    if (result == FMOD_OK && !decoder.getLength())
+    {
+        result = FMOD_ERR_FORMAT;
+    }
+    if (result != FMOD_OK)
+    {
+        decoder.release();
+        MappedFile_Advise(file, 0, file->length, file->advice);
+        return result;
+    }
+
+    int channels = decoder.getChannels();
+    unsigned int length = decoder.getLength();
+
+    FMOD_CREATESOUNDEXINFO exinfo;
+    memset(&exinfo, 0, sizeof(FMOD_CREATESOUNDEXINFO));
+    exinfo.cbsize           = sizeof(FMOD_CREATESOUNDEXINFO);
+    exinfo.length           = length * channels * sizeof(short);
+    exinfo.numchannels      = channels;
+    exinfo.defaultfrequency = decoder.getRate();
+    exinfo.format           = FMOD_SOUND_FORMAT_PCM16;
+
+    mode &= ~(FMOD_OPENMEMORY | FMOD_OPENMEMORY_POINT | FMOD_OPENONLY);
+    mode |= FMOD_OPENUSER | FMOD_CREATESAMPLE;
+
+    result = system->createSound(0, mode, &exinfo, sound);
+    if (result != FMOD_OK)
+    {
+        decoder.release();
+        MappedFile_Advise(file, 0, file->length, file->advice);
+        return result;
+    }
+
+    void *ptr1, *ptr2;
+    unsigned int len1, len2;
+    result = (*sound)->lock(0, exinfo.length, &ptr1, &ptr2, &len1, &len2);
+    if (result == FMOD_OK)
+    {
+        unsigned int samplesread = 0;
+
+        result = decoder.readPCM16((short *)ptr1, length, &samplesread);
+        short *dest = (short *)ptr1 + samplesread * channels;
+        unsigned int remaining = length - samplesread;
+
+        /*
+            A file that ends early only loses its tail, the length came from the last page's granule.
+        */
+        if (result == FMOD_ERR_FILE_EOF)
+        {
+            memset(dest, 0, remaining * channels * sizeof(short));
+            result = FMOD_OK;
+        }
+
+        FMOD_RESULT unlockresult = (*sound)->unlock(ptr1, ptr2, len1, len2);
+        if (result == FMOD_OK)
+        {
+            result = unlockresult;
+        }
+    }
+
+    decoder.release();
+    MappedFile_Advise(file, 0, file->length, file->advice);
+
+    if (result != FMOD_OK)
+    {
+        (*sound)->release();
+        *sound = 0;
+        return result;
+    }
+
+    *bytes = file->length + exinfo.length;
+    return FMOD_OK;
+}
+
+/*
+    Faults every page of a bank in, so Studio's load on the main thread never waits on the disk.
+*/
+static void SoundLoader_Prefault(const MappedFile *file)
+{
+    const volatile unsigned char *data = (const volatile unsigned char *)file->data;
+    unsigned int pagesize = (unsigned int)sysconf(_SC_PAGESIZE);
+
+    MappedFile_Advise(file, 0, file->length, MADV_WILLNEED);
+    for (unsigned int offset = 0; offset < file->length; offset += pagesize)
+    {
+        (void)data[offset];
+    }
+}
+
+SoundLoader::SoundLoader()
+{
+    m_system = 0;
+    m_initialized = false;
+    m_done = 0;
+    m_total = 0;
+    m_finished = 0;
+    m_failed = 0;
+    m_bytes = 0;
+}
+
+FMOD_RESULT SoundLoader::init(FMOD::System *system, int numthreads)
+{
+    FMOD_RESULT result = m_pool.init(numthreads);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    pthread_mutex_init(&m_lock, 0);
+    pthread_cond_init(&m_idle, 0);
+
+    m_system = system;
+    m_done = 0;
+    m_total = 0;
+    m_finished = 0;
+    m_failed = 0;
+    m_bytes = 0;
+    m_initialized = true;
+
+    return FMOD_OK;
+}
+
+void SoundLoader::release()
+{
+    if (!m_initialized)
+    {
+        return;
+    }
+
+    /*
+        The pool drains its queues before its threads exit. Callbacks still pending are dropped, the entries
+        already hold their results.
+    */
+    m_pool.release();
+
+    pthread_cond_destroy(&m_idle);
+    pthread_mutex_destroy(&m_lock);
+    m_done = 0;
+    m_initialized = false;
+}
+
+FMOD_RESULT SoundLoader::load(SoundLoaderEntry *entries, int count, SOUND_LOADER_CALLBACK callback, void *userdata)
+{
+    if (!m_initialized)
+    {
+        return FMOD_ERR_UNINITIALIZED;
+    }
+
+    /*
+        Count them all first, so progress never shows the batch as done while it's still being queued.
+    */
+    __atomic_add_fetch(&m_total, count, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < count; i++)
+    {
+        SoundLoaderEntry *entry = &entries[i];
+
+        entry->result       = FMOD_OK;
+        entry->sound        = 0;
+        entry->file         = 0;
+        entry->bytes        = 0;
+        entry->job.func     = jobMain;
+        entry->job.arg      = entry;
+        entry->loader       = this;
+        entry->callback     = callback;
+        entry->callbackdata = userdata;
+        entry->nextdone     = 0;
+
+        m_pool.submit(&entry->job);
+    }
+
+    return FMOD_OK;
+}
+
+void SoundLoader::jobMain(void *arg)
+{
+    SoundLoaderEntry *entry = (SoundLoaderEntry *)arg;
+    SoundLoader *loader = entry->loader;
+
+    if (entry->type == SOUND_LOADER_BANK)
+    {
+        entry->file = MappedFile_Acquire(entry->path);
+        if (entry->file)
+        {
+            SoundLoader_Prefault(entry->file);
+            entry->bytes = entry->file->length;
+        }
+        else
+        {
+            entry->result = FMOD_ERR_FILE_NOTFOUND;
+        }
+    }
+    else
+    {
+        MappedFile *file = MappedFile_Acquire(entry->path);
+        if (!file)
+        {
+            entry->result = FMOD_ERR_FILE_NOTFOUND;
+        }
+        else
+        {
+            entry->result = SoundLoader_Decode(loader->m_system, file, entry->mode, &entry->sound, &entry->bytes);
+            if (entry->result == FMOD_ERR_FORMAT)
+            {
+                /*
+                    Takes its own reference to the mapping, and keeps it if FMOD reads the data in place.
+                */
+                entry->result = AssetStore_CreateSound(loader->m_system, entry->path, entry->mode, 0, &entry->sound);
+                entry->bytes = (entry->result == FMOD_OK) ? file->length : 0;
+            }
+            MappedFile_Release(file);
+        }
+    }
+
+    loader->finish(entry);
+}
+
+void SoundLoader::finish(SoundLoaderEntry *entry)
+{
+    if (entry->result != FMOD_OK)
+    {
+        __atomic_add_fetch(&m_failed, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&m_bytes, (unsigned long long)entry->bytes, __ATOMIC_RELAXED);
+
+    SoundLoaderEntry *head = __atomic_load_n(&m_done, __ATOMIC_RELAXED);
+    do
+    {
+        entry->nextdone = head;
+    } while (!__atomic_compare_exchange_n(&m_done, &head, entry, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    /*
+        Counted after the push, so when wait sees everything finished every entry is on the stack.
+    */
+    int finished = __atomic_add_fetch(&m_finished, 1, __ATOMIC_ACQ_REL);
+    if (finished == __atomic_load_n(&m_total, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_lock(&m_lock);
+        pthread_cond_broadcast(&m_idle);
+        pthread_mutex_unlock(&m_lock);
+    }
+}
+
+void SoundLoader::update()
+{
+    if (!m_initialized)
+    {
+        return;
+    }
+
+    SoundLoaderEntry *entry = __atomic_exchange_n(&m_done, (SoundLoaderEntry *)0, __ATOMIC_ACQUIRE);
+
+    /*
+        The stack is newest first, turn it around so callbacks come in the order things finished.
+    */
+    SoundLoaderEntry *ordered = 0;
+    while (entry)
+    {
+        SoundLoaderEntry *next = entry->nextdone;
+        entry->nextdone = ordered;
+        ordered = entry;
+        entry = next;
+    }
+
+    while (ordered)
+    {
+        SoundLoaderEntry *next = ordered->nextdone;
+        if (ordered->callback)
+        {
+            ordered->callback(ordered, ordered->callbackdata);
+        }
+        ordered = next;
+    }
+}
+
+void SoundLoader::wait()
+{
+    if (!m_initialized)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    while (__atomic_load_n(&m_finished, __ATOMIC_ACQUIRE) != __atomic_load_n(&m_total, __ATOMIC_ACQUIRE))
+    {
+        pthread_cond_wait(&m_idle, &m_lock);
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    update();
+}
+
+void SoundLoader::getProgress(SoundLoaderProgress *progress) const
+{
+    progress->total  = __atomic_load_n(&m_total, __ATOMIC_ACQUIRE);
+    progress->done   = __atomic_load_n(&m_finished, __ATOMIC_ACQUIRE);
+    progress->failed = __atomic_load_n(&m_failed, __ATOMIC_RELAXED);
+    progress->bytes  = __atomic_load_n(&m_bytes, __ATOMIC_RELAXED);
+}
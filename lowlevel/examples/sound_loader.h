@@ -0,0 +1,112 @@
+/*==============================================================================
+Sound Loader
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Loads a whole manifest of sounds and banks at once, spread across a work
+stealing WorkerPool (see worker_pool.h), and reports back as each one is
+ready.
+
+FMOD_NONBLOCKING puts every load on FMOD's one async thread, so a level with
+thousands of samples still decodes them one at a time. Here each entry is a
+job on the pool instead:
+
+ - Ogg Vorbis samples are decoded by the example decoder (vorbis_decoder.h)
+   straight out of the mmapped file and into the memory of an FMOD_OPENUSER
+   sound, on the worker thread and outside FMOD's API lock. This is the part
+   that scales with cores.
+ - Anything else, and Vorbis opened as a stream or compressed sample, goes
+   through AssetStore_CreateSound on the worker thread. Release those, and
+   the decoded ones, with AssetStore_ReleaseSound.
+ - Banks are mapped and faulted in. Studio has to load them on its own
+   thread, so the entry keeps the mapping alive for AssetStore_LoadBank to
+   find resident; drop it with MappedFile_Release afterwards.
+
+Completion callbacks run on the thread that calls update or wait, never on a
+worker, so they can touch game state and FMOD freely. Entries must stay alive
+until their callback has run.
+==============================================================================*/
+#ifndef _SOUND_LOADER_H
+#define _SOUND_LOADER_H
+
+#include "fmod.hpp"
+#include "mapped_file.h"
+#include "worker_pool.h"
+
+enum SOUND_LOADER_TYPE
+{
+    SOUND_LOADER_SOUND,
+    SOUND_LOADER_BANK
+};
+
+class SoundLoader;
+struct SoundLoaderEntry;
+
+typedef void (*SOUND_LOADER_CALLBACK)(SoundLoaderEntry *entry, void *userdata);
+
+struct SoundLoaderEntry
+{
+    /* Filled in by the caller */
+    SOUND_LOADER_TYPE       type;
+    const char             *path;
+    FMOD_MODE               mode;           /* Sounds only. */
+    void                   *userdata;
+
+    /* Filled in by the loader before the callback */
+    FMOD_RESULT             result;
+    FMOD::Sound            *sound;          /* Sounds. */
+    MappedFile             *file;           /* Banks. */
+    unsigned int            bytes;          /* Read from disk, plus decoded for decoded sounds. */
+
+    /* Used internally by the loader */
+    WorkerJob               job;
+    SoundLoader            *loader;
+    SOUND_LOADER_CALLBACK   callback;
+    void                   *callbackdata;
+    SoundLoaderEntry       *nextdone;
+};
+
+struct SoundLoaderProgress
+{
+    int                     total;          /* Entries passed to load so far. */
+    int                     done;           /* Including failures. */
+    int                     failed;
+    unsigned long long      bytes;
+};
+
+class SoundLoader
+{
+public:
+    SoundLoader();
+
+    FMOD_RESULT init(FMOD::System *system, int numthreads);     /* 0 = one thread per online core. */
+    void        release();                                      /* Waits for everything queued. */
+
+    /*
+        Queues every entry and returns straight away. May be called again before earlier loads have finished.
+    */
+    FMOD_RESULT load(SoundLoaderEntry *entries, int count, SOUND_LOADER_CALLBACK callback, void *userdata);
+
+    void        update();                                       /* Runs callbacks for entries finished since last time. */
+    void        wait();                                         /* Blocks until everything queued is done, then update. */
+    void        getProgress(SoundLoaderProgress *progress) const;
+    int         numThreads() const { return m_pool.numThreads(); }
+
+private:
+    static void jobMain(void *arg);
+    void        finish(SoundLoaderEntry *entry);
+
+    FMOD::System       *m_system;
+    WorkerPool          m_pool;
+    bool                m_initialized;
+
+    SoundLoaderEntry   *m_done;             /* Lock free stack, pushed by workers, taken whole by update. */
+    int                 m_total;
+    int                 m_finished;
+    int                 m_failed;
+    unsigned long long  m_bytes;
+
+    pthread_mutex_t     m_lock;             /* Only for wait. */
+    pthread_cond_t      m_idle;
+};
+
+#endif
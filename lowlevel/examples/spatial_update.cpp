@@ -0,0 +1,347 @@
+/*==============================================================================
+Spatial Update
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "spatial_update.h"
+#include "monotonic_clock.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const FMOD_VECTOR gSpatialZero = { 0.0f, 0.0f, 0.0f };
+
+static float SpatialUpdate_DistanceSquared(const FMOD_VECTOR *a, const FMOD_VECTOR *b)
+{
+    float x = a->x - b->x;
+    float y = a->y - b->y;
+    float z = a->z - b->z;
+    return x * x + y * y + z * z;
+}
+
+static bool SpatialUpdate_IsZero(const FMOD_VECTOR *v)
+{
+    return v->x == 0.0f && v->y == 0.0f && v->z == 0.0f;
+}
+
+static void SpatialUpdate_Velocity(const FMOD_VECTOR *position, const FMOD_VECTOR *last, double elapsed, FMOD_VECTOR *velocity)
+{
+    float scale = (float)(1.0 / elapsed);
+    velocity->x = (position->x - last->x) * scale;
+    velocity->y = (position->y - last->y) * scale;
+    velocity->z = (position->z - last->z) * scale;
+}
+
+SpatialUpdater::SpatialUpdater()
+{
+    m_system = 0;
+    m_master = 0;
+    m_clock = SPATIAL_CLOCK_MONOTONIC;
+    m_rate = 0.0f;
+    m_epsilon = 0.0f;
+    m_emitters = 0;
+    m_maxemitters = 0;
+    m_free = 0;
+    m_numfree = 0;
+    m_dirty = 0;
+    m_numdirty = 0;
+    m_next = 0;
+    m_haslistener = false;
+    m_listenerdirty = false;
+    m_listenertime = -1.0;
+    m_lastflush = 0.0;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+FMOD_RESULT SpatialUpdater::init(FMOD::System *system, int maxemitters, float epsilon, SPATIAL_CLOCK clock)
+{
+    FMOD_RESULT result;
+
+    m_system = system;
+    m_clock = clock;
+    m_epsilon = epsilon;
+
+    if (clock == SPATIAL_CLOCK_DSP)
+    {
+        int samplerate;
+
+        result = system->getMasterChannelGroup(&m_master);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+        result = system->getSoftwareFormat(&samplerate, 0, 0);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+        m_rate = (float)samplerate;
+    }
+
+    m_emitters = (SpatialEmitter *)calloc(maxemitters, sizeof(SpatialEmitter));
+    m_free = (int *)malloc(maxemitters * sizeof(int));
+    m_dirty = (int *)malloc(maxemitters * sizeof(int));
+    m_next = (int *)malloc(maxemitters * sizeof(int));
+    if (!m_emitters || !m_free || !m_dirty || !m_next)
+    {
+        release();
+        return FMOD_ERR_MEMORY;
+    }
+
+    m_maxemitters = maxemitters;
+    for (int i = 0; i < maxemitters; i++)
+    {
+        m_free[i] = maxemitters - 1 - i;    /* Hand out low slots first. */
+    }
+    m_numfree = maxemitters;
+    m_numdirty = 0;
+
+    return now(&m_lastflush);
+}
+
+void SpatialUpdater::release()
+{
+    free(m_emitters);
+    free(m_free);
+    free(m_dirty);
+    free(m_next);
+    m_emitters = 0;
+    m_free = 0;
+    m_dirty = 0;
+    m_next = 0;
+    m_maxemitters = 0;
+    m_numfree = 0;
+    m_numdirty = 0;
+}
+
+FMOD_RESULT SpatialUpdater::now(double *seconds)
+{
+    if (m_clock == SPATIAL_CLOCK_DSP)
+    {
+        unsigned long long dspclock;
+
+        FMOD_RESULT result = m_master->getDSPClock(&dspclock, 0);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+        *seconds = (double)dspclock / m_rate;
+        return FMOD_OK;
+    }
+
+    *seconds = MonotonicClock_Now();
+    return FMOD_OK;
+}
+
+void SpatialUpdater::queue(int emitter)
+{
+    SpatialEmitter *e = &m_emitters[emitter];
+
+    if (!e->queued)
+    {
+        e->queued = true;
+        m_dirty[m_numdirty++] = emitter;
+    }
+}
+
+FMOD_RESULT SpatialUpdater::setListener(const FMOD_VECTOR *position, const FMOD_VECTOR *forward, const FMOD_VECTOR *up)
+{
+    if (!m_haslistener || memcmp(position, &m_listener[0], sizeof(FMOD_VECTOR)) || memcmp(forward, &m_listener[1], sizeof(FMOD_VECTOR)) || memcmp(up, &m_listener[2], sizeof(FMOD_VECTOR)))
+    {
+        m_listener[0] = *position;
+        m_listener[1] = *forward;
+        m_listener[2] = *up;
+        m_listenerdirty = true;
+    }
+    m_haslistener = true;
+    return FMOD_OK;
+}
+
+int SpatialUpdater::addEmitter(FMOD::Channel *channel, const FMOD_VECTOR *position)
+{
+    if (!m_numfree)
+    {
+        return -1;
+    }
+
+    int emitter = m_free[--m_numfree];
+    SpatialEmitter *e = &m_emitters[emitter];
+
+    e->channel = channel;
+    e->position = *position;
+    e->lastposition = *position;
+    e->lasttime = -1.0;
+    e->sentvelocity = gSpatialZero;
+    e->active = true;
+    e->reset = true;
+    queue(emitter);
+
+    return emitter;
+}
+
+void SpatialUpdater::removeEmitter(int emitter)
+{
+    SpatialEmitter *e = &m_emitters[emitter];
+
+    /*
+        If it's still on the dirty list flush skips it, or picks it up again if the slot is reused first.
+    */
+    e->active = false;
+    e->channel = 0;
+    m_free[m_numfree++] = emitter;
+}
+
+void SpatialUpdater::setChannel(int emitter, FMOD::Channel *channel)
+{
+    SpatialEmitter *e = &m_emitters[emitter];
+
+    e->channel = channel;
+    e->reset = true;
+    queue(emitter);
+}
+
+void SpatialUpdater::setPosition(int emitter, const FMOD_VECTOR *position)
+{
+    SpatialEmitter *e = &m_emitters[emitter];
+
+    e->position = *position;
+    queue(emitter);
+}
+
+const FMOD_VECTOR *SpatialUpdater::getVelocity(int emitter) const
+{
+    return &m_emitters[emitter].sentvelocity;
+}
+
+FMOD_RESULT SpatialUpdater::flush()
+{
+    FMOD_RESULT result;
+    double time;
+
+    result = now(&time);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_stats.emitters = m_maxemitters - m_numfree;
+    m_stats.examined = 0;
+    m_stats.sent = 0;
+    m_stats.listenersent = false;
+    m_stats.elapsed = (float)(time - m_lastflush);
+    m_lastflush = time;
+
+    float epsilon2 = m_epsilon * m_epsilon;
+
+    /*
+        The listener. It is looked at every flush while it has a velocity, so stopping zeroes it.
+    */
+    if (m_listenerdirty)
+    {
+        double elapsed = time - m_listenertime;
+
+        if (m_listenertime < 0.0 || elapsed > 0.0)
+        {
+            if (m_listenertime < 0.0)
+            {
+                m_listenervelocity = gSpatialZero;
+            }
+            else
+            {
+                SpatialUpdate_Velocity(&m_listener[0], &m_listenerlast, elapsed, &m_listenervelocity);
+            }
+            m_listenerlast = m_listener[0];
+            m_listenertime = time;
+
+            result = m_system->set3DListenerAttributes(0, &m_listener[0], &m_listenervelocity, &m_listener[1], &m_listener[2]);
+            if (result != FMOD_OK)
+            {
+                return result;
+            }
+            m_stats.listenersent = true;
+            m_listenerdirty = !SpatialUpdate_IsZero(&m_listenervelocity);
+        }
+    }
+
+    /*
+        Dirty emitters. Ones with a velocity are carried over to the next flush, if they don't move again it
+        drops to zero and is sent.
+    */
+    FMOD_RESULT error = FMOD_OK;
+    int numnext = 0;
+
+    for (int i = 0; i < m_numdirty; i++)
+    {
+        int emitter = m_dirty[i];
+        SpatialEmitter *e = &m_emitters[emitter];
+
+        if (!e->active)
+        {
+            e->queued = false;
+            continue;
+        }
+        m_stats.examined++;
+
+        double elapsed = time - e->lasttime;
+        FMOD_VECTOR velocity;
+
+        if (e->reset || e->lasttime < 0.0)
+        {
+            velocity = gSpatialZero;
+        }
+        else if (elapsed > 0.0)
+        {
+            SpatialUpdate_Velocity(&e->position, &e->lastposition, elapsed, &velocity);
+        }
+        else
+        {
+            m_next[numnext++] = emitter;    /* The DSP clock hasn't moved yet. */
+            continue;
+        }
+        e->lastposition = e->position;
+        e->lasttime = time;
+
+        /*
+            Coming to a stop is always sent, even when the last velocity sent is within epsilon of zero. Otherwise
+            that velocity would never be cleared, and the emitter would stay queued for good.
+        */
+        bool send = e->reset ||
+                    SpatialUpdate_DistanceSquared(&e->position, &e->sentposition) > epsilon2 ||
+                    SpatialUpdate_DistanceSquared(&velocity, &e->sentvelocity) > epsilon2 ||
+                    (SpatialUpdate_IsZero(&velocity) && !SpatialUpdate_IsZero(&e->sentvelocity));
+
+        if (send && e->channel)
+        {
+            result = e->channel->set3DAttributes(&e->position, &velocity);
+            if (result == FMOD_ERR_INVALID_HANDLE || result == FMOD_ERR_CHANNEL_STOLEN)
+            {
+                e->channel = 0;     /* The voice has gone, setChannel gives it a new one. */
+            }
+            else if (result != FMOD_OK && error == FMOD_OK)
+            {
+                error = result;
+            }
+            m_stats.sent++;
+        }
+        if (send)
+        {
+            e->sentposition = e->position;
+            e->sentvelocity = velocity;
+            e->reset = false;
+        }
+
+        if (!SpatialUpdate_IsZero(&velocity) || !SpatialUpdate_IsZero(&e->sentvelocity))
+        {
+            m_next[numnext++] = emitter;
+        }
+        else
+        {
+            e->queued = false;
+        }
+    }
+
+    int *swap = m_dirty;
+    m_dirty = m_next;
+    m_next = swap;
+    m_numdirty = numnext;
+
+    return error;
+}
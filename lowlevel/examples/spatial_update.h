@@ -0,0 +1,109 @@
+/*==============================================================================
+Spatial Update
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Batches 3D listener and emitter updates and works out their velocities.
+
+Positions are handed in whenever the game moves something, and flush, called
+once a frame before System::update, makes the set3DAttributes calls. Only
+emitters that were moved are looked at, and of those only ones that moved
+further than the epsilon, or whose velocity changed by more than the epsilon
+per second, are sent to FMOD. Thousands of mostly still emitters cost a
+handful of calls a frame.
+
+Velocity is the distance moved since the emitter was last looked at, over the
+time that actually passed, not an assumed frame length. A frame that stalls
+for 200ms gets a fifth of the velocity a 40ms frame would for the same
+distance, so doppler stays right. An emitter that stops is sent once more with
+its velocity back at zero, without the caller having to move it again.
+
+The time comes from a monotonic clock by default. SPATIAL_CLOCK_DSP uses the
+master channel group's DSP clock instead, the mixer's own idea of time. It
+moves in whole mix blocks, so frames where it hasn't moved are skipped and
+picked up on the next one.
+==============================================================================*/
+#ifndef _SPATIAL_UPDATE_H
+#define _SPATIAL_UPDATE_H
+
+#include "fmod.hpp"
+
+enum SPATIAL_CLOCK
+{
+    SPATIAL_CLOCK_MONOTONIC,
+    SPATIAL_CLOCK_DSP
+};
+
+struct SpatialEmitter
+{
+    FMOD::Channel      *channel;
+    FMOD_VECTOR         position;           /* Latest from setPosition. */
+    FMOD_VECTOR         lastposition;       /* When velocity was last worked out. */
+    double              lasttime;
+    FMOD_VECTOR         sentposition;       /* What FMOD has. */
+    FMOD_VECTOR         sentvelocity;
+    bool                active;
+    bool                queued;             /* On the dirty list. */
+    bool                reset;              /* Send next flush whatever the epsilon, with zero velocity. */
+};
+
+struct SpatialUpdateStats
+{
+    int                 emitters;           /* In use. */
+    int                 examined;           /* Dirty emitters looked at in the last flush. */
+    int                 sent;               /* set3DAttributes calls in the last flush. */
+    bool                listenersent;
+    float               elapsed;            /* Seconds the last flush's velocities were measured over. */
+};
+
+class SpatialUpdater
+{
+public:
+    SpatialUpdater();
+
+    /*
+        'epsilon' is in the same units as positions, see System::set3DSettings' distance factor.
+    */
+    FMOD_RESULT init(FMOD::System *system, int maxemitters, float epsilon, SPATIAL_CLOCK clock);
+    void        release();
+
+    FMOD_RESULT setListener(const FMOD_VECTOR *position, const FMOD_VECTOR *forward, const FMOD_VECTOR *up);
+
+    int         addEmitter(FMOD::Channel *channel, const FMOD_VECTOR *position);   /* -1 if full. */
+    void        removeEmitter(int emitter);
+    void        setChannel(int emitter, FMOD::Channel *channel);                 /* New voice, sent next flush. */
+    void        setPosition(int emitter, const FMOD_VECTOR *position);
+    const FMOD_VECTOR *getVelocity(int emitter) const;
+
+    FMOD_RESULT flush();
+    void        getStats(SpatialUpdateStats *stats) const   { *stats = m_stats; }
+
+private:
+    FMOD_RESULT now(double *seconds);
+    void        queue(int emitter);
+
+    FMOD::System       *m_system;
+    FMOD::ChannelGroup *m_master;
+    SPATIAL_CLOCK       m_clock;
+    float               m_rate;             /* DSP clock ticks per second. */
+    float               m_epsilon;
+
+    SpatialEmitter     *m_emitters;
+    int                 m_maxemitters;
+    int                *m_free;             /* Stack of unused emitter slots. */
+    int                 m_numfree;
+    int                *m_dirty;
+    int                 m_numdirty;
+    int                *m_next;             /* Emitters still moving, carried to the next flush. */
+
+    bool                m_haslistener;
+    bool                m_listenerdirty;
+    FMOD_VECTOR         m_listener[3];      /* Position, forward, up. */
+    FMOD_VECTOR         m_listenerlast;
+    double              m_listenertime;
+    FMOD_VECTOR         m_listenervelocity;
+
+    double              m_lastflush;
+    SpatialUpdateStats  m_stats;
+};
+
+#endif
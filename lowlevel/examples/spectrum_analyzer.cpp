@@ -0,0 +1,411 @@
+/*==============================================================================
+Spectrum Analyzer
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "spectrum_analyzer.h"
+#include "monotonic_clock.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define SPECTRUM_ANALYZER_FRESH     4
+
+/*
+    Periodic Hann, returns 2 / the sum of the window to scale magnitudes by.
+*/
+static float SpectrumAnalyzer_Hann(float *window, int size)
+{
+    double sum = 0.0;
+
+    for (int i = 0; i < size; i++)
+    {
+        window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / size));
+        sum += window[i];
+    }
+
+    return (float)(2.0 / sum);
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer()
+{
+    m_size = 0;
+    m_hop = 0;
+    m_memory = 0;
+    m_window = 0;
+    m_window_scale = 0.0f;
+    m_history = 0;
+    m_filled = 0;
+    m_re = 0;
+    m_im = 0;
+    m_ring = 0;
+    m_capacity = 0;
+    m_write = 0;
+    m_read = 0;
+    memset(m_slots, 0, sizeof(m_slots));
+    m_back = 2;
+    m_middle = 1;
+    m_front = 0;
+    m_frames = 0;
+    m_dropped = 0;
+    m_cost = 0.0f;
+    m_running = false;
+    m_quit = false;
+}
+
+FMOD_RESULT SpectrumAnalyzer::init(int size, int hop, int samplerate)
+{
+    FMOD_RESULT result;
+
+    if (hop == 0)
+    {
+        hop = size / 2;
+    }
+    if (hop < 1 || hop > size)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    result = m_fft.init(size);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_capacity = SPECTRUM_ANALYZER_MIN_RING;
+    while (m_capacity < 4 * (unsigned int)size)
+    {
+        m_capacity *= 2;
+    }
+
+    int numbins = size / 2 + 1;
+    m_memory = (float *)calloc(2 * size + 5 * numbins + m_capacity, sizeof(float));
+    if (!m_memory)
+    {
+        m_fft.release();
+        return FMOD_ERR_MEMORY;
+    }
+
+    m_size = size;
+    m_hop = hop;
+    m_window = m_memory;
+    m_history = m_window + size;
+    m_re = m_history + size;
+    m_im = m_re + numbins;
+    m_ring = m_im + numbins;
+    m_filled = 0;
+    m_write = 0;
+    m_read = 0;
+    m_window_scale = SpectrumAnalyzer_Hann(m_window, size);
+
+    for (int i = 0; i < 3; i++)
+    {
+        m_slots[i].size = size;
+        m_slots[i].numbins = numbins;
+        m_slots[i].samplerate = samplerate;
+        m_slots[i].sequence = 0;
+        m_slots[i].rms = 0.0f;
+        m_slots[i].peak = 0.0f;
+        m_slots[i].spectrum = m_ring + m_capacity + i * numbins;
+    }
+    m_back = 2;
+    m_middle = 1;
+    m_front = 0;
+    m_frames = 0;
+    m_dropped = 0;
+    m_cost = 0.0f;
+
+    m_quit = false;
+    if (pthread_create(&m_thread, 0, threadMain, this) != 0)
+    {
+        release();
+        return FMOD_ERR_MEMORY;
+    }
+    m_running = true;
+
+    return FMOD_OK;
+}
+
+void SpectrumAnalyzer::release()
+{
+    if (m_running)
+    {
+        __atomic_store_n(&m_quit, true, __ATOMIC_RELEASE);
+        pthread_join(m_thread, 0);
+        m_running = false;
+    }
+
+    m_fft.release();
+    free(m_memory);
+    m_memory = 0;
+    m_size = 0;
+}
+
+void SpectrumAnalyzer::describe(FMOD_DSP_DESCRIPTION *desc)
+{
+    FMOD_DSP_INIT_PARAMDESC_DATA(m_param, "Spectrum", "", "Read only. The latest SpectrumData.", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+    m_params[SPECTRUM_ANALYZER_PARAM_SPECTRUM] = &m_param;
+
+    memset(desc, 0, sizeof(FMOD_DSP_DESCRIPTION));
+    strncpy(desc->name, "Spectrum Analyzer", sizeof(desc->name));
+    desc->version = 0x00010000;
+    desc->numinputbuffers = 1;
+    desc->numoutputbuffers = 1;
+    desc->read = readCallback;
+    desc->numparameters = SPECTRUM_ANALYZER_NUM_PARAMETERS;
+    desc->paramdesc = m_params;
+    desc->getparameterdata = getParamDataCallback;
+    desc->userdata = this;
+}
+
+void SpectrumAnalyzer::getStats(SpectrumAnalyzerStats *stats) const
+{
+    stats->frames  = __atomic_load_n(&m_frames, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&m_dropped, __ATOMIC_RELAXED);
+    __atomic_load(&m_cost, &stats->cost, __ATOMIC_RELAXED);
+}
+
+float SpectrumAnalyzer::benchmark(int size, int iterations)
+{
+    RealFFT fft;
+
+    if (fft.init(size) != FMOD_OK || iterations < 1)
+    {
+        return 0.0f;
+    }
+
+    float *memory = (float *)malloc((2 * size + 2 * (size / 2 + 1)) * sizeof(float));
+    if (!memory)
+    {
+        fft.release();
+        return 0.0f;
+    }
+
+    float *in = memory;
+    float *window = in + size;
+    float *re = window + size;
+    float *im = re + size / 2 + 1;
+
+    SpectrumAnalyzer_Hann(window, size);
+    for (int i = 0; i < size; i++)
+    {
+        in[i] = sinf(0.1f * i) + 0.25f * sinf(0.37f * i);
+    }
+
+    /*
+        One untimed run to fault everything in.
+    */
+    fft.forward(in, window, re, im);
+
+    double start = MonotonicClock_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        fft.forward(in, window, re, im);
+    }
+    double elapsed = MonotonicClock_Now() - start;
+
+    free(memory);
+    fft.release();
+
+    return (float)(elapsed * 1e6 / iterations);
+}
+
+void SpectrumAnalyzer::write(const float *inbuffer, unsigned int length, int channels)
+{
+    unsigned int space = m_capacity - (m_write - __atomic_load_n(&m_read, __ATOMIC_ACQUIRE));
+
+    /*
+        Never wait on the analysis thread. A partial block would put a discontinuity in a frame, so drop all of it.
+    */
+    if (length > space)
+    {
+        __atomic_store_n(&m_dropped, m_dropped + length, __ATOMIC_RELAXED);
+        return;
+    }
+
+    unsigned int mask = m_capacity - 1;
+    unsigned int write = m_write;
+
+    if (channels == 1)
+    {
+        unsigned int offset = write & mask;
+        unsigned int first = (length < m_capacity - offset) ? length : m_capacity - offset;
+
+        memcpy(m_ring + offset, inbuffer, first * sizeof(float));
+        memcpy(m_ring, inbuffer + first, (length - first) * sizeof(float));
+    }
+    else
+    {
+        float scale = 1.0f / channels;
+
+        for (unsigned int i = 0; i < length; i++)
+        {
+            float sum = 0.0f;
+            for (int chan = 0; chan < channels; chan++)
+            {
+                sum += inbuffer[i * channels + chan];
+            }
+            m_ring[(write + i) & mask] = sum * scale;
+        }
+    }
+
+    __atomic_store_n(&m_write, write + length, __ATOMIC_RELEASE);
+}
+
+bool SpectrumAnalyzer::fill()
+{
+    unsigned int available = __atomic_load_n(&m_write, __ATOMIC_ACQUIRE) - m_read;
+    unsigned int count = m_size - m_filled;
+
+    if (count > available)
+    {
+        count = available;
+    }
+
+    unsigned int offset = m_read & (m_capacity - 1);
+    unsigned int first = (count < m_capacity - offset) ? count : m_capacity - offset;
+
+    memcpy(m_history + m_filled, m_ring + offset, first * sizeof(float));
+    memcpy(m_history + m_filled + first, m_ring, (count - first) * sizeof(float));
+
+    __atomic_store_n(&m_read, m_read + count, __ATOMIC_RELEASE);
+    m_filled += count;
+
+    return m_filled == m_size;
+}
+
+void SpectrumAnalyzer::analyze()
+{
+    SpectrumData *slot = &m_slots[m_back];
+    const int numbins = slot->numbins;
+    float *spectrum = slot->spectrum;
+    double start = MonotonicClock_Now();
+
+    m_fft.forward(m_history, m_window, m_re, m_im);
+
+    int k = 0;
+#if defined(__SSE2__)
+    __m128 scale = _mm_set1_ps(m_window_scale);
+    for (; k + 4 <= numbins; k += 4)
+    {
+        __m128 re = _mm_loadu_ps(m_re + k);
+        __m128 im = _mm_loadu_ps(m_im + k);
+        _mm_storeu_ps(spectrum + k, _mm_mul_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im))), scale));
+    }
+#endif
+    for (; k < numbins; k++)
+    {
+        spectrum[k] = sqrtf(m_re[k] * m_re[k] + m_im[k] * m_im[k]) * m_window_scale;
+    }
+
+    /*
+        DC and Nyquist have no mirror image, so they don't get the factor of two.
+    */
+    spectrum[0] *= 0.5f;
+    spectrum[numbins - 1] *= 0.5f;
+
+    float sum = 0.0f, peak = 0.0f;
+    for (int i = 0; i < m_size; i++)
+    {
+        float sample = m_history[i];
+        sum += sample * sample;
+        peak = (fabsf(sample) > peak) ? fabsf(sample) : peak;
+    }
+    slot->rms = sqrtf(sum / m_size);
+    slot->peak = peak;
+
+    float cost = (float)((MonotonicClock_Now() - start) * 1e6);
+    float average = m_frames ? m_cost + (cost - m_cost) * 0.05f : cost;
+    __atomic_store(&m_cost, &average, __ATOMIC_RELAXED);
+
+    slot->sequence = m_frames + 1;
+    __atomic_store_n(&m_frames, m_frames + 1, __ATOMIC_RELAXED);
+
+    /*
+        Publish, and take back whichever slot the reader isn't holding.
+    */
+    m_back = __atomic_exchange_n(&m_middle, m_back | SPECTRUM_ANALYZER_FRESH, __ATOMIC_ACQ_REL) & 3;
+
+    memmove(m_history, m_history + m_hop, (m_size - m_hop) * sizeof(float));
+    m_filled = m_size - m_hop;
+}
+
+const SpectrumData *SpectrumAnalyzer::latest()
+{
+    if (__atomic_load_n(&m_middle, __ATOMIC_ACQUIRE) & SPECTRUM_ANALYZER_FRESH)
+    {
+        m_front = __atomic_exchange_n(&m_middle, m_front, __ATOMIC_ACQ_REL) & 3;
+    }
+
+    return &m_slots[m_front];
+}
+
+void *SpectrumAnalyzer::threadMain(void *arg)
+{
+    SpectrumAnalyzer *analyzer = (SpectrumAnalyzer *)arg;
+
+    while (!__atomic_load_n(&analyzer->m_quit, __ATOMIC_ACQUIRE))
+    {
+        if (analyzer->fill())
+        {
+            analyzer->analyze();
+        }
+        else
+        {
+            /*
+                The mixer can't signal us without risking a wait, so poll.
+            */
+            usleep(SPECTRUM_ANALYZER_POLL_MS * 1000);
+        }
+    }
+
+    return 0;
+}
+
+FMOD_RESULT F_CALLBACK SpectrumAnalyzer::readCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+{
+    SpectrumAnalyzer *analyzer;
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&analyzer);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    memcpy(outbuffer, inbuffer, length * inchannels * sizeof(float));
+    analyzer->write(inbuffer, length, inchannels);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK SpectrumAnalyzer::getParamDataCallback(FMOD_DSP_STATE *dsp_state, int index, void **data, unsigned int *length, char *valuestr)
+{
+    SpectrumAnalyzer *analyzer;
+
+    if (index != SPECTRUM_ANALYZER_PARAM_SPECTRUM)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    FMOD_RESULT result = ((FMOD::DSP *)dsp_state->instance)->getUserData((void **)&analyzer);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    const SpectrumData *spectrum = analyzer->latest();
+
+    *data = (void *)spectrum;
+    *length = sizeof(SpectrumData);
+    if (valuestr) sprintf(valuestr, "%d bins", spectrum->numbins);
+
+    return FMOD_OK;
+}
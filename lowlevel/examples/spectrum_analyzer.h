@@ -0,0 +1,124 @@
+/*==============================================================================
+Spectrum Analyzer
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+A DSP that measures the spectrum of whatever passes through it, without
+doing the analysis on the mixer thread. The read callback passes the audio
+through, mixes it down to mono and copies it into a single producer, single
+consumer ring. That is all the mixer pays for. If the ring is full the block
+is dropped and counted rather than waiting.
+
+An analysis thread takes overlapping frames out of the ring, windows them,
+runs a RealFFT (see real_fft.h) and converts the bins to magnitudes. Each
+result is published through a triple buffer: the thread always has a slot to
+write to and the reader always has a complete one to look at, and neither
+ever waits for the other.
+
+Read the latest result with DSP::getParameterData on
+SPECTRUM_ANALYZER_PARAM_SPECTRUM, which returns a SpectrumData. It stays
+valid until the next call, so only one thread should read it.
+==============================================================================*/
+#ifndef _SPECTRUM_ANALYZER_H
+#define _SPECTRUM_ANALYZER_H
+
+#include "fmod.hpp"
+#include "real_fft.h"
+#include <pthread.h>
+
+#define SPECTRUM_ANALYZER_MIN_RING      16384   /* Samples, grown to at least four frames. */
+#define SPECTRUM_ANALYZER_POLL_MS       2
+
+enum
+{
+    SPECTRUM_ANALYZER_PARAM_SPECTRUM = 0,
+    SPECTRUM_ANALYZER_NUM_PARAMETERS
+};
+
+struct SpectrumData
+{
+    int             size;           /* FFT size. */
+    int             numbins;        /* size / 2 + 1, DC to Nyquist. */
+    int             samplerate;
+    unsigned int    sequence;       /* Frames analyzed when this was written, 0 = nothing yet. */
+    float           rms;            /* Of the frame, before windowing. */
+    float           peak;
+    float          *spectrum;       /* Linear magnitudes, a full scale sine reads 1. */
+};
+
+struct SpectrumAnalyzerStats
+{
+    unsigned int    frames;         /* FFTs run. */
+    unsigned int    dropped;        /* Samples the ring had no room for. */
+    float           cost;           /* Microseconds per frame, window to magnitudes, averaged. */
+};
+
+class SpectrumAnalyzer
+{
+public:
+    SpectrumAnalyzer();
+
+    /*
+        'hop' 0 = size / 2. Starts the analysis thread.
+    */
+    FMOD_RESULT init(int size, int hop, int samplerate);
+    void        release();                  /* Only once the DSP is released. */
+
+    /*
+        Fills in a description for System::createDSP, with this as the userdata.
+    */
+    void        describe(FMOD_DSP_DESCRIPTION *desc);
+    void        getStats(SpectrumAnalyzerStats *stats) const;
+
+    /*
+        Microseconds for one RealFFT::forward of 'size', window included.
+    */
+    static float benchmark(int size, int iterations);
+
+    static FMOD_RESULT F_CALLBACK readCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels);
+    static FMOD_RESULT F_CALLBACK getParamDataCallback(FMOD_DSP_STATE *dsp_state, int index, void **data, unsigned int *length, char *valuestr);
+
+private:
+    static void *threadMain(void *arg);
+    void        write(const float *inbuffer, unsigned int length, int channels);   /* Mixer thread. */
+    bool        fill();                     /* Analysis thread, true once the history holds a frame. */
+    void        analyze();
+    const SpectrumData *latest();
+
+    int                 m_size;
+    int                 m_hop;
+    RealFFT             m_fft;
+    float              *m_memory;
+    float              *m_window;
+    float               m_window_scale;     /* 2 / sum of the window. */
+    float              *m_history;          /* The frame being built, m_filled samples so far. */
+    int                 m_filled;
+    float              *m_re;
+    float              *m_im;
+
+    float              *m_ring;
+    unsigned int        m_capacity;         /* Samples, a power of two. */
+    unsigned int        m_write;            /* Free running, only written by the mixer. */
+    unsigned int        m_read;             /* Free running, only written by the analysis thread. */
+
+    /*
+        Triple buffer. m_middle holds a slot index, with SPECTRUM_ANALYZER_FRESH set when the writer put
+        it there and the reader hasn't taken it yet.
+    */
+    SpectrumData        m_slots[3];
+    int                 m_back;             /* Analysis thread's. */
+    int                 m_middle;
+    int                 m_front;            /* Reader's. */
+
+    unsigned int        m_frames;
+    unsigned int        m_dropped;
+    float               m_cost;
+
+    FMOD_DSP_PARAMETER_DESC  m_param;
+    FMOD_DSP_PARAMETER_DESC *m_params[SPECTRUM_ANALYZER_NUM_PARAMETERS];
+
+    pthread_t           m_thread;
+    bool                m_running;
+    bool                m_quit;
+};
+
+#endif
@@ -0,0 +1,473 @@
+/*==============================================================================
+Stream Bridge
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "stream_bridge.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+StreamBridge::StreamBridge()
+{
+    m_channels = 0;
+    m_format = FMOD_SOUND_FORMAT_NONE;
+    m_framesize = 0;
+    m_ring = 0;
+    m_capacity = 0;
+    m_length = 0;
+    m_read = 0;
+    m_seek = 0;
+    m_userdata = 0;
+    m_write = 0;
+    m_readpos = 0;
+    m_produced = 0;
+    m_position = 0;
+    m_seek_position = 0;
+    m_seek_requested = 0;
+    m_seek_done = 0;
+    m_seek_mark = 0;
+    m_seek_seen = 0;
+    m_underruns = 0;
+    m_silence = 0;
+    m_seeks = 0;
+    m_error = false;
+    m_next = 0;
+    m_busy = false;
+}
+
+FMOD_RESULT StreamBridge::init(int channels, FMOD_SOUND_FORMAT format, unsigned int ringsamples, unsigned int length, StreamBridgeRead read, StreamBridgeSeek seek, void *userdata)
+{
+    int bytes;
+
+    switch (format)
+    {
+        case FMOD_SOUND_FORMAT_PCM8:     bytes = 1; break;
+        case FMOD_SOUND_FORMAT_PCM16:    bytes = 2; break;
+        case FMOD_SOUND_FORMAT_PCM24:    bytes = 3; break;
+        case FMOD_SOUND_FORMAT_PCM32:
+        case FMOD_SOUND_FORMAT_PCMFLOAT: bytes = 4; break;
+        default:                         return FMOD_ERR_FORMAT;
+    }
+    if (channels < 1 || !read)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    /*
+        Power of two so the free running counters can be masked, and room for at least two chunks.
+    */
+    m_capacity = 2 * STREAM_BRIDGE_CHUNK;
+    while (m_capacity < ringsamples)
+    {
+        m_capacity *= 2;
+    }
+
+    m_channels = channels;
+    m_format = format;
+    m_framesize = bytes * channels;
+    m_length = seek ? length : 0;
+    m_read = read;
+    m_seek = seek;
+    m_userdata = userdata;
+
+    m_ring = (char *)malloc(m_capacity * m_framesize);
+    if (!m_ring)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    return FMOD_OK;
+}
+
+void StreamBridge::release()
+{
+    free(m_ring);
+    m_ring = 0;
+}
+
+void StreamBridge::setupExInfo(FMOD_CREATESOUNDEXINFO *exinfo)
+{
+    exinfo->numchannels       = m_channels;
+    exinfo->format            = m_format;
+    exinfo->pcmreadcallback   = pcmReadCallback;
+    exinfo->pcmsetposcallback = pcmSetPosCallback;
+    exinfo->userdata          = this;
+}
+
+void StreamBridge::getStats(StreamBridgeStats *stats) const
+{
+    stats->fill      = __atomic_load_n(&m_write, __ATOMIC_RELAXED) - __atomic_load_n(&m_readpos, __ATOMIC_RELAXED);
+    stats->capacity  = m_capacity;
+    stats->underruns = __atomic_load_n(&m_underruns, __ATOMIC_RELAXED);
+    stats->silence   = __atomic_load_n(&m_silence, __ATOMIC_RELAXED);
+    stats->seeks     = __atomic_load_n(&m_seeks, __ATOMIC_RELAXED);
+}
+
+unsigned int StreamBridge::space() const
+{
+    return m_capacity - (m_write - __atomic_load_n(&m_readpos, __ATOMIC_ACQUIRE));
+}
+
+bool StreamBridge::needsWork() const
+{
+    if (m_error)
+    {
+        return false;
+    }
+    return __atomic_load_n(&m_seek_requested, __ATOMIC_ACQUIRE) != m_seek_done || space() >= STREAM_BRIDGE_CHUNK;
+}
+
+FMOD_RESULT StreamBridge::produce()
+{
+    FMOD_RESULT result;
+
+    unsigned int requested = __atomic_load_n(&m_seek_requested, __ATOMIC_ACQUIRE);
+    if (requested != m_seek_done)
+    {
+        /*
+            Read the position until it's stable against the request count, another seek may land in between.
+        */
+        unsigned int position;
+        do
+        {
+            requested = __atomic_load_n(&m_seek_requested, __ATOMIC_ACQUIRE);
+            position = __atomic_load_n(&m_seek_position, __ATOMIC_RELAXED);
+        } while (requested != __atomic_load_n(&m_seek_requested, __ATOMIC_ACQUIRE));
+
+        if (m_seek)
+        {
+            result = m_seek(m_userdata, position);
+            if (result != FMOD_OK)
+            {
+                m_error = true;
+                return result;
+            }
+        }
+        m_produced = position;
+
+        /*
+            Anything written before this mark is from the old position and the consumer will skip it.
+        */
+        __atomic_store_n(&m_seek_mark, m_write, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_seek_done, requested, __ATOMIC_RELEASE);
+    }
+
+    unsigned int count = space();
+    unsigned int offset = m_write & (m_capacity - 1);
+
+    if (count > STREAM_BRIDGE_CHUNK)
+    {
+        count = STREAM_BRIDGE_CHUNK;
+    }
+    if (count > m_capacity - offset)
+    {
+        count = m_capacity - offset;
+    }
+    if (m_length && count > m_length - m_produced)
+    {
+        count = m_length - m_produced;
+    }
+    if (!count)
+    {
+        return FMOD_OK;
+    }
+
+    result = m_read(m_userdata, m_ring + offset * m_framesize, count * m_framesize);
+    if (result != FMOD_OK)
+    {
+        m_error = true;
+        return result;
+    }
+
+    m_produced += count;
+    if (m_length && m_produced >= m_length)
+    {
+        /*
+            Wrap here rather than have FMOD seek us, the data carries straight on in the ring.
+        */
+        result = m_seek(m_userdata, 0);
+        if (result != FMOD_OK)
+        {
+            m_error = true;
+            return result;
+        }
+        m_produced = 0;
+    }
+
+    __atomic_store_n(&m_write, m_write + count, __ATOMIC_RELEASE);
+    return FMOD_OK;
+}
+
+FMOD_RESULT StreamBridge::consume(void *data, unsigned int datalen)
+{
+    unsigned int frames = datalen / m_framesize;
+    unsigned int readpos = m_readpos;
+    char *dest = (char *)data;
+
+    unsigned int done = __atomic_load_n(&m_seek_done, __ATOMIC_ACQUIRE);
+    if (done != m_seek_seen)
+    {
+        readpos = __atomic_load_n(&m_seek_mark, __ATOMIC_RELAXED);
+        m_seek_seen = done;
+    }
+
+    if (__atomic_load_n(&m_seek_requested, __ATOMIC_RELAXED) != m_seek_seen)
+    {
+        /*
+            Still waiting on the producer to reposition, play silence rather than audio from the old position.
+        */
+        __atomic_store_n(&m_readpos, readpos, __ATOMIC_RELEASE);
+        memset(data, 0, datalen);
+        return FMOD_OK;
+    }
+
+    unsigned int available = __atomic_load_n(&m_write, __ATOMIC_ACQUIRE) - readpos;
+    unsigned int count = (available < frames) ? available : frames;
+    unsigned int offset = readpos & (m_capacity - 1);
+    unsigned int first = (count < m_capacity - offset) ? count : m_capacity - offset;
+
+    memcpy(dest, m_ring + offset * m_framesize, first * m_framesize);
+    memcpy(dest + first * m_framesize, m_ring, (count - first) * m_framesize);
+
+    __atomic_store_n(&m_readpos, readpos + count, __ATOMIC_RELEASE);
+
+    m_position += count;
+    if (m_length && m_position >= m_length)
+    {
+        m_position -= m_length;
+    }
+
+    if (count < frames)
+    {
+        memset(dest + count * m_framesize, 0, datalen - count * m_framesize);
+        __atomic_store_n(&m_underruns, m_underruns + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_silence, m_silence + (frames - count), __ATOMIC_RELAXED);
+    }
+
+    return FMOD_OK;
+}
+
+void StreamBridge::requestSeek(unsigned int position)
+{
+    m_position = position;
+    __atomic_store_n(&m_seek_position, position, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&m_seek_requested, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&m_seeks, 1, __ATOMIC_RELAXED);
+}
+
+FMOD_RESULT F_CALLBACK StreamBridge::pcmReadCallback(FMOD_SOUND *sound, void *data, unsigned int datalen)
+{
+    StreamBridge *bridge;
+
+    FMOD_RESULT result = ((FMOD::Sound *)sound)->getUserData((void **)&bridge);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    return bridge->consume(data, datalen);
+}
+
+FMOD_RESULT F_CALLBACK StreamBridge::pcmSetPosCallback(FMOD_SOUND *sound, int subsound, unsigned int position, FMOD_TIMEUNIT postype)
+{
+    StreamBridge *bridge;
+
+    if (postype != FMOD_TIMEUNIT_PCM)
+    {
+        return FMOD_OK;
+    }
+
+    FMOD_RESULT result = ((FMOD::Sound *)sound)->getUserData((void **)&bridge);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    /*
+        FMOD seeks to 0 as the stream opens, and back to the start each time it loops. The producer has already
+        wrapped there, so the ring holds the right data and isn't thrown away.
+    */
+    if (bridge->m_length)
+    {
+        position %= bridge->m_length;
+    }
+    if (position == bridge->m_position)
+    {
+        return FMOD_OK;
+    }
+
+    bridge->requestSeek(position);
+    return FMOD_OK;
+}
+
+StreamProducer::StreamProducer()
+{
+    m_num_threads = 0;
+    m_bridges = 0;
+    m_quit = false;
+}
+
+FMOD_RESULT StreamProducer::init(int numthreads)
+{
+    if (numthreads <= 0)
+    {
+        numthreads = 1;
+    }
+    if (numthreads > STREAM_PRODUCER_MAX_THREADS)
+    {
+        numthreads = STREAM_PRODUCER_MAX_THREADS;
+    }
+
+    pthread_mutex_init(&m_lock, 0);
+    pthread_cond_init(&m_wake, 0);
+    pthread_cond_init(&m_idle, 0);
+    m_quit = false;
+
+    for (m_num_threads = 0; m_num_threads < numthreads; m_num_threads++)
+    {
+        if (pthread_create(&m_threads[m_num_threads], 0, threadMain, this) != 0)
+        {
+            release();
+            return FMOD_ERR_MEMORY;
+        }
+    }
+
+    return FMOD_OK;
+}
+
+void StreamProducer::release()
+{
+    pthread_mutex_lock(&m_lock);
+    m_quit = true;
+    pthread_cond_broadcast(&m_wake);
+    pthread_mutex_unlock(&m_lock);
+
+    for (int i = 0; i < m_num_threads; i++)
+    {
+        pthread_join(m_threads[i], 0);
+    }
+    m_num_threads = 0;
+
+    pthread_cond_destroy(&m_idle);
+    pthread_cond_destroy(&m_wake);
+    pthread_mutex_destroy(&m_lock);
+}
+
+FMOD_RESULT StreamProducer::add(StreamBridge *bridge)
+{
+    /*
+        Nobody else can see the bridge yet, so prime it on this thread.
+    */
+    while (bridge->needsWork())
+    {
+        FMOD_RESULT result = bridge->produce();
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    pthread_mutex_lock(&m_lock);
+    bridge->m_busy = false;
+    bridge->m_next = m_bridges;
+    m_bridges = bridge;
+    pthread_cond_signal(&m_wake);
+    pthread_mutex_unlock(&m_lock);
+
+    return FMOD_OK;
+}
+
+void StreamProducer::remove(StreamBridge *bridge)
+{
+    pthread_mutex_lock(&m_lock);
+
+    while (bridge->m_busy)
+    {
+        pthread_cond_wait(&m_idle, &m_lock);
+    }
+
+    StreamBridge **link = &m_bridges;
+    while (*link && *link != bridge)
+    {
+        link = &(*link)->m_next;
+    }
+    if (*link)
+    {
+        *link = bridge->m_next;
+    }
+
+    pthread_mutex_unlock(&m_lock);
+}
+
+StreamBridge *StreamProducer::claim()
+{
+    StreamBridge *best = 0;
+    unsigned int bestspace = 0;
+
+    /*
+        Emptiest ring first, a pending seek beats everything since that stream is outputting silence.
+    */
+    for (StreamBridge *bridge = m_bridges; bridge; bridge = bridge->m_next)
+    {
+        if (bridge->m_busy || !bridge->needsWork())
+        {
+            continue;
+        }
+
+        unsigned int space = bridge->space();
+        if (__atomic_load_n(&bridge->m_seek_requested, __ATOMIC_ACQUIRE) != bridge->m_seek_done)
+        {
+            space = bridge->m_capacity + 1;
+        }
+        if (!best || space > bestspace)
+        {
+            best = bridge;
+            bestspace = space;
+        }
+    }
+
+    return best;
+}
+
+void *StreamProducer::threadMain(void *arg)
+{
+    StreamProducer *producer = (StreamProducer *)arg;
+
+    pthread_mutex_lock(&producer->m_lock);
+    while (!producer->m_quit)
+    {
+        StreamBridge *bridge = producer->claim();
+        if (!bridge)
+        {
+            /*
+                The stream thread never signals us, it isn't allowed to take a lock, so poll for space.
+            */
+            struct timeval now;
+            struct timespec until;
+
+            gettimeofday(&now, 0);
+            until.tv_sec = now.tv_sec;
+            until.tv_nsec = (now.tv_usec + STREAM_PRODUCER_POLL_MS * 1000) * 1000;
+            if (until.tv_nsec >= 1000000000)
+            {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+
+            pthread_cond_timedwait(&producer->m_wake, &producer->m_lock, &until);
+            continue;
+        }
+
+        bridge->m_busy = true;
+        pthread_mutex_unlock(&producer->m_lock);
+
+        bridge->produce();
+
+        pthread_mutex_lock(&producer->m_lock);
+        bridge->m_busy = false;
+        pthread_cond_broadcast(&producer->m_idle);
+    }
+    pthread_mutex_unlock(&producer->m_lock);
+
+    return 0;
+}
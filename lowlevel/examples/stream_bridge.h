@@ -0,0 +1,125 @@
+/*==============================================================================
+Stream Bridge
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Decouples a user created stream from whatever generates its audio. The
+generator runs on a StreamProducer thread and writes into a single producer,
+single consumer ring. The stream's pcmreadcallback, on FMOD's stream thread,
+only copies out of the ring. It never waits. If the ring runs dry it outputs
+silence for the missing part and counts an underrun.
+
+Seeking through pcmsetposcallback doesn't touch the ring directly. It posts
+the new position and the stream outputs silence until the producer has
+repositioned the generator and marked where the new data starts. The reader
+then skips straight to that mark, so old and new audio are never mixed in the
+same block.
+
+Given the sound's length, the producer wraps the generator back to the start
+itself, in step with the data, so a looping sound plays straight through. The
+seek FMOD makes as it loops, or as the stream opens, asks for the position
+the reader is already at and is let through without flushing the ring.
+
+One StreamProducer can serve many bridges. Its threads fill whichever bridges
+are furthest from full, one chunk at a time.
+==============================================================================*/
+#ifndef _STREAM_BRIDGE_H
+#define _STREAM_BRIDGE_H
+
+#include "fmod.hpp"
+#include <pthread.h>
+
+#define STREAM_BRIDGE_CHUNK             1024    /* Most samples produced in one go, keeps seeks responsive. */
+#define STREAM_PRODUCER_MAX_THREADS     16
+#define STREAM_PRODUCER_POLL_MS         2
+
+typedef FMOD_RESULT (*StreamBridgeRead)(void *userdata, void *data, unsigned int datalen);
+typedef FMOD_RESULT (*StreamBridgeSeek)(void *userdata, unsigned int position);
+
+struct StreamBridgeStats
+{
+    unsigned int    fill;           /* Samples buffered. */
+    unsigned int    capacity;       /* Samples the ring holds. */
+    unsigned int    underruns;      /* Reads that came up short. */
+    unsigned int    silence;        /* Samples of silence output because of underruns. */
+    unsigned int    seeks;
+};
+
+class StreamBridge
+{
+public:
+    StreamBridge();
+
+    FMOD_RESULT init(int channels, FMOD_SOUND_FORMAT format, unsigned int ringsamples, unsigned int length, StreamBridgeRead read, StreamBridgeSeek seek, void *userdata);    /* length in samples, 0 to never wrap. */
+    void        release();
+    void        setupExInfo(FMOD_CREATESOUNDEXINFO *exinfo);
+    void        getStats(StreamBridgeStats *stats) const;
+
+    static FMOD_RESULT F_CALLBACK pcmReadCallback(FMOD_SOUND *sound, void *data, unsigned int datalen);
+    static FMOD_RESULT F_CALLBACK pcmSetPosCallback(FMOD_SOUND *sound, int subsound, unsigned int position, FMOD_TIMEUNIT postype);
+
+private:
+    friend class StreamProducer;
+
+    unsigned int    space() const;
+    bool            needsWork() const;
+    FMOD_RESULT     produce();                  /* Producer thread. */
+    FMOD_RESULT     consume(void *data, unsigned int datalen);     /* Stream thread. */
+    void            requestSeek(unsigned int position);
+
+    int                 m_channels;
+    FMOD_SOUND_FORMAT   m_format;
+    unsigned int        m_framesize;            /* Bytes per sample for all channels. */
+    char               *m_ring;
+    unsigned int        m_capacity;             /* Samples, a power of two. */
+    unsigned int        m_length;               /* Samples, where the producer wraps to 0. */
+    StreamBridgeRead    m_read;
+    StreamBridgeSeek    m_seek;
+    void               *m_userdata;
+
+    /* Free running sample counters, masked to index the ring. */
+    unsigned int        m_write;                /* Only written by the producer. */
+    unsigned int        m_readpos;              /* Only written by the consumer. */
+    unsigned int        m_produced;             /* Sound position of m_write, producer only. */
+    unsigned int        m_position;             /* Sound position of m_readpos, consumer only. */
+
+    /* Seek handshake. */
+    unsigned int        m_seek_position;
+    unsigned int        m_seek_requested;       /* Bumped by the consumer. */
+    unsigned int        m_seek_done;            /* Set to m_seek_requested by the producer once m_seek_mark is valid. */
+    unsigned int        m_seek_mark;            /* Write position where post seek data starts. */
+    unsigned int        m_seek_seen;            /* Last m_seek_done the consumer acted on. */
+
+    unsigned int        m_underruns;
+    unsigned int        m_silence;
+    unsigned int        m_seeks;
+    bool                m_error;
+
+    /* Owned by StreamProducer. */
+    StreamBridge       *m_next;
+    bool                m_busy;
+};
+
+class StreamProducer
+{
+public:
+    StreamProducer();
+
+    FMOD_RESULT init(int numthreads);
+    void        release();
+    FMOD_RESULT add(StreamBridge *bridge);      /* Fills the ring before returning, so the stream can start straight away. */
+    void        remove(StreamBridge *bridge);
+
+private:
+    static void *threadMain(void *arg);
+    StreamBridge *claim();
+
+    pthread_t       m_threads[STREAM_PRODUCER_MAX_THREADS];
+    int             m_num_threads;
+    pthread_mutex_t m_lock;
+    pthread_cond_t  m_wake;
+    pthread_cond_t  m_idle;
+    StreamBridge   *m_bridges;
+    bool            m_quit;
+};
+
+#endif
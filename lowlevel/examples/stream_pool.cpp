@@ -0,0 +1,310 @@
+/*==============================================================================
+Stream Pool
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "stream_pool.h"
+#include <string.h>
+
+StreamPool::StreamPool()
+{
+    m_system = 0;
+    m_names = 0;
+    m_numnames = 0;
+    m_spares = 0;
+    m_mode = 0;
+    memset(&m_exinfo, 0, sizeof(m_exinfo));
+    m_have_exinfo = false;
+    memset(m_entries, 0, sizeof(m_entries));
+    m_hits = 0;
+    m_misses = 0;
+    m_recycled = 0;
+    m_opened = 0;
+    m_failed = 0;
+}
+
+FMOD_RESULT StreamPool::init(FMOD::System *system, const char * const *names, int numnames, int spares, FMOD_MODE mode, const FMOD_CREATESOUNDEXINFO *exinfo)
+{
+    if (!system || !names || numnames < 1 || numnames > STREAM_POOL_MAX_FILES || spares < 1 || numnames * spares * 2 > STREAM_POOL_MAX_STREAMS)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    m_system = system;
+    m_names = names;
+    m_numnames = numnames;
+    m_spares = spares;
+    m_mode = (mode | FMOD_CREATESTREAM) & ~FMOD_NONBLOCKING;
+    if (exinfo)
+    {
+        m_exinfo = *exinfo;
+        m_have_exinfo = true;
+    }
+
+    for (int file = 0; file < m_numnames; file++)
+    {
+        FMOD_RESULT result = prefetch(file);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT StreamPool::release()
+{
+    FMOD_RESULT result = FMOD_OK;
+
+    for (int i = 0; i < STREAM_POOL_MAX_STREAMS; i++)
+    {
+        StreamPoolEntry *entry = &m_entries[i];
+        if (entry->state != STREAM_POOL_FREE)
+        {
+            /*
+                Blocks if the stream is still opening, that's fine at shutdown.
+            */
+            FMOD_RESULT r = entry->sound->release();
+            if (result == FMOD_OK)
+            {
+                result = r;
+            }
+            entry->sound = 0;
+            entry->state = STREAM_POOL_FREE;
+        }
+    }
+
+    return result;
+}
+
+FMOD_RESULT StreamPool::update()
+{
+    for (int i = 0; i < STREAM_POOL_MAX_STREAMS; i++)
+    {
+        FMOD_RESULT result = poll(&m_entries[i]);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    for (int file = 0; file < m_numnames; file++)
+    {
+        FMOD_RESULT result = prefetch(file);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT StreamPool::acquire(int file, FMOD::Sound **sound)
+{
+    FMOD_RESULT result;
+    StreamPoolEntry *entry = 0;
+
+    if (file < 0 || file >= m_numnames || !sound)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    for (int i = 0; i < STREAM_POOL_MAX_STREAMS && !entry; i++)
+    {
+        if (m_entries[i].file == file)
+        {
+            result = poll(&m_entries[i]);
+            if (result != FMOD_OK)
+            {
+                return result;
+            }
+            if (m_entries[i].state == STREAM_POOL_READY)
+            {
+                entry = &m_entries[i];
+            }
+        }
+    }
+
+    if (entry)
+    {
+        m_hits++;
+    }
+    else
+    {
+        /*
+            Nothing ready in time, open one the slow way.
+        */
+        FMOD_CREATESOUNDEXINFO exinfo = m_exinfo;
+
+        entry = allocEntry();
+        if (!entry)
+        {
+            return FMOD_ERR_MEMORY;
+        }
+
+        result = m_system->createStream(m_names[file], m_mode, m_have_exinfo ? &exinfo : 0, &entry->sound);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+
+        entry->file = file;
+        m_opened++;
+        m_misses++;
+    }
+
+    entry->state = STREAM_POOL_IN_USE;
+    *sound = entry->sound;
+
+    /*
+        Start opening a replacement now, it has the whole length of this grain to get ready.
+    */
+    prefetch(file);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT StreamPool::recycle(FMOD::Sound *sound)
+{
+    StreamPoolEntry *entry = 0;
+    int spares = 0;
+
+    for (int i = 0; i < STREAM_POOL_MAX_STREAMS && !entry; i++)
+    {
+        if (m_entries[i].state == STREAM_POOL_IN_USE && m_entries[i].sound == sound)
+        {
+            entry = &m_entries[i];
+        }
+    }
+    if (!entry)
+    {
+        return sound->release();   /* Not one of ours. */
+    }
+
+    for (int i = 0; i < STREAM_POOL_MAX_STREAMS; i++)
+    {
+        if (m_entries[i].file == entry->file && m_entries[i].state != STREAM_POOL_FREE && m_entries[i].state != STREAM_POOL_IN_USE)
+        {
+            spares++;
+        }
+    }
+
+    /*
+        Keep the decoder and rewind it, unless the file already has plenty of spares.
+        Allowing up to twice the target means recycled streams cover most acquires and prefetch rarely has to open new ones.
+        Codecs that can't seek back fall through to being closed and reopened.
+    */
+    if (spares < m_spares * 2 && sound->seekData(0) == FMOD_OK)
+    {
+        entry->state = STREAM_POOL_REWINDING;
+        m_recycled++;
+        return FMOD_OK;
+    }
+
+    entry->sound = 0;
+    entry->state = STREAM_POOL_FREE;
+    return sound->release();
+}
+
+void StreamPool::getStats(StreamPoolStats *stats) const
+{
+    stats->hits = m_hits;
+    stats->misses = m_misses;
+    stats->recycled = m_recycled;
+    stats->opened = m_opened;
+    stats->failed = m_failed;
+    stats->ready = 0;
+    stats->pending = 0;
+
+    for (int i = 0; i < STREAM_POOL_MAX_STREAMS; i++)
+    {
+        if (m_entries[i].state == STREAM_POOL_READY)
+        {
+            stats->ready++;
+        }
+        else if (m_entries[i].state == STREAM_POOL_OPENING || m_entries[i].state == STREAM_POOL_REWINDING)
+        {
+            stats->pending++;
+        }
+    }
+}
+
+FMOD_RESULT StreamPool::poll(StreamPoolEntry *entry)
+{
+    FMOD_OPENSTATE openstate;
+
+    if (entry->state != STREAM_POOL_OPENING && entry->state != STREAM_POOL_REWINDING)
+    {
+        return FMOD_OK;
+    }
+
+    FMOD_RESULT result = entry->sound->getOpenState(&openstate, 0, 0, 0);
+    if (result != FMOD_OK || openstate == FMOD_OPENSTATE_ERROR)
+    {
+        /*
+            Drop it, update will open another.
+        */
+        m_failed++;
+        entry->state = STREAM_POOL_FREE;
+        result = entry->sound->release();
+        entry->sound = 0;
+        return result;
+    }
+
+    if (openstate == FMOD_OPENSTATE_READY)
+    {
+        entry->state = STREAM_POOL_READY;
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT StreamPool::prefetch(int file)
+{
+    int spares = 0;
+
+    for (int i = 0; i < STREAM_POOL_MAX_STREAMS; i++)
+    {
+        if (m_entries[i].file == file && m_entries[i].state != STREAM_POOL_FREE && m_entries[i].state != STREAM_POOL_IN_USE)
+        {
+            spares++;
+        }
+    }
+
+    for (; spares < m_spares; spares++)
+    {
+        FMOD_CREATESOUNDEXINFO exinfo = m_exinfo;
+        StreamPoolEntry *entry = allocEntry();
+        if (!entry)
+        {
+            return FMOD_OK;     /* Everything is in use, acquire will have to open blocking. */
+        }
+
+        FMOD_RESULT result = m_system->createStream(m_names[file], m_mode | FMOD_NONBLOCKING, m_have_exinfo ? &exinfo : 0, &entry->sound);
+        if (result != FMOD_OK)
+        {
+            m_failed++;
+            return result;
+        }
+
+        entry->file = file;
+        entry->state = STREAM_POOL_OPENING;
+        m_opened++;
+    }
+
+    return FMOD_OK;
+}
+
+StreamPoolEntry *StreamPool::allocEntry()
+{
+    for (int i = 0; i < STREAM_POOL_MAX_STREAMS; i++)
+    {
+        if (m_entries[i].state == STREAM_POOL_FREE)
+        {
+            m_entries[i].sound = 0;
+            return &m_entries[i];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*==============================================================================
+Stream Pool
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Keeps a few streams of each file opened ahead of time, so taking one to play
+never waits on the disk or on codec setup. Spare streams are opened with
+FMOD_NONBLOCKING and only handed out once Sound::getOpenState says they're
+ready. Finished streams are given back with recycle, which rewinds them with
+Sound::seekData and keeps the decoder for next time rather than closing it. If
+a file has no ready stream when one is asked for, that's a miss and the stream
+is opened blocking on the spot.
+
+Everything here must be called from the thread that calls System::update. Call
+StreamPool::update once a frame to pick up streams that have finished opening
+and to start opening new spares.
+==============================================================================*/
+#ifndef _STREAM_POOL_H
+#define _STREAM_POOL_H
+
+#include "fmod.hpp"
+
+#define STREAM_POOL_MAX_FILES       16
+#define STREAM_POOL_MAX_STREAMS     64
+
+enum StreamPoolState
+{
+    STREAM_POOL_FREE,
+    STREAM_POOL_OPENING,        /* Non blocking open in progress. */
+    STREAM_POOL_REWINDING,      /* Recycled, waiting for the seek back to the start. */
+    STREAM_POOL_READY,
+    STREAM_POOL_IN_USE
+};
+
+struct StreamPoolEntry
+{
+    FMOD::Sound        *sound;
+    int                 file;
+    StreamPoolState     state;
+};
+
+struct StreamPoolStats
+{
+    unsigned int    hits;           /* Acquires served by a ready stream. */
+    unsigned int    misses;         /* Acquires that had to open a stream blocking. */
+    unsigned int    recycled;       /* Streams rewound and kept rather than released. */
+    unsigned int    opened;         /* Streams opened, either way. */
+    unsigned int    failed;         /* Non blocking opens or rewinds that failed. */
+    unsigned int    ready;          /* Streams ready right now. */
+    unsigned int    pending;        /* Streams opening or rewinding right now. */
+};
+
+class StreamPool
+{
+public:
+    StreamPool();
+
+    FMOD_RESULT init(FMOD::System *system, const char * const *names, int numnames, int spares, FMOD_MODE mode, const FMOD_CREATESOUNDEXINFO *exinfo);
+    FMOD_RESULT release();
+    FMOD_RESULT update();
+
+    FMOD_RESULT acquire(int file, FMOD::Sound **sound);
+    FMOD_RESULT recycle(FMOD::Sound *sound);
+    void        getStats(StreamPoolStats *stats) const;
+
+private:
+    FMOD_RESULT poll(StreamPoolEntry *entry);
+    FMOD_RESULT prefetch(int file);
+    StreamPoolEntry *allocEntry();
+
+    FMOD::System           *m_system;
+    const char * const     *m_names;
+    int                     m_numnames;
+    int                     m_spares;           /* Streams per file kept opening or ready. */
+    FMOD_MODE               m_mode;
+    FMOD_CREATESOUNDEXINFO  m_exinfo;
+    bool                    m_have_exinfo;
+
+    StreamPoolEntry         m_entries[STREAM_POOL_MAX_STREAMS];
+
+    unsigned int            m_hits;
+    unsigned int            m_misses;
+    unsigned int            m_recycled;
+    unsigned int            m_opened;
+    unsigned int            m_failed;
+};
+
+#endif
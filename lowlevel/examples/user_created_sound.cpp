@@ -6,36 +6,26 @@ This example shows how create a sound with data filled by the user. It shows a
 user created static sample, followed by a user created stream. The former
 allocates all memory needed for the sound and is played back as a static sample, 
 while the latter streams the data in chunks as it plays, using far less memory.
+
+The data comes from a SignalGenerator (see signal_generator.h), which keeps its
+state in the sound's userdata and fills each block with SIMD FM oscillators.
+When streaming, the generator runs on its own thread and feeds the stream
+through a lock free ring (see stream_bridge.h), so however long it takes it
+can't hold up FMOD's stream thread.
 ==============================================================================*/
 #include "fmod.hpp"
 #include "common.h"
-#include <math.h>
+#include "signal_generator.h"
+#include "stream_bridge.h"
 
-FMOD_RESULT F_CALLBACK pcmreadcallback(FMOD_SOUND* /*sound*/, void *data, unsigned int datalen)
+FMOD_RESULT generatorRead(void *userdata, void *data, unsigned int datalen)
 {
-    static float  t1 = 0, t2 = 0;        // time
-    static float  v1 = 0, v2 = 0;        // velocity
-    signed short *stereo16bitbuffer = (signed short *)data;
-
-    for (unsigned int count = 0; count < (datalen >> 2); count++)     // >>2 = 16bit stereo (4 bytes per sample)
-    {
-        *stereo16bitbuffer++ = (signed short)(sin(t1) * 32767.0f);    // left channel
-        *stereo16bitbuffer++ = (signed short)(sin(t2) * 32767.0f);    // right channel
-
-        t1 += 0.01f   + v1;
-        t2 += 0.0142f + v2;
-        v1 += (float)(sin(t1) * 0.002f);
-        v2 += (float)(sin(t2) * 0.002f);
-    }
-
-    return FMOD_OK;
+    return ((SignalGenerator *)userdata)->read(data, datalen);
 }
 
-FMOD_RESULT F_CALLBACK pcmsetposcallback(FMOD_SOUND* /*sound*/, int /*subsound*/, unsigned int /*position*/, FMOD_TIMEUNIT /*postype*/)
+FMOD_RESULT generatorSeek(void *userdata, unsigned int position)
 {
-    /*
-        This is useful if the user calls Channel::setPosition and you want to seek your data accordingly.
-    */
+    ((SignalGenerator *)userdata)->setPosition(position);
     return FMOD_OK;
 }
 
@@ -49,6 +39,9 @@ int FMOD_Main()
     FMOD_CREATESOUNDEXINFO  exinfo;
     unsigned int            version;
     void                   *extradriverdata = 0;
+    SignalGenerator         generator;
+    StreamBridge            bridge;
+    StreamProducer          producer;
     
     Common_Init(&extradriverdata);
 
@@ -98,15 +91,47 @@ int FMOD_Main()
     /*
         Create and play the sound.
     */
+    result = generator.init(2, 44100, FMOD_SOUND_FORMAT_PCM16);
+    ERRCHECK(result);
+
+    {
+        /*
+            A slowly wobbling low tone in each ear, the right one a little higher.
+        */
+        SignalGeneratorVoice voice;
+        voice.wave      = SIGNAL_GENERATOR_FM;
+        voice.frequency = 70.0f;
+        voice.ratio     = 0.01f;
+        voice.index     = 20.0f;
+        voice.amplitude = 1.0f;
+        generator.setVoice(0, voice);
+
+        voice.frequency = 100.0f;
+        voice.ratio     = 0.013f;
+        generator.setVoice(1, voice);
+    }
+
     memset(&exinfo, 0, sizeof(FMOD_CREATESOUNDEXINFO));
     exinfo.cbsize            = sizeof(FMOD_CREATESOUNDEXINFO);  /* Required. */
-    exinfo.numchannels       = 2;                               /* Number of channels in the sound. */
-    exinfo.defaultfrequency  = 44100;                           /* Default playback rate of sound. */
+    generator.setupExInfo(&exinfo);                             /* Channels, rate, format, callbacks and userdata. */
     exinfo.decodebuffersize  = 44100;                           /* Chunk size of stream update in samples. This will be the amount of data passed to the user callback. */
     exinfo.length            = exinfo.defaultfrequency * exinfo.numchannels * sizeof(signed short) * 5; /* Length of PCM data in bytes of whole song (for Sound::getLength) */
-    exinfo.format            = FMOD_SOUND_FORMAT_PCM16;         /* Data format of sound. */
-    exinfo.pcmreadcallback   = pcmreadcallback;                 /* User callback for reading. */
-    exinfo.pcmsetposcallback = pcmsetposcallback;               /* User callback for seeking. */
+
+    if (mode & FMOD_CREATESTREAM)
+    {
+        /*
+            Put the ring between the generator and FMOD. It holds two stream updates, so one can be produced while the other is read.
+            It is told the sound's length so it can loop the generator itself, without a gap where FMOD seeks back to the start.
+        */
+        result = producer.init(1);
+        ERRCHECK(result);
+        result = bridge.init(exinfo.numchannels, exinfo.format, exinfo.decodebuffersize * 2, exinfo.length / (exinfo.numchannels * sizeof(signed short)), generatorRead, generatorSeek, &generator);
+        ERRCHECK(result);
+        result = producer.add(&bridge);
+        ERRCHECK(result);
+
+        bridge.setupExInfo(&exinfo);                            /* Replaces the generator's callbacks and userdata with the ring's. */
+    }
 
     result = system->createSound(0, mode, &exinfo, &sound);
     ERRCHECK(result);
@@ -175,6 +200,13 @@ int FMOD_Main()
             Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
             Common_Draw("");
             Common_Draw("Time %02d:%02d:%02d/%02d:%02d:%02d : %s", ms / 1000 / 60, ms / 1000 % 60, ms / 10 % 100, lenms / 1000 / 60, lenms / 1000 % 60, lenms / 10 % 100, paused ? "Paused " : playing ? "Playing" : "Stopped");
+
+            if (mode & FMOD_CREATESTREAM)
+            {
+                StreamBridgeStats stats;
+                bridge.getStats(&stats);
+                Common_Draw("Ring %3d%% full, %d underruns", stats.fill * 100 / stats.capacity, stats.underruns);
+            }
         }
 
         Common_Sleep(50);
@@ -185,6 +217,12 @@ int FMOD_Main()
     */
     result = sound->release();
     ERRCHECK(result);
+    if (mode & FMOD_CREATESTREAM)
+    {
+        producer.remove(&bridge);
+        producer.release();
+        bridge.release();
+    }
     result = system->close();
     ERRCHECK(result);
     result = system->release();
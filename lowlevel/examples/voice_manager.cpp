@@ -0,0 +1,455 @@
+/*==============================================================================
+Voice Manager
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "voice_manager.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+VoiceManager::VoiceManager()
+{
+    m_system = 0;
+    m_master = 0;
+    m_spatial = 0;
+    m_outputrate = 0.0f;
+    m_fadesamples = 0;
+    m_emitters = 0;
+    m_maxemitters = 0;
+    m_maxreal = 0;
+    m_free = 0;
+    m_numfree = 0;
+    m_candidates = 0;
+    m_scores = 0;
+    m_wanted = 0;
+    memset(&m_listener, 0, sizeof(m_listener));
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+FMOD_RESULT VoiceManager::init(FMOD::System *system, SpatialUpdater *spatial, int maxemitters, int maxreal, float fadems)
+{
+    FMOD_RESULT result;
+    int samplerate;
+
+    result = system->getMasterChannelGroup(&m_master);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+    result = system->getSoftwareFormat(&samplerate, 0, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_system = system;
+    m_spatial = spatial;
+    m_outputrate = (float)samplerate;
+    m_fadesamples = (unsigned long long)(fadems * 0.001f * samplerate);
+
+    m_emitters = (VoiceEmitter *)calloc(maxemitters, sizeof(VoiceEmitter));
+    m_free = (int *)malloc(maxemitters * sizeof(int));
+    m_candidates = (int *)malloc(maxemitters * sizeof(int));
+    m_scores = (float *)malloc(maxemitters * sizeof(float));
+    m_wanted = (unsigned char *)malloc(maxemitters);
+    if (!m_emitters || !m_free || !m_candidates || !m_scores || !m_wanted)
+    {
+        release();
+        return FMOD_ERR_MEMORY;
+    }
+
+    m_maxemitters = maxemitters;
+    m_maxreal = maxreal;
+    for (int i = 0; i < maxemitters; i++)
+    {
+        m_free[i] = maxemitters - 1 - i;
+    }
+    m_numfree = maxemitters;
+
+    return FMOD_OK;
+}
+
+void VoiceManager::release()
+{
+    for (int i = 0; i < m_maxemitters; i++)
+    {
+        if (m_emitters[i].active)
+        {
+            removeEmitter(i);
+        }
+    }
+
+    free(m_emitters);
+    free(m_free);
+    free(m_candidates);
+    free(m_scores);
+    free(m_wanted);
+    m_emitters = 0;
+    m_free = 0;
+    m_candidates = 0;
+    m_scores = 0;
+    m_wanted = 0;
+    m_maxemitters = 0;
+    m_numfree = 0;
+}
+
+int VoiceManager::addEmitter(FMOD::Sound *sound, const FMOD_VECTOR *position, float volume, int priority)
+{
+    FMOD_MODE mode;
+    int defaultpriority;
+
+    if (!m_numfree)
+    {
+        return -1;
+    }
+
+    int spatial = m_spatial->addEmitter(0, position);
+    if (spatial < 0)
+    {
+        return -1;
+    }
+
+    unsigned long long now = 0;
+    m_master->getDSPClock(&now, 0);
+
+    int emitter = m_free[--m_numfree];
+    VoiceEmitter *e = &m_emitters[emitter];
+
+    memset(e, 0, sizeof(VoiceEmitter));
+    e->sound = sound;
+    e->spatial = spatial;
+    e->position = *position;
+    e->volume = volume;
+    e->priority = priority;
+    e->start = now;
+    e->active = true;
+
+    /*
+        Everything the score and the timeline need from the sound, so update never has to ask FMOD.
+    */
+    sound->get3DMinMaxDistance(&e->mindistance, &e->maxdistance);
+    sound->getDefaults(&e->frequency, &defaultpriority);
+    sound->getLength(&e->length, FMOD_TIMEUNIT_PCM);
+    sound->getMode(&mode);
+    e->loop = (mode & FMOD_LOOP_NORMAL) != 0;
+
+    return emitter;
+}
+
+void VoiceManager::removeEmitter(int emitter)
+{
+    VoiceEmitter *e = &m_emitters[emitter];
+
+    if (e->channel)
+    {
+        e->channel->stop();
+        e->channel = 0;
+    }
+    m_spatial->removeEmitter(e->spatial);
+
+    e->active = false;
+    m_free[m_numfree++] = emitter;
+}
+
+void VoiceManager::setPosition(int emitter, const FMOD_VECTOR *position)
+{
+    VoiceEmitter *e = &m_emitters[emitter];
+
+    e->position = *position;
+    m_spatial->setPosition(e->spatial, position);
+}
+
+void VoiceManager::setVolume(int emitter, float volume)
+{
+    VoiceEmitter *e = &m_emitters[emitter];
+
+    e->volume = volume;
+    if (e->channel)
+    {
+        e->channel->setVolume(volume);
+    }
+}
+
+void VoiceManager::setOcclusion(int emitter, float occlusion)
+{
+    VoiceEmitter *e = &m_emitters[emitter];
+
+    if (e->occlusion == occlusion)
+    {
+        return;     /* Fed every frame by occlusion_engine.h, most of it doesn't change. */
+    }
+    e->occlusion = occlusion;
+    if (e->channel)
+    {
+        e->channel->set3DOcclusion(occlusion, occlusion);
+    }
+}
+
+/*
+    FMOD's default inverse rolloff: full volume inside the min distance, then min/distance, held at the max distance.
+*/
+float VoiceManager::audibility(const VoiceEmitter *e) const
+{
+    float x = e->position.x - m_listener.x;
+    float y = e->position.y - m_listener.y;
+    float z = e->position.z - m_listener.z;
+    float distance = sqrtf(x * x + y * y + z * z);
+    float gain = 1.0f;
+
+    if (distance > e->mindistance)
+    {
+        gain = e->mindistance / ((distance < e->maxdistance) ? distance : e->maxdistance);
+    }
+
+    return e->volume * (1.0f - e->occlusion) * gain;
+}
+
+unsigned int VoiceManager::timelinePosition(const VoiceEmitter *e, unsigned long long now) const
+{
+    unsigned long long elapsed = (now > e->start) ? now - e->start : 0;
+    unsigned long long position = (unsigned long long)((double)elapsed * e->frequency / m_outputrate);
+
+    if (e->loop && e->length)
+    {
+        position %= e->length;
+    }
+    return (position < e->length) ? (unsigned int)position : e->length;
+}
+
+FMOD_RESULT VoiceManager::promote(VoiceEmitter *e, unsigned long long now)
+{
+    FMOD_RESULT result;
+    FMOD::Channel *channel;
+    unsigned long long parentclock;
+
+    result = m_system->playSound(e->sound, 0, true, &channel);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    /*
+        Start where the timeline says it would be, then fade up from silence so the join isn't heard.
+    */
+    channel->setPosition(timelinePosition(e, now), FMOD_TIMEUNIT_PCM);
+    channel->setVolume(e->volume);
+    channel->set3DOcclusion(e->occlusion, e->occlusion);
+    channel->getDSPClock(0, &parentclock);
+    channel->addFadePoint(parentclock, 0.0f);
+    channel->addFadePoint(parentclock + m_fadesamples, 1.0f);
+
+    /*
+        The spatial updater places it on its next flush, before the mixer gets past the silent start of the fade.
+    */
+    m_spatial->setChannel(e->spatial, channel);
+
+    result = channel->setPaused(false);
+    if (result != FMOD_OK)
+    {
+        channel->stop();
+        m_spatial->setChannel(e->spatial, 0);
+        return result;
+    }
+
+    e->channel = channel;
+    return FMOD_OK;
+}
+
+void VoiceManager::demote(VoiceEmitter *e, unsigned long long now)
+{
+    unsigned long long parentclock;
+    unsigned int position;
+
+    /*
+        Pick the timeline up from where the channel really got to, pitch and doppler move it away from the clock.
+    */
+    if (e->channel->getPosition(&position, FMOD_TIMEUNIT_PCM) == FMOD_OK)
+    {
+        unsigned long long played = (unsigned long long)((double)position * m_outputrate / e->frequency);
+        e->start = (now > played) ? now - played : 0;
+    }
+
+    if (e->channel->getDSPClock(0, &parentclock) == FMOD_OK)
+    {
+        e->channel->removeFadePoints(parentclock, (unsigned long long)-1);
+        e->channel->addFadePoint(parentclock, 1.0f);
+        e->channel->addFadePoint(parentclock + m_fadesamples, 0.0f);
+        e->channel->setDelay(0, parentclock + m_fadesamples, true);
+    }
+
+    e->channel = 0;
+    m_spatial->setChannel(e->spatial, 0);
+}
+
+/*
+    Quickselect, leaves the k highest scores in the first k candidates in no particular order.
+*/
+void VoiceManager::select(int count, int k)
+{
+    int left = 0;
+    int right = count - 1;
+
+    while (left < right)
+    {
+        int middle = left + (right - left) / 2;
+        float pivot = m_scores[middle];
+        int i = left;
+        int j = right;
+
+        while (i <= j)
+        {
+            while (m_scores[i] > pivot) i++;
+            while (m_scores[j] < pivot) j--;
+            if (i <= j)
+            {
+                float score = m_scores[i]; m_scores[i] = m_scores[j]; m_scores[j] = score;
+                int index = m_candidates[i]; m_candidates[i] = m_candidates[j]; m_candidates[j] = index;
+                i++;
+                j--;
+            }
+        }
+
+        if (k - 1 <= j)
+        {
+            right = j;
+        }
+        else if (k - 1 >= i)
+        {
+            left = i;
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+FMOD_RESULT VoiceManager::update()
+{
+    FMOD_RESULT result;
+    unsigned long long now;
+
+    result = m_master->getDSPClock(&now, 0);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_stats.emitters = m_maxemitters - m_numfree;
+    m_stats.playing = 0;
+    m_stats.real = 0;
+    m_stats.audible = 0;
+    m_stats.promotions = 0;
+    m_stats.demotions = 0;
+
+    /*
+        Score everything still playing. The score puts priority first and audibility within it, so one float sorts
+        on both.
+    */
+    int count = 0;
+    for (int i = 0; i < m_maxemitters; i++)
+    {
+        VoiceEmitter *e = &m_emitters[i];
+
+        if (!e->active || e->finished)
+        {
+            continue;
+        }
+
+        if (e->channel)
+        {
+            bool playing = false;
+            result = e->channel->isPlaying(&playing);
+            if (result != FMOD_OK || !playing)
+            {
+                /*
+                    A one shot that played out is done. Anything else was stolen by something outside the manager
+                    and carries on as virtual.
+                */
+                if (result == FMOD_OK && !e->loop)
+                {
+                    e->finished = true;
+                }
+                e->channel = 0;
+                m_spatial->setChannel(e->spatial, 0);
+            }
+        }
+        if (!e->finished && !e->loop && !e->channel && timelinePosition(e, now) >= e->length)
+        {
+            e->finished = true;
+        }
+        if (e->finished)
+        {
+            continue;
+        }
+
+        m_stats.playing++;
+        m_wanted[i] = 0;
+
+        e->audibility = audibility(e);
+        if (e->audibility < VOICE_MANAGER_MIN_AUDIBILITY)
+        {
+            continue;
+        }
+        m_stats.audible++;
+
+        float audibility = e->channel ? e->audibility * VOICE_MANAGER_HYSTERESIS : e->audibility;
+        if (audibility > 1.0f)
+        {
+            audibility = 1.0f;
+        }
+
+        m_candidates[count] = i;
+        m_scores[count] = (float)(256 - e->priority) + audibility * 0.999f;
+        count++;
+    }
+
+    int k = (count < m_maxreal) ? count : m_maxreal;
+    if (count > k)
+    {
+        select(count, k);
+    }
+    for (int i = 0; i < k; i++)
+    {
+        m_wanted[m_candidates[i]] = 1;
+    }
+
+    /*
+        Demote first, so the channels they free are there for the promotions.
+    */
+    for (int i = 0; i < m_maxemitters; i++)
+    {
+        VoiceEmitter *e = &m_emitters[i];
+
+        if (e->active && !e->finished && e->channel && !m_wanted[i])
+        {
+            demote(e, now);
+            m_stats.demotions++;
+        }
+    }
+
+    FMOD_RESULT error = FMOD_OK;
+    for (int i = 0; i < k; i++)
+    {
+        VoiceEmitter *e = &m_emitters[m_candidates[i]];
+
+        if (!e->channel)
+        {
+            result = promote(e, now);
+            if (result != FMOD_OK && error == FMOD_OK)
+            {
+                error = result;
+            }
+            else if (result == FMOD_OK)
+            {
+                m_stats.promotions++;
+            }
+        }
+        if (e->channel)
+        {
+            m_stats.real++;
+        }
+    }
+
+    return error;
+}
@@ -0,0 +1,114 @@
+/*==============================================================================
+Voice Manager
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Plays thousands of logical 3D emitters on a fixed number of real channels.
+
+Every update each emitter is scored by how loud it would be: its volume, its
+direct occlusion, and the inverse rolloff between its sound's 3D min and max
+distance at its distance from the listener. Priority comes first, like
+Channel::setPriority, lower numbers win whatever their audibility. The top
+'maxreal' emitters get real channels, the rest are virtual, costing nothing
+in the mixer.
+
+A virtual emitter keeps a timeline, the DSP clock it started at, so when it
+becomes real again it starts playing from where it would have been. Channels
+are faded in and out over 'fadems' rather than cut, and a real emitter needs
+to be beaten by VOICE_MANAGER_HYSTERESIS to lose its channel, so emitters
+near the cut off don't flicker between the two. Real channels are positioned
+through a SpatialUpdater (see spatial_update.h), call its flush after update.
+
+Leave room in System::init for the channels still fading out, maxreal plus a
+quarter is plenty.
+==============================================================================*/
+#ifndef _VOICE_MANAGER_H
+#define _VOICE_MANAGER_H
+
+#include "fmod.hpp"
+#include "spatial_update.h"
+
+#define VOICE_MANAGER_MIN_AUDIBILITY    0.001f  /* -60dB, quieter emitters never get a channel. */
+#define VOICE_MANAGER_HYSTERESIS        1.25f   /* Audibility bonus for keeping a channel. */
+
+struct VoiceEmitter
+{
+    FMOD::Sound        *sound;
+    FMOD::Channel      *channel;        /* 0 while virtual. */
+    int                 spatial;        /* SpatialUpdater emitter. */
+    FMOD_VECTOR         position;
+    float               volume;
+    float               occlusion;
+    int                 priority;
+    float               audibility;     /* From the last update. */
+
+    /* From the sound when added */
+    float               mindistance;
+    float               maxdistance;
+    float               frequency;
+    unsigned int        length;         /* PCM samples. */
+    bool                loop;
+
+    unsigned long long  start;          /* Master DSP clock the timeline started at. */
+    bool                active;
+    bool                finished;       /* A one shot that has played to the end. */
+};
+
+struct VoiceManagerStats
+{
+    int                 emitters;
+    int                 playing;        /* Not finished. */
+    int                 real;
+    int                 audible;        /* Above VOICE_MANAGER_MIN_AUDIBILITY. */
+    int                 promotions;     /* Last update. */
+    int                 demotions;
+};
+
+class VoiceManager
+{
+public:
+    VoiceManager();
+
+    FMOD_RESULT init(FMOD::System *system, SpatialUpdater *spatial, int maxemitters, int maxreal, float fadems);
+    void        release();                  /* Stops every real channel. */
+
+    int         addEmitter(FMOD::Sound *sound, const FMOD_VECTOR *position, float volume, int priority);   /* -1 if full. */
+    void        removeEmitter(int emitter);
+    void        setPosition(int emitter, const FMOD_VECTOR *position);
+    void        setVolume(int emitter, float volume);
+    void        setOcclusion(int emitter, float occlusion);
+    bool        isPlaying(int emitter) const    { return !m_emitters[emitter].finished; }
+    bool        isReal(int emitter) const       { return m_emitters[emitter].channel != 0; }
+
+    void        setListener(const FMOD_VECTOR *position)    { m_listener = *position; }
+
+    FMOD_RESULT update();
+    void        getStats(VoiceManagerStats *stats) const    { *stats = m_stats; }
+
+private:
+    float       audibility(const VoiceEmitter *e) const;
+    unsigned int timelinePosition(const VoiceEmitter *e, unsigned long long now) const;
+    FMOD_RESULT promote(VoiceEmitter *e, unsigned long long now);
+    void        demote(VoiceEmitter *e, unsigned long long now);
+    void        select(int count, int k);
+
+    FMOD::System       *m_system;
+    FMOD::ChannelGroup *m_master;
+    SpatialUpdater     *m_spatial;
+    float               m_outputrate;
+    unsigned long long  m_fadesamples;
+
+    VoiceEmitter       *m_emitters;
+    int                 m_maxemitters;
+    int                 m_maxreal;
+    int                *m_free;
+    int                 m_numfree;
+
+    int                *m_candidates;       /* Scratch for update, emitter indices and their scores. */
+    float              *m_scores;
+    unsigned char      *m_wanted;
+
+    FMOD_VECTOR         m_listener;
+    VoiceManagerStats   m_stats;
+};
+
+#endif
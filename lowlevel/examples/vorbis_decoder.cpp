@@ -0,0 +1,2694 @@
+/*==============================================================================
+Vorbis Decoder
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Follows the Vorbis I specification. Section numbers in the comments below refer
+to it.
+==============================================================================*/
+#include "vorbis_decoder.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define VORBIS_FAST_BITS            10      /* Codewords up to this long are decoded with one table lookup. */
+#define VORBIS_FLOOR1_MAX_VALUES    65
+#define VORBIS_PAGE_MAX_BODY        (255 * 255)
+#define VORBIS_SCAN_CHUNK           4096
+#define VORBIS_SEEK_LINEAR          65536   /* Bisection stops once the range is this small and reads pages in order. */
+#define VORBIS_MAX_VECTOR_FLOATS    (1 << 24)
+#define VORBIS_PCM16_CHUNK          512     /* Samples readPCM16 decodes at a time before converting. */
+
+struct VorbisCodebook
+{
+    int             dimensions;
+    int             entries;
+    unsigned char  *lengths;                            /* Codeword length per entry, 0 for unused entries. */
+    int             fast[1 << VORBIS_FAST_BITS];        /* Entry for the next VORBIS_FAST_BITS bits of the stream, -1 if the codeword is longer. */
+    unsigned int   *sortedcodes;                        /* Codewords longer than VORBIS_FAST_BITS, msb first and left aligned, ascending. */
+    int            *sortedentries;
+    int             numsorted;
+    float          *vectors;                            /* entries * dimensions, 0 for books without a lookup table. */
+};
+
+struct VorbisFloor
+{
+    int             partitions;
+    unsigned char   partitionclass[31];
+    unsigned char   classdimensions[16];
+    unsigned char   classsubclasses[16];
+    short           classmasterbook[16];
+    short           subclassbooks[16][8];
+    int             multiplier;
+    int             values;
+    int             x[VORBIS_FLOOR1_MAX_VALUES];
+    unsigned char   sorted[VORBIS_FLOOR1_MAX_VALUES];   /* Indices of x in ascending order. */
+    unsigned char   low[VORBIS_FLOOR1_MAX_VALUES];      /* Neighbours of each x among the ones before it. */
+    unsigned char   high[VORBIS_FLOOR1_MAX_VALUES];
+};
+
+struct VorbisResidue
+{
+    int             type;
+    unsigned int    begin;
+    unsigned int    end;
+    unsigned int    partitionsize;
+    int             classifications;
+    int             classbook;
+    short           books[64][8];
+};
+
+struct VorbisMapping
+{
+    int             submaps;
+    int             couplingsteps;
+    unsigned char   magnitude[256];
+    unsigned char   angle[256];
+    unsigned char   mux[VORBIS_MAX_CHANNELS];
+    unsigned char   submapfloor[16];
+    unsigned char   submapresidue[16];
+};
+
+struct VorbisMode
+{
+    int             blockflag;
+    int             mapping;
+};
+
+struct VorbisMDCT
+{
+    int             n;
+    int            *bitrev;
+    float          *pre;            /* n/4 cosines then n/4 sines. */
+    float          *post;
+    float          *twiddles;       /* For each FFT pass of half length h >= 4, h cosines then h sines. */
+    float          *re;
+    float          *im;
+    float          *z;
+};
+
+/*
+    Vorbis to FMOD speaker order, 8.3.9.
+*/
+static const unsigned char VORBIS_CHANNEL_ORDER[VORBIS_MAX_CHANNELS + 1][VORBIS_MAX_CHANNELS] =
+{
+    { 0 },
+    { 0 },
+    { 0, 1 },
+    { 0, 2, 1 },
+    { 0, 1, 2, 3 },
+    { 0, 2, 1, 3, 4 },
+    { 0, 2, 1, 5, 3, 4 },
+    { 0, 2, 1, 6, 3, 4, 5 },
+    { 0, 2, 1, 7, 3, 4, 5, 6 },
+};
+
+/*
+    10.1, 140dB in 256 steps.
+*/
+static const float VORBIS_INVERSE_DB[256] =
+{
+    1.06498561e-07f, 1.13419439e-07f, 1.20790077e-07f, 1.28639698e-07f, 1.36999432e-07f, 1.45902419e-07f,
+    1.55383987e-07f, 1.65481708e-07f, 1.76235645e-07f, 1.87688428e-07f, 1.99885477e-07f, 2.12875165e-07f,
+    2.26708991e-07f, 2.41441825e-07f, 2.57132086e-07f, 2.73841977e-07f, 2.91637747e-07f, 3.10590025e-07f,
+    3.30773901e-07f, 3.52269467e-07f, 3.75161932e-07f, 3.99542046e-07f, 4.25506556e-07f, 4.53158350e-07f,
+    4.82607163e-07f, 5.13969667e-07f, 5.47370348e-07f, 5.82941539e-07f, 6.20824380e-07f, 6.61169054e-07f,
+    7.04135516e-07f, 7.49894184e-07f, 7.98626559e-07f, 8.50525794e-07f, 9.05797776e-07f, 9.64661581e-07f,
+    1.02735078e-06f, 1.09411383e-06f, 1.16521551e-06f, 1.24093776e-06f, 1.32158084e-06f, 1.40746465e-06f,
+    1.49892969e-06f, 1.59633851e-06f, 1.70007763e-06f, 1.81055827e-06f, 1.92821858e-06f, 2.05352512e-06f,
+    2.18697460e-06f, 2.32909656e-06f, 2.48045444e-06f, 2.64164828e-06f, 2.81331745e-06f, 2.99614271e-06f,
+    3.19084893e-06f, 3.39820826e-06f, 3.61904313e-06f, 3.85422891e-06f, 4.10469829e-06f, 4.37144490e-06f,
+    4.65552603e-06f, 4.95806808e-06f, 5.28027158e-06f, 5.62341347e-06f, 5.98885435e-06f, 6.37804396e-06f,
+    6.79252526e-06f, 7.23394169e-06f, 7.70404404e-06f, 8.20469631e-06f, 8.73788395e-06f, 9.30572060e-06f,
+    9.91045817e-06f, 1.05544959e-05f, 1.12403868e-05f, 1.19708502e-05f, 1.27487838e-05f, 1.35772716e-05f,
+    1.44595988e-05f, 1.53992660e-05f, 1.63999957e-05f, 1.74657598e-05f, 1.86007837e-05f, 1.98095677e-05f,
+    2.10969047e-05f, 2.24679006e-05f, 2.39279925e-05f, 2.54829683e-05f, 2.71389945e-05f, 2.89026393e-05f,
+    3.07808950e-05f, 3.27812122e-05f, 3.49115180e-05f, 3.71802671e-05f, 3.95964489e-05f, 4.21696495e-05f,
+    4.49100735e-05f, 4.78285801e-05f, 5.09367528e-05f, 5.42469097e-05f, 5.77721803e-05f, 6.15265380e-05f,
+    6.55248805e-05f, 6.97830619e-05f, 7.43179553e-05f, 7.91475541e-05f, 8.42910085e-05f, 8.97687132e-05f,
+    9.56023869e-05f, 1.01815174e-04f, 1.08431697e-04f, 1.15478200e-04f, 1.22982616e-04f, 1.30974731e-04f,
+    1.39486205e-04f, 1.48550796e-04f, 1.58204464e-04f, 1.68485494e-04f, 1.79434617e-04f, 1.91095300e-04f,
+    2.03513744e-04f, 2.16739223e-04f, 2.30824153e-04f, 2.45824398e-04f, 2.61799461e-04f, 2.78812659e-04f,
+    2.96931481e-04f, 3.16227757e-04f, 3.36778030e-04f, 3.58663761e-04f, 3.81971768e-04f, 4.06794425e-04f,
+    4.33230220e-04f, 4.61383956e-04f, 4.91367304e-04f, 5.23299095e-04f, 5.57306048e-04f, 5.93522913e-04f,
+    6.32093404e-04f, 6.73170376e-04f, 7.16916809e-04f, 7.63506105e-04f, 8.13123013e-04f, 8.65964335e-04f,
+    9.22239560e-04f, 9.82171856e-04f, 1.04599900e-03f, 1.11397391e-03f, 1.18636619e-03f, 1.26346294e-03f,
+    1.34556985e-03f, 1.43301254e-03f, 1.52613781e-03f, 1.62531482e-03f, 1.73093693e-03f, 1.84342300e-03f,
+    1.96321891e-03f, 2.09080009e-03f, 2.22667190e-03f, 2.37137382e-03f, 2.52547883e-03f, 2.68959883e-03f,
+    2.86438409e-03f, 3.05052800e-03f, 3.24876839e-03f, 3.45989177e-03f, 3.68473493e-03f, 3.92418960e-03f,
+    4.17920575e-03f, 4.45079384e-03f, 4.74003190e-03f, 5.04806591e-03f, 5.37611730e-03f, 5.72548807e-03f,
+    6.09756215e-03f, 6.49381615e-03f, 6.91582123e-03f, 7.36525003e-03f, 7.84388557e-03f, 8.35362542e-03f,
+    8.89649149e-03f, 9.47463512e-03f, 1.00903502e-02f, 1.07460786e-02f, 1.14444187e-02f, 1.21881422e-02f,
+    1.29801957e-02f, 1.38237225e-02f, 1.47220660e-02f, 1.56787876e-02f, 1.66976843e-02f, 1.77827943e-02f,
+    1.89384203e-02f, 2.01691464e-02f, 2.14798506e-02f, 2.28757318e-02f, 2.43623257e-02f, 2.59455275e-02f,
+    2.76316144e-02f, 2.94272713e-02f, 3.13396230e-02f, 3.33762467e-02f, 3.55452225e-02f, 3.78551520e-02f,
+    4.03151922e-02f, 4.29351032e-02f, 4.57252674e-02f, 4.86967526e-02f, 5.18613420e-02f, 5.52315824e-02f,
+    5.88208437e-02f, 6.26433566e-02f, 6.67142719e-02f, 7.10497424e-02f, 7.56669566e-02f, 8.05842206e-02f,
+    8.58210325e-02f, 9.13981721e-02f, 9.73377377e-02f, 1.03663296e-01f, 1.10399917e-01f, 1.17574327e-01f,
+    1.25214964e-01f, 1.33352146e-01f, 1.42018110e-01f, 1.51247248e-01f, 1.61076158e-01f, 1.71543792e-01f,
+    1.82691678e-01f, 1.94564000e-01f, 2.07207873e-01f, 2.20673412e-01f, 2.35014006e-01f, 2.50286549e-01f,
+    2.66551584e-01f, 2.83873588e-01f, 3.02321315e-01f, 3.21967840e-01f, 3.42891127e-01f, 3.65174115e-01f,
+    3.88905197e-01f, 4.14178461e-01f, 4.41094100e-01f, 4.69758868e-01f, 5.00286460e-01f, 5.32797873e-01f,
+    5.67422092e-01f, 6.04296386e-01f, 6.43566966e-01f, 6.85389578e-01f, 7.29930043e-01f, 7.77365029e-01f,
+    8.27882588e-01f, 8.81683052e-01f, 9.38979805e-01f, 1.00000000e+00f
+};
+
+
+/*
+    Packet bit reader, 2.1.4. Bits are packed lsb first. Reading past the end of the packet sets 'eop' and returns 0.
+*/
+struct VorbisBits
+{
+    const unsigned char    *data;
+    unsigned int            bits;
+    unsigned int            pos;
+    bool                    eop;
+};
+
+static inline unsigned long long VorbisBits_Peek(const VorbisBits *bits)
+{
+    unsigned int byte = bits->pos >> 3;
+    unsigned int length = bits->bits >> 3;
+    unsigned long long value = 0;
+
+    if (byte + 8 <= length)
+    {
+        memcpy(&value, bits->data + byte, 8);   /* Little endian */
+    }
+    else
+    {
+        for (unsigned int count = 0; byte + count < length; count++)
+        {
+            value |= (unsigned long long)bits->data[byte + count] << (count * 8);
+        }
+    }
+
+    return value >> (bits->pos & 7);
+}
+
+static inline unsigned int VorbisBits_Read(VorbisBits *bits, int count)
+{
+    if (bits->pos + count > bits->bits)
+    {
+        bits->eop = true;
+        bits->pos = bits->bits;
+        return 0;
+    }
+
+    unsigned int value = (unsigned int)VorbisBits_Peek(bits);
+    if (count < 32)
+    {
+        value &= (1u << count) - 1;
+    }
+    bits->pos += count;
+    return value;
+}
+
+static int VorbisILog(unsigned int value)
+{
+    int bits = 0;
+    while (value)
+    {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+static inline unsigned int VorbisBitReverse(unsigned int value)
+{
+    value = ((value & 0xAAAAAAAA) >> 1) | ((value & 0x55555555) << 1);
+    value = ((value & 0xCCCCCCCC) >> 2) | ((value & 0x33333333) << 2);
+    value = ((value & 0xF0F0F0F0) >> 4) | ((value & 0x0F0F0F0F) << 4);
+    value = ((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8);
+    return (value >> 16) | (value << 16);
+}
+
+static float VorbisFloat32Unpack(unsigned int value)
+{
+    double mantissa = (double)(value & 0x1fffff);
+    if (value & 0x80000000)
+    {
+        mantissa = -mantissa;
+    }
+    return (float)ldexp(mantissa, (int)((value & 0x7fe00000) >> 21) - 788);
+}
+
+/*
+    9.2.3, the largest r where r^dimensions <= entries.
+*/
+static int VorbisLookup1Values(int entries, int dimensions)
+{
+    int values = (int)floor(exp(log((double)entries) / dimensions));
+
+    while (pow((double)values + 1, dimensions) <= entries)
+    {
+        values++;
+    }
+    while (values > 0 && pow((double)values, dimensions) > entries)
+    {
+        values--;
+    }
+    return values;
+}
+
+/*
+    Codebooks, 3.2.1.
+*/
+struct VorbisSortedCode
+{
+    unsigned int    code;
+    int             entry;
+};
+
+static int VorbisSortedCode_Compare(const void *a, const void *b)
+{
+    unsigned int codea = ((const VorbisSortedCode *)a)->code;
+    unsigned int codeb = ((const VorbisSortedCode *)b)->code;
+    return (codea < codeb) ? -1 : (codea > codeb) ? 1 : 0;
+}
+
+static FMOD_RESULT VorbisCodebook_Build(VorbisCodebook *book)
+{
+    unsigned int marker[33];
+    int used = 0;
+
+    unsigned int *codes = (unsigned int *)malloc(book->entries * sizeof(unsigned int));
+    if (!codes)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    /*
+        Assign codewords in entry order, each taking the lowest free code of its length.
+    */
+    memset(marker, 0, sizeof(marker));
+    for (int entry = 0; entry < book->entries; entry++)
+    {
+        int length = book->lengths[entry];
+        if (!length)
+        {
+            continue;
+        }
+
+        unsigned int code = marker[length];
+        if (length < 32 && (code >> length))
+        {
+            free(codes);
+            return FMOD_ERR_FORMAT;     /* Overspecified */
+        }
+        codes[entry] = code;
+        used++;
+
+        for (int bit = length; bit > 0; bit--)
+        {
+            if (marker[bit] & 1)
+            {
+                marker[bit] = (bit == 1) ? marker[1] + 1 : marker[bit - 1] << 1;
+                break;
+            }
+            marker[bit]++;
+        }
+        for (int bit = length + 1; bit < 33; bit++)
+        {
+            if ((marker[bit] >> 1) != code)
+            {
+                break;
+            }
+            code = marker[bit];
+            marker[bit] = marker[bit - 1] << 1;
+        }
+    }
+
+    for (int index = 0; index < (1 << VORBIS_FAST_BITS); index++)
+    {
+        book->fast[index] = -1;
+    }
+
+    VorbisSortedCode *sorted = (VorbisSortedCode *)malloc(book->entries * sizeof(VorbisSortedCode));
+    if (!sorted)
+    {
+        free(codes);
+        return FMOD_ERR_MEMORY;
+    }
+
+    book->numsorted = 0;
+    for (int entry = 0; entry < book->entries; entry++)
+    {
+        int length = book->lengths[entry];
+        if (!length)
+        {
+            continue;
+        }
+
+        if (used == 1)
+        {
+            /*
+                A book with a single entry decodes it whatever the bits say.
+            */
+            for (int index = 0; index < (1 << VORBIS_FAST_BITS); index++)
+            {
+                book->fast[index] = entry;
+            }
+        }
+        else if (length <= VORBIS_FAST_BITS)
+        {
+            unsigned int reversed = VorbisBitReverse(codes[entry]) >> (32 - length);
+            for (unsigned int index = reversed; index < (1u << VORBIS_FAST_BITS); index += 1u << length)
+            {
+                book->fast[index] = entry;
+            }
+        }
+        else
+        {
+            sorted[book->numsorted].code = codes[entry] << (32 - length);
+            sorted[book->numsorted].entry = entry;
+            book->numsorted++;
+        }
+    }
+    free(codes);
+
+    if (book->numsorted)
+    {
+        qsort(sorted, book->numsorted, sizeof(VorbisSortedCode), VorbisSortedCode_Compare);
+
+        book->sortedcodes = (unsigned int *)malloc(book->numsorted * sizeof(unsigned int));
+        book->sortedentries = (int *)malloc(book->numsorted * sizeof(int));
+        if (!book->sortedcodes || !book->sortedentries)
+        {
+            free(sorted);
+            return FMOD_ERR_MEMORY;
+        }
+        for (int index = 0; index < book->numsorted; index++)
+        {
+            book->sortedcodes[index] = sorted[index].code;
+            book->sortedentries[index] = sorted[index].entry;
+        }
+    }
+    free(sorted);
+
+    return FMOD_OK;
+}
+
+static FMOD_RESULT VorbisCodebook_Parse(VorbisCodebook *book, VorbisBits *bits)
+{
+    if (VorbisBits_Read(bits, 24) != 0x564342)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    book->dimensions = VorbisBits_Read(bits, 16);
+    book->entries = VorbisBits_Read(bits, 24);
+    if (!book->entries || bits->eop)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    book->lengths = (unsigned char *)calloc(book->entries, 1);
+    if (!book->lengths)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    if (!VorbisBits_Read(bits, 1))
+    {
+        bool sparse = VorbisBits_Read(bits, 1) != 0;
+
+        for (int entry = 0; entry < book->entries; entry++)
+        {
+            if (!sparse || VorbisBits_Read(bits, 1))
+            {
+                book->lengths[entry] = (unsigned char)(VorbisBits_Read(bits, 5) + 1);
+            }
+        }
+    }
+    else
+    {
+        /*
+            Ordered, runs of entries with increasing lengths.
+        */
+        int entry = 0;
+        int length = VorbisBits_Read(bits, 5) + 1;
+
+        while (entry < book->entries)
+        {
+            int number = VorbisBits_Read(bits, VorbisILog(book->entries - entry));
+            if (entry + number > book->entries || length > 32 || bits->eop)
+            {
+                return FMOD_ERR_FORMAT;
+            }
+            memset(book->lengths + entry, length, number);
+            entry += number;
+            length++;
+        }
+    }
+
+    int lookup = VorbisBits_Read(bits, 4);
+    if (lookup == 1 || lookup == 2)
+    {
+        float minimum = VorbisFloat32Unpack(VorbisBits_Read(bits, 32));
+        float delta = VorbisFloat32Unpack(VorbisBits_Read(bits, 32));
+        int valuebits = VorbisBits_Read(bits, 4) + 1;
+        bool sequence = VorbisBits_Read(bits, 1) != 0;
+        long long numvalues = (lookup == 1) ? VorbisLookup1Values(book->entries, book->dimensions) : (long long)book->entries * book->dimensions;
+
+        if (!book->dimensions || numvalues <= 0 || (long long)book->entries * book->dimensions > VORBIS_MAX_VECTOR_FLOATS || bits->eop)
+        {
+            return FMOD_ERR_FORMAT;
+        }
+
+        unsigned short *multiplicands = (unsigned short *)malloc((size_t)numvalues * sizeof(unsigned short));
+        book->vectors = (float *)malloc((size_t)book->entries * book->dimensions * sizeof(float));
+        if (!multiplicands || !book->vectors)
+        {
+            free(multiplicands);
+            return FMOD_ERR_MEMORY;
+        }
+        for (long long index = 0; index < numvalues; index++)
+        {
+            multiplicands[index] = (unsigned short)VorbisBits_Read(bits, valuebits);
+        }
+
+        /*
+            Unpack every entry's vector now rather than on each decode, 9.2.3 and 9.2.4.
+        */
+        for (int entry = 0; entry < book->entries; entry++)
+        {
+            float *vector = book->vectors + entry * book->dimensions;
+            float last = 0.0f;
+            unsigned long long divisor = 1;
+
+            for (int dim = 0; dim < book->dimensions; dim++)
+            {
+                long long offset = (lookup == 1) ? (long long)((entry / divisor) % numvalues) : (long long)entry * book->dimensions + dim;
+                float value = multiplicands[offset] * delta + minimum + last;
+                if (sequence)
+                {
+                    last = value;
+                }
+                vector[dim] = value;
+                if (divisor <= (unsigned long long)book->entries)
+                {
+                    divisor *= numvalues;
+                }
+            }
+        }
+        free(multiplicands);
+    }
+    else if (lookup != 0)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    if (bits->eop)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    return VorbisCodebook_Build(book);
+}
+
+static void VorbisCodebook_Release(VorbisCodebook *book)
+{
+    free(book->lengths);
+    free(book->sortedcodes);
+    free(book->sortedentries);
+    free(book->vectors);
+}
+
+/*
+    Returns the entry, or -1 at the end of the packet or on a codeword that isn't in the book.
+*/
+static inline int VorbisCodebook_Decode(const VorbisCodebook *book, VorbisBits *bits)
+{
+    unsigned long long value = VorbisBits_Peek(bits);
+    int entry = book->fast[value & ((1 << VORBIS_FAST_BITS) - 1)];
+
+    if (entry < 0 && book->numsorted)
+    {
+        unsigned int code = VorbisBitReverse((unsigned int)value);
+        int lo = 0;
+        int hi = book->numsorted;
+
+        while (hi - lo > 1)
+        {
+            int mid = (lo + hi) >> 1;
+            if (book->sortedcodes[mid] <= code)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        int length = book->lengths[book->sortedentries[lo]];
+        if (book->sortedcodes[lo] <= code && ((code ^ book->sortedcodes[lo]) >> (32 - length)) == 0)
+        {
+            entry = book->sortedentries[lo];
+        }
+    }
+
+    if (entry < 0 || bits->pos + book->lengths[entry] > bits->bits)
+    {
+        bits->eop = true;
+        bits->pos = bits->bits;
+        return -1;
+    }
+
+    bits->pos += book->lengths[entry];
+    return entry;
+}
+
+/*
+    Floor type 1, 7.2.
+*/
+static FMOD_RESULT VorbisFloor_Parse(VorbisFloor *floor, VorbisBits *bits, int numcodebooks)
+{
+    int maxclass = -1;
+
+    floor->partitions = VorbisBits_Read(bits, 5);
+    for (int partition = 0; partition < floor->partitions; partition++)
+    {
+        floor->partitionclass[partition] = (unsigned char)VorbisBits_Read(bits, 4);
+        if (floor->partitionclass[partition] > maxclass)
+        {
+            maxclass = floor->partitionclass[partition];
+        }
+    }
+
+    for (int cls = 0; cls <= maxclass; cls++)
+    {
+        floor->classdimensions[cls] = (unsigned char)(VorbisBits_Read(bits, 3) + 1);
+        floor->classsubclasses[cls] = (unsigned char)VorbisBits_Read(bits, 2);
+        floor->classmasterbook[cls] = -1;
+        if (floor->classsubclasses[cls])
+        {
+            floor->classmasterbook[cls] = (short)VorbisBits_Read(bits, 8);
+            if (floor->classmasterbook[cls] >= numcodebooks)
+            {
+                return FMOD_ERR_FORMAT;
+            }
+        }
+        for (int sub = 0; sub < (1 << floor->classsubclasses[cls]); sub++)
+        {
+            floor->subclassbooks[cls][sub] = (short)((int)VorbisBits_Read(bits, 8) - 1);
+            if (floor->subclassbooks[cls][sub] >= numcodebooks)
+            {
+                return FMOD_ERR_FORMAT;
+            }
+        }
+    }
+
+    floor->multiplier = VorbisBits_Read(bits, 2) + 1;
+    int rangebits = VorbisBits_Read(bits, 4);
+
+    floor->x[0] = 0;
+    floor->x[1] = 1 << rangebits;
+    floor->values = 2;
+    for (int partition = 0; partition < floor->partitions; partition++)
+    {
+        int cls = floor->partitionclass[partition];
+        for (int dim = 0; dim < floor->classdimensions[cls]; dim++)
+        {
+            if (floor->values >= VORBIS_FLOOR1_MAX_VALUES)
+            {
+                return FMOD_ERR_FORMAT;
+            }
+            floor->x[floor->values++] = VorbisBits_Read(bits, rangebits);
+        }
+    }
+
+    /*
+        Sort order and neighbours only depend on the x list, so work them out once here.
+    */
+    for (int index = 0; index < floor->values; index++)
+    {
+        int pos = index;
+        while (pos > 0 && floor->x[floor->sorted[pos - 1]] > floor->x[index])
+        {
+            floor->sorted[pos] = floor->sorted[pos - 1];
+            pos--;
+        }
+        floor->sorted[pos] = (unsigned char)index;
+    }
+    for (int index = 1; index < floor->values; index++)
+    {
+        if (floor->x[floor->sorted[index]] == floor->x[floor->sorted[index - 1]])
+        {
+            return FMOD_ERR_FORMAT;
+        }
+    }
+
+    for (int index = 2; index < floor->values; index++)
+    {
+        int low = 0;
+        int high = 1;
+
+        for (int prev = 0; prev < index; prev++)
+        {
+            if (floor->x[prev] < floor->x[index] && floor->x[prev] > floor->x[low])
+            {
+                low = prev;
+            }
+            if (floor->x[prev] > floor->x[index] && floor->x[prev] < floor->x[high])
+            {
+                high = prev;
+            }
+        }
+        floor->low[index] = (unsigned char)low;
+        floor->high[index] = (unsigned char)high;
+    }
+
+    return bits->eop ? FMOD_ERR_FORMAT : FMOD_OK;
+}
+
+static inline int VorbisRenderPoint(int x0, int y0, int x1, int y1, int x)
+{
+    int dy = y1 - y0;
+    int offset = abs(dy) * (x - x0) / (x1 - x0);
+    return (dy < 0) ? y0 - offset : y0 + offset;
+}
+
+static void VorbisRenderLine(int x0, int y0, int x1, int y1, float *out, int n)
+{
+    int dy = y1 - y0;
+    int adx = x1 - x0;
+    int base = dy / adx;
+    int ady = abs(dy) - abs(base) * adx;
+    int sy = (dy < 0) ? base - 1 : base + 1;
+    int y = y0;
+    int err = 0;
+
+    if (x1 > n)
+    {
+        x1 = n;
+    }
+    if (x0 < x1)
+    {
+        out[x0] = VORBIS_INVERSE_DB[y & 255];
+    }
+    for (int x = x0 + 1; x < x1; x++)
+    {
+        err += ady;
+        if (err >= adx)
+        {
+            err -= adx;
+            y += sy;
+        }
+        else
+        {
+            y += base;
+        }
+        out[x] = VORBIS_INVERSE_DB[y & 255];
+    }
+}
+
+/*
+    Decodes and synthesizes the floor curve into 'out', 7.2.3 and 7.2.4. Returns false if the channel is unused.
+*/
+static bool VorbisFloor_Decode(const VorbisFloor *floor, const VorbisCodebook *books, VorbisBits *bits, int n, float *out)
+{
+    static const int ranges[4] = { 256, 128, 86, 64 };
+    int y[VORBIS_FLOOR1_MAX_VALUES];
+    int finaly[VORBIS_FLOOR1_MAX_VALUES];
+    bool step2[VORBIS_FLOOR1_MAX_VALUES];
+
+    if (!VorbisBits_Read(bits, 1))
+    {
+        return false;
+    }
+
+    int range = ranges[floor->multiplier - 1];
+    int ybits = VorbisILog(range - 1);
+    int offset = 2;
+
+    y[0] = VorbisBits_Read(bits, ybits);
+    y[1] = VorbisBits_Read(bits, ybits);
+
+    for (int partition = 0; partition < floor->partitions; partition++)
+    {
+        int cls = floor->partitionclass[partition];
+        int cbits = floor->classsubclasses[cls];
+        int csub = (1 << cbits) - 1;
+        int cval = 0;
+
+        if (cbits)
+        {
+            cval = VorbisCodebook_Decode(&books[floor->classmasterbook[cls]], bits);
+        }
+        for (int dim = 0; dim < floor->classdimensions[cls]; dim++)
+        {
+            int book = floor->subclassbooks[cls][cval & csub];
+            cval >>= cbits;
+            y[offset + dim] = (book >= 0) ? VorbisCodebook_Decode(&books[book], bits) : 0;
+        }
+        offset += floor->classdimensions[cls];
+    }
+
+    if (bits->eop)
+    {
+        return false;
+    }
+
+    /*
+        Amplitude values.
+    */
+    finaly[0] = y[0];
+    finaly[1] = y[1];
+    step2[0] = true;
+    step2[1] = true;
+
+    for (int index = 2; index < floor->values; index++)
+    {
+        int low = floor->low[index];
+        int high = floor->high[index];
+        int predicted = VorbisRenderPoint(floor->x[low], finaly[low], floor->x[high], finaly[high], floor->x[index]);
+        int value = y[index];
+        int highroom = range - predicted;
+        int lowroom = predicted;
+        int room = ((highroom < lowroom) ? highroom : lowroom) * 2;
+
+        if (value)
+        {
+            step2[low] = true;
+            step2[high] = true;
+            step2[index] = true;
+
+            if (value >= room)
+            {
+                finaly[index] = (highroom > lowroom) ? value - lowroom + predicted : predicted - value + highroom - 1;
+            }
+            else
+            {
+                finaly[index] = (value & 1) ? predicted - ((value + 1) >> 1) : predicted + (value >> 1);
+            }
+        }
+        else
+        {
+            step2[index] = false;
+            finaly[index] = predicted;
+        }
+    }
+
+    /*
+        Curve, straight lines between the points that were used.
+    */
+    int lx = 0;
+    int ly = finaly[floor->sorted[0]] * floor->multiplier;
+
+    for (int index = 1; index < floor->values; index++)
+    {
+        int point = floor->sorted[index];
+        if (step2[point])
+        {
+            int hx = floor->x[point];
+            int hy = finaly[point] * floor->multiplier;
+            VorbisRenderLine(lx, ly, hx, hy, out, n);
+            lx = hx;
+            ly = hy;
+        }
+    }
+    if (lx < n)
+    {
+        VorbisRenderLine(lx, ly, n, ly, out, n);
+    }
+
+    return true;
+}
+
+/*
+    Residue, 8.6.
+*/
+static FMOD_RESULT VorbisResidue_Parse(VorbisResidue *residue, VorbisBits *bits, const VorbisCodebook *books, int numcodebooks)
+{
+    int cascade[64];
+
+    residue->begin = VorbisBits_Read(bits, 24);
+    residue->end = VorbisBits_Read(bits, 24);
+    residue->partitionsize = VorbisBits_Read(bits, 24) + 1;
+    residue->classifications = VorbisBits_Read(bits, 6) + 1;
+    residue->classbook = VorbisBits_Read(bits, 8);
+
+    if (residue->classbook >= numcodebooks || !books[residue->classbook].dimensions)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    for (int cls = 0; cls < residue->classifications; cls++)
+    {
+        int low = VorbisBits_Read(bits, 3);
+        int high = VorbisBits_Read(bits, 1) ? VorbisBits_Read(bits, 5) : 0;
+        cascade[cls] = high * 8 + low;
+    }
+    for (int cls = 0; cls < residue->classifications; cls++)
+    {
+        for (int pass = 0; pass < 8; pass++)
+        {
+            residue->books[cls][pass] = -1;
+            if (cascade[cls] & (1 << pass))
+            {
+                int book = VorbisBits_Read(bits, 8);
+                if (book >= numcodebooks || !books[book].vectors)
+                {
+                    return FMOD_ERR_FORMAT;
+                }
+                residue->books[cls][pass] = (short)book;
+            }
+        }
+    }
+
+    return bits->eop ? FMOD_ERR_FORMAT : FMOD_OK;
+}
+
+/*
+    Partitions to read for 'channels' channels of 'n' samples, also the number of classifications to store per vector.
+*/
+static unsigned int VorbisResidue_Partitions(const VorbisResidue *residue, int channels, unsigned int n)
+{
+    unsigned int size = (residue->type == 2) ? n * channels : n;
+    unsigned int begin = (residue->begin < size) ? residue->begin : size;
+    unsigned int end = (residue->end < size) ? residue->end : size;
+
+    return (end - begin) / residue->partitionsize;
+}
+
+static void VorbisResidue_Decode(const VorbisResidue *residue, const VorbisCodebook *books, VorbisBits *bits, float **vectors, const bool *decode, int channels, unsigned int n, unsigned char *classifications)
+{
+    const VorbisCodebook *classbook = &books[residue->classbook];
+    unsigned int partitions = VorbisResidue_Partitions(residue, channels, n);
+    unsigned int psize = residue->partitionsize;
+    int numvectors = channels;
+    bool decodeany = false;
+
+    if (!partitions)
+    {
+        return;
+    }
+
+    for (int channel = 0; channel < channels; channel++)
+    {
+        decodeany |= decode[channel];
+    }
+    if (!decodeany)
+    {
+        return;
+    }
+
+    /*
+        Format 2 decodes all the channels as one interleaved vector.
+    */
+    static const bool decodeall[1] = { true };
+    if (residue->type == 2)
+    {
+        numvectors = 1;
+        decode = decodeall;
+    }
+
+    for (int pass = 0; pass < 8; pass++)
+    {
+        unsigned int partition = 0;
+
+        while (partition < partitions)
+        {
+            if (pass == 0)
+            {
+                for (int vec = 0; vec < numvectors; vec++)
+                {
+                    if (!decode[vec])
+                    {
+                        continue;
+                    }
+
+                    int temp = VorbisCodebook_Decode(classbook, bits);
+                    if (temp < 0)
+                    {
+                        return;
+                    }
+                    for (int dim = classbook->dimensions - 1; dim >= 0; dim--)
+                    {
+                        if (partition + dim < partitions)
+                        {
+                            classifications[vec * partitions + partition + dim] = (unsigned char)(temp % residue->classifications);
+                        }
+                        temp /= residue->classifications;
+                    }
+                }
+            }
+
+            for (int word = 0; word < classbook->dimensions && partition < partitions; word++, partition++)
+            {
+                for (int vec = 0; vec < numvectors; vec++)
+                {
+                    if (!decode[vec])
+                    {
+                        continue;
+                    }
+
+                    int bookindex = residue->books[classifications[vec * partitions + partition]][pass];
+                    if (bookindex < 0)
+                    {
+                        continue;
+                    }
+
+                    const VorbisCodebook *book = &books[bookindex];
+                    unsigned int offset = residue->begin + partition * psize;
+                    int dims = book->dimensions;
+
+                    if (residue->type == 0)
+                    {
+                        float *out = vectors[vec] + offset;
+                        unsigned int step = psize / dims;
+
+                        for (unsigned int count = 0; count < step; count++)
+                        {
+                            int entry = VorbisCodebook_Decode(book, bits);
+                            if (entry < 0)
+                            {
+                                return;
+                            }
+                            const float *values = book->vectors + entry * dims;
+                            for (int dim = 0; dim < dims; dim++)
+                            {
+                                out[count + dim * step] += values[dim];
+                            }
+                        }
+                    }
+                    else if (residue->type == 1)
+                    {
+                        float *out = vectors[vec] + offset;
+
+                        for (unsigned int count = 0; count < psize; )
+                        {
+                            int entry = VorbisCodebook_Decode(book, bits);
+                            if (entry < 0)
+                            {
+                                return;
+                            }
+                            const float *values = book->vectors + entry * dims;
+                            for (int dim = 0; dim < dims && count < psize; dim++)
+                            {
+                                out[count++] += values[dim];
+                            }
+                        }
+                    }
+                    else
+                    {
+                        /*
+                            Deinterleave as we go rather than decoding into a scratch vector.
+                        */
+                        int channel = offset % channels;
+                        unsigned int index = offset / channels;
+
+                        for (unsigned int count = 0; count < psize; )
+                        {
+                            int entry = VorbisCodebook_Decode(book, bits);
+                            if (entry < 0)
+                            {
+                                return;
+                            }
+                            const float *values = book->vectors + entry * dims;
+                            for (int dim = 0; dim < dims && count < psize; dim++, count++)
+                            {
+                                vectors[channel][index] += values[dim];
+                                if (++channel == channels)
+                                {
+                                    channel = 0;
+                                    index++;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+    Inverse MDCT, 1.3.2. The n/2 coefficients are folded into an n/4 point complex sequence, transformed with a radix 2
+    FFT and unfolded again, which gives a DCT-IV of length n/2. The n outputs are that DCT-IV with its symmetries applied.
+*/
+static void VorbisMDCT_Release(VorbisMDCT *mdct)
+{
+    if (mdct)
+    {
+        free(mdct->bitrev);
+        free(mdct->pre);
+        free(mdct->post);
+        free(mdct->twiddles);
+        free(mdct->re);
+        free(mdct->im);
+        free(mdct->z);
+        free(mdct);
+    }
+}
+
+static VorbisMDCT *VorbisMDCT_Create(int n)
+{
+    int half = n >> 1;
+    int quarter = n >> 2;
+    int bits = VorbisILog(quarter) - 1;
+
+    VorbisMDCT *mdct = (VorbisMDCT *)calloc(1, sizeof(VorbisMDCT));
+    if (!mdct)
+    {
+        return 0;
+    }
+
+    mdct->n = n;
+    mdct->bitrev = (int *)malloc(quarter * sizeof(int));
+    mdct->pre = (float *)malloc(2 * quarter * sizeof(float));
+    mdct->post = (float *)malloc(2 * quarter * sizeof(float));
+    mdct->twiddles = (float *)malloc(2 * quarter * sizeof(float));
+    mdct->re = (float *)malloc(quarter * sizeof(float));
+    mdct->im = (float *)malloc(quarter * sizeof(float));
+    mdct->z = (float *)malloc(half * sizeof(float));
+    if (!mdct->bitrev || !mdct->pre || !mdct->post || !mdct->twiddles || !mdct->re || !mdct->im || !mdct->z)
+    {
+        VorbisMDCT_Release(mdct);
+        return 0;
+    }
+
+    for (int index = 0; index < quarter; index++)
+    {
+        mdct->bitrev[index] = (int)(VorbisBitReverse(index) >> (32 - bits));
+        mdct->pre[index] = (float)cos(M_PI * index / half);
+        mdct->pre[quarter + index] = (float)-sin(M_PI * index / half);
+        mdct->post[index] = (float)cos(M_PI * (index + 0.25) / half);
+        mdct->post[quarter + index] = (float)-sin(M_PI * (index + 0.25) / half);
+    }
+
+    float *twiddles = mdct->twiddles;
+    for (int h = 4; h < quarter; h <<= 1)
+    {
+        for (int k = 0; k < h; k++)
+        {
+            twiddles[k] = (float)cos(M_PI * k / h);
+            twiddles[h + k] = (float)-sin(M_PI * k / h);
+        }
+        twiddles += 2 * h;
+    }
+
+    return mdct;
+}
+
+static void VorbisMDCT_Inverse(const VorbisMDCT *mdct, const float *in, float *out)
+{
+    int n = mdct->n;
+    int half = n >> 1;
+    int quarter = n >> 2;
+    float *re = mdct->re;
+    float *im = mdct->im;
+    float *z = mdct->z;
+    const float *pre = mdct->pre;
+    const float *post = mdct->post;
+    int index = 0;
+
+    /*
+        Fold even coefficients and reversed odd ones into complex pairs, pre twiddle, and store in bit reversed order.
+    */
+#if defined(__SSE2__)
+    for (; index < quarter; index += 4)
+    {
+        __m128 lo = _mm_loadu_ps(in + 2 * index);
+        __m128 hi = _mm_loadu_ps(in + 2 * index + 4);
+        __m128 a = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+        lo = _mm_loadu_ps(in + half - 8 - 2 * index);
+        hi = _mm_loadu_ps(in + half - 4 - 2 * index);
+        __m128 b = _mm_shuffle_ps(hi, lo, _MM_SHUFFLE(1, 3, 1, 3));
+        __m128 c = _mm_loadu_ps(pre + index);
+        __m128 s = _mm_loadu_ps(pre + quarter + index);
+        float r[4], i[4];
+
+        _mm_storeu_ps(r, _mm_sub_ps(_mm_mul_ps(a, c), _mm_mul_ps(b, s)));
+        _mm_storeu_ps(i, _mm_add_ps(_mm_mul_ps(a, s), _mm_mul_ps(b, c)));
+        for (int k = 0; k < 4; k++)
+        {
+            int dest = mdct->bitrev[index + k];
+            re[dest] = r[k];
+            im[dest] = i[k];
+        }
+    }
+#endif
+    for (; index < quarter; index++)
+    {
+        float a = in[2 * index];
+        float b = in[half - 1 - 2 * index];
+        float c = pre[index];
+        float s = pre[quarter + index];
+        int dest = mdct->bitrev[index];
+
+        re[dest] = a * c - b * s;
+        im[dest] = a * s + b * c;
+    }
+
+    /*
+        First two FFT passes together, their twiddles are 1 and -i.
+    */
+    for (index = 0; index < quarter; index += 4)
+    {
+        float r0 = re[index] + re[index + 1], i0 = im[index] + im[index + 1];
+        float r1 = re[index] - re[index + 1], i1 = im[index] - im[index + 1];
+        float r2 = re[index + 2] + re[index + 3], i2 = im[index + 2] + im[index + 3];
+        float r3 = re[index + 2] - re[index + 3], i3 = im[index + 2] - im[index + 3];
+
+        re[index]     = r0 + r2;  im[index]     = i0 + i2;
+        re[index + 2] = r0 - r2;  im[index + 2] = i0 - i2;
+        re[index + 1] = r1 + i3;  im[index + 1] = i1 - r3;
+        re[index + 3] = r1 - i3;  im[index + 3] = i1 + r3;
+    }
+
+    /*
+        Remaining passes, four butterflies at a time.
+    */
+    const float *twiddles = mdct->twiddles;
+    for (int h = 4; h < quarter; h <<= 1)
+    {
+        for (int group = 0; group < quarter; group += 2 * h)
+        {
+            float *ar = re + group, *ai = im + group;
+            float *br = ar + h, *bi = ai + h;
+            int k = 0;
+
+#if defined(__SSE2__)
+            for (; k < h; k += 4)
+            {
+                __m128 wr = _mm_loadu_ps(twiddles + k);
+                __m128 wi = _mm_loadu_ps(twiddles + h + k);
+                __m128 xr = _mm_loadu_ps(br + k);
+                __m128 xi = _mm_loadu_ps(bi + k);
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+                __m128 yr = _mm_loadu_ps(ar + k);
+                __m128 yi = _mm_loadu_ps(ai + k);
+
+                _mm_storeu_ps(ar + k, _mm_add_ps(yr, tr));
+                _mm_storeu_ps(ai + k, _mm_add_ps(yi, ti));
+                _mm_storeu_ps(br + k, _mm_sub_ps(yr, tr));
+                _mm_storeu_ps(bi + k, _mm_sub_ps(yi, ti));
+            }
+#endif
+            for (; k < h; k++)
+            {
+                float wr = twiddles[k], wi = twiddles[h + k];
+                float tr = br[k] * wr - bi[k] * wi;
+                float ti = br[k] * wi + bi[k] * wr;
+
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] += tr;
+                ai[k] += ti;
+            }
+        }
+        twiddles += 2 * h;
+    }
+
+    /*
+        Post twiddle and unfold into the DCT-IV output.
+    */
+    index = 0;
+#if defined(__SSE2__)
+    for (; index < quarter; index += 4)
+    {
+        __m128 cr = _mm_loadu_ps(re + index);
+        __m128 ci = _mm_loadu_ps(im + index);
+        __m128 wr = _mm_loadu_ps(post + index);
+        __m128 wi = _mm_loadu_ps(post + quarter + index);
+        float r[4], i[4];
+
+        _mm_storeu_ps(r, _mm_sub_ps(_mm_mul_ps(cr, wr), _mm_mul_ps(ci, wi)));
+        _mm_storeu_ps(i, _mm_add_ps(_mm_mul_ps(cr, wi), _mm_mul_ps(ci, wr)));
+        for (int k = 0; k < 4; k++)
+        {
+            z[2 * (index + k)] = r[k];
+            z[half - 1 - 2 * (index + k)] = -i[k];
+        }
+    }
+#endif
+    for (; index < quarter; index++)
+    {
+        float dr = re[index] * post[index] - im[index] * post[quarter + index];
+        float di = re[index] * post[quarter + index] + im[index] * post[index];
+
+        z[2 * index] = dr;
+        z[half - 1 - 2 * index] = -di;
+    }
+
+    /*
+        Apply the DCT-IV's symmetries to fill all n outputs.
+    */
+    memcpy(out, z + quarter, quarter * sizeof(float));
+
+    float *dest = out + quarter;
+    index = 0;
+#if defined(__SSE2__)
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    for (; index < half; index += 4)
+    {
+        __m128 v = _mm_loadu_ps(z + half - 4 - index);
+        _mm_storeu_ps(dest + index, _mm_xor_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)), sign));
+    }
+#endif
+    for (; index < half; index++)
+    {
+        dest[index] = -z[half - 1 - index];
+    }
+
+    dest = out + half + quarter;
+    index = 0;
+#if defined(__SSE2__)
+    for (; index < quarter; index += 4)
+    {
+        _mm_storeu_ps(dest + index, _mm_xor_ps(_mm_loadu_ps(z + index), sign));
+    }
+#endif
+    for (; index < quarter; index++)
+    {
+        dest[index] = -z[index];
+    }
+}
+
+/*
+    Vector helpers for the per sample stages of a packet.
+*/
+static void VorbisMultiply(float *dest, const float *src, int count)
+{
+    int index = 0;
+#if defined(__SSE2__)
+    for (; index + 4 <= count; index += 4)
+    {
+        _mm_storeu_ps(dest + index, _mm_mul_ps(_mm_loadu_ps(dest + index), _mm_loadu_ps(src + index)));
+    }
+#endif
+    for (; index < count; index++)
+    {
+        dest[index] *= src[index];
+    }
+}
+
+static void VorbisMultiplyReversed(float *dest, const float *src, int count)
+{
+    int index = 0;
+#if defined(__SSE2__)
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128 v = _mm_loadu_ps(src + count - 4 - index);
+        _mm_storeu_ps(dest + index, _mm_mul_ps(_mm_loadu_ps(dest + index), _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3))));
+    }
+#endif
+    for (; index < count; index++)
+    {
+        dest[index] *= src[count - 1 - index];
+    }
+}
+
+static void VorbisAdd(float *dest, const float *src, int count)
+{
+    int index = 0;
+#if defined(__SSE2__)
+    for (; index + 4 <= count; index += 4)
+    {
+        _mm_storeu_ps(dest + index, _mm_add_ps(_mm_loadu_ps(dest + index), _mm_loadu_ps(src + index)));
+    }
+#endif
+    for (; index < count; index++)
+    {
+        dest[index] += src[index];
+    }
+}
+
+/*
+    Square polar channel coupling, 4.3.5.
+*/
+static void VorbisInverseCoupling(float *magnitude, float *angle, int count)
+{
+    int index = 0;
+#if defined(__SSE2__)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128 m = _mm_loadu_ps(magnitude + index);
+        __m128 a = _mm_loadu_ps(angle + index);
+        __m128 s = _mm_xor_ps(a, _mm_and_ps(_mm_cmpgt_ps(m, zero), sign));    /* m > 0 ? -a : a */
+        __m128 apos = _mm_cmpgt_ps(a, zero);
+        __m128 newm = _mm_or_ps(_mm_and_ps(apos, m), _mm_andnot_ps(apos, _mm_sub_ps(m, s)));
+        __m128 newa = _mm_or_ps(_mm_and_ps(apos, _mm_add_ps(m, s)), _mm_andnot_ps(apos, m));
+
+        _mm_storeu_ps(magnitude + index, newm);
+        _mm_storeu_ps(angle + index, newa);
+    }
+#endif
+    for (; index < count; index++)
+    {
+        float m = magnitude[index];
+        float a = angle[index];
+
+        if (m > 0.0f)
+        {
+            if (a > 0.0f)
+            {
+                angle[index] = m - a;
+            }
+            else
+            {
+                angle[index] = m;
+                magnitude[index] = m + a;
+            }
+        }
+        else
+        {
+            if (a > 0.0f)
+            {
+                angle[index] = m + a;
+            }
+            else
+            {
+                angle[index] = m;
+                magnitude[index] = m - a;
+            }
+        }
+    }
+}
+
+/*
+    Writes 'count' samples from each channel into 'dest', interleaved.
+*/
+static void VorbisInterleave(float *dest, int channels, const float * const *src, unsigned int count)
+{
+    unsigned int index = 0;
+
+    if (channels == 1)
+    {
+        memcpy(dest, src[0], count * sizeof(float));
+        return;
+    }
+
+#if defined(__SSE2__)
+    if (channels == 2)
+    {
+        for (; index + 4 <= count; index += 4)
+        {
+            __m128 l = _mm_loadu_ps(src[0] + index);
+            __m128 r = _mm_loadu_ps(src[1] + index);
+            _mm_storeu_ps(dest + index * 2, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(dest + index * 2 + 4, _mm_unpackhi_ps(l, r));
+        }
+    }
+#endif
+
+    dest += index * channels;
+    for (; index < count; index++)
+    {
+        for (int channel = 0; channel < channels; channel++)
+        {
+            *dest++ = src[channel][index];
+        }
+    }
+}
+/*
+    Ogg page checksum, polynomial 0x04c11db7 without reflection.
+*/
+static void VorbisCRC_Build(unsigned int *table)
+{
+    for (unsigned int index = 0; index < 256; index++)
+    {
+        unsigned int value = index << 24;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            value = (value & 0x80000000) ? (value << 1) ^ 0x04c11db7 : value << 1;
+        }
+        table[index] = value;
+    }
+}
+
+static unsigned int VorbisCRC(const unsigned int *table, unsigned int crc, const unsigned char *data, unsigned int length)
+{
+    for (unsigned int index = 0; index < length; index++)
+    {
+        crc = (crc << 8) ^ table[(crc >> 24) ^ data[index]];
+    }
+    return crc;
+}
+
+VorbisDecoder::VorbisDecoder()
+{
+    clear();
+    VorbisCRC_Build(m_crctable);
+}
+
+/*
+    Back to how the constructor left it, so release can be followed by another open.
+*/
+void VorbisDecoder::clear()
+{
+    m_read = 0;
+    m_seek = 0;
+    m_handle = 0;
+    m_userdata = 0;
+    m_filesize = 0;
+    m_fileoffset = 0;
+    memset(m_header, 0, sizeof(m_header));
+    m_body = 0;
+    m_bodylength = 0;
+    m_bodypos = 0;
+    m_numsegments = 0;
+    m_segment = 0;
+    m_lastcomplete = -1;
+    m_granule = -1;
+    m_serial = 0;
+    m_eos = false;
+    m_packet = 0;
+    m_packetsize = 0;
+    m_audiooffset = 0;
+    m_channels = 0;
+    m_rate = 0;
+    m_blocksize[0] = m_blocksize[1] = 0;
+    m_length = 0;
+    m_comments = 0;
+    m_numcomments = 0;
+    m_numcodebooks = 0;
+    m_codebooks = 0;
+    m_numfloors = 0;
+    m_floors = 0;
+    m_numresidues = 0;
+    m_residues = 0;
+    m_nummappings = 0;
+    m_mappings = 0;
+    m_nummodes = 0;
+    m_modes = 0;
+    m_mdct[0] = m_mdct[1] = 0;
+    m_slope[0] = m_slope[1] = 0;
+    memset(m_spectrum, 0, sizeof(m_spectrum));
+    memset(m_floor, 0, sizeof(m_floor));
+    memset(m_window, 0, sizeof(m_window));
+    m_classifications = 0;
+    m_current = 0;
+    m_prevsize = 0;
+    m_cursize = 0;
+    m_leftstart = 0;
+    m_position = 0;
+    m_synced = false;
+    m_target = 0;
+    m_pending = 0;
+    m_pendingpos = 0;
+    m_pendingcount = 0;
+}
+
+FMOD_RESULT VorbisDecoder::open(FMOD_FILE_READ_CALLBACK readcallback, FMOD_FILE_SEEK_CALLBACK seekcallback, void *handle, void *userdata, unsigned int filesize)
+{
+    FMOD_RESULT result;
+    const unsigned char *data;
+    unsigned int length;
+    bool last;
+
+    m_read = readcallback;
+    m_seek = seekcallback;
+    m_handle = handle;
+    m_userdata = userdata;
+    m_filesize = filesize;
+    m_fileoffset = 0;
+
+    m_body = (unsigned char *)malloc(VORBIS_PAGE_MAX_BODY);
+    if (!m_body)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    /*
+        Anything that doesn't start with a beginning of stream page holding a Vorbis identification header isn't ours.
+    */
+    result = readPage(false);
+    if (result != FMOD_OK || !(m_header[5] & 2))
+    {
+        return FMOD_ERR_FORMAT;
+    }
+    m_serial = m_header[14] | (m_header[15] << 8) | (m_header[16] << 16) | ((unsigned int)m_header[17] << 24);
+
+    if (nextPacket(&data, &length, &last) != FMOD_OK)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+    result = parseIdentification(data, length);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    result = nextPacket(&data, &length, &last);
+    if (result != FMOD_OK)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+    result = parseComments(data, length);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    result = nextPacket(&data, &length, &last);
+    if (result != FMOD_OK)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+    result = parseSetup(data, length);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    /*
+        Audio starts on a fresh page, 4.2.1.
+    */
+    if (m_segment < m_numsegments)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+    m_audiooffset = m_fileoffset;
+
+    /*
+        Decode buffers.
+    */
+    int halfmax = m_blocksize[1] >> 1;
+
+    for (int size = 0; size < 2; size++)
+    {
+        int slopelength = m_blocksize[size] >> 1;
+
+        m_mdct[size] = VorbisMDCT_Create(m_blocksize[size]);
+        m_slope[size] = (float *)malloc(slopelength * sizeof(float));
+        if (!m_mdct[size] || !m_slope[size])
+        {
+            return FMOD_ERR_MEMORY;
+        }
+
+        /*
+            4.3.1
+        */
+        for (int index = 0; index < slopelength; index++)
+        {
+            double x = sin((index + 0.5) / slopelength * M_PI / 2.0);
+            m_slope[size][index] = (float)sin(M_PI / 2.0 * x * x);
+        }
+    }
+
+    for (int channel = 0; channel < m_channels; channel++)
+    {
+        m_spectrum[channel] = (float *)malloc(halfmax * sizeof(float));
+        m_floor[channel] = (float *)malloc(halfmax * sizeof(float));
+        m_window[channel][0] = (float *)calloc(m_blocksize[1], sizeof(float));
+        m_window[channel][1] = (float *)calloc(m_blocksize[1], sizeof(float));
+        if (!m_spectrum[channel] || !m_floor[channel] || !m_window[channel][0] || !m_window[channel][1])
+        {
+            return FMOD_ERR_MEMORY;
+        }
+    }
+
+    unsigned int maxclassifications = 1;
+    for (int index = 0; index < m_numresidues; index++)
+    {
+        unsigned int count = VorbisResidue_Partitions(&m_residues[index], m_channels, halfmax) * m_channels;
+        if (count > maxclassifications)
+        {
+            maxclassifications = count;
+        }
+    }
+    m_classifications = (unsigned char *)malloc(maxclassifications);
+    m_pending = (float *)malloc(halfmax * m_channels * sizeof(float));
+    if (!m_classifications || !m_pending)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    /*
+        The last page's granule position is the length.
+    */
+    if (m_filesize && m_seek)
+    {
+        result = findLength();
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    m_target = 0;
+    return restart(m_audiooffset, true);
+}
+
+void VorbisDecoder::release()
+{
+    if (m_codebooks)
+    {
+        for (int index = 0; index < m_numcodebooks; index++)
+        {
+            VorbisCodebook_Release(&m_codebooks[index]);
+        }
+        free(m_codebooks);
+        m_codebooks = 0;
+    }
+    if (m_comments)
+    {
+        for (int index = 0; index < m_numcomments; index++)
+        {
+            free(m_comments[index]);
+        }
+        free(m_comments);
+        m_comments = 0;
+    }
+
+    free(m_floors);
+    free(m_residues);
+    free(m_mappings);
+    free(m_modes);
+    m_floors = 0;
+    m_residues = 0;
+    m_mappings = 0;
+    m_modes = 0;
+
+    for (int size = 0; size < 2; size++)
+    {
+        VorbisMDCT_Release(m_mdct[size]);
+        free(m_slope[size]);
+        m_mdct[size] = 0;
+        m_slope[size] = 0;
+    }
+    for (int channel = 0; channel < VORBIS_MAX_CHANNELS; channel++)
+    {
+        free(m_spectrum[channel]);
+        free(m_floor[channel]);
+        free(m_window[channel][0]);
+        free(m_window[channel][1]);
+        m_spectrum[channel] = 0;
+        m_floor[channel] = 0;
+        m_window[channel][0] = 0;
+        m_window[channel][1] = 0;
+    }
+
+    free(m_classifications);
+    free(m_pending);
+    free(m_packet);
+    free(m_body);
+    m_classifications = 0;
+    m_pending = 0;
+    m_packet = 0;
+    m_body = 0;
+
+    clear();
+}
+
+const char *VorbisDecoder::getComment(int index) const
+{
+    return (index >= 0 && index < m_numcomments) ? m_comments[index] : 0;
+}
+
+/*
+    Ogg layer
+*/
+FMOD_RESULT VorbisDecoder::fileRead(void *buffer, unsigned int size)
+{
+    unsigned int bytesread = 0;
+
+    FMOD_RESULT result = m_read(m_handle, buffer, size, &bytesread, m_userdata);
+    m_fileoffset += bytesread;
+
+    if (bytesread < size)
+    {
+        return (result == FMOD_OK) ? FMOD_ERR_FILE_EOF : result;
+    }
+    return FMOD_OK;
+}
+
+FMOD_RESULT VorbisDecoder::fileSeek(unsigned int offset)
+{
+    if (!m_seek)
+    {
+        return FMOD_ERR_FILE_COULDNOTSEEK;
+    }
+
+    FMOD_RESULT result = m_seek(m_handle, offset, m_userdata);
+    m_fileoffset = offset;
+    return result;
+}
+
+FMOD_RESULT VorbisDecoder::readPage(bool verify)
+{
+    FMOD_RESULT result;
+
+    m_numsegments = 0;
+    m_segment = 0;
+
+    result = fileRead(m_header, 27);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+    if (memcmp(m_header, "OggS", 4) || m_header[4] != 0)
+    {
+        return FMOD_ERR_FILE_BAD;
+    }
+
+    int numsegments = m_header[26];
+    result = fileRead(m_header + 27, numsegments);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    m_bodylength = 0;
+    m_lastcomplete = -1;
+    for (int segment = 0; segment < numsegments; segment++)
+    {
+        m_bodylength += m_header[27 + segment];
+        if (m_header[27 + segment] < 255)
+        {
+            m_lastcomplete = segment;
+        }
+    }
+
+    result = fileRead(m_body, m_bodylength);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    if (verify)
+    {
+        unsigned int expected = m_header[22] | (m_header[23] << 8) | (m_header[24] << 16) | ((unsigned int)m_header[25] << 24);
+        static const unsigned char zero[4] = { 0, 0, 0, 0 };
+
+        unsigned int crc = VorbisCRC(m_crctable, 0, m_header, 22);
+        crc = VorbisCRC(m_crctable, crc, zero, 4);
+        crc = VorbisCRC(m_crctable, crc, m_header + 26, 1 + numsegments);
+        crc = VorbisCRC(m_crctable, crc, m_body, m_bodylength);
+        if (crc != expected)
+        {
+            return FMOD_ERR_FILE_BAD;
+        }
+    }
+
+    unsigned int serial = m_header[14] | (m_header[15] << 8) | (m_header[16] << 16) | ((unsigned int)m_header[17] << 24);
+    if (m_eos || (m_serial && serial != m_serial))
+    {
+        /*
+            Another logical stream, or a chained one after ours ended. Its pages have no packets for us.
+        */
+        m_bodypos = 0;
+        return FMOD_OK;
+    }
+
+    m_numsegments = numsegments;
+    m_bodypos = 0;
+    m_granule = 0;
+    for (int byte = 7; byte >= 0; byte--)
+    {
+        m_granule = (m_granule << 8) | m_header[6 + byte];
+    }
+    m_eos = (m_header[5] & 4) != 0;
+
+    return FMOD_OK;
+}
+
+/*
+    Finds the first valid page at or after 'offset' and before 'limit', and leaves it loaded.
+*/
+FMOD_RESULT VorbisDecoder::findPage(unsigned int offset, unsigned int limit, unsigned int *pageoffset)
+{
+    unsigned char chunk[VORBIS_SCAN_CHUNK];
+
+    while (offset + 27 <= limit)
+    {
+        unsigned int size = limit - offset;
+        unsigned int bytesread = 0;
+
+        if (size > VORBIS_SCAN_CHUNK)
+        {
+            size = VORBIS_SCAN_CHUNK;
+        }
+
+        FMOD_RESULT result = fileSeek(offset);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+        m_read(m_handle, chunk, size, &bytesread, m_userdata);
+        m_fileoffset += bytesread;
+        if (bytesread < 4)
+        {
+            break;
+        }
+
+        for (unsigned int pos = 0; pos + 4 <= bytesread; pos++)
+        {
+            if (chunk[pos] == 'O' && !memcmp(chunk + pos, "OggS", 4))
+            {
+                result = fileSeek(offset + pos);
+                if (result != FMOD_OK)
+                {
+                    return result;
+                }
+                if (readPage(true) == FMOD_OK)
+                {
+                    *pageoffset = offset + pos;
+                    return FMOD_OK;
+                }
+            }
+        }
+
+        offset += bytesread - 3;    /* A capture pattern can straddle chunks. */
+    }
+
+    return FMOD_ERR_FILE_EOF;
+}
+
+FMOD_RESULT VorbisDecoder::nextPacket(const unsigned char **data, unsigned int *length, bool *lastinpage)
+{
+    unsigned int size = 0;
+    bool partial = false;
+
+    for (;;)
+    {
+        if (m_segment >= m_numsegments)
+        {
+            if (m_eos)
+            {
+                return FMOD_ERR_FILE_EOF;
+            }
+
+            unsigned int pageoffset = m_fileoffset;
+
+            FMOD_RESULT result = readPage(false);
+            if (result == FMOD_ERR_FILE_BAD && m_seek && m_filesize)
+            {
+                /*
+                    Damaged page, carry on from the next good one. The blocks either side don't overlap.
+                */
+                result = findPage(pageoffset + 1, m_filesize, &pageoffset);
+                m_cursize = 0;
+                partial = false;
+                size = 0;
+            }
+            if (result != FMOD_OK)
+            {
+                return result;
+            }
+
+            bool continued = (m_header[5] & 1) != 0;
+            if (continued && !partial)
+            {
+                /*
+                    The start of this packet was before where we started reading, skip the rest of it.
+                */
+                while (m_segment < m_numsegments)
+                {
+                    int lacing = m_header[27 + m_segment++];
+                    m_bodypos += lacing;
+                    if (lacing < 255)
+                    {
+                        break;
+                    }
+                }
+            }
+            else if (!continued && partial)
+            {
+                partial = false;    /* Lost the end of it. */
+                size = 0;
+            }
+            continue;
+        }
+
+        unsigned int start = m_bodypos;
+        unsigned int bytes = 0;
+        bool complete = false;
+
+        while (m_segment < m_numsegments)
+        {
+            int lacing = m_header[27 + m_segment++];
+            bytes += lacing;
+            if (lacing < 255)
+            {
+                complete = true;
+                break;
+            }
+        }
+        m_bodypos += bytes;
+
+        if (complete && !partial)
+        {
+            /*
+                Usual case, the whole packet is on this page, use it in place.
+            */
+            *data = m_body + start;
+            *length = bytes;
+            *lastinpage = (m_segment - 1 == m_lastcomplete);
+            return FMOD_OK;
+        }
+
+        if (size + bytes > m_packetsize)
+        {
+            unsigned int newsize = (size + bytes) * 2;
+            unsigned char *packet = (unsigned char *)realloc(m_packet, newsize);
+            if (!packet)
+            {
+                return FMOD_ERR_MEMORY;
+            }
+            m_packet = packet;
+            m_packetsize = newsize;
+        }
+        memcpy(m_packet + size, m_body + start, bytes);
+        size += bytes;
+        partial = true;
+
+        if (complete)
+        {
+            *data = m_packet;
+            *length = size;
+            *lastinpage = (m_segment - 1 == m_lastcomplete);
+            return FMOD_OK;
+        }
+    }
+}
+
+FMOD_RESULT VorbisDecoder::findLength()
+{
+    long long last = -1;
+    unsigned int back = VORBIS_PAGE_MAX_BODY;
+
+    /*
+        Scan the pages near the end, going further back if there's no granule position there.
+    */
+    while (last < 0)
+    {
+        unsigned int start = (m_filesize > m_audiooffset + back) ? m_filesize - back : m_audiooffset;
+        unsigned int offset = start;
+        unsigned int pageoffset;
+
+        while (findPage(offset, m_filesize, &pageoffset) == FMOD_OK)
+        {
+            if (m_numsegments && m_granule >= 0)
+            {
+                last = m_granule;
+            }
+            offset = m_fileoffset;
+        }
+
+        if (start == m_audiooffset)
+        {
+            break;
+        }
+        back *= 2;
+    }
+
+    m_eos = false;
+    if (last > 0 && last <= 0xFFFFFFFFLL)
+    {
+        m_length = (unsigned int)last;
+    }
+    return FMOD_OK;
+}
+
+FMOD_RESULT VorbisDecoder::restart(unsigned int offset, bool fromstart)
+{
+    m_numsegments = 0;
+    m_segment = 0;
+    m_eos = false;
+    m_cursize = 0;
+    m_prevsize = 0;
+    m_pendingcount = 0;
+    m_pendingpos = 0;
+    m_position = 0;
+    m_synced = fromstart;
+
+    return (offset != m_fileoffset) ? fileSeek(offset) : FMOD_OK;
+}
+
+/*
+    Headers, 4.2.
+*/
+static bool VorbisCheckHeader(VorbisBits *bits, int type)
+{
+    if ((int)VorbisBits_Read(bits, 8) != type)
+    {
+        return false;
+    }
+    for (int index = 0; index < 6; index++)
+    {
+        if (VorbisBits_Read(bits, 8) != (unsigned int)"vorbis"[index])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+FMOD_RESULT VorbisDecoder::parseIdentification(const unsigned char *data, unsigned int length)
+{
+    VorbisBits bits = { data, length * 8, 0, false };
+
+    if (!VorbisCheckHeader(&bits, 1) || VorbisBits_Read(&bits, 32) != 0)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    m_channels = VorbisBits_Read(&bits, 8);
+    m_rate = (int)VorbisBits_Read(&bits, 32);
+    VorbisBits_Read(&bits, 32);     /* Bitrates */
+    VorbisBits_Read(&bits, 32);
+    VorbisBits_Read(&bits, 32);
+    m_blocksize[0] = 1 << VorbisBits_Read(&bits, 4);
+    m_blocksize[1] = 1 << VorbisBits_Read(&bits, 4);
+
+    if (!VorbisBits_Read(&bits, 1) || bits.eop || m_rate <= 0 ||
+        m_blocksize[0] < 64 || m_blocksize[1] > 8192 || m_blocksize[0] > m_blocksize[1])
+    {
+        return FMOD_ERR_FORMAT;
+    }
+    if (m_channels < 1 || m_channels > VORBIS_MAX_CHANNELS)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT VorbisDecoder::parseComments(const unsigned char *data, unsigned int length)
+{
+    VorbisBits bits = { data, length * 8, 0, false };
+
+    if (!VorbisCheckHeader(&bits, 3))
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    unsigned int vendorlength = VorbisBits_Read(&bits, 32);
+    if (vendorlength > length - (bits.pos >> 3))
+    {
+        return FMOD_ERR_FORMAT;
+    }
+    bits.pos += vendorlength * 8;
+
+    unsigned int count = VorbisBits_Read(&bits, 32);
+    if (count > length / 4)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    m_comments = (char **)calloc(count ? count : 1, sizeof(char *));
+    if (!m_comments)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    for (unsigned int index = 0; index < count; index++)
+    {
+        unsigned int commentlength = VorbisBits_Read(&bits, 32);
+        if (bits.eop || commentlength > length - (bits.pos >> 3))
+        {
+            return FMOD_ERR_FORMAT;
+        }
+
+        char *comment = (char *)malloc(commentlength + 1);
+        if (!comment)
+        {
+            return FMOD_ERR_MEMORY;
+        }
+        memcpy(comment, data + (bits.pos >> 3), commentlength);
+        comment[commentlength] = 0;
+        bits.pos += commentlength * 8;
+
+        m_comments[m_numcomments++] = comment;
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT VorbisDecoder::parseSetup(const unsigned char *data, unsigned int length)
+{
+    VorbisBits bits = { data, length * 8, 0, false };
+    FMOD_RESULT result;
+
+    if (!VorbisCheckHeader(&bits, 5))
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    m_numcodebooks = VorbisBits_Read(&bits, 8) + 1;
+    m_codebooks = (VorbisCodebook *)calloc(m_numcodebooks, sizeof(VorbisCodebook));
+    if (!m_codebooks)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    for (int index = 0; index < m_numcodebooks; index++)
+    {
+        result = VorbisCodebook_Parse(&m_codebooks[index], &bits);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    /*
+        Time domain transforms, placeholders that must be zero.
+    */
+    int numtimes = VorbisBits_Read(&bits, 6) + 1;
+    for (int index = 0; index < numtimes; index++)
+    {
+        if (VorbisBits_Read(&bits, 16) != 0)
+        {
+            return FMOD_ERR_FORMAT;
+        }
+    }
+
+    m_numfloors = VorbisBits_Read(&bits, 6) + 1;
+    m_floors = (VorbisFloor *)calloc(m_numfloors, sizeof(VorbisFloor));
+    if (!m_floors)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    for (int index = 0; index < m_numfloors; index++)
+    {
+        if (VorbisBits_Read(&bits, 16) != 1)
+        {
+            return FMOD_ERR_FORMAT;     /* Floor 0 */
+        }
+        result = VorbisFloor_Parse(&m_floors[index], &bits, m_numcodebooks);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    m_numresidues = VorbisBits_Read(&bits, 6) + 1;
+    m_residues = (VorbisResidue *)calloc(m_numresidues, sizeof(VorbisResidue));
+    if (!m_residues)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    for (int index = 0; index < m_numresidues; index++)
+    {
+        m_residues[index].type = VorbisBits_Read(&bits, 16);
+        if (m_residues[index].type > 2)
+        {
+            return FMOD_ERR_FORMAT;
+        }
+        result = VorbisResidue_Parse(&m_residues[index], &bits, m_codebooks, m_numcodebooks);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    m_nummappings = VorbisBits_Read(&bits, 6) + 1;
+    m_mappings = (VorbisMapping *)calloc(m_nummappings, sizeof(VorbisMapping));
+    if (!m_mappings)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    for (int index = 0; index < m_nummappings; index++)
+    {
+        VorbisMapping *mapping = &m_mappings[index];
+        int channelbits = VorbisILog(m_channels - 1);
+
+        if (VorbisBits_Read(&bits, 16) != 0)
+        {
+            return FMOD_ERR_FORMAT;
+        }
+
+        mapping->submaps = VorbisBits_Read(&bits, 1) ? VorbisBits_Read(&bits, 4) + 1 : 1;
+        if (VorbisBits_Read(&bits, 1))
+        {
+            mapping->couplingsteps = VorbisBits_Read(&bits, 8) + 1;
+            for (int step = 0; step < mapping->couplingsteps; step++)
+            {
+                mapping->magnitude[step] = (unsigned char)VorbisBits_Read(&bits, channelbits);
+                mapping->angle[step] = (unsigned char)VorbisBits_Read(&bits, channelbits);
+                if (mapping->magnitude[step] == mapping->angle[step] || mapping->magnitude[step] >= m_channels || mapping->angle[step] >= m_channels)
+                {
+                    return FMOD_ERR_FORMAT;
+                }
+            }
+        }
+        if (VorbisBits_Read(&bits, 2) != 0)
+        {
+            return FMOD_ERR_FORMAT;
+        }
+        if (mapping->submaps > 1)
+        {
+            for (int channel = 0; channel < m_channels; channel++)
+            {
+                mapping->mux[channel] = (unsigned char)VorbisBits_Read(&bits, 4);
+                if (mapping->mux[channel] >= mapping->submaps)
+                {
+                    return FMOD_ERR_FORMAT;
+                }
+            }
+        }
+        for (int submap = 0; submap < mapping->submaps; submap++)
+        {
+            VorbisBits_Read(&bits, 8);
+            mapping->submapfloor[submap] = (unsigned char)VorbisBits_Read(&bits, 8);
+            mapping->submapresidue[submap] = (unsigned char)VorbisBits_Read(&bits, 8);
+            if (mapping->submapfloor[submap] >= m_numfloors || mapping->submapresidue[submap] >= m_numresidues)
+            {
+                return FMOD_ERR_FORMAT;
+            }
+        }
+    }
+
+    m_nummodes = VorbisBits_Read(&bits, 6) + 1;
+    m_modes = (VorbisMode *)calloc(m_nummodes, sizeof(VorbisMode));
+    if (!m_modes)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    for (int index = 0; index < m_nummodes; index++)
+    {
+        m_modes[index].blockflag = VorbisBits_Read(&bits, 1);
+        int windowtype = VorbisBits_Read(&bits, 16);
+        int transformtype = VorbisBits_Read(&bits, 16);
+        m_modes[index].mapping = VorbisBits_Read(&bits, 8);
+        if (windowtype || transformtype || m_modes[index].mapping >= m_nummappings)
+        {
+            return FMOD_ERR_FORMAT;
+        }
+    }
+
+    if (!VorbisBits_Read(&bits, 1) || bits.eop)
+    {
+        return FMOD_ERR_FORMAT;
+    }
+
+    return FMOD_OK;
+}
+
+/*
+    Audio packets, 4.3. Leaves the windowed block in m_window[][m_current] with the previous block's overlap already
+    added in, and returns how many samples it finishes.
+*/
+FMOD_RESULT VorbisDecoder::decodePacket(const unsigned char *data, unsigned int length, unsigned int *samples)
+{
+    VorbisBits bits = { data, length * 8, 0, false };
+    bool used[VORBIS_MAX_CHANNELS];
+    bool decode[VORBIS_MAX_CHANNELS];
+
+    *samples = 0;
+
+    if (VorbisBits_Read(&bits, 1) != 0)
+    {
+        return FMOD_OK;     /* Not audio */
+    }
+
+    int modenumber = VorbisBits_Read(&bits, VorbisILog(m_nummodes - 1));
+    if (modenumber >= m_nummodes)
+    {
+        return FMOD_OK;
+    }
+
+    const VorbisMode *mode = &m_modes[modenumber];
+    const VorbisMapping *mapping = &m_mappings[mode->mapping];
+    int blockflag = mode->blockflag;
+    int n = m_blocksize[blockflag];
+    int half = n >> 1;
+    bool prevlong = false;
+    bool nextlong = false;
+
+    if (blockflag)
+    {
+        prevlong = VorbisBits_Read(&bits, 1) != 0;
+        nextlong = VorbisBits_Read(&bits, 1) != 0;
+    }
+    if (bits.eop)
+    {
+        return FMOD_OK;     /* Too short to be anything, drop it. */
+    }
+
+    /*
+        Floors, then which residue vectors need decoding.
+    */
+    for (int channel = 0; channel < m_channels; channel++)
+    {
+        const VorbisFloor *floor = &m_floors[mapping->submapfloor[mapping->mux[channel]]];
+        used[channel] = VorbisFloor_Decode(floor, m_codebooks, &bits, half, m_floor[channel]);
+        decode[channel] = used[channel];
+        memset(m_spectrum[channel], 0, half * sizeof(float));
+    }
+    for (int step = 0; step < mapping->couplingsteps; step++)
+    {
+        if (decode[mapping->magnitude[step]] || decode[mapping->angle[step]])
+        {
+            decode[mapping->magnitude[step]] = true;
+            decode[mapping->angle[step]] = true;
+        }
+    }
+
+    for (int submap = 0; submap < mapping->submaps; submap++)
+    {
+        float *vectors[VORBIS_MAX_CHANNELS];
+        bool flags[VORBIS_MAX_CHANNELS];
+        int count = 0;
+
+        for (int channel = 0; channel < m_channels; channel++)
+        {
+            if (mapping->mux[channel] == submap)
+            {
+                vectors[count] = m_spectrum[channel];
+                flags[count] = decode[channel];
+                count++;
+            }
+        }
+
+        VorbisResidue_Decode(&m_residues[mapping->submapresidue[submap]], m_codebooks, &bits, vectors, flags, count, half, m_classifications);
+    }
+
+    for (int step = mapping->couplingsteps - 1; step >= 0; step--)
+    {
+        VorbisInverseCoupling(m_spectrum[mapping->magnitude[step]], m_spectrum[mapping->angle[step]], half);
+    }
+
+    /*
+        Window shape, 4.3.1. A long block next to a short one uses the short slope on that side.
+    */
+    int shortquarter = m_blocksize[0] >> 2;
+    int leftstart = 0, leftlength = half;
+    int rightstart = half, rightlength = half;
+    const float *leftslope = m_slope[blockflag];
+    const float *rightslope = m_slope[blockflag];
+
+    if (blockflag && !prevlong)
+    {
+        leftstart = (n >> 2) - shortquarter;
+        leftlength = shortquarter * 2;
+        leftslope = m_slope[0];
+    }
+    if (blockflag && !nextlong)
+    {
+        rightstart = n - (n >> 2) - shortquarter;
+        rightlength = shortquarter * 2;
+        rightslope = m_slope[0];
+    }
+
+    /*
+        Overlap with the previous block runs from the centre of that block to the centre of this one.
+    */
+    int prevsize = m_cursize;
+    int current = m_current ^ 1;
+    int overlapstart = (prevsize > n) ? (prevsize >> 2) - (n >> 2) : 0;       /* Output sample where this block's left slope starts */
+    int overlaplength = (prevsize >> 1) - overlapstart;
+    if (overlaplength > leftlength)
+    {
+        overlaplength = leftlength;     /* Past the end of a short right slope the previous block is silent. */
+    }
+
+    for (int channel = 0; channel < m_channels; channel++)
+    {
+        float *out = m_window[channel][current];
+
+        if (!used[channel])
+        {
+            memset(out, 0, n * sizeof(float));
+        }
+        else
+        {
+            VorbisMultiply(m_spectrum[channel], m_floor[channel], half);
+            VorbisMDCT_Inverse(m_mdct[blockflag], m_spectrum[channel], out);
+            VorbisMultiply(out + leftstart, leftslope, leftlength);
+            VorbisMultiplyReversed(out + rightstart, rightslope, rightlength);
+        }
+
+        if (prevsize)
+        {
+            const float *prev = m_window[channel][m_current] + (prevsize >> 1) + overlapstart;
+            VorbisAdd(out + leftstart, prev, overlaplength);
+        }
+    }
+
+    m_prevsize = prevsize;
+    m_cursize = n;
+    m_current = current;
+    m_leftstart = leftstart;
+
+    if (prevsize)
+    {
+        *samples = (prevsize >> 2) + (n >> 2);
+    }
+    return FMOD_OK;
+}
+
+/*
+    Writes output samples [start, end) of the last decoded packet to 'dest', interleaved. Output begins with the part of
+    the previous block before this one's left slope, then carries on from the slope in this block.
+*/
+void VorbisDecoder::emit(float *dest, unsigned int start, unsigned int end)
+{
+    const unsigned char *order = VORBIS_CHANNEL_ORDER[m_channels];
+    const float *src[VORBIS_MAX_CHANNELS];
+    unsigned int prevonly = (m_prevsize > m_cursize) ? (m_prevsize >> 2) - (m_cursize >> 2) : 0;
+
+    if (start < prevonly)
+    {
+        unsigned int count = ((end < prevonly) ? end : prevonly) - start;
+        for (int channel = 0; channel < m_channels; channel++)
+        {
+            src[channel] = m_window[order[channel]][m_current ^ 1] + (m_prevsize >> 1) + start;
+        }
+        VorbisInterleave(dest, m_channels, src, count);
+        dest += count * m_channels;
+        start += count;
+    }
+
+    if (start < end)
+    {
+        for (int channel = 0; channel < m_channels; channel++)
+        {
+            src[channel] = m_window[order[channel]][m_current] + m_leftstart + (start - prevonly);
+        }
+        VorbisInterleave(dest, m_channels, src, end - start);
+    }
+}
+
+FMOD_RESULT VorbisDecoder::read(float *buffer, unsigned int samples, unsigned int *samplesread)
+{
+    unsigned int done = 0;
+
+    while (done < samples)
+    {
+        if (m_pendingcount)
+        {
+            unsigned int count = (m_pendingcount < samples - done) ? m_pendingcount : samples - done;
+
+            memcpy(buffer + done * m_channels, m_pending + m_pendingpos * m_channels, count * m_channels * sizeof(float));
+            m_pendingpos += count;
+            m_pendingcount -= count;
+            done += count;
+            continue;
+        }
+
+        const unsigned char *data;
+        unsigned int length;
+        unsigned int count;
+        bool last;
+
+        FMOD_RESULT result = nextPacket(&data, &length, &last);
+        if (result == FMOD_ERR_FILE_EOF)
+        {
+            break;
+        }
+        if (result != FMOD_OK)
+        {
+            *samplesread = done;
+            return result;
+        }
+
+        result = decodePacket(data, length, &count);
+        if (result != FMOD_OK)
+        {
+            *samplesread = done;
+            return result;
+        }
+
+        bool granule = last && m_granule >= 0;
+
+        if (!m_synced)
+        {
+            /*
+                After a seek the position isn't known until a packet ends a page, which is when the page's granule
+                position applies. Anything decoded before then is thrown away.
+            */
+            if (granule)
+            {
+                m_position = m_granule;
+                m_synced = true;
+
+                if (m_position > m_target)
+                {
+                    result = restart(m_audiooffset, true);     /* Overshot, decode from the start instead. */
+                    if (result != FMOD_OK)
+                    {
+                        *samplesread = done;
+                        return result;
+                    }
+                }
+            }
+            continue;
+        }
+
+        /*
+            The final page's granule position, or the length worked out at open, trims the last packet.
+        */
+        if (granule && m_eos && m_granule < m_position + count)
+        {
+            count = (m_granule > m_position) ? (unsigned int)(m_granule - m_position) : 0;
+        }
+        if (m_length && m_position + count > m_length)
+        {
+            count = (m_length > m_position) ? (unsigned int)(m_length - m_position) : 0;
+        }
+
+        unsigned int skip = 0;
+        if (m_target > m_position)
+        {
+            skip = (m_target - m_position < count) ? (unsigned int)(m_target - m_position) : count;
+        }
+        m_position += count;
+
+        if (skip < count)
+        {
+            unsigned int available = count - skip;
+
+            if (available <= samples - done)
+            {
+                emit(buffer + done * m_channels, skip, count);
+                done += available;
+            }
+            else
+            {
+                emit(m_pending, skip, count);
+                m_pendingpos = 0;
+                m_pendingcount = available;
+            }
+        }
+    }
+
+    *samplesread = done;
+    return (done < samples) ? FMOD_ERR_FILE_EOF : FMOD_OK;
+}
+
+FMOD_RESULT VorbisDecoder::readPCM16(short *buffer, unsigned int samples, unsigned int *samplesread)
+{
+    float scratch[VORBIS_PCM16_CHUNK * VORBIS_MAX_CHANNELS];
+    unsigned int done = 0;
+    FMOD_RESULT result = FMOD_OK;
+
+    while (done < samples)
+    {
+        unsigned int count = (samples - done < VORBIS_PCM16_CHUNK) ? samples - done : VORBIS_PCM16_CHUNK;
+        unsigned int got = 0;
+
+        result = read(scratch, count, &got);
+
+        short *dest = buffer + done * m_channels;
+        unsigned int total = got * m_channels;
+        unsigned int i = 0;
+#if defined(__SSE2__)
+        /*
+            packs saturates, so out of range samples clip instead of wrapping.
+        */
+        const __m128 scale = _mm_set1_ps(32767.0f);
+        for (; i + 8 <= total; i += 8)
+        {
+            __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(scratch + i), scale));
+            __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(scratch + i + 4), scale));
+            _mm_storeu_si128((__m128i *)(dest + i), _mm_packs_epi32(lo, hi));
+        }
+#endif
+        for (; i < total; i++)
+        {
+            float value = scratch[i] * 32767.0f;
+            if (value > 32767.0f) value = 32767.0f;
+            if (value < -32768.0f) value = -32768.0f;
+            dest[i] = (short)(value < 0.0f ? value - 0.5f : value + 0.5f);
+        }
+
+        done += got;
+        if (result != FMOD_OK)
+        {
+            break;
+        }
+    }
+
+    *samplesread = done;
+    return result;
+}
+
+FMOD_RESULT VorbisDecoder::setPosition(unsigned int position)
+{
+    FMOD_RESULT result;
+
+    m_target = position;
+
+    if (position == 0 || !m_filesize)
+    {
+        return restart(m_audiooffset, true);
+    }
+
+    /*
+        Bisect for the last page whose granule position is at or before the target.
+    */
+    unsigned int lo = m_audiooffset;
+    unsigned int hi = m_filesize;
+    unsigned int best = m_audiooffset;
+
+    while (hi - lo > VORBIS_SEEK_LINEAR)
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+        unsigned int pageoffset;
+
+        m_eos = false;
+        if (findPage(mid, hi, &pageoffset) == FMOD_OK && m_numsegments && m_granule >= 0 && m_granule <= (long long)position)
+        {
+            lo = pageoffset;
+            best = pageoffset;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    /*
+        Then step through the pages in order.
+    */
+    result = fileSeek(lo);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+    m_eos = false;
+    for (;;)
+    {
+        unsigned int pageoffset = m_fileoffset;
+
+        if (readPage(false) != FMOD_OK)
+        {
+            break;
+        }
+        if (m_numsegments && m_granule >= 0)
+        {
+            if (m_granule > (long long)position)
+            {
+                break;
+            }
+            best = pageoffset;
+        }
+        if (m_eos)
+        {
+            break;
+        }
+    }
+
+    return restart(best, best == m_audiooffset);
+}
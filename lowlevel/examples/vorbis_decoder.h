@@ -0,0 +1,142 @@
+/*==============================================================================
+Vorbis Decoder
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Decodes Ogg Vorbis to interleaved float. Used by the Vorbis codec plugin (see
+plugins/fmod_codec_vorbis.cpp), but it only needs a pair of read and seek
+functions so it can decode from anywhere.
+
+The inverse MDCT is done as a quarter length complex FFT between a pre and
+post twiddle, and the FFT, twiddles, windowing, channel coupling and floor
+multiply all work four floats at a time with SSE where the compiler has it.
+Overlap-add writes its interleaved result straight into the caller's buffer,
+only a packet that doesn't fit is held back for the next read.
+
+Floor type 0 isn't supported, nothing has encoded it since the earliest
+encoder betas. open returns FMOD_ERR_FORMAT for those files, and for anything
+that isn't Ogg Vorbis, so a codec using this can let FMOD fall back to its own.
+Chained streams decode up to the end of the first link.
+==============================================================================*/
+#ifndef _VORBIS_DECODER_H
+#define _VORBIS_DECODER_H
+
+#include "fmod.hpp"
+
+#define VORBIS_MAX_CHANNELS     8
+
+struct VorbisCodebook;
+struct VorbisFloor;
+struct VorbisResidue;
+struct VorbisMapping;
+struct VorbisMode;
+struct VorbisMDCT;
+
+class VorbisDecoder
+{
+public:
+    VorbisDecoder();
+
+    /*
+        'filesize' may be 0 if it isn't known, and 'seekcallback' may be 0 if the source can't seek. Without both the length
+        isn't known up front and setPosition isn't available. Call release afterwards even if open fails, the decoder
+        can then be opened again.
+    */
+    FMOD_RESULT     open(FMOD_FILE_READ_CALLBACK readcallback, FMOD_FILE_SEEK_CALLBACK seekcallback, void *handle, void *userdata, unsigned int filesize);
+    void            release();
+
+    int             getChannels() const     { return m_channels; }
+    int             getRate() const         { return m_rate; }
+    unsigned int    getLength() const       { return m_length; }    /* In samples, 0 if unknown. */
+    int             getNumComments() const  { return m_numcomments; }
+    const char     *getComment(int index) const;                    /* "NAME=value" */
+
+    FMOD_RESULT     read(float *buffer, unsigned int samples, unsigned int *samplesread);
+    FMOD_RESULT     readPCM16(short *buffer, unsigned int samples, unsigned int *samplesread);  /* Clipped, for decoding to memory. */
+    FMOD_RESULT     setPosition(unsigned int position);
+
+private:
+    void            clear();
+
+    /* Ogg layer */
+    FMOD_RESULT     fileRead(void *buffer, unsigned int size);
+    FMOD_RESULT     fileSeek(unsigned int offset);
+    FMOD_RESULT     readPage(bool verify);
+    FMOD_RESULT     findPage(unsigned int offset, unsigned int limit, unsigned int *pageoffset);
+    FMOD_RESULT     nextPacket(const unsigned char **data, unsigned int *length, bool *lastinpage);
+    FMOD_RESULT     findLength();
+    FMOD_RESULT     restart(unsigned int offset, bool fromstart);
+
+    /* Headers */
+    FMOD_RESULT     parseIdentification(const unsigned char *data, unsigned int length);
+    FMOD_RESULT     parseComments(const unsigned char *data, unsigned int length);
+    FMOD_RESULT     parseSetup(const unsigned char *data, unsigned int length);
+
+    /* Audio */
+    FMOD_RESULT     decodePacket(const unsigned char *data, unsigned int length, unsigned int *samples);
+    void            emit(float *dest, unsigned int start, unsigned int end);
+
+    FMOD_FILE_READ_CALLBACK m_read;
+    FMOD_FILE_SEEK_CALLBACK m_seek;
+    void                   *m_handle;
+    void                   *m_userdata;
+    unsigned int            m_filesize;
+    unsigned int            m_fileoffset;
+
+    /* Current page and the packet being put together from it. */
+    unsigned char           m_header[27 + 255];
+    unsigned char          *m_body;
+    unsigned int            m_bodylength;
+    unsigned int            m_bodypos;
+    int                     m_numsegments;
+    int                     m_segment;
+    int                     m_lastcomplete;     /* Last segment on the page that ends a packet, -1 if none. */
+    long long               m_granule;
+    unsigned int            m_serial;
+    bool                    m_eos;
+    unsigned char          *m_packet;
+    unsigned int            m_packetsize;
+    unsigned int            m_audiooffset;      /* File offset of the first audio page. */
+    unsigned int            m_crctable[256];
+
+    /* Stream */
+    int                     m_channels;
+    int                     m_rate;
+    int                     m_blocksize[2];
+    unsigned int            m_length;
+    char                  **m_comments;
+    int                     m_numcomments;
+
+    /* Setup */
+    int                     m_numcodebooks;
+    VorbisCodebook         *m_codebooks;
+    int                     m_numfloors;
+    VorbisFloor            *m_floors;
+    int                     m_numresidues;
+    VorbisResidue          *m_residues;
+    int                     m_nummappings;
+    VorbisMapping          *m_mappings;
+    int                     m_nummodes;
+    VorbisMode             *m_modes;
+    VorbisMDCT             *m_mdct[2];
+    float                  *m_slope[2];         /* Rising half of the window, for each block size. */
+
+    /* Decode state, per channel buffers are m_blocksize[1] long */
+    float                  *m_spectrum[VORBIS_MAX_CHANNELS];
+    float                  *m_floor[VORBIS_MAX_CHANNELS];
+    float                  *m_window[VORBIS_MAX_CHANNELS][2];   /* Windowed IMDCT output, current and previous. */
+    unsigned char          *m_classifications;
+    int                     m_current;          /* Which m_window holds the latest block. */
+    int                     m_prevsize;         /* 0 until a block has been decoded. */
+    int                     m_cursize;
+    int                     m_leftstart;        /* Where the latest block's left slope starts. */
+
+    /* Output */
+    long long               m_position;         /* Sample the next decoded packet's output starts at. */
+    bool                    m_synced;           /* m_position is known. */
+    long long               m_target;           /* Discard output before this, after a seek. */
+    float                  *m_pending;          /* Interleaved output that didn't fit in the last read. */
+    unsigned int            m_pendingpos;
+    unsigned int            m_pendingcount;
+};
+
+#endif
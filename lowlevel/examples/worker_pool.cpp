@@ -0,0 +1,315 @@
+/*==============================================================================
+Worker Pool
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "worker_pool.h"
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/task.h>
+#endif
+
+/*
+    Which pool thread the caller is, so jobs submitted from a job stay on that thread's queue. A pthread key rather
+    than __thread, which needs 10.7.
+*/
+static pthread_once_t gWorkerPool_CurrentOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t  gWorkerPool_Current;
+
+static void WorkerPool_CreateKey()
+{
+    pthread_key_create(&gWorkerPool_Current, 0);
+}
+
+WorkerPool::WorkerPool()
+{
+    m_num_threads = 0;
+    m_next_queue = 0;
+    m_inboxes = 0;
+    m_quit = false;
+}
+
+int WorkerPool::numCores()
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0) ? (int)cores : 1;
+}
+
+FMOD_RESULT WorkerPool::init(int numthreads)
+{
+    if (numthreads <= 0)
+    {
+        numthreads = numCores();
+    }
+    if (numthreads > WORKER_POOL_MAX_THREADS)
+    {
+        numthreads = WORKER_POOL_MAX_THREADS;
+    }
+
+    pthread_once(&gWorkerPool_CurrentOnce, WorkerPool_CreateKey);
+
+#if defined(__APPLE__)
+    if (semaphore_create(mach_task_self(), &m_sleep, SYNC_POLICY_FIFO, 0) != KERN_SUCCESS)
+#else
+    if (sem_init(&m_sleep, 0, 0) != 0)
+#endif
+    {
+        return FMOD_ERR_INTERNAL;
+    }
+    pthread_mutex_init(&m_inbox_lock, 0);
+    m_quit = false;
+    m_next_queue = 0;
+    m_inboxes = 0;
+
+    /*
+        All the queues exist before any thread starts, threads steal from each other straight away.
+    */
+    for (int i = 0; i < numthreads; i++)
+    {
+        pthread_mutex_init(&m_queues[i].lock, 0);
+        m_queues[i].head = 0;
+        m_queues[i].tail = 0;
+        m_thread_info[i].pool = this;
+        m_thread_info[i].index = i;
+    }
+    m_num_threads = numthreads;
+
+    for (int i = 0; i < numthreads; i++)
+    {
+        if (pthread_create(&m_threads[i], 0, threadMain, &m_thread_info[i]) != 0)
+        {
+            /*
+                init fails as a whole. The threads already started are stopped and every queue is torn down again.
+            */
+            m_num_threads = i;
+            release();
+            for (int j = i; j < numthreads; j++)
+            {
+                pthread_mutex_destroy(&m_queues[j].lock);
+            }
+            return FMOD_ERR_INTERNAL;
+        }
+    }
+
+    return FMOD_OK;
+}
+
+void WorkerPool::release()
+{
+    /*
+        One post per thread. A thread that wakes and finds nothing left to do sees m_quit and doesn't sleep again.
+    */
+    __atomic_store_n(&m_quit, true, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < m_num_threads; i++)
+    {
+        wake();
+    }
+
+    for (int i = 0; i < m_num_threads; i++)
+    {
+        pthread_join(m_threads[i], 0);
+    }
+    for (int i = 0; i < m_num_threads; i++)
+    {
+        pthread_mutex_destroy(&m_queues[i].lock);
+    }
+    m_num_threads = 0;
+
+    pthread_mutex_destroy(&m_inbox_lock);
+#if defined(__APPLE__)
+    semaphore_destroy(mach_task_self(), m_sleep);
+#else
+    sem_destroy(&m_sleep);
+#endif
+}
+
+/*
+    Real time safe, neither semaphore post takes a lock.
+*/
+void WorkerPool::wake()
+{
+#if defined(__APPLE__)
+    semaphore_signal(m_sleep);
+#else
+    sem_post(&m_sleep);
+#endif
+}
+
+void WorkerPool::push(int queue, WorkerJob *job)
+{
+    Queue *q = &m_queues[queue];
+
+    job->next = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail)
+    {
+        q->tail->next = job;
+    }
+    else
+    {
+        __atomic_store_n(&q->head, job, __ATOMIC_RELAXED);     /* pop peeks at head without the lock. */
+    }
+    q->tail = job;
+    pthread_mutex_unlock(&q->lock);
+}
+
+WorkerJob *WorkerPool::pop(int queue)
+{
+    Queue *q = &m_queues[queue];
+
+    if (!__atomic_load_n(&q->head, __ATOMIC_RELAXED))
+    {
+        return 0;   /* Don't bother locking an empty queue, push will wake us if that changes. */
+    }
+
+    pthread_mutex_lock(&q->lock);
+    WorkerJob *job = q->head;
+    if (job)
+    {
+        __atomic_store_n(&q->head, job->next, __ATOMIC_RELAXED);
+        if (!job->next)
+        {
+            q->tail = 0;
+        }
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return job;
+}
+
+/*
+    Own queue first, then the others starting from the next one along, so thieves spread out, then the inboxes.
+*/
+WorkerJob *WorkerPool::take(int self)
+{
+    for (int i = 0; i < m_num_threads; i++)
+    {
+        WorkerJob *job = pop((self + i) % m_num_threads);
+        if (job)
+        {
+            return job;
+        }
+    }
+    return takeInbox();
+}
+
+WorkerJob *WorkerPool::takeInbox()
+{
+    WorkerJob *job = 0;
+
+    if (!__atomic_load_n(&m_inboxes, __ATOMIC_RELAXED))
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&m_inbox_lock);
+    for (WorkerInbox *inbox = m_inboxes; inbox && !job; inbox = inbox->next)
+    {
+        if (inbox->read != __atomic_load_n(&inbox->write, __ATOMIC_ACQUIRE))
+        {
+            job = inbox->slots[inbox->read & (WORKER_INBOX_SLOTS - 1)];
+            __atomic_store_n(&inbox->read, inbox->read + 1, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&m_inbox_lock);
+
+    return job;
+}
+
+void WorkerPool::attach(WorkerInbox *inbox)
+{
+    inbox->write = 0;
+    inbox->read = 0;
+
+    pthread_mutex_lock(&m_inbox_lock);
+    inbox->next = m_inboxes;
+    __atomic_store_n(&m_inboxes, inbox, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&m_inbox_lock);
+}
+
+void WorkerPool::detach(WorkerInbox *inbox)
+{
+    pthread_mutex_lock(&m_inbox_lock);
+    WorkerInbox **link = &m_inboxes;
+    while (*link && *link != inbox)
+    {
+        link = &(*link)->next;
+    }
+    if (*link)
+    {
+        __atomic_store_n(link, inbox->next, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&m_inbox_lock);
+}
+
+bool WorkerPool::submit(WorkerInbox *inbox, WorkerJob *job)
+{
+    unsigned int write = inbox->write;
+
+    if (write - __atomic_load_n(&inbox->read, __ATOMIC_ACQUIRE) == WORKER_INBOX_SLOTS)
+    {
+        return false;
+    }
+
+    inbox->slots[write & (WORKER_INBOX_SLOTS - 1)] = job;
+    __atomic_store_n(&inbox->write, write + 1, __ATOMIC_RELEASE);
+
+    wake();
+    return true;
+}
+
+void WorkerPool::submit(WorkerJob *job)
+{
+    int queue;
+    Thread *current = (Thread *)pthread_getspecific(gWorkerPool_Current);
+
+    if (current && current->pool == this)
+    {
+        queue = current->index;
+    }
+    else
+    {
+        queue = (int)(__atomic_fetch_add(&m_next_queue, 1, __ATOMIC_RELAXED) % m_num_threads);
+    }
+
+    push(queue, job);
+    wake();
+}
+
+void *WorkerPool::threadMain(void *arg)
+{
+    Thread *thread = (Thread *)arg;
+    WorkerPool *pool = thread->pool;
+
+    pthread_setspecific(gWorkerPool_Current, thread);
+
+    for (;;)
+    {
+        WorkerJob *job = pool->take(thread->index);
+        if (job)
+        {
+            job->func(job->arg);
+            continue;
+        }
+
+        /*
+            Only quit once every queue is empty, so nobody is left waiting on a job that never ran. Every job posts
+            the semaphore after it is queued, so one that lands after take looked is never slept through.
+        */
+        if (__atomic_load_n(&pool->m_quit, __ATOMIC_SEQ_CST))
+        {
+            break;
+        }
+
+#if defined(__APPLE__)
+        semaphore_wait(pool->m_sleep);
+#else
+        while (sem_wait(&pool->m_sleep) != 0)
+        {
+        }
+#endif
+    }
+
+    return 0;
+}
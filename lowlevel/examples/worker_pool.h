@@ -0,0 +1,105 @@
+/*==============================================================================
+Worker Pool
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+A small fixed size pool of pthreads that runs caller owned jobs. Jobs are not
+allocated by the pool, the caller embeds a WorkerJob in whatever it wants to
+process and keeps it alive until the job function has run.
+
+Each thread has its own queue. Jobs submitted from outside the pool are dealt
+round robin across the queues, jobs submitted from inside a job go on the
+running thread's own queue. A thread whose queue is empty steals from the
+others before it sleeps, so uneven jobs don't leave cores idle and threads
+mostly touch only their own queue's lock. Jobs can run in any order.
+
+A real time thread, such as the mixer, mustn't take the queue locks. It
+gets a WorkerInbox of its own instead, a single producer ring that the
+workers empty, and submits through that. Sleeping threads wait on a
+semaphore, which it can post without a lock either.
+==============================================================================*/
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H
+
+#include "fmod.h"
+#include <pthread.h>
+#if defined(__APPLE__)
+#include <mach/semaphore.h>
+#else
+#include <semaphore.h>
+#endif
+
+#define WORKER_POOL_MAX_THREADS 64
+#define WORKER_INBOX_SLOTS      256     /* A power of two. */
+
+struct WorkerJob
+{
+    void      (*func)(void *arg);   /* Function to run on a worker thread. */
+    void       *arg;                /* Passed to func. */
+    WorkerJob  *next;               /* Used internally by the pool. */
+};
+
+/*
+    Jobs from one thread that can't take a lock. Attach it to the pool before the first push and detach it once
+    the last job has run.
+*/
+struct WorkerInbox
+{
+    WorkerJob      *slots[WORKER_INBOX_SLOTS];
+    unsigned int    write;          /* Free running, only written by the producer. */
+    unsigned int    read;           /* Free running, only written by a worker holding the pool's inbox lock. */
+    WorkerInbox    *next;
+};
+
+class WorkerPool
+{
+public:
+    WorkerPool();
+
+    FMOD_RESULT init(int numthreads);   /* 0 = one thread per online core. */
+    void        release();
+    void        submit(WorkerJob *job);
+
+    void        attach(WorkerInbox *inbox);
+    void        detach(WorkerInbox *inbox);
+    bool        submit(WorkerInbox *inbox, WorkerJob *job);    /* Never blocks, false if the inbox is full. */
+    int         numThreads() const { return m_num_threads; }
+
+    static int  numCores();
+
+private:
+    struct Queue
+    {
+        pthread_mutex_t lock;
+        WorkerJob      *head;
+        WorkerJob      *tail;
+    };
+
+    struct Thread
+    {
+        WorkerPool     *pool;
+        int             index;
+    };
+
+    static void *threadMain(void *arg);
+    void        push(int queue, WorkerJob *job);
+    WorkerJob  *pop(int queue);
+    WorkerJob  *take(int self);
+    WorkerJob  *takeInbox();
+    void        wake();
+
+    pthread_t       m_threads[WORKER_POOL_MAX_THREADS];
+    Thread          m_thread_info[WORKER_POOL_MAX_THREADS];
+    Queue           m_queues[WORKER_POOL_MAX_THREADS];
+    int             m_num_threads;
+    unsigned int    m_next_queue;           /* Round robin for outside submits. */
+    WorkerInbox    *m_inboxes;
+    pthread_mutex_t m_inbox_lock;           /* Workers only, keeps each inbox to one reader at a time. */
+#if defined(__APPLE__)
+    semaphore_t     m_sleep;                /* Posted once per job, and once per thread to quit. */
+#else
+    sem_t           m_sleep;
+#endif
+    bool            m_quit;
+};
+
+#endif
@@ -8,18 +8,157 @@ This example demonstrates how to position events in 3D for spatialization.
 #include "fmod.hpp"
 #include "fmod_errors.h"
 #include "common.h"
+#include "flac_encoder.h"
+#include "mapped_file.h"
+#include "asset_store.h"
+#include "memory_pool.h"
+#include "fsb5_reader.h"
+#include "sound_loader.h"
+#include "render_farm.h"
+#include "loudness_meter.h"
+#include "sidechain_ducker.h"
+
+extern "C" FMOD_CODEC_DESCRIPTION* F_STDCALL FMODGetCodecDescription();
+
+// Capture the master bus and encode it straight to FLAC while the event plays.
+// Comment this out to go back to FMOD's WAV writer.
+#define EXTRACT_FLAC
+
+// Measure loudness and true peak off the master bus as well, and write them next to the output as JSON.
+#define EXTRACT_LOUDNESS
+
+// Upper limit on what FMOD may allocate for one extraction, 0 for no limit.
+#define EXTRACT_MEMORY_BUDGET (256 * 1024 * 1024)
+
+// Open the audio embedded in the music bank as a sound of its own, to list what's in it.
+// PCM containers go through the example FSB5 codec in lowlevel/examples/plugins/fmod_codec_fsb5.cpp.
+#define OPEN_BANK_AUDIO
+
+// Render farm mode. Instead of playing one event, render every event in renderFarmEvents to its own FLAC file at
+// once, each on its own Studio system and core, all reading one mapped copy of the banks. See render_farm.h.
+//#define RENDER_FARM
+
+// Systems to render on (0 for one per core), where to cut each render off in seconds, and the rate to mix at.
+#define RENDER_FARM_SYSTEMS 0
+#define RENDER_FARM_SECONDS 300.0f
+#define RENDER_FARM_SAMPLERATE 48000
+
+// Stems of the event, by sub-ChannelGroup: the instruments to duck, and the vocal to duck them under.
+// Both are hardcoded, and may vary for each track.
+#define REMIX_DUCKED_STEM 3
+#define REMIX_VOCAL_STEM 0
 
 const int SCREEN_WIDTH = NUM_COLUMNS;
 const int SCREEN_HEIGHT = 16;
 
 int currentScreenPosition = -1;
 
+#ifdef EXTRACT_FLAC
+// Sits on the master bus and hands every mixed block to the encoder. The audio passes through untouched.
+FMOD_RESULT F_CALLBACK captureDSPCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+{
+    FlacEncoder *encoder;
+    FMOD::DSP *thisdsp = (FMOD::DSP *)dsp_state->instance;
+
+    FMOD_RESULT result = thisdsp->getUserData((void **)&encoder);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    memcpy(outbuffer, inbuffer, length * inchannels * sizeof(float));
+
+    // Encoding happens on the worker threads, this only converts and queues the block.
+    return encoder->write(inbuffer, length, inchannels);
+}
+#endif
+
+#ifdef RENDER_FARM
+// One line per track. The strings are the same ones lookupEventID takes below.
+const char *renderFarmEvents[] = { "/Music/SoftJazzy_MC" };
+
+int renderFarmMain()
+{
+    const char *bankNames[] = { "MasterBank.bank", "MasterBank.bank.strings", "AudenFMOD_Ambience.bank", "AudenFMOD_Music.bank", "AudenFMOD_OldSounds.bank", "AudenFMOD_Sounds.bank" };
+    const int numBanks = sizeof(bankNames) / sizeof(bankNames[0]);
+    const int numEvents = sizeof(renderFarmEvents) / sizeof(renderFarmEvents[0]);
+
+    char bankPaths[numBanks][256];
+    const char *bankPathPointers[numBanks];
+    for (int i = 0; i < numBanks; i++)
+    {
+        strncpy(bankPaths[i], Common_MediaPath(bankNames[i]), sizeof(bankPaths[i]) - 1);
+        bankPaths[i][sizeof(bankPaths[i]) - 1] = 0;
+        bankPathPointers[i] = bankPaths[i];
+    }
+
+    char outputPaths[numEvents][64];
+    RenderFarmJob jobs[numEvents];
+    memset(jobs, 0, sizeof(jobs));
+    for (int i = 0; i < numEvents; i++)
+    {
+        sprintf(outputPaths[i], "fmodoutput_%d.flac", i);
+        jobs[i].eventpath = renderFarmEvents[i];
+        jobs[i].outputpath = outputPaths[i];
+        jobs[i].seconds = RENDER_FARM_SECONDS;
+    }
+
+    RenderFarm farm;
+    ERRCHECK( farm.init(RENDER_FARM_SYSTEMS, bankPathPointers, numBanks, RENDER_FARM_SAMPLERATE) );
+    ERRCHECK( farm.start(jobs, numEvents) );
+
+    // The farm works in the background, this just shows how it's getting on.
+    RenderFarmStats stats;
+    do
+    {
+        Common_Update();
+
+        farm.getStats(&stats);
+
+        Common_Draw("==================================================");
+        Common_Draw("TRANSISTOR BREACH. Render farm.");
+        Common_Draw("==================================================");
+        Common_Draw("%d systems, %d of %d events done (%d failed)", stats.systems, stats.done, stats.jobs, stats.failed);
+        Common_Draw("Rendered %.0f seconds in %.1f, %.1fx real time", stats.rendered, stats.elapsed, stats.speed);
+        Common_Draw("Banks: %d KB mapped once for all %d systems", stats.bankbytes / 1024, stats.systems);
+        for (int i = 0; i < numEvents; i++)
+        {
+            // The render threads write the jobs as they finish, so take a copy rather than reading jobs[i].
+            RenderFarmJob job;
+            farm.getJob(i, &job);
+            if (job.result != FMOD_ERR_NOTREADY)
+            {
+                Common_Draw("%s -> %s: %s, %.0f s in %.1f s, %.1f LUFS, %.1f dBTP", job.eventpath, job.outputpath, FMOD_ErrorString(job.result),
+                    job.rendered, job.elapsed, job.loudness.integrated, job.loudness.truepeak);
+            }
+        }
+        Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
+
+        Common_Sleep(50);
+    } while (!Common_BtnPress(BTN_QUIT));
+
+    // Quitting early lets the events being rendered finish first.
+    farm.release();
+
+    Common_Close();
+
+    return 0;
+}
+#endif
+
 int FMOD_Main()
 {
     // Basic init stuff -- I think this was here when I started
     void *extraDriverData = 0;
     Common_Init(&extraDriverData);
 
+    // Route every FMOD allocation through our pools. This has to happen before anything is created.
+    ERRCHECK( MemoryPool_Initialize(0, 0, EXTRACT_MEMORY_BUDGET) );
+
+#ifdef RENDER_FARM
+    return renderFarmMain();
+#endif
+
     // Create the FMOD Studio System. This is the brains of the API!!
     FMOD::Studio::System system;
     FMOD_RESULT result = FMOD::Studio::System::create(&system);
@@ -29,37 +168,179 @@ int FMOD_Main()
     FMOD::System* lowLevel;
     system.getLowLevelSystem(&lowLevel);
     
+#ifdef EXTRACT_FLAC
+    // Nothing needs to come out of the speakers, the capture DSP picks up the mix.
+    lowLevel->setOutput(FMOD_OUTPUTTYPE_NOSOUND);
+
+    // Force a stereo mix so the FLAC file always has two channels.
+    int sampleRate = 0;
+    ERRCHECK( lowLevel->getSoftwareFormat(&sampleRate, 0, 0) );
+    ERRCHECK( lowLevel->setSoftwareFormat(sampleRate, FMOD_SPEAKERMODE_STEREO, 0) );
+#else
     // Tell the low-level system to write audio-out to a WAV file, instead of the default speakers.
     lowLevel->setOutput(FMOD_OUTPUTTYPE_WAVWRITER);
+#endif
 
 
+    // Banks are read straight out of mmapped files instead of through FMOD's buffered file layer.
+    ERRCHECK( MappedFile_InstallFileSystem(lowLevel) );
+
     // Initialize the system. Missing plugins are okay for what we're doing
     result = system.initialize(32, FMOD_STUDIO_INIT_ALLOW_MISSING_PLUGINS, FMOD_INIT_NORMAL, extraDriverData);
     ERRCHECK(result);
 
+#ifdef EXTRACT_FLAC
+    // One encoder thread per core. Frames are encoded in parallel but land in the file in order.
+    WorkerPool encoderPool;
+    ERRCHECK( encoderPool.init(0) );
+
+    FlacEncoder flacEncoder;
+    ERRCHECK( flacEncoder.open("fmodoutput.flac", 2, sampleRate, 16, &encoderPool) );
+
+    FMOD::DSP *captureDSP;
+    {
+        FMOD_DSP_DESCRIPTION dspdesc;
+        memset(&dspdesc, 0, sizeof(dspdesc));
+
+        strncpy(dspdesc.name, "FLAC capture", sizeof(dspdesc.name));
+        dspdesc.version = 0x00010000;
+        dspdesc.numinputbuffers = 1;
+        dspdesc.numoutputbuffers = 1;
+        dspdesc.read = captureDSPCallback;
+        dspdesc.userdata = &flacEncoder;
+
+        ERRCHECK( lowLevel->createDSP(&dspdesc, &captureDSP) );
+    }
+
+    // Index 0 is the tail of the master bus, so we record exactly what would have been heard.
+    FMOD::ChannelGroup *masterGroup;
+    ERRCHECK( lowLevel->getMasterChannelGroup(&masterGroup) );
+    ERRCHECK( masterGroup->addDSP(0, captureDSP, 0) );
+#endif
+
+#ifdef EXTRACT_LOUDNESS
+#ifdef EXTRACT_FLAC
+    const char *outputPath = "fmodoutput.flac";
+#else
+    const char *outputPath = "fmodoutput.wav";
+#endif
+
+    // Metered at the tail of the master bus too, so the numbers are for exactly what goes in the file.
+    int meterRate = 0;
+    ERRCHECK( lowLevel->getSoftwareFormat(&meterRate, 0, 0) );
+
+    LoudnessMeter loudnessMeter;
+    ERRCHECK( loudnessMeter.init(meterRate) );
+
+    FMOD::DSP *loudnessDSP;
+    {
+        FMOD_DSP_DESCRIPTION dspdesc;
+        loudnessMeter.describe(&dspdesc);
+        ERRCHECK( lowLevel->createDSP(&dspdesc, &loudnessDSP) );
+    }
+
+    FMOD::ChannelGroup *meterGroup;
+    ERRCHECK( lowLevel->getMasterChannelGroup(&meterGroup) );
+    ERRCHECK( meterGroup->addDSP(0, loudnessDSP, 0) );
+#endif
+
     // Load each of the audio banks in to the system. Nothing worked unless I loaded all of the audio banks.
-    
+    // The banks are mmapped and FMOD reads them in place, so nothing gets copied on to the heap.
+
+    // Fault all the banks in on every core at once first, so the loads below only parse memory that's resident.
+    const char *bankNames[] = { "MasterBank.bank", "MasterBank.bank.strings", "AudenFMOD_Ambience.bank", "AudenFMOD_Music.bank", "AudenFMOD_OldSounds.bank", "AudenFMOD_Sounds.bank" };
+    const int numBanks = sizeof(bankNames) / sizeof(bankNames[0]);
+    char bankPaths[numBanks][256];
+    SoundLoaderEntry bankEntries[numBanks];
+    memset(bankPaths, 0, sizeof(bankPaths));
+    memset(bankEntries, 0, sizeof(bankEntries));
+    for (int i = 0; i < numBanks; i++)
+    {
+        strncpy(bankPaths[i], Common_MediaPath(bankNames[i]), sizeof(bankPaths[i]) - 1);
+        bankEntries[i].type = SOUND_LOADER_BANK;
+        bankEntries[i].path = bankPaths[i];
+    }
+    {
+        SoundLoader bankLoader;
+        ERRCHECK( bankLoader.init(lowLevel, 0) );
+        ERRCHECK( bankLoader.load(bankEntries, numBanks, 0, 0) );
+        bankLoader.wait();
+        bankLoader.release();
+    }
+
     FMOD::Studio::Bank masterBank;
-    ERRCHECK( system.loadBankFile(Common_MediaPath("MasterBank.bank"), &masterBank) );
+    MappedFile *masterBankFile;
+    ERRCHECK( AssetStore_LoadBank(&system, Common_MediaPath("MasterBank.bank"), &masterBank, &masterBankFile) );
 
     FMOD::Studio::Bank stringsBank;
-    ERRCHECK( system.loadBankFile(Common_MediaPath("MasterBank.bank.strings"), &stringsBank) );
+    MappedFile *stringsBankFile;
+    ERRCHECK( AssetStore_LoadBank(&system, Common_MediaPath("MasterBank.bank.strings"), &stringsBank, &stringsBankFile) );
     
     FMOD::Studio::Bank ambienceBank;
-    ERRCHECK( system.loadBankFile(Common_MediaPath("AudenFMOD_Ambience.bank"), &ambienceBank) );
+    MappedFile *ambienceBankFile;
+    ERRCHECK( AssetStore_LoadBank(&system, Common_MediaPath("AudenFMOD_Ambience.bank"), &ambienceBank, &ambienceBankFile) );
     
     FMOD::Studio::Bank musicBank;
-    ERRCHECK( system.loadBankFile(Common_MediaPath("AudenFMOD_Music.bank"), &musicBank) );
+    MappedFile *musicBankFile;
+    ERRCHECK( AssetStore_LoadBank(&system, Common_MediaPath("AudenFMOD_Music.bank"), &musicBank, &musicBankFile) );
     
     FMOD::Studio::Bank oldSoundsBank;
-    ERRCHECK( system.loadBankFile(Common_MediaPath("AudenFMOD_OldSounds.bank"), &oldSoundsBank) );
+    MappedFile *oldSoundsBankFile;
+    ERRCHECK( AssetStore_LoadBank(&system, Common_MediaPath("AudenFMOD_OldSounds.bank"), &oldSoundsBank, &oldSoundsBankFile) );
     
     FMOD::Studio::Bank soundsBank;
-    ERRCHECK( system.loadBankFile(Common_MediaPath("AudenFMOD_Sounds.bank"), &soundsBank) );
+    MappedFile *soundsBankFile;
+    ERRCHECK( AssetStore_LoadBank(&system, Common_MediaPath("AudenFMOD_Sounds.bank"), &soundsBank, &soundsBankFile) );
+
+    // Each loaded bank holds its own reference to its mapping now.
+    for (int i = 0; i < numBanks; i++)
+    {
+        if (bankEntries[i].file)
+        {
+            MappedFile_Release(bankEntries[i].file);
+        }
+    }
     
+#ifdef OPEN_BANK_AUDIO
+    // The bank's FSB5 is opened as a stream out of the mapping. The codec only reads its fixed header here, subsound
+    // headers are read when FMOD asks about a subsound, so this costs the same for a bank with ten sounds or ten
+    // thousand. FMOD_OPENMEMORY with FMOD_CREATESTREAM streams straight out of the mapping without a copy, so the
+    // mapping must stay alive until musicBankAudio is released.
+    // The codec is only registered for as long as this takes, after the banks are loaded and before the event is,
+    // so none of Studio's own loading goes through it.
+    unsigned int fsbCodec;
+    ERRCHECK( lowLevel->registerCodec(FMODGetCodecDescription(), &fsbCodec, 0) );
+
+    int musicBankSubsounds = 0;
+    char musicBankFirstName[256] = "";
+    {
+        unsigned int fsbOffset, fsbSize;
+        if (Fsb5Reader::find(musicBankFile->data, musicBankFile->length, &fsbOffset, &fsbSize))
+        {
+            FMOD::Sound *musicBankAudio;
+            FMOD_CREATESOUNDEXINFO exinfo;
+            memset(&exinfo, 0, sizeof(exinfo));
+            exinfo.cbsize = sizeof(exinfo);
+            exinfo.length = fsbSize;
+
+            ERRCHECK( lowLevel->createSound((const char *)musicBankFile->data + fsbOffset, FMOD_OPENMEMORY | FMOD_CREATESTREAM | FMOD_OPENONLY, &exinfo, &musicBankAudio) );
+            ERRCHECK( musicBankAudio->getNumSubSounds(&musicBankSubsounds) );
+            if (musicBankSubsounds > 0)
+            {
+                FMOD::Sound *subsound;
+                ERRCHECK( musicBankAudio->getSubSound(0, &subsound) );
+                ERRCHECK( subsound->getName(musicBankFirstName, sizeof(musicBankFirstName)) );
+            }
+            ERRCHECK( musicBankAudio->release() );
+        }
+    }
+    ERRCHECK( lowLevel->unloadPlugin(fsbCodec) );
+#endif
+
     // Look up the event ID by its name. These should be given in a file called `GUIDs.txt`.
     FMOD::Studio::ID eventID = {0};
-    ERRCHECK( system.lookupEventID("/Music/SoftJazzy_MC", &eventID) );  // The string is hardcoded; each track has its own string
+    const char *eventPath = "/Music/SoftJazzy_MC";  // The string is hardcoded; each track has its own string
+    ERRCHECK( system.lookupEventID(eventPath, &eventID) );
     
     // From the event ID, we'll load actually load the event audio
     FMOD::Studio::EventDescription eventDescription;
@@ -83,6 +364,22 @@ int FMOD_Main()
     attributes.position.z = 0.0f;
     ERRCHECK( eventInstance.set3DAttributes(&attributes) );
     
+    // The instrument stem is ducked under the vocal stem, instead of being muted by hand. The ducker goes on once the
+    // event has made its stems, see the loop below.
+    int duckerRate = 0;
+    ERRCHECK( lowLevel->getSoftwareFormat(&duckerRate, 0, 0) );
+
+    SidechainDucker ducker;
+    ERRCHECK( ducker.init(duckerRate) );
+
+    FMOD::DSP *duckerDSP;
+    {
+        FMOD_DSP_DESCRIPTION dspdesc;
+        ducker.describe(&dspdesc);
+        ERRCHECK( lowLevel->createDSP(&dspdesc, &duckerDSP) );
+    }
+    FMOD::ChannelGroup *duckedGroup = 0;
+
     // I have no idea what this is -- it was probably here when I started.
     FMOD_STUDIO_PLAYBACK_STATE state;
 
@@ -100,44 +397,111 @@ int FMOD_Main()
         Common_Draw("Enjoy!",
             Common_BtnStr(BTN_LEFT), Common_BtnStr(BTN_RIGHT), Common_BtnStr(BTN_UP), Common_BtnStr(BTN_DOWN));
         Common_Draw("Press %s to quit", Common_BtnStr(BTN_QUIT));
+#ifdef EXTRACT_FLAC
+        {
+            unsigned int seconds = (unsigned int)(flacEncoder.samplesWritten() / sampleRate);
+            Common_Draw("Encoded %d:%02d to fmodoutput.flac (%d KB), %d samples dropped", seconds / 60, seconds % 60, (int)(flacEncoder.bytesWritten() / 1024), (int)flacEncoder.samplesDropped());
+        }
+#endif
+#ifdef EXTRACT_LOUDNESS
+        {
+            LoudnessResults loudness;
+            loudnessMeter.getResults(&loudness);
+            Common_Draw("Loudness %.1f LUFS (short-term %.1f), true peak %.1f dBTP", loudness.integrated, loudness.shortterm, loudness.truepeak);
+        }
+#endif
+#ifdef OPEN_BANK_AUDIO
+        Common_Draw("Music bank audio: %d subsounds, first is \"%s\"", musicBankSubsounds, musicBankFirstName);
+#endif
+        {
+            SidechainDuckerStats duckerStats;
+            ducker.getStats(&duckerStats);
+            Common_Draw("Stem %d ducked under stem %d: %s, down %.1f dB (%.1f dB at most)", REMIX_DUCKED_STEM, REMIX_VOCAL_STEM,
+                duckedGroup ? "on" : "waiting", duckerStats.reduction, duckerStats.maxreduction);
+        }
+        {
+            MemoryPoolStats memStats;
+            MemoryPool_GetStats(&memStats);
+            Common_Draw("Memory %d KB (peak %d KB), samples %d KB, streams %d KB", memStats.total / 1024, memStats.totalhighwater / 1024,
+                memStats.current[MEMORY_POOL_SAMPLEDATA] / 1024, (memStats.current[MEMORY_POOL_STREAM_FILE] + memStats.current[MEMORY_POOL_STREAM_DECODE]) / 1024);
+        }
         
         
         
         Common_Sleep(50);
         
-        // This section is where the guesswork comes in! We can mute audio channels by number by doing this.
-        
-        // Each track has a ChannelGroup. Inside a ChannelGroup are a number of other ChannelGroups..
-        FMOD::ChannelGroup *topGroup;
-        int topNumChannels;  // Only good for debug purposes, e.g. printing the number of channels.
-        eventInstance.getChannelGroup(&topGroup);
-        topGroup->getNumGroups(&topNumChannels);
-        
-        // In Transistor's audio, the track's sub-ChannelGroups are the ones that have the actual audio channels.
-        FMOD::ChannelGroup *sub1;
-        int numChannels;
-        int numGroups;
-        
-        // Get the ChannelGroup that we want to manipulate (e.g. mute)
-        topGroup->getGroup(3, &sub1);  // 3 is hardcoded, and may vary for each track.
-        
-        // Get some info about the Sub-ChannelGroup
-        sub1->getNumChannels(&numChannels);
-        sub1->getNumGroups(&numGroups);
-        
-        // The audio channels don't load in instantly, so we want to wait until they exist before doing stuff to them.
-        if (numChannels > 0) {
-            // Get the audio channel that we want to manuplate.
-            FMOD::Channel *channel;
-            sub1->getChannel(0, &channel);  // 0 is hardcoded, and may vary for each track.
-            channel->setVolume(0.0);  // MUTE!
+        // Each track has a ChannelGroup, and inside it a ChannelGroup per stem. The stems don't load in instantly, so
+        // the ducker goes on the first time both are there.
+        if (!duckedGroup)
+        {
+            // Until the event has started playing it has no ChannelGroup to ask.
+            FMOD::ChannelGroup *topGroup;
+            int numGroups = 0;
+            if (eventInstance.getChannelGroup(&topGroup) == FMOD_OK)
+            {
+                ERRCHECK( topGroup->getNumGroups(&numGroups) );
+            }
+
+            if (numGroups > REMIX_DUCKED_STEM && numGroups > REMIX_VOCAL_STEM)
+            {
+                FMOD::ChannelGroup *vocalGroup;
+                FMOD::DSP *vocalDSP;
+                ERRCHECK( topGroup->getGroup(REMIX_DUCKED_STEM, &duckedGroup) );
+                ERRCHECK( topGroup->getGroup(REMIX_VOCAL_STEM, &vocalGroup) );
+
+                // The sidechain connection runs the vocal for the ducker to listen to, without mixing it in again.
+                ERRCHECK( duckedGroup->addDSP(0, duckerDSP, 0) );
+                ERRCHECK( vocalGroup->getDSP(FMOD_CHANNELCONTROL_DSP_HEAD, &vocalDSP) );
+                ERRCHECK( duckerDSP->addInput(vocalDSP, 0, FMOD_DSPCONNECTION_TYPE_SIDECHAIN) );
+
+                FMOD_DSP_PARAMETER_SIDECHAIN sidechain;
+                sidechain.sidechainenable = true;
+                ERRCHECK( duckerDSP->setParameterData(SIDECHAIN_DUCKER_PARAM_SIDECHAIN, &sidechain, sizeof(sidechain)) );
+            }
         }
         
     } while (!Common_BtnPress(BTN_QUIT));
 
+    // The stems belong to the event, so the ducker comes off before Studio lets them go.
+    if (duckedGroup)
+    {
+        ERRCHECK( duckedGroup->removeDSP(duckerDSP) );
+        ERRCHECK( duckerDSP->disconnectAll(true, false) );  // The sidechain from the vocal.
+    }
+    ERRCHECK( duckerDSP->release() );
+    ducker.release();
+
+#ifdef EXTRACT_FLAC
+    ERRCHECK( masterGroup->removeDSP(captureDSP) );
+    ERRCHECK( captureDSP->release() );
+#endif
+
+#ifdef EXTRACT_LOUDNESS
+    ERRCHECK( meterGroup->removeDSP(loudnessDSP) );
+    ERRCHECK( loudnessDSP->release() );
+
+    // Written as the extraction stops, so it covers everything in the file.
+    ERRCHECK( loudnessMeter.writeSidecar(outputPath, eventPath) );
+    loudnessMeter.release();
+#endif
+
+    // Unload the banks before dropping their mappings, FMOD is reading them in place.
+    ERRCHECK( AssetStore_UnloadBank(&masterBank, masterBankFile) );
+    ERRCHECK( AssetStore_UnloadBank(&stringsBank, stringsBankFile) );
+    ERRCHECK( AssetStore_UnloadBank(&ambienceBank, ambienceBankFile) );
+    ERRCHECK( AssetStore_UnloadBank(&musicBank, musicBankFile) );
+    ERRCHECK( AssetStore_UnloadBank(&oldSoundsBank, oldSoundsBankFile) );
+    ERRCHECK( AssetStore_UnloadBank(&soundsBank, soundsBankFile) );
+
     result = system.release();
     ERRCHECK(result);
 
+#ifdef EXTRACT_FLAC
+    // The mixer is gone, so the last partial frame can be flushed and the seek table written.
+    ERRCHECK( flacEncoder.close() );
+    encoderPool.release();
+#endif
+
     Common_Close();
 
     return 0;
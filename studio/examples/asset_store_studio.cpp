@@ -0,0 +1,54 @@
+/*==============================================================================
+Asset Store (Studio)
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Bank loading half of the asset store, see lowlevel/examples/asset_store.h.
+==============================================================================*/
+#include "fmod_studio.hpp"
+#include "asset_store.h"
+#include <sys/mman.h>
+
+FMOD_RESULT AssetStore_LoadBank(FMOD::Studio::System *system, const char *path, FMOD::Studio::Bank *bank, MappedFile **file)
+{
+    FMOD_RESULT result;
+
+    *file = MappedFile_Acquire(path);
+    if (!*file)
+    {
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+
+    /*
+        Bank metadata is parsed in full on load, sample data is only touched when it's used. Set on the mapping, so
+        handles reading the same file put it back when they're done with their own advice.
+    */
+    MappedFile_SetAdvice(*file, MADV_RANDOM);
+
+    /*
+        mmap returns page aligned memory, which covers the alignment FMOD needs for MEMORY_POINT.
+    */
+    result = system->loadBankMemory((const char *)(*file)->data, (int)(*file)->length, FMOD_STUDIO_LOAD_MEMORY_POINT, bank);
+    if (result != FMOD_OK)
+    {
+        MappedFile_Release(*file);
+        *file = 0;
+    }
+
+    return result;
+}
+
+FMOD_RESULT AssetStore_UnloadBank(FMOD::Studio::Bank *bank, MappedFile *file)
+{
+    FMOD_RESULT result = FMOD_OK;
+
+    if (bank->isValid())
+    {
+        result = bank->unload();
+    }
+    if (file)
+    {
+        MappedFile_Release(file);
+    }
+
+    return result;
+}
@@ -0,0 +1,664 @@
+/*==============================================================================
+Render Farm
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+==============================================================================*/
+#include "render_farm.h"
+#include "asset_store.h"
+#include "monotonic_clock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+#define RENDER_FARM_LOAD_UPDATES    2000    /* Most updates to wait for an event to load before rendering it anyway. */
+
+struct RenderFarmSystem
+{
+    RenderFarm         *farm;
+    int                 index;
+    pthread_t           thread;
+    bool                started;
+    bool                ready;              /* createSystem has finished, 'result' says how it went. */
+    FMOD_RESULT         result;
+
+    FMOD::System       *lowlevel;
+    FMOD::ChannelGroup *master;
+    FMOD::DSP          *capture;
+    MappedFile         *bankfiles[RENDER_FARM_MAX_BANKS];
+
+    pthread_mutex_t     lock;               /* Held by the capture DSP while it writes. */
+    FlacEncoder        *encoder;            /* 0 between jobs. */
+    LoudnessMeter      *meter;              /* Sees exactly what the encoder gets. */
+    unsigned long long  captured;           /* Samples handed to the encoder this job. */
+    unsigned long long  limit;              /* Where to stop handing them over. */
+    unsigned long long  rendered;           /* 'captured', for getStats to read without the lock. */
+};
+
+/*
+    Linux pins the thread to the core outright. OS X has no hard pinning, the affinity tag only asks for threads with
+    different tags to be kept on different cores.
+*/
+static void RenderFarm_Pin(int index)
+{
+    int core = index % WorkerPool::numCores();
+
+#if defined(__APPLE__)
+    thread_affinity_policy_data_t policy = { core + 1 };
+    thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY, (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)core;
+#endif
+}
+
+/*
+    Sits at the tail of a system's master bus and hands each mixed block to the job's encoder and loudness meter,
+    cut off at the job's length. The audio passes through untouched.
+*/
+static FMOD_RESULT F_CALLBACK RenderFarm_CaptureCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+{
+    RenderFarmSystem *system;
+    FMOD::DSP *thisdsp = (FMOD::DSP *)dsp_state->instance;
+
+    FMOD_RESULT result = thisdsp->getUserData((void **)&system);
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    memcpy(outbuffer, inbuffer, length * inchannels * sizeof(float));
+
+    pthread_mutex_lock(&system->lock);
+    if (system->encoder && system->captured < system->limit)
+    {
+        unsigned long long left = system->limit - system->captured;
+        unsigned int count = (length < left) ? length : (unsigned int)left;
+
+        result = system->encoder->write(inbuffer, count, inchannels);
+        system->meter->process(inbuffer, count, inchannels);
+        system->captured += count;
+    }
+    pthread_mutex_unlock(&system->lock);
+
+    return result;
+}
+
+RenderFarm::RenderFarm()
+{
+    m_systems = 0;
+    m_num_systems = 0;
+    m_num_banks = 0;
+    m_samplerate = 0;
+    m_jobs = 0;
+    m_num_jobs = 0;
+    m_next_job = 0;
+    m_done = 0;
+    m_failed = 0;
+    m_rendered = 0.0;
+    m_generation = 0;
+    m_start_time = 0.0;
+    m_quit = false;
+    m_initialized = false;
+    memset(m_banks, 0, sizeof(m_banks));
+    memset(m_bank_paths, 0, sizeof(m_bank_paths));
+}
+
+FMOD_RESULT RenderFarm::init(int numsystems, const char *const *bankpaths, int numbanks, int samplerate)
+{
+    FMOD_RESULT result;
+
+    if (numbanks <= 0 || numbanks > RENDER_FARM_MAX_BANKS || !bankpaths || samplerate <= 0)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    if (numsystems <= 0)
+    {
+        numsystems = WorkerPool::numCores();
+    }
+    if (numsystems > RENDER_FARM_MAX_SYSTEMS)
+    {
+        numsystems = RENDER_FARM_MAX_SYSTEMS;
+    }
+
+    pthread_mutex_init(&m_lock, 0);
+    pthread_cond_init(&m_wake, 0);
+    pthread_cond_init(&m_idle, 0);
+    m_initialized = true;
+    m_quit = false;
+    m_samplerate = samplerate;
+
+    /*
+        The farm holds its own reference to each mapping, so every system's AssetStore_LoadBank finds it already
+        mapped and loads from the same pages. Fault them in once up front rather than every system faulting them in
+        as it parses.
+    */
+    m_num_banks = numbanks;
+    for (int i = 0; i < numbanks; i++)
+    {
+        m_bank_paths[i] = bankpaths[i];
+        m_banks[i] = MappedFile_Acquire(bankpaths[i]);
+        if (!m_banks[i])
+        {
+            release();
+            return FMOD_ERR_FILE_NOTFOUND;
+        }
+        MappedFile_Advise(m_banks[i], 0, m_banks[i]->length, MADV_WILLNEED);
+    }
+
+    result = m_encoder_pool.init(0);
+    if (result != FMOD_OK)
+    {
+        release();
+        return result;
+    }
+
+    m_systems = (RenderFarmSystem *)calloc(numsystems, sizeof(RenderFarmSystem));
+    if (!m_systems)
+    {
+        release();
+        return FMOD_ERR_MEMORY;
+    }
+
+    m_num_systems = numsystems;
+    for (int i = 0; i < numsystems; i++)
+    {
+        RenderFarmSystem *system = &m_systems[i];
+
+        system->farm = this;
+        system->index = i;
+        pthread_mutex_init(&system->lock, 0);
+        if (pthread_create(&system->thread, 0, threadMain, system) != 0)
+        {
+            system->ready = true;
+            system->result = FMOD_ERR_INTERNAL;
+            break;
+        }
+        system->started = true;
+    }
+
+    /*
+        Systems are created and their banks loaded on their own threads, all at once.
+    */
+    result = FMOD_OK;
+    pthread_mutex_lock(&m_lock);
+    for (int i = 0; i < numsystems; i++)
+    {
+        if (!m_systems[i].started && !m_systems[i].ready)
+        {
+            break;
+        }
+        while (!m_systems[i].ready)
+        {
+            pthread_cond_wait(&m_idle, &m_lock);
+        }
+        if (m_systems[i].result != FMOD_OK && result == FMOD_OK)
+        {
+            result = m_systems[i].result;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    if (result != FMOD_OK)
+    {
+        release();
+    }
+    return result;
+}
+
+void RenderFarm::release()
+{
+    if (!m_initialized)
+    {
+        return;
+    }
+
+    /*
+        Render threads finish the job they're on, then release their systems.
+    */
+    pthread_mutex_lock(&m_lock);
+    __atomic_store_n(&m_quit, true, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&m_wake);
+    pthread_mutex_unlock(&m_lock);
+
+    for (int i = 0; i < m_num_systems; i++)
+    {
+        if (m_systems[i].started)
+        {
+            pthread_join(m_systems[i].thread, 0);
+        }
+        pthread_mutex_destroy(&m_systems[i].lock);
+    }
+    free(m_systems);
+    m_systems = 0;
+    m_num_systems = 0;
+
+    m_encoder_pool.release();
+
+    for (int i = 0; i < m_num_banks; i++)
+    {
+        if (m_banks[i])
+        {
+            MappedFile_Release(m_banks[i]);
+            m_banks[i] = 0;
+        }
+    }
+    m_num_banks = 0;
+
+    pthread_cond_destroy(&m_idle);
+    pthread_cond_destroy(&m_wake);
+    pthread_mutex_destroy(&m_lock);
+    m_initialized = false;
+}
+
+FMOD_RESULT RenderFarm::start(RenderFarmJob *jobs, int numjobs)
+{
+    if (!m_systems)
+    {
+        return FMOD_ERR_UNINITIALIZED;
+    }
+    if (numjobs < 0 || (numjobs && !jobs))
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (m_done < m_num_jobs)
+    {
+        pthread_mutex_unlock(&m_lock);
+        return FMOD_ERR_NOTREADY;
+    }
+
+    for (int i = 0; i < numjobs; i++)
+    {
+        jobs[i].result = FMOD_ERR_NOTREADY;
+        jobs[i].rendered = 0.0f;
+        jobs[i].elapsed = 0.0f;
+    }
+
+    m_jobs = jobs;
+    m_num_jobs = numjobs;
+    m_next_job = 0;
+    m_done = 0;
+    m_failed = 0;
+    m_rendered = 0.0;
+    m_start_time = MonotonicClock_Now();
+    m_generation++;
+    pthread_cond_broadcast(&m_wake);
+    pthread_mutex_unlock(&m_lock);
+
+    return FMOD_OK;
+}
+
+bool RenderFarm::isDone() const
+{
+    if (!m_systems)
+    {
+        return true;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    bool done = (m_done >= m_num_jobs);
+    pthread_mutex_unlock(&m_lock);
+
+    return done;
+}
+
+void RenderFarm::wait()
+{
+    if (!m_systems)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    while (m_done < m_num_jobs)
+    {
+        pthread_cond_wait(&m_idle, &m_lock);
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+void RenderFarm::getJob(int index, RenderFarmJob *job) const
+{
+    pthread_mutex_lock(&m_lock);
+    *job = m_jobs[index];
+    pthread_mutex_unlock(&m_lock);
+}
+
+void RenderFarm::getStats(RenderFarmStats *stats) const
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!m_systems)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    double rendered = m_rendered;
+    for (int i = 0; i < m_num_systems; i++)
+    {
+        rendered += (double)__atomic_load_n(&m_systems[i].rendered, __ATOMIC_RELAXED) / m_samplerate;
+    }
+
+    stats->systems = m_num_systems;
+    stats->jobs = m_num_jobs;
+    stats->done = m_done;
+    stats->failed = m_failed;
+    stats->rendered = (float)rendered;
+    stats->elapsed = m_num_jobs ? (float)(MonotonicClock_Now() - m_start_time) : 0.0f;
+    pthread_mutex_unlock(&m_lock);
+
+    stats->speed = (stats->elapsed > 0.0f) ? stats->rendered / stats->elapsed : 0.0f;
+    for (int i = 0; i < m_num_banks; i++)
+    {
+        stats->bankbytes += m_banks[i]->length;
+    }
+}
+
+void *RenderFarm::threadMain(void *arg)
+{
+    RenderFarmSystem *system = (RenderFarmSystem *)arg;
+    RenderFarm *farm = system->farm;
+    FMOD::Studio::System studio;
+    FMOD::Studio::Bank banks[RENDER_FARM_MAX_BANKS];
+    unsigned int generation = 0;
+
+    RenderFarm_Pin(system->index);
+
+    FMOD_RESULT result = farm->createSystem(system, &studio, banks);
+
+    pthread_mutex_lock(&farm->m_lock);
+    system->result = result;
+    system->ready = true;
+    pthread_cond_broadcast(&farm->m_idle);
+    pthread_mutex_unlock(&farm->m_lock);
+
+    while (result == FMOD_OK)
+    {
+        pthread_mutex_lock(&farm->m_lock);
+        while (!farm->m_quit && farm->m_generation == generation)
+        {
+            pthread_cond_wait(&farm->m_wake, &farm->m_lock);
+        }
+        if (farm->m_quit)
+        {
+            pthread_mutex_unlock(&farm->m_lock);
+            break;
+        }
+        generation = farm->m_generation;
+        pthread_mutex_unlock(&farm->m_lock);
+
+        /*
+            Whoever is free takes the next job, so long and short events even out across the systems.
+        */
+        while (!__atomic_load_n(&farm->m_quit, __ATOMIC_ACQUIRE))
+        {
+            int index = __atomic_fetch_add(&farm->m_next_job, 1, __ATOMIC_RELAXED);
+            if (index >= farm->m_num_jobs)
+            {
+                break;
+            }
+
+            RenderFarmJob *job = &farm->m_jobs[index];
+            FMOD_RESULT jobresult = farm->renderJob(system, &studio, job);
+
+            pthread_mutex_lock(&farm->m_lock);
+            job->result = jobresult;
+            farm->m_rendered += job->rendered;
+            __atomic_store_n(&system->rendered, 0, __ATOMIC_RELAXED);
+            if (jobresult != FMOD_OK)
+            {
+                farm->m_failed++;
+            }
+            if (++farm->m_done == farm->m_num_jobs)
+            {
+                pthread_cond_broadcast(&farm->m_idle);
+            }
+            pthread_mutex_unlock(&farm->m_lock);
+        }
+    }
+
+    farm->releaseSystem(system, &studio, banks);
+    return 0;
+}
+
+FMOD_RESULT RenderFarm::createSystem(RenderFarmSystem *system, FMOD::Studio::System *studio, FMOD::Studio::Bank *banks)
+{
+    FMOD_RESULT result;
+
+    /*
+        Creating, initializing and releasing a system isn't safe to do on several threads at once, so the systems
+        take turns. Loading the banks is, so that runs on every thread together.
+    */
+    pthread_mutex_lock(&m_lock);
+
+    result = FMOD::Studio::System::create(studio);
+    if (result == FMOD_OK)
+    {
+        result = studio->getLowLevelSystem(&system->lowlevel);
+    }
+
+    /*
+        Non real time, the mixer only runs when update is called. Streams are serviced from update too, so the
+        mixer running flat out never gets ahead of them.
+    */
+    if (result == FMOD_OK)
+    {
+        result = system->lowlevel->setOutput(FMOD_OUTPUTTYPE_NOSOUND_NRT);
+    }
+    if (result == FMOD_OK)
+    {
+        result = system->lowlevel->setSoftwareFormat(m_samplerate, FMOD_SPEAKERMODE_STEREO, 0);
+    }
+    if (result == FMOD_OK)
+    {
+        result = studio->initialize(RENDER_FARM_MAX_CHANNELS, FMOD_STUDIO_INIT_ALLOW_MISSING_PLUGINS, FMOD_INIT_STREAM_FROM_UPDATE, 0);
+    }
+    if (result == FMOD_OK)
+    {
+        FMOD_DSP_DESCRIPTION dspdesc;
+        memset(&dspdesc, 0, sizeof(dspdesc));
+
+        strncpy(dspdesc.name, "Render farm capture", sizeof(dspdesc.name));
+        dspdesc.version = 0x00010000;
+        dspdesc.numinputbuffers = 1;
+        dspdesc.numoutputbuffers = 1;
+        dspdesc.read = RenderFarm_CaptureCallback;
+        dspdesc.userdata = system;
+
+        result = system->lowlevel->createDSP(&dspdesc, &system->capture);
+    }
+    if (result == FMOD_OK)
+    {
+        result = system->lowlevel->getMasterChannelGroup(&system->master);
+    }
+    if (result == FMOD_OK)
+    {
+        result = system->master->addDSP(0, system->capture, 0);
+    }
+
+    pthread_mutex_unlock(&m_lock);
+
+    if (result != FMOD_OK)
+    {
+        return result;
+    }
+
+    for (int i = 0; i < m_num_banks; i++)
+    {
+        result = AssetStore_LoadBank(studio, m_bank_paths[i], &banks[i], &system->bankfiles[i]);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    return FMOD_OK;
+}
+
+void RenderFarm::releaseSystem(RenderFarmSystem *system, FMOD::Studio::System *studio, FMOD::Studio::Bank *banks)
+{
+    if (system->capture)
+    {
+        if (system->master)
+        {
+            system->master->removeDSP(system->capture);
+        }
+        system->capture->release();
+        system->capture = 0;
+    }
+
+    for (int i = 0; i < m_num_banks; i++)
+    {
+        if (system->bankfiles[i])
+        {
+            AssetStore_UnloadBank(&banks[i], system->bankfiles[i]);
+            system->bankfiles[i] = 0;
+        }
+    }
+
+    if (studio->isValid())
+    {
+        pthread_mutex_lock(&m_lock);
+        studio->release();
+        pthread_mutex_unlock(&m_lock);
+    }
+    system->lowlevel = 0;
+    system->master = 0;
+}
+
+FMOD_RESULT RenderFarm::renderJob(RenderFarmSystem *system, FMOD::Studio::System *studio, RenderFarmJob *job)
+{
+    FMOD_RESULT result;
+    double start = MonotonicClock_Now();
+    FMOD::Studio::ID id;
+    FMOD::Studio::EventDescription description;
+    FMOD::Studio::EventInstance instance;
+    FMOD_STUDIO_LOADING_STATE loading = FMOD_STUDIO_LOADING_STATE_UNLOADED;
+    FMOD_STUDIO_PLAYBACK_STATE state = FMOD_STUDIO_PLAYBACK_PLAYING;
+    FlacEncoder encoder;
+    LoudnessMeter meter;
+    unsigned long long written = 0;
+
+    result = studio->lookupEventID(job->eventpath, &id);
+    if (result == FMOD_OK)
+    {
+        result = studio->getEvent(&id, FMOD_STUDIO_LOAD_BEGIN_NOW, &description);
+    }
+    if (result == FMOD_OK)
+    {
+        result = description.createInstance(&instance);
+    }
+
+    /*
+        Let the event finish loading before capturing anything, so the file starts with the event and not with
+        however many blocks of silence the load took.
+    */
+    for (int i = 0; result == FMOD_OK && loading != FMOD_STUDIO_LOADING_STATE_LOADED && i < RENDER_FARM_LOAD_UPDATES; i++)
+    {
+        result = studio->update();
+        if (result == FMOD_OK)
+        {
+            result = instance.getLoadingState(&loading);
+        }
+    }
+
+    if (result == FMOD_OK)
+    {
+        result = meter.init(m_samplerate);
+    }
+    if (result == FMOD_OK)
+    {
+        result = encoder.open(job->outputpath, 2, m_samplerate, 16, &m_encoder_pool);
+    }
+    if (result == FMOD_OK)
+    {
+        pthread_mutex_lock(&system->lock);
+        system->encoder = &encoder;
+        system->meter = &meter;
+        system->captured = 0;
+        system->limit = (job->seconds > 0.0f) ? (unsigned long long)((double)job->seconds * m_samplerate) : ~0ULL;
+        pthread_mutex_unlock(&system->lock);
+
+        result = instance.start();
+    }
+
+    /*
+        Every update mixes another block. Go until the event stops or the capture reaches the job's length.
+    */
+    while (result == FMOD_OK && state != FMOD_STUDIO_PLAYBACK_STOPPED)
+    {
+        /*
+            Nothing is waiting on this render, so wait for the encoder rather than have it drop a block.
+        */
+        encoder.waitForFrame();
+
+        result = studio->update();
+        if (result == FMOD_OK)
+        {
+            result = instance.getPlaybackState(&state);
+        }
+
+        pthread_mutex_lock(&system->lock);
+        written = system->captured;
+        bool full = (written >= system->limit);
+        pthread_mutex_unlock(&system->lock);
+
+        __atomic_store_n(&system->rendered, written, __ATOMIC_RELAXED);
+        if (full)
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&system->lock);
+    system->encoder = 0;
+    system->meter = 0;
+    pthread_mutex_unlock(&system->lock);
+
+    if (instance.isValid())
+    {
+        instance.stop(FMOD_STUDIO_STOP_IMMEDIATE);
+        instance.release();
+        studio->update();
+    }
+
+    if (encoder.isOpen())
+    {
+        FMOD_RESULT closeresult = encoder.close();
+        if (result == FMOD_OK)
+        {
+            result = closeresult;
+        }
+    }
+
+    /*
+        The loudness goes next to the file, so nothing has to read it back to normalize it.
+    */
+    LoudnessResults loudness;
+    meter.getResults(&loudness);
+    if (result == FMOD_OK)
+    {
+        result = meter.writeSidecar(job->outputpath, job->eventpath);
+    }
+    meter.release();
+
+    /*
+        Under the lock, getJob may be copying the job out on another thread.
+    */
+    pthread_mutex_lock(&m_lock);
+    job->loudness = loudness;
+    job->rendered = (float)((double)written / m_samplerate);
+    job->elapsed = (float)(MonotonicClock_Now() - start);
+    pthread_mutex_unlock(&m_lock);
+    return result;
+}
@@ -0,0 +1,125 @@
+/*==============================================================================
+Render Farm
+Copyright (c), Firelight Technologies Pty, Ltd 2004-2014.
+
+Renders several events at once, each to its own FLAC file, faster than real
+time. Like the multiple system example there is more than one system in the
+process, but here every one is a complete Studio system with a non real time
+output, running on a thread of its own pinned to a core.
+
+Each system is created on its render thread, so on Linux the threads FMOD
+starts inside it inherit the pinning and stay on that core too. Systems are
+created and released one at a time, only loading the banks runs on every
+thread at once. Its master bus is captured by a pass-through DSP into a
+FlacEncoder, and the mixer only runs when the render thread calls update, as
+fast as it can.
+
+The banks are mapped once for the whole process (see mapped_file.h) and
+every system loads them in place with FMOD_STUDIO_LOAD_MEMORY_POINT through
+AssetStore_LoadBank. Each system parses the bank metadata into its own
+memory, but the sample data, the bulk of a bank, is read out of the one
+shared mapping however many systems there are.
+
+The capture DSP also runs everything it encodes through a LoudnessMeter
+(see loudness_meter.h). When a job finishes, its loudness and true peak are
+written next to its FLAC file as JSON, with the extension changed to .json.
+
+Jobs are taken by whichever system is free next. start returns straight
+away, poll isDone and getStats or block in wait. Each job's result and
+timings are written back into its RenderFarmJob when it finishes, so while
+the farm is running read them with getJob, which copies under the farm's
+lock, rather than from the array.
+==============================================================================*/
+#ifndef _RENDER_FARM_H
+#define _RENDER_FARM_H
+
+#include "fmod_studio.hpp"
+#include "fmod.hpp"
+#include "mapped_file.h"
+#include "flac_encoder.h"
+#include "loudness_meter.h"
+#include "worker_pool.h"
+#include <pthread.h>
+
+#define RENDER_FARM_MAX_SYSTEMS     32
+#define RENDER_FARM_MAX_BANKS       16
+#define RENDER_FARM_MAX_CHANNELS    32      /* Virtual channels per system. */
+
+struct RenderFarmJob
+{
+    const char         *eventpath;          /* "/Music/SoftJazzy_MC" */
+    const char         *outputpath;         /* FLAC file to write. */
+    float               seconds;            /* Where to cut the render off, 0 = when the event stops by itself. */
+
+    FMOD_RESULT         result;             /* Filled in when the job is done. */
+    float               rendered;           /* Seconds of audio written. */
+    float               elapsed;            /* Seconds it took. */
+    LoudnessResults     loudness;           /* Of what was written, also in the .json sidecar. */
+};
+
+struct RenderFarmStats
+{
+    int                 systems;
+    int                 jobs;               /* In the current start. */
+    int                 done;
+    int                 failed;
+    float               rendered;           /* Seconds of audio, jobs still running included. */
+    float               elapsed;            /* Seconds since start. */
+    float               speed;              /* rendered / elapsed, how many times faster than real time. */
+    unsigned int        bankbytes;          /* Mapped once and shared by every system. */
+};
+
+struct RenderFarmSystem;
+
+class RenderFarm
+{
+public:
+    RenderFarm();
+
+    /*
+        'numsystems' 0 = one per online core. Returns once every system has loaded the banks.
+    */
+    FMOD_RESULT init(int numsystems, const char *const *bankpaths, int numbanks, int samplerate);
+    void        release();
+
+    /*
+        'jobs' must stay alive until the farm is done with them.
+    */
+    FMOD_RESULT start(RenderFarmJob *jobs, int numjobs);
+    bool        isDone() const;
+    void        wait();
+    void        getStats(RenderFarmStats *stats) const;
+    void        getJob(int index, RenderFarmJob *job) const;   /* A copy of one of the jobs given to start. */
+    int         numSystems() const          { return m_num_systems; }
+
+private:
+    static void *threadMain(void *arg);
+    FMOD_RESULT createSystem(RenderFarmSystem *system, FMOD::Studio::System *studio, FMOD::Studio::Bank *banks);
+    void        releaseSystem(RenderFarmSystem *system, FMOD::Studio::System *studio, FMOD::Studio::Bank *banks);
+    FMOD_RESULT renderJob(RenderFarmSystem *system, FMOD::Studio::System *studio, RenderFarmJob *job);
+
+    RenderFarmSystem   *m_systems;
+    int                 m_num_systems;
+    MappedFile         *m_banks[RENDER_FARM_MAX_BANKS];
+    const char         *m_bank_paths[RENDER_FARM_MAX_BANKS];
+    int                 m_num_banks;
+    int                 m_samplerate;
+    WorkerPool          m_encoder_pool;     /* Shared by every system's encoder. */
+
+    RenderFarmJob      *m_jobs;
+    int                 m_num_jobs;
+    int                 m_next_job;         /* Taken with an atomic add. */
+    int                 m_done;
+    int                 m_failed;
+    double              m_rendered;         /* Seconds from finished jobs. */
+    unsigned int        m_generation;       /* Bumped by start, wakes the render threads. */
+    double              m_start_time;
+    bool                m_quit;
+    bool                m_initialized;
+
+    mutable pthread_mutex_t m_lock;
+    pthread_cond_t      m_wake;             /* Render threads wait on this for work. */
+    pthread_cond_t      m_idle;             /* And signal this when a system is ready or the last job is done. */
+};
+
+#endif